@@ -281,6 +281,7 @@ workspace("xenia")
   include("src/xenia/app")
   include("src/xenia/app/discord")
   include("src/xenia/apu")
+  include("src/xenia/apu/file")
   include("src/xenia/apu/nop")
   include("src/xenia/base")
   include("src/xenia/cpu")
@@ -7,6 +7,7 @@ project("xenia-app")
   language("C++")
   links({
     "xenia-apu",
+    "xenia-apu-file",
     "xenia-apu-nop",
     "xenia-base",
     "xenia-core",
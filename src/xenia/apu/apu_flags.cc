@@ -10,3 +10,13 @@
 #include "xenia/apu/apu_flags.h"
 
 DEFINE_bool(mute, false, "Mutes all audio output.", "APU")
+
+DEFINE_bool(apu_low_latency, false,
+            "Keep only apu_low_latency_queue_depth frames queued for the host "
+            "audio device instead of 64 (about 340 ms). Reduces audio latency, "
+            "but may cause crackling if the guest can't keep up.",
+            "APU")
+DEFINE_int32(apu_low_latency_queue_depth, 4,
+             "Number of 256-sample frames (5.33 ms each) to keep queued in "
+             "low-latency mode, from 2 to 64.",
+             "APU")
@@ -12,7 +12,8 @@
 namespace xe {
 namespace apu {
 
-AudioDriver::AudioDriver(Memory* memory) : memory_(memory) {}
+AudioDriver::AudioDriver(Memory* memory, AudioFrameRing* frame_ring)
+    : memory_(memory), frame_ring_(frame_ring) {}
 
 AudioDriver::~AudioDriver() = default;
 
@@ -10,6 +10,7 @@
 #ifndef XENIA_APU_AUDIO_DRIVER_H_
 #define XENIA_APU_AUDIO_DRIVER_H_
 
+#include "xenia/apu/audio_frame_ring.h"
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -18,10 +19,12 @@ namespace apu {
 
 class AudioDriver {
  public:
-  explicit AudioDriver(Memory* memory);
+  AudioDriver(Memory* memory, AudioFrameRing* frame_ring);
   virtual ~AudioDriver();
 
-  virtual void SubmitFrame(uint32_t samples_ptr) = 0;
+  // Called on the submitting thread after a frame has been written to the
+  // ring. Drivers pulling frames from their own threads don't need this.
+  virtual void OnFrameSubmitted() {}
 
  protected:
   inline uint8_t* TranslatePhysical(uint32_t guest_address) const {
@@ -29,6 +32,9 @@ class AudioDriver {
   }
 
   Memory* memory_ = nullptr;
+  // Frames from the client, owned by the AudioSystem. The driver is the
+  // consumer and must release every frame it acquires.
+  AudioFrameRing* frame_ring_ = nullptr;
 };
 
 }  // namespace apu
@@ -0,0 +1,116 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/audio_frame_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace apu {
+
+AudioFrameRing::AudioFrameRing(threading::Event* wake_event)
+    : wake_event_(wake_event), slots_(new Slot[kCapacity]) {}
+
+AudioFrameRing::~AudioFrameRing() = default;
+
+void AudioFrameRing::Reset() {
+  write_index_ = 0;
+  frames_written_ = 0;
+  frames_dropped_ = 0;
+  depth_sum_ = 0;
+  depth_max_ = 0;
+  requested_count_ = 0;
+  acquire_index_ = 0;
+  release_index_ = 0;
+  underruns_ = 0;
+  latency_sum_ns_ = 0;
+  latency_max_ns_ = 0;
+  wake_in_flight_ = -1;
+}
+
+bool AudioFrameRing::WriteFrame(const float* samples) {
+  uint64_t write_index = write_index_.load(std::memory_order_relaxed);
+  uint64_t depth = write_index - release_index_.load(std::memory_order_acquire);
+  if (depth >= kCapacity) {
+    frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  Slot& slot = slots_[write_index % kCapacity];
+  std::memcpy(slot.samples, samples, sizeof(slot.samples));
+  slot.write_time = Clock::now();
+  write_index_.store(write_index + 1, std::memory_order_release);
+
+  ++depth;
+  frames_written_.fetch_add(1, std::memory_order_relaxed);
+  depth_sum_.fetch_add(depth, std::memory_order_relaxed);
+  if (depth > depth_max_.load(std::memory_order_relaxed)) {
+    depth_max_.store(uint32_t(depth), std::memory_order_relaxed);
+  }
+  return true;
+}
+
+const float* AudioFrameRing::AcquireFrame() {
+  uint64_t acquire_index = acquire_index_.load(std::memory_order_relaxed);
+  if (acquire_index == write_index_.load(std::memory_order_acquire)) {
+    underruns_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  acquire_index_.store(acquire_index + 1, std::memory_order_release);
+  return slots_[acquire_index % kCapacity].samples;
+}
+
+void AudioFrameRing::ReleaseFrame() {
+  uint64_t release_index = release_index_.load(std::memory_order_relaxed);
+  assert_true(release_index < acquire_index_.load(std::memory_order_acquire));
+  const Slot& slot = slots_[release_index % kCapacity];
+  int64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - slot.write_time)
+                           .count();
+  // seq_cst to pair with ArmWake - either it sees the new release index, or
+  // this sees it armed.
+  release_index_.store(release_index + 1, std::memory_order_seq_cst);
+
+  latency_sum_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+  if (latency_ns > latency_max_ns_.load(std::memory_order_relaxed)) {
+    latency_max_ns_.store(latency_ns, std::memory_order_relaxed);
+  }
+
+  int64_t wake_in_flight = wake_in_flight_.load(std::memory_order_seq_cst);
+  if (wake_in_flight >= 0 && int64_t(frames_in_flight()) <= wake_in_flight &&
+      wake_in_flight_.exchange(-1, std::memory_order_seq_cst) >= 0 &&
+      wake_event_) {
+    wake_event_->Set();
+  }
+}
+
+size_t AudioFrameRing::ArmWake(size_t wake_in_flight) {
+  wake_in_flight_.store(int64_t(wake_in_flight), std::memory_order_seq_cst);
+  return FramesInFlight(std::memory_order_seq_cst);
+}
+
+AudioFrameRing::Stats AudioFrameRing::stats() const {
+  Stats stats;
+  stats.frames_written = frames_written_.load(std::memory_order_relaxed);
+  stats.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+  stats.frames_released = release_index_.load(std::memory_order_relaxed);
+  stats.underruns = underruns_.load(std::memory_order_relaxed);
+  stats.depth_sum = depth_sum_.load(std::memory_order_relaxed);
+  stats.depth_max = depth_max_.load(std::memory_order_relaxed);
+  stats.latency_sum = std::chrono::nanoseconds(
+      latency_sum_ns_.load(std::memory_order_relaxed));
+  stats.latency_max = std::chrono::nanoseconds(
+      latency_max_ns_.load(std::memory_order_relaxed));
+  return stats;
+}
+
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,149 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_AUDIO_FRAME_RING_H_
+#define XENIA_APU_AUDIO_FRAME_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace apu {
+
+// Lock-free single-producer, single-consumer queue of audio frames between an
+// AudioSystem client and its AudioDriver.
+//
+// The producer is the thread running the guest render callback, which writes
+// frames as submitted by the guest (6 channels of 256 big-endian float
+// samples, one channel after another). The consumer is the driver: it acquires
+// frames in order to hand them to the host device and releases each one once
+// it's done with it (played or copied out). Acquire and release may happen on
+// different threads, but each on only one at a time.
+//
+// Flow control mirrors the console: the AudioSystem requests a frame from the
+// guest for every slot freed by a release, up to a target number of frames in
+// flight (requested or written, and not yet released).
+class AudioFrameRing {
+ public:
+  static constexpr size_t kCapacity = 64;
+  static constexpr size_t kFrameChannels = 6;
+  static constexpr size_t kChannelSamples = 256;
+  static constexpr size_t kFrameSamples = kFrameChannels * kChannelSamples;
+  static constexpr uint32_t kSampleRate = 48000;
+
+  using Clock = std::chrono::steady_clock;
+
+  // Counters for buffer-level telemetry. Safe to read from any thread.
+  struct Stats {
+    uint64_t frames_written;
+    // Frames submitted by the guest while all slots were in use.
+    uint64_t frames_dropped;
+    uint64_t frames_released;
+    // The consumer needed a frame and there was none queued.
+    uint64_t underruns;
+    // Frames queued or held by the driver, sampled at every write.
+    uint64_t depth_sum;
+    uint32_t depth_max;
+    // From the guest submitting a frame to the driver releasing it.
+    std::chrono::nanoseconds latency_sum;
+    std::chrono::nanoseconds latency_max;
+  };
+
+  // wake_event, if not null, is set by ReleaseFrame when the number of frames
+  // in flight drops to the threshold passed to ArmWake.
+  explicit AudioFrameRing(threading::Event* wake_event = nullptr);
+  ~AudioFrameRing();
+
+  // Drops all frames and requests and clears the statistics. No producer or
+  // consumer may be active.
+  void Reset();
+
+  // Producer. Copies a guest frame into the next free slot, returns false and
+  // counts a drop if there is none.
+  bool WriteFrame(const float* samples);
+
+  // Consumer. Returns the oldest frame not acquired yet, or nullptr (counting
+  // an underrun) if none is queued. The frame stays valid until released.
+  const float* AcquireFrame();
+  // Releases the oldest acquired frame.
+  void ReleaseFrame();
+
+  // Number of written frames not released yet.
+  size_t depth() const {
+    return size_t(write_index_.load(std::memory_order_acquire) -
+                  release_index_.load(std::memory_order_acquire));
+  }
+
+  // Flow control, used by the thread running the guest callback. Frames the
+  // guest writes without being asked for still count as in flight.
+  size_t frames_in_flight() const {
+    return FramesInFlight(std::memory_order_acquire);
+  }
+  void RequestFrame() {
+    requested_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Withdraws the requests that the guest hasn't written a frame for, once
+  // the callback they were made for has returned, so that they don't stay in
+  // flight forever.
+  void EndRequests() {
+    requested_count_.store(write_index_.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+  }
+  // Makes the next ReleaseFrame that leaves at most wake_in_flight frames in
+  // flight set the wake event. Returns the frames in flight after arming, as a
+  // release may have happened just before - only wait if it's still above the
+  // threshold.
+  size_t ArmWake(size_t wake_in_flight);
+
+  Stats stats() const;
+
+ private:
+  size_t FramesInFlight(std::memory_order release_order) const {
+    uint64_t requested = requested_count_.load(std::memory_order_relaxed);
+    uint64_t written = write_index_.load(std::memory_order_relaxed);
+    return size_t(std::max(requested, written) -
+                  release_index_.load(release_order));
+  }
+
+  struct Slot {
+    float samples[kFrameSamples];
+    Clock::time_point write_time;
+  };
+
+  threading::Event* wake_event_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Producer side.
+  alignas(64) std::atomic<uint64_t> write_index_{0};
+  std::atomic<uint64_t> frames_written_{0};
+  std::atomic<uint64_t> frames_dropped_{0};
+  std::atomic<uint64_t> depth_sum_{0};
+  std::atomic<uint32_t> depth_max_{0};
+  std::atomic<uint64_t> requested_count_{0};
+
+  // Consumer side.
+  alignas(64) std::atomic<uint64_t> acquire_index_{0};
+  std::atomic<uint64_t> release_index_{0};
+  std::atomic<uint64_t> underruns_{0};
+  std::atomic<int64_t> latency_sum_ns_{0};
+  std::atomic<int64_t> latency_max_ns_{0};
+
+  // Wake threshold, or -1 when not armed.
+  alignas(64) std::atomic<int64_t> wake_in_flight_{-1};
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_AUDIO_FRAME_RING_H_
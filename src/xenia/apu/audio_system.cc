@@ -9,6 +9,8 @@
 
 #include "xenia/apu/audio_system.h"
 
+#include <algorithm>
+
 #include "xenia/apu/apu_flags.h"
 #include "xenia/apu/audio_driver.h"
 #include "xenia/apu/xma_decoder.h"
@@ -43,15 +45,10 @@ AudioSystem::AudioSystem(cpu::Processor* processor)
       worker_running_(false) {
   std::memset(clients_, 0, sizeof(clients_));
 
-  for (size_t i = 0; i < kMaximumClientCount; ++i) {
-    client_semaphores_[i] =
-        xe::threading::Semaphore::Create(0, kMaximumQueuedFrames);
-    assert_not_null(client_semaphores_[i]);
-    wait_handles_[i] = client_semaphores_[i].get();
-  }
+  frame_released_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+  assert_not_null(frame_released_event_);
   shutdown_event_ = xe::threading::Event::CreateAutoResetEvent(false);
   assert_not_null(shutdown_event_);
-  wait_handles_[kMaximumClientCount] = shutdown_event_.get();
 
   xma_decoder_ = std::make_unique<xe::apu::XmaDecoder>(processor_);
 
@@ -81,6 +78,7 @@ X_STATUS AudioSystem::Setup(kernel::KernelState* kernel_state) {
   worker_thread_->set_can_debugger_suspend(true);
   worker_thread_->set_name("Audio Worker");
   worker_thread_->Create();
+  worker_thread_->SetRealtimePriority();
 
   return X_STATUS_SUCCESS;
 }
@@ -89,35 +87,23 @@ void AudioSystem::WorkerThreadMain() {
   // Initialize driver and ringbuffer.
   Initialize();
 
+  xe::threading::WaitHandle* wait_handles[] = {frame_released_event_.get(),
+                                               shutdown_event_.get()};
+
   // Main run loop.
   while (worker_running_) {
-    // These handles signify the number of submitted samples. Once we reach
-    // 64 samples, we wait until our audio backend releases a semaphore
-    // (signaling a sample has finished playing)
-    auto result =
-        xe::threading::WaitAny(wait_handles_, xe::countof(wait_handles_), true);
-    if (result.first == xe::threading::WaitResult::kFailed) {
-      // TODO: Assert?
-      continue;
-    }
-
-    if (result.first == threading::WaitResult::kSuccess &&
-        result.second == kMaximumClientCount) {
-      // Shutdown event signaled.
-      if (paused_) {
-        pause_fence_.Signal();
-        threading::Wait(resume_event_.get(), false);
-      }
-
-      continue;
-    }
-
-    // Number of clients pumped
+    // Request a frame from every client that has fewer than the target number
+    // of frames in flight, and let the drivers' releases (signaling a frame
+    // has finished playing) make room for more.
+    size_t target_depth = GetTargetQueueDepth();
     bool pumped = false;
-    if (result.first == xe::threading::WaitResult::kSuccess) {
-      auto index = result.second;
-
+    for (size_t index = 0; index < kMaximumClientCount; ++index) {
       auto global_lock = global_critical_region_.Acquire();
+      if (!clients_[index].in_use ||
+          client_rings_[index]->frames_in_flight() >= target_depth) {
+        continue;
+      }
+      client_rings_[index]->RequestFrame();
       uint32_t client_callback = clients_[index].callback;
       uint32_t client_callback_arg = clients_[index].wrapped_callback_arg;
       global_lock.unlock();
@@ -128,17 +114,53 @@ void AudioSystem::WorkerThreadMain() {
         processor_->Execute(worker_thread_->thread_state(), client_callback,
                             args, xe::countof(args));
       }
-
+      global_lock.lock();
+      if (clients_[index].in_use) {
+        client_rings_[index]->EndRequests();
+      }
+      global_lock.unlock();
       pumped = true;
     }
 
     if (!worker_running_) {
       break;
     }
+    if (pumped) {
+      continue;
+    }
 
-    if (!pumped) {
-      SCOPE_profile_cpu_i("apu", "Sleep");
+    // All queues are full. Sleep until a quarter of the target has been
+    // played, rather than waking up for every frame.
+    size_t wake_in_flight =
+        target_depth - std::max(size_t(1), target_depth / 4);
+    bool has_room = false;
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      for (size_t index = 0; index < kMaximumClientCount; ++index) {
+        if (clients_[index].in_use &&
+            client_rings_[index]->ArmWake(wake_in_flight) < target_depth) {
+          has_room = true;
+        }
+      }
+    }
+    if (has_room) {
+      continue;
+    }
+
+    SCOPE_profile_cpu_i("apu", "Sleep");
+    auto result =
+        xe::threading::WaitAny(wait_handles, xe::countof(wait_handles), true);
+    if (result.first == xe::threading::WaitResult::kFailed) {
       xe::threading::Sleep(std::chrono::milliseconds(500));
+      continue;
+    }
+    if (result.first == threading::WaitResult::kSuccess &&
+        result.second == 1) {
+      // Shutdown event signaled.
+      if (paused_) {
+        pause_fence_.Signal();
+        threading::Wait(resume_event_.get(), false);
+      }
     }
   }
   worker_running_ = false;
@@ -146,6 +168,34 @@ void AudioSystem::WorkerThreadMain() {
   // TODO(benvanik): call module API to kill?
 }
 
+size_t AudioSystem::GetTargetQueueDepth() {
+  if (!cvars::apu_low_latency) {
+    return kMaximumQueuedFrames;
+  }
+  return size_t(std::clamp(cvars::apu_low_latency_queue_depth, int32_t(2),
+                           int32_t(kMaximumQueuedFrames)));
+}
+
+void AudioSystem::LogClientStats(size_t index) {
+  AudioFrameRing::Stats stats = client_rings_[index]->stats();
+  if (!stats.frames_written) {
+    return;
+  }
+  double latency_avg_ms =
+      stats.frames_released
+          ? std::chrono::duration<double, std::milli>(stats.latency_sum)
+                    .count() /
+                stats.frames_released
+          : 0.0;
+  XELOGI(
+      "Audio client {}: {} frames, {} dropped, {} underruns, queue depth avg "
+      "{:.1f} max {} (target {}), latency avg {:.1f} ms max {:.1f} ms",
+      index, stats.frames_written, stats.frames_dropped, stats.underruns,
+      double(stats.depth_sum) / stats.frames_written, stats.depth_max,
+      GetTargetQueueDepth(), latency_avg_ms,
+      std::chrono::duration<double, std::milli>(stats.latency_max).count());
+}
+
 int AudioSystem::FindFreeClient() {
   for (int i = 0; i < kMaximumClientCount; i++) {
     auto& client = clients_[i];
@@ -160,6 +210,14 @@ int AudioSystem::FindFreeClient() {
 void AudioSystem::Initialize() {}
 
 void AudioSystem::Shutdown() {
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    for (size_t i = 0; i < kMaximumClientCount; ++i) {
+      if (clients_[i].in_use) {
+        LogClientStats(i);
+      }
+    }
+  }
   worker_running_ = false;
   shutdown_event_->Set();
   if (worker_thread_) {
@@ -175,12 +233,10 @@ X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
   auto index = FindFreeClient();
   assert_true(index >= 0);
 
-  auto client_semaphore = client_semaphores_[index].get();
-  auto ret = client_semaphore->Release(kMaximumQueuedFrames, nullptr);
-  assert_true(ret);
+  AudioFrameRing* frame_ring = GetClientRing(index);
 
   AudioDriver* driver;
-  auto result = CreateDriver(index, client_semaphore, &driver);
+  auto result = CreateDriver(index, frame_ring, &driver);
   if (XFAILED(result)) {
     return result;
   }
@@ -190,6 +246,8 @@ X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
   xe::store_and_swap<uint32_t>(memory()->TranslateVirtual(ptr), callback_arg);
 
   clients_[index] = {driver, callback, callback_arg, ptr, true};
+  // Have the worker request the first frames.
+  frame_released_event_->Set();
 
   if (out_index) {
     *out_index = index;
@@ -204,7 +262,12 @@ void AudioSystem::SubmitFrame(size_t index, uint32_t samples_ptr) {
   auto global_lock = global_critical_region_.Acquire();
   assert_true(index < kMaximumClientCount);
   assert_true(clients_[index].driver != NULL);
-  (clients_[index].driver)->SubmitFrame(samples_ptr);
+  // Dropped (and counted) if all slots are in use. Frames beyond those
+  // requested are kept, but hold back the next requests.
+  if (client_rings_[index]->WriteFrame(
+          memory()->TranslateVirtual<const float*>(samples_ptr))) {
+    clients_[index].driver->OnFrameSubmitted();
+  }
 }
 
 void AudioSystem::UnregisterClient(size_t index) {
@@ -212,18 +275,22 @@ void AudioSystem::UnregisterClient(size_t index) {
 
   auto global_lock = global_critical_region_.Acquire();
   assert_true(index < kMaximumClientCount);
+  LogClientStats(index);
   DestroyDriver(clients_[index].driver);
   memory()->SystemHeapFree(clients_[index].wrapped_callback_arg);
   clients_[index] = {0};
+  // The driver is gone, nothing consumes the remaining frames anymore.
+  client_rings_[index]->Reset();
+}
 
-  // Drain the semaphore of its count.
-  auto client_semaphore = client_semaphores_[index].get();
-  xe::threading::WaitResult wait_result;
-  do {
-    wait_result = xe::threading::Wait(client_semaphore, false,
-                                      std::chrono::milliseconds(0));
-  } while (wait_result == xe::threading::WaitResult::kSuccess);
-  assert_true(wait_result == xe::threading::WaitResult::kTimeout);
+AudioFrameRing* AudioSystem::GetClientRing(size_t index) {
+  auto& frame_ring = client_rings_[index];
+  if (!frame_ring) {
+    frame_ring = std::make_unique<AudioFrameRing>(frame_released_event_.get());
+  } else {
+    frame_ring->Reset();
+  }
+  return frame_ring.get();
 }
 
 bool AudioSystem::Save(ByteStream* stream) {
@@ -278,12 +345,8 @@ bool AudioSystem::Restore(ByteStream* stream) {
 
     client.in_use = true;
 
-    auto client_semaphore = client_semaphores_[id].get();
-    auto ret = client_semaphore->Release(kMaximumQueuedFrames, nullptr);
-    assert_true(ret);
-
     AudioDriver* driver = nullptr;
-    auto status = CreateDriver(id, client_semaphore, &driver);
+    auto status = CreateDriver(id, GetClientRing(id), &driver);
     if (XFAILED(status)) {
       XELOGE(
           "AudioSystem::Restore - Call to CreateDriver failed with status "
@@ -295,6 +358,7 @@ bool AudioSystem::Restore(ByteStream* stream) {
     assert_not_null(driver);
     client.driver = driver;
   }
+  frame_released_event_->Set();
 
   return true;
 }
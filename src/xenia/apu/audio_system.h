@@ -11,8 +11,9 @@
 #define XENIA_APU_AUDIO_SYSTEM_H_
 
 #include <atomic>
-#include <queue>
+#include <memory>
 
+#include "xenia/apu/audio_frame_ring.h"
 #include "xenia/base/mutex.h"
 #include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
@@ -58,14 +59,19 @@ class AudioSystem {
 
   void WorkerThreadMain();
 
-  virtual X_STATUS CreateDriver(size_t index,
-                                xe::threading::Semaphore* semaphore,
+  virtual X_STATUS CreateDriver(size_t index, AudioFrameRing* frame_ring,
                                 AudioDriver** out_driver) = 0;
   virtual void DestroyDriver(AudioDriver* driver) = 0;
 
   // TODO(gibbed): respect XAUDIO2_MAX_QUEUED_BUFFERS somehow (ie min(64,
   // XAUDIO2_MAX_QUEUED_BUFFERS))
   static const size_t kMaximumQueuedFrames = 64;
+  static_assert(kMaximumQueuedFrames <= AudioFrameRing::kCapacity);
+
+  // Number of frames to keep requested from each client and not yet released
+  // by its driver.
+  static size_t GetTargetQueueDepth();
+  void LogClientStats(size_t index);
 
   Memory* memory_ = nullptr;
   cpu::Processor* processor_ = nullptr;
@@ -85,12 +91,15 @@ class AudioSystem {
   } clients_[kMaximumClientCount];
 
   int FindFreeClient();
-
-  std::unique_ptr<xe::threading::Semaphore>
-      client_semaphores_[kMaximumClientCount];
-  // Event is always there in case we have no clients.
+  // Returns the emptied frame ring of a client slot.
+  AudioFrameRing* GetClientRing(size_t index);
+
+  // Created on first use of the client slot, then kept.
+  std::unique_ptr<AudioFrameRing> client_rings_[kMaximumClientCount];
+  // Set by the rings when enough frames have been released to request more,
+  // and when a client is registered.
+  std::unique_ptr<xe::threading::Event> frame_released_event_;
   std::unique_ptr<xe::threading::Event> shutdown_event_;
-  xe::threading::WaitHandle* wait_handles_[kMaximumClientCount + 1];
 
   bool paused_ = false;
   threading::Fence pause_fence_;
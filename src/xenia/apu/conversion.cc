@@ -0,0 +1,277 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2021 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/conversion.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64 && XE_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+namespace xe {
+namespace apu {
+namespace conversion {
+
+#if XE_ARCH_AMD64
+// Defined in conversion_avx2.cc and conversion_avx512.cc, which are built with
+// the respective instruction sets enabled and must only be called after
+// checking for support.
+extern const Kernels kAvx2Kernels;
+extern const Kernels kAvx512Kernels;
+
+static void sequential_6_BE_to_interleaved_6_LE_sse(float* output,
+                                                    const float* input,
+                                                    size_t ch_sample_count) {
+  const uint32_t* in = reinterpret_cast<const uint32_t*>(input);
+  uint32_t* out = reinterpret_cast<uint32_t*>(output);
+  const __m128i byte_swap_shuffle =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  for (size_t sample = 0; sample < ch_sample_count; sample++) {
+    __m128i sample0 = _mm_set_epi32(
+        in[3 * ch_sample_count + sample], in[2 * ch_sample_count + sample],
+        in[1 * ch_sample_count + sample], in[0 * ch_sample_count + sample]);
+    uint32_t sample1 = in[4 * ch_sample_count + sample];
+    uint32_t sample2 = in[5 * ch_sample_count + sample];
+    sample0 = _mm_shuffle_epi8(sample0, byte_swap_shuffle);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[sample * 6]), sample0);
+    sample1 = xe::byte_swap(sample1);
+    out[sample * 6 + 4] = sample1;
+    sample2 = xe::byte_swap(sample2);
+    out[sample * 6 + 5] = sample2;
+  }
+}
+
+static void sequential_6_BE_to_interleaved_2_LE_sse(float* output,
+                                                    const float* input,
+                                                    size_t ch_sample_count) {
+  assert_true(ch_sample_count % 4 == 0);
+  const __m128i byte_swap_shuffle =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 two_fifths = _mm_set1_ps(1.0f / 2.5f);
+
+  // put center on left and right, discard low frequency
+  for (size_t sample = 0; sample < ch_sample_count; sample += 4) {
+    // load 4 samples from 6 channels each
+    __m128 fl = _mm_loadu_ps(&input[0 * ch_sample_count + sample]);
+    __m128 fr = _mm_loadu_ps(&input[1 * ch_sample_count + sample]);
+    __m128 fc = _mm_loadu_ps(&input[2 * ch_sample_count + sample]);
+    __m128 bl = _mm_loadu_ps(&input[4 * ch_sample_count + sample]);
+    __m128 br = _mm_loadu_ps(&input[5 * ch_sample_count + sample]);
+    // byte swap
+    fl = _mm_castsi128_ps(
+        _mm_shuffle_epi8(_mm_castps_si128(fl), byte_swap_shuffle));
+    fr = _mm_castsi128_ps(
+        _mm_shuffle_epi8(_mm_castps_si128(fr), byte_swap_shuffle));
+    fc = _mm_castsi128_ps(
+        _mm_shuffle_epi8(_mm_castps_si128(fc), byte_swap_shuffle));
+    bl = _mm_castsi128_ps(
+        _mm_shuffle_epi8(_mm_castps_si128(bl), byte_swap_shuffle));
+    br = _mm_castsi128_ps(
+        _mm_shuffle_epi8(_mm_castps_si128(br), byte_swap_shuffle));
+
+    __m128 center_halved = _mm_mul_ps(fc, half);
+    __m128 left = _mm_add_ps(_mm_add_ps(fl, bl), center_halved);
+    __m128 right = _mm_add_ps(_mm_add_ps(fr, br), center_halved);
+    left = _mm_mul_ps(left, two_fifths);
+    right = _mm_mul_ps(right, two_fifths);
+    _mm_storeu_ps(&output[sample * 2], _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps(&output[(sample + 2) * 2], _mm_unpackhi_ps(left, right));
+  }
+}
+
+static void planar_to_interleaved_int16_BE_sse(int16_t* output,
+                                               const float* const* input,
+                                               bool is_two_channel,
+                                               size_t ch_sample_count) {
+  assert_true(ch_sample_count % 8 == 0);
+  const float* in_channel_0 = input[0];
+  const __m128 scale_mm = _mm_set1_ps(float((1 << 15) - 1));
+  if (is_two_channel) {
+    const float* in_channel_1 = input[1];
+    const __m128i shufmask =
+        _mm_set_epi8(14, 15, 6, 7, 12, 13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1);
+    for (size_t i = 0; i < ch_sample_count; i += 4) {
+      // Load 8 samples, 4 for each channel.
+      __m128 in_mm0 = _mm_loadu_ps(&in_channel_0[i]);
+      __m128 in_mm1 = _mm_loadu_ps(&in_channel_1[i]);
+      // Rescale.
+      in_mm0 = _mm_mul_ps(in_mm0, scale_mm);
+      in_mm1 = _mm_mul_ps(in_mm1, scale_mm);
+      // Cast to int32.
+      __m128i out_mm0 = _mm_cvtps_epi32(in_mm0);
+      __m128i out_mm1 = _mm_cvtps_epi32(in_mm1);
+      // Saturated cast and pack to int16.
+      __m128i out_mm = _mm_packs_epi32(out_mm0, out_mm1);
+      // Interleave channels and byte swap.
+      out_mm = _mm_shuffle_epi8(out_mm, shufmask);
+      // Store, as [out + i * 4] movdqu.
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i * 2]), out_mm);
+    }
+  } else {
+    const __m128i shufmask =
+        _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    for (size_t i = 0; i < ch_sample_count; i += 8) {
+      // Load 8 samples, as [in_channel_0 + i * 4] and
+      // [in_channel_0 + i * 4 + 16] movups.
+      __m128 in_mm0 = _mm_loadu_ps(&in_channel_0[i]);
+      __m128 in_mm1 = _mm_loadu_ps(&in_channel_0[i + 4]);
+      // Rescale.
+      in_mm0 = _mm_mul_ps(in_mm0, scale_mm);
+      in_mm1 = _mm_mul_ps(in_mm1, scale_mm);
+      // Cast to int32.
+      __m128i out_mm0 = _mm_cvtps_epi32(in_mm0);
+      __m128i out_mm1 = _mm_cvtps_epi32(in_mm1);
+      // Saturated cast and pack to int16.
+      __m128i out_mm = _mm_packs_epi32(out_mm0, out_mm1);
+      // Byte swap.
+      out_mm = _mm_shuffle_epi8(out_mm, shufmask);
+      // Store, as [out + i * 2] movdqu.
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), out_mm);
+    }
+  }
+}
+
+static const Kernels kBaselineKernels = {
+    "sse",
+    sequential_6_BE_to_interleaved_6_LE_sse,
+    sequential_6_BE_to_interleaved_2_LE_sse,
+    planar_to_interleaved_int16_BE_sse,
+};
+
+// The wider registers are only usable if the OS saves their state, which the
+// compiler builtins check along with the CPUID feature bits.
+static bool HasAvx2() {
+#if XE_COMPILER_MSVC
+  int registers[4];
+  __cpuid(registers, 0);
+  if (registers[0] < 7) {
+    return false;
+  }
+  __cpuid(registers, 1);
+  // OSXSAVE and AVX.
+  if ((registers[2] & 0x18000000) != 0x18000000 ||
+      (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(registers, 7, 0);
+  return (registers[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool HasAvx512() {
+#if XE_COMPILER_MSVC
+  if (!HasAvx2()) {
+    return false;
+  }
+  // Opmask, upper ZMM0-15 and ZMM16-31 state.
+  if ((_xgetbv(0) & 0xE6) != 0xE6) {
+    return false;
+  }
+  int registers[4];
+  __cpuidex(registers, 7, 0);
+  // AVX512F and AVX512BW.
+  return (registers[1] & ((1 << 16) | (1 << 30))) == ((1 << 16) | (1 << 30));
+#else
+  return __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512bw");
+#endif
+}
+#else
+static void sequential_6_BE_to_interleaved_6_LE_scalar(float* output,
+                                                       const float* input,
+                                                       size_t ch_sample_count) {
+  for (size_t sample = 0; sample < ch_sample_count; sample++) {
+    for (size_t channel = 0; channel < 6; channel++) {
+      output[sample * 6 + channel] =
+          xe::byte_swap(input[channel * ch_sample_count + sample]);
+    }
+  }
+}
+
+static void sequential_6_BE_to_interleaved_2_LE_scalar(float* output,
+                                                       const float* input,
+                                                       size_t ch_sample_count) {
+  // Default 5.1 channel mapping is fl, fr, fc, lf, bl, br
+  // https://docs.microsoft.com/en-us/windows/win32/xaudio2/xaudio2-default-channel-mapping
+  for (size_t sample = 0; sample < ch_sample_count; sample++) {
+    // put center on left and right, discard low frequency
+    float fl = xe::byte_swap(input[0 * ch_sample_count + sample]);
+    float fr = xe::byte_swap(input[1 * ch_sample_count + sample]);
+    float fc = xe::byte_swap(input[2 * ch_sample_count + sample]);
+    float br = xe::byte_swap(input[4 * ch_sample_count + sample]);
+    float bl = xe::byte_swap(input[5 * ch_sample_count + sample]);
+    float center_halved = fc * 0.5f;
+    output[sample * 2] = (fl + bl + center_halved) * (1.0f / 2.5f);
+    output[sample * 2 + 1] = (fr + br + center_halved) * (1.0f / 2.5f);
+  }
+}
+
+static void planar_to_interleaved_int16_BE_scalar(int16_t* output,
+                                                  const float* const* input,
+                                                  bool is_two_channel,
+                                                  size_t ch_sample_count) {
+  constexpr float scale = (1 << 15) - 1;
+  size_t o = 0;
+  for (size_t i = 0; i < ch_sample_count; i++) {
+    for (uint32_t j = 0; j <= uint32_t(is_two_channel); j++) {
+      // Raw samples sometimes aren't within [-1, 1]
+      float scaled_sample = xe::clamp_float(input[j][i], -1.0f, 1.0f) * scale;
+
+      // Convert the sample and output it in big endian.
+      auto sample = static_cast<int16_t>(scaled_sample);
+      output[o++] = xe::byte_swap(sample);
+    }
+  }
+}
+
+static const Kernels kBaselineKernels = {
+    "scalar",
+    sequential_6_BE_to_interleaved_6_LE_scalar,
+    sequential_6_BE_to_interleaved_2_LE_scalar,
+    planar_to_interleaved_int16_BE_scalar,
+};
+#endif
+
+const std::vector<const Kernels*>& GetSupportedKernels() {
+  static const std::vector<const Kernels*> supported_kernels = []() {
+    std::vector<const Kernels*> kernels;
+    kernels.push_back(&kBaselineKernels);
+#if XE_ARCH_AMD64
+    if (HasAvx2()) {
+      kernels.push_back(&kAvx2Kernels);
+      if (HasAvx512()) {
+        kernels.push_back(&kAvx512Kernels);
+      }
+    }
+#endif
+    return kernels;
+  }();
+  return supported_kernels;
+}
+
+const Kernels& GetKernels() {
+  static const Kernels& kernels = []() -> const Kernels& {
+    const Kernels& best = *GetSupportedKernels().back();
+    XELOGI("Audio sample conversion using {} kernels", best.name);
+    return best;
+  }();
+  return kernels;
+}
+
+}  // namespace conversion
+}  // namespace apu
+}  // namespace xe
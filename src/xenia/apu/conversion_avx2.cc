@@ -0,0 +1,160 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2021 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/conversion.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/platform.h"
+
+// Built with AVX2 enabled (see premake5.lua), only reached through
+// GetKernels() after checking for support.
+
+#if XE_ARCH_AMD64
+
+namespace xe {
+namespace apu {
+namespace conversion {
+
+// Swaps the bytes of every 32-bit element, within each 128-bit lane.
+static inline __m256i ByteSwap32(__m256i value) {
+  const __m256i byte_swap_shuffle = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  return _mm256_shuffle_epi8(value, byte_swap_shuffle);
+}
+
+static inline __m256 LoadBE(const float* input) {
+  return _mm256_castsi256_ps(ByteSwap32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input))));
+}
+
+// Also used by the AVX-512 kernels, wider vectors don't help this transpose.
+void sequential_6_BE_to_interleaved_6_LE_avx2(float* output, const float* input,
+                                              size_t ch_sample_count) {
+  assert_true(ch_sample_count % 8 == 0);
+  for (size_t sample = 0; sample < ch_sample_count; sample += 8) {
+    __m256 c[6];
+    for (size_t channel = 0; channel < 6; ++channel) {
+      c[channel] = LoadBE(&input[channel * ch_sample_count + sample]);
+    }
+    // Each lane holds 4 samples, transpose them within the lanes. Channels 0
+    // to 3 of each sample:
+    __m256 c01_lo = _mm256_unpacklo_ps(c[0], c[1]);
+    __m256 c01_hi = _mm256_unpackhi_ps(c[0], c[1]);
+    __m256 c23_lo = _mm256_unpacklo_ps(c[2], c[3]);
+    __m256 c23_hi = _mm256_unpackhi_ps(c[2], c[3]);
+    __m256 s0 = _mm256_shuffle_ps(c01_lo, c23_lo, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(c01_lo, c23_lo, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(c01_hi, c23_hi, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(c01_hi, c23_hi, _MM_SHUFFLE(3, 2, 3, 2));
+    // Channels 4 and 5 of samples 0 and 1, and 2 and 3.
+    __m256 s01_c45 = _mm256_unpacklo_ps(c[4], c[5]);
+    __m256 s23_c45 = _mm256_unpackhi_ps(c[4], c[5]);
+    // The 24 output floats of each lane, 4 at a time.
+    __m256 o0 = s0;
+    __m256 o1 = _mm256_shuffle_ps(s01_c45, s1, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 o2 = _mm256_shuffle_ps(s1, s01_c45, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 o3 = s2;
+    __m256 o4 = _mm256_shuffle_ps(s23_c45, s3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 o5 = _mm256_shuffle_ps(s3, s23_c45, _MM_SHUFFLE(3, 2, 3, 2));
+    // The low lanes make samples 0 to 3, the high lanes samples 4 to 7.
+    float* out = &output[sample * 6];
+    _mm256_storeu_ps(out, _mm256_permute2f128_ps(o0, o1, 0x20));
+    _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(o2, o3, 0x20));
+    _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(o4, o5, 0x20));
+    _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(o0, o1, 0x31));
+    _mm256_storeu_ps(out + 32, _mm256_permute2f128_ps(o2, o3, 0x31));
+    _mm256_storeu_ps(out + 40, _mm256_permute2f128_ps(o4, o5, 0x31));
+  }
+}
+
+static void sequential_6_BE_to_interleaved_2_LE_avx2(float* output,
+                                                     const float* input,
+                                                     size_t ch_sample_count) {
+  assert_true(ch_sample_count % 8 == 0);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 two_fifths = _mm256_set1_ps(1.0f / 2.5f);
+
+  // Same arithmetic, in the same order, as the SSE version, so the results
+  // are identical.
+  for (size_t sample = 0; sample < ch_sample_count; sample += 8) {
+    __m256 fl = LoadBE(&input[0 * ch_sample_count + sample]);
+    __m256 fr = LoadBE(&input[1 * ch_sample_count + sample]);
+    __m256 fc = LoadBE(&input[2 * ch_sample_count + sample]);
+    __m256 bl = LoadBE(&input[4 * ch_sample_count + sample]);
+    __m256 br = LoadBE(&input[5 * ch_sample_count + sample]);
+
+    __m256 center_halved = _mm256_mul_ps(fc, half);
+    __m256 left = _mm256_add_ps(_mm256_add_ps(fl, bl), center_halved);
+    __m256 right = _mm256_add_ps(_mm256_add_ps(fr, br), center_halved);
+    left = _mm256_mul_ps(left, two_fifths);
+    right = _mm256_mul_ps(right, two_fifths);
+    // Samples 0, 1, 4, 5 and 2, 3, 6, 7, interleaved within each lane.
+    __m256 lo = _mm256_unpacklo_ps(left, right);
+    __m256 hi = _mm256_unpackhi_ps(left, right);
+    _mm256_storeu_ps(&output[sample * 2], _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(&output[(sample + 4) * 2],
+                     _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+}
+
+static void planar_to_interleaved_int16_BE_avx2(int16_t* output,
+                                                const float* const* input,
+                                                bool is_two_channel,
+                                                size_t ch_sample_count) {
+  assert_true(ch_sample_count % 16 == 0);
+  const float* in_channel_0 = input[0];
+  const __m256 scale = _mm256_set1_ps(float((1 << 15) - 1));
+  if (is_two_channel) {
+    const float* in_channel_1 = input[1];
+    // The pack leaves 4 samples of each channel in each lane, the same
+    // interleaving and byte swap shuffle as for SSE then applies to both lanes.
+    const __m256i shufmask =
+        _mm256_set_epi8(14, 15, 6, 7, 12, 13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1,
+                        14, 15, 6, 7, 12, 13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1);
+    for (size_t i = 0; i < ch_sample_count; i += 8) {
+      __m256i out0 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_0[i]), scale));
+      __m256i out1 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_1[i]), scale));
+      __m256i out =
+          _mm256_shuffle_epi8(_mm256_packs_epi32(out0, out1), shufmask);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&output[i * 2]), out);
+    }
+  } else {
+    const __m256i shufmask =
+        _mm256_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                        14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    for (size_t i = 0; i < ch_sample_count; i += 16) {
+      __m256i out0 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_0[i]), scale));
+      __m256i out1 = _mm256_cvtps_epi32(
+          _mm256_mul_ps(_mm256_loadu_ps(&in_channel_0[i + 8]), scale));
+      // The pack interleaves the inputs by 64 bits within lanes, put the
+      // samples back in order.
+      __m256i out = _mm256_permute4x64_epi64(_mm256_packs_epi32(out0, out1),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+      out = _mm256_shuffle_epi8(out, shufmask);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&output[i]), out);
+    }
+  }
+}
+
+extern const Kernels kAvx2Kernels = {
+    "avx2",
+    sequential_6_BE_to_interleaved_6_LE_avx2,
+    sequential_6_BE_to_interleaved_2_LE_avx2,
+    planar_to_interleaved_int16_BE_avx2,
+};
+
+}  // namespace conversion
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XE_ARCH_AMD64
@@ -0,0 +1,125 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2021 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/conversion.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/platform.h"
+
+// Built with AVX-512 F and BW enabled (see premake5.lua), only reached through
+// GetKernels() after checking for support.
+
+#if XE_ARCH_AMD64
+
+namespace xe {
+namespace apu {
+namespace conversion {
+
+void sequential_6_BE_to_interleaved_6_LE_avx2(float* output, const float* input,
+                                              size_t ch_sample_count);
+
+// Swaps the bytes of every 32-bit element, within each 128-bit lane.
+static inline __m512i ByteSwap32(__m512i value) {
+  const __m512i byte_swap_shuffle = _mm512_broadcast_i32x4(
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+  return _mm512_shuffle_epi8(value, byte_swap_shuffle);
+}
+
+static void sequential_6_BE_to_interleaved_2_LE_avx512(float* output,
+                                                       const float* input,
+                                                       size_t ch_sample_count) {
+  assert_true(ch_sample_count % 16 == 0);
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 two_fifths = _mm512_set1_ps(1.0f / 2.5f);
+  alignas(64) static const int kInterleaveLo[16] = {0, 16, 1, 17, 2, 18, 3, 19,
+                                                    4, 20, 5, 21, 6, 22, 7, 23};
+  alignas(64) static const int kInterleaveHi[16] = {
+      8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31};
+  const __m512i interleave_lo = _mm512_load_si512(kInterleaveLo);
+  const __m512i interleave_hi = _mm512_load_si512(kInterleaveHi);
+
+  // Same arithmetic, in the same order, as the SSE version, so the results
+  // are identical (this file is built without floating-point contraction).
+  for (size_t sample = 0; sample < ch_sample_count; sample += 16) {
+    __m512 fl = _mm512_castsi512_ps(
+        ByteSwap32(_mm512_loadu_si512(&input[0 * ch_sample_count + sample])));
+    __m512 fr = _mm512_castsi512_ps(
+        ByteSwap32(_mm512_loadu_si512(&input[1 * ch_sample_count + sample])));
+    __m512 fc = _mm512_castsi512_ps(
+        ByteSwap32(_mm512_loadu_si512(&input[2 * ch_sample_count + sample])));
+    __m512 bl = _mm512_castsi512_ps(
+        ByteSwap32(_mm512_loadu_si512(&input[4 * ch_sample_count + sample])));
+    __m512 br = _mm512_castsi512_ps(
+        ByteSwap32(_mm512_loadu_si512(&input[5 * ch_sample_count + sample])));
+
+    __m512 center_halved = _mm512_mul_ps(fc, half);
+    __m512 left = _mm512_add_ps(_mm512_add_ps(fl, bl), center_halved);
+    __m512 right = _mm512_add_ps(_mm512_add_ps(fr, br), center_halved);
+    left = _mm512_mul_ps(left, two_fifths);
+    right = _mm512_mul_ps(right, two_fifths);
+    _mm512_storeu_ps(&output[sample * 2],
+                     _mm512_permutex2var_ps(left, interleave_lo, right));
+    _mm512_storeu_ps(&output[(sample + 8) * 2],
+                     _mm512_permutex2var_ps(left, interleave_hi, right));
+  }
+}
+
+static void planar_to_interleaved_int16_BE_avx512(int16_t* output,
+                                                  const float* const* input,
+                                                  bool is_two_channel,
+                                                  size_t ch_sample_count) {
+  assert_true(ch_sample_count % 32 == 0);
+  const float* in_channel_0 = input[0];
+  const __m512 scale = _mm512_set1_ps(float((1 << 15) - 1));
+  if (is_two_channel) {
+    const float* in_channel_1 = input[1];
+    // The pack leaves 4 samples of each channel in each lane, the same
+    // interleaving and byte swap shuffle as for SSE then applies to all lanes.
+    const __m512i shufmask = _mm512_broadcast_i32x4(
+        _mm_set_epi8(14, 15, 6, 7, 12, 13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1));
+    for (size_t i = 0; i < ch_sample_count; i += 16) {
+      __m512i out0 = _mm512_cvtps_epi32(
+          _mm512_mul_ps(_mm512_loadu_ps(&in_channel_0[i]), scale));
+      __m512i out1 = _mm512_cvtps_epi32(
+          _mm512_mul_ps(_mm512_loadu_ps(&in_channel_1[i]), scale));
+      __m512i out =
+          _mm512_shuffle_epi8(_mm512_packs_epi32(out0, out1), shufmask);
+      _mm512_storeu_si512(&output[i * 2], out);
+    }
+  } else {
+    const __m512i shufmask = _mm512_broadcast_i32x4(
+        _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+    // The pack interleaves the inputs by 64 bits within lanes, put the
+    // samples back in order.
+    const __m512i unpack_order = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    for (size_t i = 0; i < ch_sample_count; i += 32) {
+      __m512i out0 = _mm512_cvtps_epi32(
+          _mm512_mul_ps(_mm512_loadu_ps(&in_channel_0[i]), scale));
+      __m512i out1 = _mm512_cvtps_epi32(
+          _mm512_mul_ps(_mm512_loadu_ps(&in_channel_0[i + 16]), scale));
+      __m512i out = _mm512_permutexvar_epi64(
+          unpack_order, _mm512_packs_epi32(out0, out1));
+      out = _mm512_shuffle_epi8(out, shufmask);
+      _mm512_storeu_si512(&output[i], out);
+    }
+  }
+}
+
+extern const Kernels kAvx512Kernels = {
+    "avx512",
+    sequential_6_BE_to_interleaved_6_LE_avx2,
+    sequential_6_BE_to_interleaved_2_LE_avx512,
+    planar_to_interleaved_int16_BE_avx512,
+};
+
+}  // namespace conversion
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XE_ARCH_AMD64
@@ -0,0 +1,26 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/file/file_apu_flags.h"
+
+DEFINE_path(apu_file_path, "",
+            "For the file audio system, WAV file to write the output to "
+            "(5.1, 32-bit float, 48 kHz). Clients after the first one get "
+            "their index appended to the name. Empty to not write audio.",
+            "APU");
+DEFINE_path(apu_file_stats_path, "",
+            "For the file audio system, CSV file to write per-frame timing "
+            "statistics to. Empty to only log a summary.",
+            "APU");
+DEFINE_string(apu_file_clock, "realtime",
+              "Clock the file audio system consumes frames at. Use: "
+              "[realtime, fast]. realtime plays a frame every 5.33 ms like a "
+              "sound card and inserts silence on underruns, fast takes every "
+              "frame as soon as it's submitted.",
+              "APU");
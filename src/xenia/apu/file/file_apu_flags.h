@@ -0,0 +1,19 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_FILE_FILE_APU_FLAGS_H_
+#define XENIA_APU_FILE_FILE_APU_FLAGS_H_
+
+#include "xenia/base/cvar.h"
+
+DECLARE_path(apu_file_path)
+DECLARE_path(apu_file_stats_path)
+DECLARE_string(apu_file_clock)
+
+#endif  // XENIA_APU_FILE_FILE_APU_FLAGS_H_
@@ -0,0 +1,251 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/file/file_audio_driver.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/apu/apu_flags.h"
+#include "xenia/apu/conversion.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace apu {
+namespace file {
+
+namespace {
+
+constexpr uint32_t kWavHeaderSize = 68;
+
+void StoreLE16(uint8_t* out, uint16_t value) {
+  out[0] = uint8_t(value);
+  out[1] = uint8_t(value >> 8);
+}
+
+void StoreLE32(uint8_t* out, uint32_t value) {
+  StoreLE16(out, uint16_t(value));
+  StoreLE16(out + 2, uint16_t(value >> 16));
+}
+
+// WAVE_FORMAT_EXTENSIBLE header for 5.1 32-bit float, as more than 2 channels
+// require a channel mask.
+void BuildWavHeader(uint8_t* out, uint32_t data_size) {
+  constexpr uint32_t kChannels = AudioFrameRing::kFrameChannels;
+  constexpr uint32_t kBlockAlign = kChannels * sizeof(float);
+  static const uint8_t kSubFormatIeeeFloat[16] = {
+      0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+      0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+  std::memcpy(out, "RIFF", 4);
+  StoreLE32(out + 4, kWavHeaderSize - 8 + data_size);
+  std::memcpy(out + 8, "WAVEfmt ", 8);
+  StoreLE32(out + 16, 40);
+  StoreLE16(out + 20, 0xFFFE);
+  StoreLE16(out + 22, uint16_t(kChannels));
+  StoreLE32(out + 24, AudioFrameRing::kSampleRate);
+  StoreLE32(out + 28, AudioFrameRing::kSampleRate * kBlockAlign);
+  StoreLE16(out + 32, uint16_t(kBlockAlign));
+  StoreLE16(out + 34, 32);
+  StoreLE16(out + 36, 22);
+  StoreLE16(out + 38, 32);
+  // Front left, front right, front center, low frequency, back left, back
+  // right.
+  StoreLE32(out + 40, 0x3F);
+  std::memcpy(out + 44, kSubFormatIeeeFloat, sizeof(kSubFormatIeeeFloat));
+  std::memcpy(out + 60, "data", 4);
+  StoreLE32(out + 64, data_size);
+}
+
+double ToMilliseconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+FileAudioDriver::FileAudioDriver(Memory* memory, AudioFrameRing* frame_ring,
+                                 const std::filesystem::path& wav_path,
+                                 const std::filesystem::path& stats_path,
+                                 bool realtime)
+    : AudioDriver(memory, frame_ring),
+      wav_path_(wav_path),
+      stats_path_(stats_path),
+      realtime_(realtime) {}
+
+FileAudioDriver::~FileAudioDriver() {
+  assert_false(worker_thread_.joinable());
+  assert_null(wav_file_);
+  assert_null(stats_file_);
+}
+
+bool FileAudioDriver::Initialize() {
+  if (!wav_path_.empty()) {
+    wav_file_ = xe::filesystem::OpenFile(wav_path_, "wb");
+    if (!wav_file_) {
+      XELOGE("Failed to open audio output file {}",
+             xe::path_to_utf8(wav_path_));
+      return false;
+    }
+    uint8_t header[kWavHeaderSize];
+    BuildWavHeader(header, 0);
+    std::fwrite(header, 1, sizeof(header), wav_file_);
+  }
+  if (!stats_path_.empty()) {
+    stats_file_ = xe::filesystem::OpenFile(stats_path_, "w");
+    if (!stats_file_) {
+      XELOGE("Failed to open audio statistics file {}",
+             xe::path_to_utf8(stats_path_));
+      return false;
+    }
+    std::fputs("frame,time_us,lateness_us,queue_depth,underrun\n",
+               stats_file_);
+  }
+
+  frame_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+  stop_event_ = xe::threading::Event::CreateManualResetEvent(false);
+  if (!frame_event_ || !stop_event_) {
+    return false;
+  }
+  XXH3_64bits_reset(&hash_state_);
+  worker_thread_ = std::thread(&FileAudioDriver::WorkerThread, this);
+  return true;
+}
+
+void FileAudioDriver::OnFrameSubmitted() {
+  if (!realtime_) {
+    frame_event_->Set();
+  }
+}
+
+void FileAudioDriver::Shutdown() {
+  if (worker_thread_.joinable()) {
+    stop_requested_ = true;
+    stop_event_->Set();
+    worker_thread_.join();
+
+    std::chrono::nanoseconds elapsed = end_time_ - start_time_;
+    std::chrono::nanoseconds audio_duration = kFrameDuration * frame_count_;
+    XELOGI(
+        "File audio: {} frames ({:.3f} s) in {:.3f} s, {:.2f}x real time, {} "
+        "underruns, lateness avg {:.3f} ms max {:.3f} ms, PCM hash {:016X}",
+        frame_count_, ToMilliseconds(audio_duration) / 1000.0,
+        ToMilliseconds(elapsed) / 1000.0,
+        ToMilliseconds(audio_duration) /
+            std::max(ToMilliseconds(elapsed), 1e-6),
+        underrun_count_,
+        frame_count_ ? ToMilliseconds(lateness_sum_) / frame_count_ : 0.0,
+        ToMilliseconds(lateness_max_), XXH3_64bits_digest(&hash_state_));
+  }
+  FinishWav();
+  if (stats_file_) {
+    std::fclose(stats_file_);
+    stats_file_ = nullptr;
+  }
+}
+
+void FileAudioDriver::WorkerThread() {
+  xe::threading::set_name("File Audio");
+
+  xe::threading::WaitHandle* fast_wait_handles[] = {frame_event_.get(),
+                                                    stop_event_.get()};
+  start_time_ = Clock::now();
+  Clock::time_point deadline = start_time_;
+  while (!stop_requested_) {
+    const float* frame = nullptr;
+    if (realtime_) {
+      // Play a frame every kFrameDuration from the start, regardless of how
+      // long the previous one took, like a sound card would.
+      deadline += kFrameDuration;
+      Clock::time_point now = Clock::now();
+      if (deadline > now) {
+        // Short enough for shutdown to not need waking this up.
+        std::this_thread::sleep_until(deadline);
+        if (stop_requested_) {
+          break;
+        }
+      }
+      frame = frame_ring_->AcquireFrame();
+    } else {
+      frame = frame_ring_->AcquireFrame();
+      if (!frame) {
+        // Only an underrun in real time, here just wait for the guest.
+        xe::threading::WaitAny(fast_wait_handles,
+                               xe::countof(fast_wait_handles), false);
+        continue;
+      }
+    }
+
+    SCOPE_profile_cpu_i("apu", "FileAudioDriver::ConsumeFrame");
+    Clock::time_point consume_time = Clock::now();
+    std::chrono::nanoseconds lateness(0);
+    if (realtime_) {
+      lateness = std::max(consume_time - deadline, Clock::duration(0));
+      lateness_sum_ += lateness;
+      lateness_max_ = std::max(lateness_max_, lateness);
+    }
+    size_t queue_depth = frame_ring_->depth();
+    ConsumeFrame(frame);
+    if (frame) {
+      frame_ring_->ReleaseFrame();
+    } else {
+      ++underrun_count_;
+    }
+    if (stats_file_) {
+      std::fprintf(
+          stats_file_, "%llu,%lld,%lld,%zu,%d\n",
+          static_cast<unsigned long long>(frame_count_),
+          static_cast<long long>(
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  consume_time - start_time_)
+                  .count()),
+          static_cast<long long>(
+              std::chrono::duration_cast<std::chrono::microseconds>(lateness)
+                  .count()),
+          queue_depth, frame ? 0 : 1);
+    }
+    ++frame_count_;
+  }
+  end_time_ = Clock::now();
+}
+
+void FileAudioDriver::ConsumeFrame(const float* frame) {
+  if (frame && !cvars::mute) {
+    conversion::sequential_6_BE_to_interleaved_6_LE(
+        output_frame_, frame, AudioFrameRing::kChannelSamples);
+  } else {
+    std::memset(output_frame_, 0, sizeof(output_frame_));
+  }
+  XXH3_64bits_update(&hash_state_, output_frame_, sizeof(output_frame_));
+  if (wav_file_) {
+    std::fwrite(output_frame_, 1, sizeof(output_frame_), wav_file_);
+    wav_data_size_ += sizeof(output_frame_);
+  }
+}
+
+void FileAudioDriver::FinishWav() {
+  if (!wav_file_) {
+    return;
+  }
+  // The sizes in the header are 32-bit, cut off at whole frames past 4 GB.
+  constexpr uint64_t kMaxDataSize =
+      (UINT32_MAX - kWavHeaderSize) / sizeof(output_frame_) *
+      sizeof(output_frame_);
+  uint8_t header[kWavHeaderSize];
+  BuildWavHeader(header, uint32_t(std::min(wav_data_size_, kMaxDataSize)));
+  std::fseek(wav_file_, 0, SEEK_SET);
+  std::fwrite(header, 1, sizeof(header), wav_file_);
+  std::fclose(wav_file_);
+  wav_file_ = nullptr;
+}
+
+}  // namespace file
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_FILE_FILE_AUDIO_DRIVER_H_
+#define XENIA_APU_FILE_FILE_AUDIO_DRIVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#include "xenia/apu/audio_driver.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
+
+namespace xe {
+namespace apu {
+namespace file {
+
+// Consumes frames without sound hardware, either at the rate a sound card
+// would or as fast as they're submitted, optionally writing them to a WAV file
+// and per-frame timing to a CSV file, for measuring the audio pipeline
+// headlessly.
+class FileAudioDriver : public AudioDriver {
+ public:
+  FileAudioDriver(Memory* memory, AudioFrameRing* frame_ring,
+                  const std::filesystem::path& wav_path,
+                  const std::filesystem::path& stats_path, bool realtime);
+  ~FileAudioDriver() override;
+
+  bool Initialize();
+  void OnFrameSubmitted() override;
+  void Shutdown();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void WorkerThread();
+  // Writes one frame of interleaved little-endian samples, or silence if
+  // frame is null.
+  void ConsumeFrame(const float* frame);
+  void FinishWav();
+
+  static constexpr std::chrono::nanoseconds kFrameDuration{
+      std::chrono::nanoseconds(std::chrono::seconds(1)) *
+      AudioFrameRing::kChannelSamples / AudioFrameRing::kSampleRate};
+
+  std::filesystem::path wav_path_;
+  std::filesystem::path stats_path_;
+  bool realtime_;
+
+  FILE* wav_file_ = nullptr;
+  uint64_t wav_data_size_ = 0;
+  FILE* stats_file_ = nullptr;
+
+  std::unique_ptr<xe::threading::Event> frame_event_;
+  std::unique_ptr<xe::threading::Event> stop_event_;
+  std::atomic<bool> stop_requested_ = {false};
+  std::thread worker_thread_;
+
+  // Accessed only by the worker thread until it's joined.
+  float output_frame_[AudioFrameRing::kFrameSamples];
+  XXH3_state_t hash_state_;
+  uint64_t frame_count_ = 0;
+  uint64_t underrun_count_ = 0;
+  std::chrono::nanoseconds lateness_sum_{0};
+  std::chrono::nanoseconds lateness_max_{0};
+  Clock::time_point start_time_;
+  Clock::time_point end_time_;
+};
+
+}  // namespace file
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_FILE_FILE_AUDIO_DRIVER_H_
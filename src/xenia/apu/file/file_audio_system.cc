@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/file/file_audio_system.h"
+
+#include "xenia/apu/apu_flags.h"
+#include "xenia/apu/file/file_apu_flags.h"
+#include "xenia/apu/file/file_audio_driver.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string.h"
+
+namespace xe {
+namespace apu {
+namespace file {
+
+// Clients after the first one get their index appended to the file name.
+static std::filesystem::path GetClientPath(const std::filesystem::path& path,
+                                           size_t index) {
+  if (path.empty() || !index) {
+    return path;
+  }
+  std::filesystem::path client_path = path;
+  client_path.replace_filename(
+      fmt::format("{}_{}{}", xe::path_to_utf8(path.stem()), index,
+                  xe::path_to_utf8(path.extension())));
+  return client_path;
+}
+
+std::unique_ptr<AudioSystem> FileAudioSystem::Create(
+    cpu::Processor* processor) {
+  return std::make_unique<FileAudioSystem>(processor);
+}
+
+FileAudioSystem::FileAudioSystem(cpu::Processor* processor)
+    : AudioSystem(processor) {}
+
+FileAudioSystem::~FileAudioSystem() = default;
+
+X_STATUS FileAudioSystem::CreateDriver(size_t index,
+                                       AudioFrameRing* frame_ring,
+                                       AudioDriver** out_driver) {
+  assert_not_null(out_driver);
+  bool realtime = cvars::apu_file_clock != "fast";
+  if (realtime && cvars::apu_file_clock != "realtime") {
+    XELOGW("Unknown apu_file_clock {}, using realtime",
+           cvars::apu_file_clock);
+  }
+  auto driver = new FileAudioDriver(
+      memory_, frame_ring, GetClientPath(cvars::apu_file_path, index),
+      GetClientPath(cvars::apu_file_stats_path, index), realtime);
+  if (!driver->Initialize()) {
+    driver->Shutdown();
+    delete driver;
+    return X_STATUS_UNSUCCESSFUL;
+  }
+
+  *out_driver = driver;
+  return X_STATUS_SUCCESS;
+}
+
+void FileAudioSystem::DestroyDriver(AudioDriver* driver) {
+  assert_not_null(driver);
+  auto file_driver = dynamic_cast<FileAudioDriver*>(driver);
+  assert_not_null(file_driver);
+  file_driver->Shutdown();
+  delete file_driver;
+}
+
+}  // namespace file
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,37 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_FILE_FILE_AUDIO_SYSTEM_H_
+#define XENIA_APU_FILE_FILE_AUDIO_SYSTEM_H_
+
+#include "xenia/apu/audio_system.h"
+
+namespace xe {
+namespace apu {
+namespace file {
+
+class FileAudioSystem : public AudioSystem {
+ public:
+  explicit FileAudioSystem(cpu::Processor* processor);
+  ~FileAudioSystem() override;
+
+  static bool IsAvailable() { return true; }
+
+  static std::unique_ptr<AudioSystem> Create(cpu::Processor* processor);
+
+  X_STATUS CreateDriver(size_t index, AudioFrameRing* frame_ring,
+                        AudioDriver** out_driver) override;
+  void DestroyDriver(AudioDriver* driver) override;
+};
+
+}  // namespace file
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_FILE_FILE_AUDIO_SYSTEM_H_
@@ -0,0 +1,15 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+group("src")
+project("xenia-apu-file")
+  uuid("9c3f6a1e-4d27-4b85-a0e2-7f1b8c5d3e96")
+  kind("StaticLib")
+  language("C++")
+  links({
+    "xenia-apu",
+    "xenia-base",
+  })
+  defines({
+  })
+  local_platform_files()
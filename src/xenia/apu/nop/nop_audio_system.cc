@@ -24,8 +24,7 @@ NopAudioSystem::NopAudioSystem(cpu::Processor* processor)
 
 NopAudioSystem::~NopAudioSystem() = default;
 
-X_STATUS NopAudioSystem::CreateDriver(size_t index,
-                                      xe::threading::Semaphore* semaphore,
+X_STATUS NopAudioSystem::CreateDriver(size_t index, AudioFrameRing* frame_ring,
                                       AudioDriver** out_driver) {
   return X_STATUS_NOT_IMPLEMENTED;
 }
@@ -25,7 +25,7 @@ class NopAudioSystem : public AudioSystem {
 
   static std::unique_ptr<AudioSystem> Create(cpu::Processor* processor);
 
-  X_STATUS CreateDriver(size_t index, xe::threading::Semaphore* semaphore,
+  X_STATUS CreateDriver(size_t index, AudioFrameRing* frame_ring,
                         AudioDriver** out_driver) override;
   void DestroyDriver(AudioDriver* driver) override;
 };
@@ -17,3 +17,43 @@ project("xenia-apu")
     project_root.."/third_party/FFmpeg/",
   })
   local_platform_files()
+  removefiles({"xma_bench.cc"})
+
+  -- Kernels for newer instruction sets, selected at runtime by CPUID.
+  filter({"architecture:x86_64", "files:conversion_avx2.cc"})
+    vectorextensions("AVX2")
+  filter({"architecture:x86_64", "platforms:Windows",
+          "files:conversion_avx512.cc"})
+    buildoptions({"/arch:AVX512"})
+  filter({"architecture:x86_64", "platforms:not Windows",
+          "files:conversion_avx512.cc"})
+    -- No contraction to FMA, the kernels must match the SSE results exactly.
+    buildoptions({"-mavx512f", "-mavx512bw", "-ffp-contract=off"})
+  filter({})
+
+  include("testing")
+
+project("xenia-apu-xma-bench")
+  uuid("5b2e8d14-9c6f-4a3b-8e17-2f4c9d6a0b83")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "capstone", -- cpu-backend-x64
+    "fmt",
+    "libavcodec",
+    "libavutil",
+    "mspack",
+    "xenia-apu",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+  })
+  defines({})
+
+  files({
+    "xma_bench.cc",
+    project_root.."/src/xenia/base/console_app_main_"..platform_suffix..".cc",
+  })
+  resincludedirs({
+    project_root,
+  })
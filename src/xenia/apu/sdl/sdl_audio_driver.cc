@@ -23,14 +23,10 @@ namespace xe {
 namespace apu {
 namespace sdl {
 
-SDLAudioDriver::SDLAudioDriver(Memory* memory,
-                               xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+SDLAudioDriver::SDLAudioDriver(Memory* memory, AudioFrameRing* frame_ring)
+    : AudioDriver(memory, frame_ring) {}
 
-SDLAudioDriver::~SDLAudioDriver() {
-  assert_true(frames_queued_.empty());
-  assert_true(frames_unused_.empty());
-};
+SDLAudioDriver::~SDLAudioDriver() = default;
 
 bool SDLAudioDriver::Initialize() {
   SDL_version ver = {};
@@ -86,27 +82,6 @@ bool SDLAudioDriver::Initialize() {
   return true;
 }
 
-void SDLAudioDriver::SubmitFrame(uint32_t frame_ptr) {
-  const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
-  float* output_frame;
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    if (frames_unused_.empty()) {
-      output_frame = new float[frame_samples_];
-    } else {
-      output_frame = frames_unused_.top();
-      frames_unused_.pop();
-    }
-  }
-
-  std::memcpy(output_frame, input_frame, frame_samples_ * sizeof(float));
-
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    frames_queued_.push(output_frame);
-  }
-}
-
 void SDLAudioDriver::Shutdown() {
   if (sdl_device_id_ > 0) {
     SDL_CloseAudioDevice(sdl_device_id_);
@@ -116,15 +91,6 @@ void SDLAudioDriver::Shutdown() {
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
     sdl_initialized_ = false;
   }
-  std::unique_lock<std::mutex> guard(frames_mutex_);
-  while (!frames_unused_.empty()) {
-    delete[] frames_unused_.top();
-    frames_unused_.pop();
-  };
-  while (!frames_queued_.empty()) {
-    delete[] frames_queued_.front();
-    frames_queued_.pop();
-  };
 }
 
 void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
@@ -137,12 +103,10 @@ void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
   assert_true(len ==
               sizeof(float) * channel_samples_ * driver->sdl_device_channels_);
 
-  std::unique_lock<std::mutex> guard(driver->frames_mutex_);
-  if (driver->frames_queued_.empty()) {
+  const float* buffer = driver->frame_ring_->AcquireFrame();
+  if (!buffer) {
     std::memset(stream, 0, len);
   } else {
-    auto buffer = driver->frames_queued_.front();
-    driver->frames_queued_.pop();
     if (cvars::mute) {
       std::memset(stream, 0, len);
     } else {
@@ -160,10 +124,7 @@ void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
           break;
       }
     }
-    driver->frames_unused_.push(buffer);
-
-    auto ret = driver->semaphore_->Release(1, nullptr);
-    assert_true(ret);
+    driver->frame_ring_->ReleaseFrame();
   }
 };
 }  // namespace sdl
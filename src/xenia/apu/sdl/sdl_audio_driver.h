@@ -10,13 +10,8 @@
 #ifndef XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 #define XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 
-#include <mutex>
-#include <queue>
-#include <stack>
-
 #include "SDL.h"
 #include "xenia/apu/audio_driver.h"
-#include "xenia/base/threading.h"
 
 namespace xe {
 namespace apu {
@@ -24,30 +19,23 @@ namespace sdl {
 
 class SDLAudioDriver : public AudioDriver {
  public:
-  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore);
+  SDLAudioDriver(Memory* memory, AudioFrameRing* frame_ring);
   ~SDLAudioDriver() override;
 
   bool Initialize();
-  void SubmitFrame(uint32_t frame_ptr) override;
   void Shutdown();
 
  protected:
+  // Pulls frames straight from the ring on the SDL audio thread.
   static void SDLCallback(void* userdata, Uint8* stream, int len);
 
-  xe::threading::Semaphore* semaphore_ = nullptr;
-
   SDL_AudioDeviceID sdl_device_id_ = -1;
   bool sdl_initialized_ = false;
   uint8_t sdl_device_channels_ = 0;
 
-  static const uint32_t frame_frequency_ = 48000;
-  static const uint32_t frame_channels_ = 6;
-  static const uint32_t channel_samples_ = 256;
-  static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
-  static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
-  std::queue<float*> frames_queued_ = {};
-  std::stack<float*> frames_unused_ = {};
-  std::mutex frames_mutex_ = {};
+  static const uint32_t frame_frequency_ = AudioFrameRing::kSampleRate;
+  static const uint32_t frame_channels_ = AudioFrameRing::kFrameChannels;
+  static const uint32_t channel_samples_ = AudioFrameRing::kChannelSamples;
 };
 
 }  // namespace sdl
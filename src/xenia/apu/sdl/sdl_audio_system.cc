@@ -27,11 +27,10 @@ SDLAudioSystem::~SDLAudioSystem() {}
 
 void SDLAudioSystem::Initialize() { AudioSystem::Initialize(); }
 
-X_STATUS SDLAudioSystem::CreateDriver(size_t index,
-                                      xe::threading::Semaphore* semaphore,
+X_STATUS SDLAudioSystem::CreateDriver(size_t index, AudioFrameRing* frame_ring,
                                       AudioDriver** out_driver) {
   assert_not_null(out_driver);
-  auto driver = new SDLAudioDriver(memory_, semaphore);
+  auto driver = new SDLAudioDriver(memory_, frame_ring);
   if (!driver->Initialize()) {
     driver->Shutdown();
     return X_STATUS_UNSUCCESSFUL;
@@ -25,7 +25,7 @@ class SDLAudioSystem : public AudioSystem {
 
   static std::unique_ptr<AudioSystem> Create(cpu::Processor* processor);
 
-  X_RESULT CreateDriver(size_t index, xe::threading::Semaphore* semaphore,
+  X_RESULT CreateDriver(size_t index, AudioFrameRing* frame_ring,
                         AudioDriver** out_driver) override;
   void DestroyDriver(AudioDriver* driver) override;
 
@@ -0,0 +1,174 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/audio_frame_ring.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::apu::test {
+
+using namespace std::chrono_literals;
+
+static std::vector<float> MakeFrame(float value) {
+  return std::vector<float>(AudioFrameRing::kFrameSamples, value);
+}
+
+TEST_CASE("AudioFrameRing order, drops and underruns", "[audio_frame_ring]") {
+  AudioFrameRing ring;
+  REQUIRE(ring.AcquireFrame() == nullptr);
+
+  for (size_t i = 0; i < AudioFrameRing::kCapacity; ++i) {
+    REQUIRE(ring.WriteFrame(MakeFrame(float(i)).data()));
+  }
+  REQUIRE(ring.depth() == AudioFrameRing::kCapacity);
+  REQUIRE_FALSE(ring.WriteFrame(MakeFrame(-1.0f).data()));
+
+  // Acquired frames still occupy their slots until released.
+  const float* frame = ring.AcquireFrame();
+  REQUIRE(frame);
+  REQUIRE(frame[0] == 0.0f);
+  REQUIRE(frame[AudioFrameRing::kFrameSamples - 1] == 0.0f);
+  REQUIRE_FALSE(ring.WriteFrame(MakeFrame(-1.0f).data()));
+  ring.ReleaseFrame();
+  REQUIRE(ring.WriteFrame(MakeFrame(float(AudioFrameRing::kCapacity)).data()));
+
+  for (size_t i = 1; i <= AudioFrameRing::kCapacity; ++i) {
+    frame = ring.AcquireFrame();
+    REQUIRE(frame);
+    REQUIRE(frame[0] == float(i));
+    ring.ReleaseFrame();
+  }
+  REQUIRE(ring.AcquireFrame() == nullptr);
+  REQUIRE(ring.depth() == 0);
+
+  auto stats = ring.stats();
+  REQUIRE(stats.frames_written == AudioFrameRing::kCapacity + 1);
+  REQUIRE(stats.frames_dropped == 2);
+  REQUIRE(stats.frames_released == AudioFrameRing::kCapacity + 1);
+  REQUIRE(stats.underruns == 2);
+  REQUIRE(stats.depth_max == AudioFrameRing::kCapacity);
+  REQUIRE(stats.latency_max >= stats.latency_sum / stats.frames_released);
+
+  ring.Reset();
+  stats = ring.stats();
+  REQUIRE(stats.frames_written == 0);
+  REQUIRE(stats.underruns == 0);
+  REQUIRE(ring.depth() == 0);
+}
+
+TEST_CASE("AudioFrameRing flow control wakes", "[audio_frame_ring]") {
+  auto wake_event = threading::Event::CreateAutoResetEvent(false);
+  AudioFrameRing ring(wake_event.get());
+  constexpr size_t kTarget = 8;
+
+  for (size_t i = 0; i < kTarget; ++i) {
+    ring.RequestFrame();
+    REQUIRE(ring.WriteFrame(MakeFrame(float(i)).data()));
+  }
+  REQUIRE(ring.frames_in_flight() == kTarget);
+  REQUIRE(ring.ArmWake(kTarget - 2) == kTarget);
+
+  // Not set until enough frames have been released.
+  REQUIRE(ring.AcquireFrame());
+  ring.ReleaseFrame();
+  REQUIRE(threading::Wait(wake_event.get(), false, 0ms) ==
+          threading::WaitResult::kTimeout);
+  REQUIRE(ring.AcquireFrame());
+  ring.ReleaseFrame();
+  REQUIRE(threading::Wait(wake_event.get(), false, 0ms) ==
+          threading::WaitResult::kSuccess);
+
+  // Disarmed by the wake.
+  REQUIRE(ring.AcquireFrame());
+  ring.ReleaseFrame();
+  REQUIRE(threading::Wait(wake_event.get(), false, 0ms) ==
+          threading::WaitResult::kTimeout);
+  REQUIRE(ring.frames_in_flight() == kTarget - 3);
+
+  // Arming below the current count reports that no wait is needed.
+  REQUIRE(ring.ArmWake(kTarget - 1) == kTarget - 3);
+}
+
+TEST_CASE("AudioFrameRing flow control with unrequested frames",
+          "[audio_frame_ring]") {
+  AudioFrameRing ring;
+
+  // Frames written beyond those requested are in flight until released.
+  ring.RequestFrame();
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE(ring.WriteFrame(MakeFrame(float(i)).data()));
+  }
+  ring.EndRequests();
+  REQUIRE(ring.frames_in_flight() == 3);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE(ring.AcquireFrame());
+    ring.ReleaseFrame();
+    REQUIRE(ring.frames_in_flight() == 2 - i);
+  }
+
+  // Requests that the guest doesn't write a frame for are withdrawn.
+  ring.RequestFrame();
+  ring.RequestFrame();
+  REQUIRE(ring.frames_in_flight() == 2);
+  REQUIRE(ring.WriteFrame(MakeFrame(3.0f).data()));
+  ring.EndRequests();
+  REQUIRE(ring.frames_in_flight() == 1);
+  REQUIRE(ring.AcquireFrame());
+  ring.ReleaseFrame();
+  REQUIRE(ring.frames_in_flight() == 0);
+  ring.RequestFrame();
+  ring.EndRequests();
+  REQUIRE(ring.frames_in_flight() == 0);
+}
+
+TEST_CASE("AudioFrameRing producer and consumer threads",
+          "[audio_frame_ring]") {
+  static constexpr uint32_t kFrameCount = 20000;
+  AudioFrameRing ring;
+
+  // Catch assertions aren't thread-safe, check the results after joining.
+  uint32_t received = 0, misordered = 0;
+  std::thread consumer([&ring, &received, &misordered] {
+    while (received < kFrameCount) {
+      const float* frame = ring.AcquireFrame();
+      if (!frame) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (frame[0] != float(received) ||
+          frame[AudioFrameRing::kFrameSamples - 1] != float(received)) {
+        ++misordered;
+      }
+      ring.ReleaseFrame();
+      ++received;
+    }
+  });
+
+  std::vector<float> frame(AudioFrameRing::kFrameSamples);
+  for (uint32_t i = 0; i < kFrameCount; ++i) {
+    std::fill(frame.begin(), frame.end(), float(i));
+    while (!ring.WriteFrame(frame.data())) {
+      std::this_thread::yield();
+    }
+  }
+  consumer.join();
+  REQUIRE(received == kFrameCount);
+  REQUIRE(misordered == 0);
+
+  auto stats = ring.stats();
+  REQUIRE(stats.frames_written == kFrameCount);
+  REQUIRE(stats.frames_released == kFrameCount);
+  REQUIRE(stats.depth_max <= AudioFrameRing::kCapacity);
+}
+
+}  // namespace xe::apu::test
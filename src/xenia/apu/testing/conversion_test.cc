@@ -0,0 +1,140 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/conversion.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "xenia/base/byte_order.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::apu::conversion::test {
+
+// Channel sample counts used by the audio drivers and the XMA decoder.
+constexpr size_t kSampleCounts[] = {32, 256, 512};
+
+// Samples slightly outside [-1, 1], as FFmpeg may produce, plus exact limits.
+static std::vector<float> GenerateSamples(size_t count, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> distribution(-1.25f, 1.25f);
+  std::vector<float> samples(count);
+  for (size_t i = 0; i < count; ++i) {
+    samples[i] = distribution(random);
+  }
+  samples[0] = 1.0f;
+  samples[1] = -1.0f;
+  samples[2] = 0.5f / 32767.0f;
+  samples[3] = -0.0f;
+  return samples;
+}
+
+static std::vector<float> GenerateSamplesBE(size_t count, uint32_t seed) {
+  auto samples = GenerateSamples(count, seed);
+  for (float& sample : samples) {
+    sample = xe::byte_swap(sample);
+  }
+  return samples;
+}
+
+TEST_CASE("Conversion kernels match the baseline", "[conversion]") {
+  const auto& supported = GetSupportedKernels();
+  REQUIRE(!supported.empty());
+  const Kernels& baseline = *supported.front();
+  REQUIRE(&GetKernels() == supported.back());
+
+  for (const Kernels* kernels : supported) {
+    for (size_t count : kSampleCounts) {
+      INFO(kernels->name << ", " << count << " samples per channel");
+
+      auto input_6 = GenerateSamplesBE(count * 6, uint32_t(count));
+      std::vector<float> expected(count * 6), actual(count * 6);
+      baseline.sequential_6_BE_to_interleaved_6_LE(expected.data(),
+                                                   input_6.data(), count);
+      kernels->sequential_6_BE_to_interleaved_6_LE(actual.data(),
+                                                   input_6.data(), count);
+      REQUIRE(std::memcmp(expected.data(), actual.data(),
+                          count * 6 * sizeof(float)) == 0);
+      REQUIRE(actual[1] == xe::byte_swap(input_6[count]));
+
+      baseline.sequential_6_BE_to_interleaved_2_LE(expected.data(),
+                                                   input_6.data(), count);
+      kernels->sequential_6_BE_to_interleaved_2_LE(actual.data(),
+                                                   input_6.data(), count);
+      REQUIRE(std::memcmp(expected.data(), actual.data(),
+                          count * 2 * sizeof(float)) == 0);
+
+      auto left = GenerateSamples(count, uint32_t(count) + 1);
+      auto right = GenerateSamples(count, uint32_t(count) + 2);
+      const float* channels[2] = {left.data(), right.data()};
+      std::vector<int16_t> expected_pcm(count * 2), actual_pcm(count * 2);
+      for (bool is_two_channel : {false, true}) {
+        size_t pcm_count = count * (is_two_channel ? 2 : 1);
+        baseline.planar_to_interleaved_int16_BE(
+            expected_pcm.data(), channels, is_two_channel, count);
+        kernels->planar_to_interleaved_int16_BE(actual_pcm.data(), channels,
+                                                is_two_channel, count);
+        REQUIRE(std::memcmp(expected_pcm.data(), actual_pcm.data(),
+                            pcm_count * sizeof(int16_t)) == 0);
+        // Saturated full scale, in big endian.
+        REQUIRE(xe::byte_swap(actual_pcm[0]) == 32767);
+        REQUIRE(xe::byte_swap(actual_pcm[is_two_channel ? 2 : 1]) == -32767);
+      }
+    }
+  }
+}
+
+TEST_CASE("Conversion kernel throughput", "[conversion][.benchmark]") {
+  constexpr size_t kCount = 512;
+  constexpr int kIterations = 200000;
+  auto input_6 = GenerateSamplesBE(kCount * 6, 1);
+  auto left = GenerateSamples(kCount, 2);
+  auto right = GenerateSamples(kCount, 3);
+  const float* channels[2] = {left.data(), right.data()};
+  std::vector<float> output(kCount * 6);
+  std::vector<int16_t> output_pcm(kCount * 2);
+
+  auto measure = [](const char* kernels_name, const char* kernel_name,
+                    auto&& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      function();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    WARN(kernels_name << " " << kernel_name << ": "
+                      << uint64_t(double(kCount) * kIterations / seconds)
+                      << " samples/s per channel");
+  };
+
+  for (const Kernels* kernels : GetSupportedKernels()) {
+    measure(kernels->name, "6 to 6", [&]() {
+      kernels->sequential_6_BE_to_interleaved_6_LE(output.data(),
+                                                   input_6.data(), kCount);
+    });
+    measure(kernels->name, "6 to 2", [&]() {
+      kernels->sequential_6_BE_to_interleaved_2_LE(output.data(),
+                                                   input_6.data(), kCount);
+    });
+    measure(kernels->name, "int16 mono", [&]() {
+      kernels->planar_to_interleaved_int16_BE(output_pcm.data(), channels,
+                                              false, kCount);
+    });
+    measure(kernels->name, "int16 stereo", [&]() {
+      kernels->planar_to_interleaved_int16_BE(output_pcm.data(), channels,
+                                              true, kCount);
+    });
+  }
+}
+
+}  // namespace xe::apu::conversion::test
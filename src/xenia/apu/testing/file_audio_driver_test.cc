@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/file/file_audio_driver.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::apu::file::test {
+
+TEST_CASE("File audio driver writes submitted frames", "[file_audio]") {
+  constexpr uint32_t kFrameCount = 10;
+  auto wav_path = std::filesystem::temp_directory_path() /
+                  "xenia_file_audio_driver_test.wav";
+  auto stats_path = std::filesystem::temp_directory_path() /
+                    "xenia_file_audio_driver_test.csv";
+
+  AudioFrameRing ring;
+  FileAudioDriver driver(nullptr, &ring, wav_path, stats_path, false);
+  REQUIRE(driver.Initialize());
+
+  // Frame i has sample s of channel c set to i + c / 8 + s / 65536, big
+  // endian as submitted by the guest.
+  std::vector<float> frame(AudioFrameRing::kFrameSamples);
+  for (uint32_t i = 0; i < kFrameCount; ++i) {
+    for (size_t c = 0; c < AudioFrameRing::kFrameChannels; ++c) {
+      for (size_t s = 0; s < AudioFrameRing::kChannelSamples; ++s) {
+        frame[c * AudioFrameRing::kChannelSamples + s] =
+            xe::byte_swap(float(i) + float(c) / 8 + float(s) / 65536);
+      }
+    }
+    ring.RequestFrame();
+    REQUIRE(ring.WriteFrame(frame.data()));
+    driver.OnFrameSubmitted();
+  }
+  while (ring.stats().frames_released < kFrameCount) {
+    std::this_thread::yield();
+  }
+  driver.Shutdown();
+
+  FILE* file = xe::filesystem::OpenFile(wav_path, "rb");
+  REQUIRE(file);
+  std::vector<uint8_t> wav(68 + kFrameCount * sizeof(float) *
+                                    AudioFrameRing::kFrameSamples);
+  size_t wav_size = std::fread(wav.data(), 1, wav.size() + 1, file);
+  std::fclose(file);
+  std::filesystem::remove(wav_path);
+  REQUIRE(wav_size == wav.size());
+  REQUIRE(std::memcmp(wav.data(), "RIFF", 4) == 0);
+  REQUIRE(std::memcmp(wav.data() + 8, "WAVEfmt ", 8) == 0);
+  REQUIRE(std::memcmp(wav.data() + 60, "data", 4) == 0);
+  uint32_t data_size;
+  std::memcpy(&data_size, wav.data() + 64, sizeof(data_size));
+  REQUIRE(data_size == wav.size() - 68);
+
+  // Interleaved little-endian.
+  const auto* samples = reinterpret_cast<const float*>(wav.data() + 68);
+  for (uint32_t i = 0; i < kFrameCount; ++i) {
+    for (size_t s = 0; s < AudioFrameRing::kChannelSamples; s += 51) {
+      for (size_t c = 0; c < AudioFrameRing::kFrameChannels; ++c) {
+        REQUIRE(samples[(i * AudioFrameRing::kChannelSamples + s) *
+                            AudioFrameRing::kFrameChannels +
+                        c] == float(i) + float(c) / 8 + float(s) / 65536);
+      }
+    }
+  }
+
+  // Header and one line per frame.
+  file = xe::filesystem::OpenFile(stats_path, "r");
+  REQUIRE(file);
+  uint32_t line_count = 0;
+  for (int ch; (ch = std::fgetc(file)) != EOF;) {
+    line_count += ch == '\n';
+  }
+  std::fclose(file);
+  std::filesystem::remove(stats_path);
+  REQUIRE(line_count == kFrameCount + 1);
+}
+
+}  // namespace xe::apu::file::test
@@ -0,0 +1,237 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_frame_parser.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::apu::xma::test {
+
+// A frame as a list of bits: the 15-bit length, payload and trailing bit.
+using FrameBits = std::vector<bool>;
+
+// Packets of a single stream holding the given frames back to back, along
+// with the frames' bits.
+struct Stream {
+  std::vector<uint8_t> packets;
+  std::vector<FrameBits> frames;
+
+  size_t packet_count() const { return packets.size() / kBytesPerPacket; }
+  const uint8_t* packet(size_t index) const {
+    return packets.data() + index * kBytesPerPacket;
+  }
+};
+
+static void WriteBits(uint8_t* data, size_t bit_offset, uint32_t value,
+                      uint32_t bit_count) {
+  for (uint32_t i = 0; i < bit_count; ++i) {
+    size_t bit = bit_offset + i;
+    uint8_t mask = uint8_t(0x80 >> (bit & 7));
+    if ((value >> (bit_count - 1 - i)) & 1) {
+      data[bit >> 3] |= mask;
+    } else {
+      data[bit >> 3] &= ~mask;
+    }
+  }
+}
+
+static Stream BuildStream(const std::vector<uint32_t>& lengths,
+                          uint32_t seed) {
+  constexpr uint32_t kPayloadBits = kBitsPerPacket - kBitsPerPacketHeader;
+  std::mt19937 random(seed);
+  Stream stream;
+
+  // Lay the frames out in the payload of consecutive packets.
+  std::vector<size_t> starts;
+  size_t payload_bits = 0;
+  for (uint32_t length : lengths) {
+    starts.push_back(payload_bits);
+    payload_bits += length;
+  }
+  size_t packet_count = (payload_bits + kPayloadBits - 1) / kPayloadBits;
+  stream.packets.resize(packet_count * kBytesPerPacket);
+  auto stream_to_packet_bit = [](size_t stream_bit) {
+    return stream_bit / kPayloadBits * kBitsPerPacket + kBitsPerPacketHeader +
+           stream_bit % kPayloadBits;
+  };
+
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    FrameBits bits(lengths[i]);
+    for (uint32_t j = 0; j < 15; ++j) {
+      bits[j] = (lengths[i] >> (14 - j)) & 1;
+    }
+    for (uint32_t j = 15; j + 1 < lengths[i]; ++j) {
+      bits[j] = random() & 1;
+    }
+    // Set if the next frame begins in the same packet.
+    bits.back() = i + 1 < lengths.size() &&
+                  starts[i + 1] / kPayloadBits == starts[i] / kPayloadBits;
+    for (uint32_t j = 0; j < lengths[i]; ++j) {
+      size_t bit = stream_to_packet_bit(starts[i] + j);
+      WriteBits(stream.packets.data(), bit, bits[j], 1);
+    }
+    stream.frames.push_back(std::move(bits));
+  }
+
+  for (size_t i = 0; i < packet_count; ++i) {
+    uint8_t* packet = stream.packets.data() + i * kBytesPerPacket;
+    uint32_t frame_count = 0;
+    uint32_t first_frame = 0x7FFF;
+    for (size_t start : starts) {
+      if (start / kPayloadBits == i) {
+        if (!frame_count++) {
+          first_frame = uint32_t(start % kPayloadBits);
+        }
+      }
+    }
+    WriteBits(packet, 0, frame_count, 6);
+    WriteBits(packet, 6, first_frame, 15);
+    WriteBits(packet, 21, 1, 3);
+    WriteBits(packet, 24, 0, 8);
+  }
+  return stream;
+}
+
+// What the FFmpeg XMA frame decoder takes for a frame starting at the given
+// bit alignment, built bit by bit.
+static std::vector<uint8_t> ExpectedFrameData(const FrameBits& bits,
+                                              uint32_t padding_start) {
+  size_t bit_count = 8 + padding_start + bits.size();
+  std::vector<uint8_t> data((bit_count + 7) / 8);
+  for (size_t i = 0; i < bits.size(); ++i) {
+    WriteBits(data.data(), 8 + padding_start + i, bits[i], 1);
+  }
+  uint32_t padding_end = uint32_t(data.size() * 8 - bit_count);
+  data[0] = uint8_t((padding_start << 5) | (padding_end << 2));
+  return data;
+}
+
+// Extracts all frames of the stream, checking each against its bits.
+static void CheckStream(const Stream& stream) {
+  constexpr uint32_t kPayloadBits = kBitsPerPacket - kBitsPerPacketHeader;
+  PacketFrames packet_frames;
+  FrameAssembler assembler;
+  size_t frame_index = 0;
+  uint32_t frame_alignment = 0;
+  auto check_frame = [&]() {
+    assembler.Finish();
+    REQUIRE(frame_index < stream.frames.size());
+    auto expected =
+        ExpectedFrameData(stream.frames[frame_index], frame_alignment);
+    REQUIRE(assembler.size() == expected.size());
+    REQUIRE(std::equal(expected.cbegin(), expected.cend(), assembler.data()));
+    // The decoder may read past the end.
+    for (size_t i = 0; i < FrameAssembler::kInputPaddingSize; ++i) {
+      REQUIRE(assembler.data()[assembler.size() + i] == 0);
+    }
+    assembler.Reset();
+    ++frame_index;
+  };
+
+  size_t stream_bit = 0;
+  for (size_t i = 0; i < stream.packet_count(); ++i) {
+    const uint8_t* packet = stream.packet(i);
+    if (assembler.pending()) {
+      uint32_t bits = assembler.Continue(packet);
+      stream_bit += bits;
+      if (assembler.pending()) {
+        REQUIRE(bits == kPayloadBits);
+        continue;
+      }
+      check_frame();
+    }
+    ParsePacketFrames(packet, &packet_frames);
+    for (uint32_t j = 0; j < packet_frames.count; ++j) {
+      uint32_t offset = packet_frames.offsets[j];
+      if (offset >= kBitsPerPacket) {
+        break;
+      }
+      REQUIRE(offset == kBitsPerPacketHeader + stream_bit % kPayloadBits);
+      REQUIRE(packet_frames.Find(offset) == int(j));
+      REQUIRE(packet_frames.NextOffset(j) ==
+              (j + 1 < packet_frames.count &&
+                       packet_frames.offsets[j + 1] < kBitsPerPacket
+                   ? packet_frames.offsets[j + 1]
+                   : 0));
+      frame_alignment = offset & 7;
+      assembler.Begin(packet, offset);
+      REQUIRE(assembler.pending() ==
+              (packet_frames.last_split && j + 1 == packet_frames.count));
+      if (assembler.pending()) {
+        stream_bit += kBitsPerPacket - offset;
+        break;
+      }
+      stream_bit += stream.frames[frame_index].size();
+      check_frame();
+    }
+  }
+  REQUIRE(frame_index == stream.frames.size());
+  REQUIRE_FALSE(assembler.pending());
+}
+
+TEST_CASE("XMA frames within packets", "[xma_frame_parser]") {
+  auto stream = BuildStream({100, 16, 2000, 4001, 33, 1234}, 1);
+  REQUIRE(stream.packet_count() == 1);
+  PacketFrames packet_frames;
+  ParsePacketFrames(stream.packet(0), &packet_frames);
+  REQUIRE(packet_frames.count == 6);
+  REQUIRE_FALSE(packet_frames.last_split);
+  REQUIRE(packet_frames.offsets[1] == kBitsPerPacketHeader + 100);
+  REQUIRE(packet_frames.Find(kBitsPerPacketHeader + 100) == 1);
+  REQUIRE(packet_frames.Find(kBitsPerPacketHeader + 101) == -1);
+  REQUIRE(packet_frames.NextOffset(-1) == 0);
+  REQUIRE(packet_frames.NextOffset(5) == 0);
+  CheckStream(stream);
+}
+
+TEST_CASE("XMA frames split across packets", "[xma_frame_parser]") {
+  constexpr uint32_t kPayloadBits = kBitsPerPacket - kBitsPerPacketHeader;
+
+  SECTION("Split payload") {
+    CheckStream(BuildStream({kPayloadBits - 1000, 3001, 500}, 2));
+  }
+  SECTION("Split length") {
+    // Only 6 bits of the second frame's length are in the first packet.
+    auto stream = BuildStream({kPayloadBits - 6, 777, 64}, 3);
+    PacketFrames packet_frames;
+    ParsePacketFrames(stream.packet(0), &packet_frames);
+    REQUIRE(packet_frames.count == 2);
+    REQUIRE(packet_frames.last_split);
+    CheckStream(stream);
+  }
+  SECTION("Frame ending at the packet end") {
+    CheckStream(BuildStream({kPayloadBits - 200, 200, 300}, 4));
+  }
+  SECTION("Frame spanning three packets") {
+    auto stream = BuildStream({kPayloadBits - 40, 20000, 99}, 5);
+    REQUIRE(stream.packet_count() == 3);
+    PacketFrames packet_frames;
+    ParsePacketFrames(stream.packet(1), &packet_frames);
+    REQUIRE(packet_frames.count == 0);
+    CheckStream(stream);
+  }
+}
+
+TEST_CASE("XMA frames of random lengths", "[xma_frame_parser]") {
+  std::mt19937 random(6);
+  std::uniform_int_distribution<uint32_t> length_distribution(16, 6000);
+  for (uint32_t seed = 0; seed < 16; ++seed) {
+    std::vector<uint32_t> lengths(64);
+    for (uint32_t& length : lengths) {
+      length = length_distribution(random);
+    }
+    CheckStream(BuildStream(lengths, seed));
+  }
+}
+
+}  // namespace xe::apu::xma::test
@@ -24,33 +24,30 @@ namespace xaudio2 {
 
 class XAudio2AudioDriver::VoiceCallback : public api::IXAudio2VoiceCallback {
  public:
-  explicit VoiceCallback(xe::threading::Semaphore* semaphore)
-      : semaphore_(semaphore) {}
+  explicit VoiceCallback(AudioFrameRing* frame_ring)
+      : frame_ring_(frame_ring) {}
   ~VoiceCallback() {}
 
   void OnStreamEnd() {}
   void OnVoiceProcessingPassEnd() {}
   void OnVoiceProcessingPassStart(uint32_t samples_required) {}
-  void OnBufferEnd(void* context) {
-    auto ret = semaphore_->Release(1, nullptr);
-    assert_true(ret);
-  }
+  void OnBufferEnd(void* context) { frame_ring_->ReleaseFrame(); }
   void OnBufferStart(void* context) {}
   void OnLoopEnd(void* context) {}
   void OnVoiceError(void* context, HRESULT result) {}
 
  private:
-  xe::threading::Semaphore* semaphore_ = nullptr;
+  AudioFrameRing* frame_ring_ = nullptr;
 };
 
 XAudio2AudioDriver::XAudio2AudioDriver(Memory* memory,
-                                       xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+                                       AudioFrameRing* frame_ring)
+    : AudioDriver(memory, frame_ring) {}
 
 XAudio2AudioDriver::~XAudio2AudioDriver() = default;
 
 bool XAudio2AudioDriver::Initialize() {
-  voice_callback_ = new VoiceCallback(semaphore_);
+  voice_callback_ = new VoiceCallback(frame_ring_);
 
   // Load the XAudio2 DLL dynamically. Needed both for 2.7 and for
   // differentiating between 2.8 and later versions. Windows 8.1 SDK references
@@ -189,10 +186,15 @@ bool XAudio2AudioDriver::InitializeObjects(Objects& objects) {
   return true;
 }
 
-void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
+void XAudio2AudioDriver::OnFrameSubmitted() {
   // Process samples! They are big-endian floats.
   HRESULT hr;
 
+  auto input_frame = frame_ring_->AcquireFrame();
+  if (!input_frame) {
+    return;
+  }
+
   api::XAUDIO2_VOICE_STATE state;
   if (api_minor_version_ >= 8) {
     objects_.api_2_8.pcm_voice->GetState(&state,
@@ -202,7 +204,6 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
   }
   assert_true(state.BuffersQueued < frame_count_);
 
-  auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
   auto output_frame = reinterpret_cast<float*>(frames_[current_frame_]);
   auto interleave_channels = frame_channels_;
 
@@ -227,6 +228,8 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
   }
   if (FAILED(hr)) {
     XELOGE("SubmitSourceBuffer failed with 0x{:08X}", hr);
+    // Won't get an OnBufferEnd for it.
+    frame_ring_->ReleaseFrame();
     return;
   }
 
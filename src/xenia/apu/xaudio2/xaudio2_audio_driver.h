@@ -29,7 +29,7 @@ namespace xaudio2 {
 
 class XAudio2AudioDriver : public AudioDriver {
  public:
-  XAudio2AudioDriver(Memory* memory, xe::threading::Semaphore* semaphore);
+  XAudio2AudioDriver(Memory* memory, AudioFrameRing* frame_ring);
   ~XAudio2AudioDriver() override;
 
   bool Initialize();
@@ -39,7 +39,9 @@ class XAudio2AudioDriver : public AudioDriver {
   // not explicitly requesting STA (until COM is uninitialized all threads that
   // have initialized MTA).
   // https://devblogs.microsoft.com/oldnewthing/?p=4613
-  void SubmitFrame(uint32_t frame_ptr) override;
+  // Moves the frame to an XAudio2 buffer, it's released from the ring once
+  // XAudio2 is done playing it.
+  void OnFrameSubmitted() override;
   void Shutdown();
 
  private:
@@ -89,14 +91,13 @@ class XAudio2AudioDriver : public AudioDriver {
       api::IXAudio2_8SourceVoice* pcm_voice;
     } api_2_8;
   } objects_ = {};
-  xe::threading::Semaphore* semaphore_ = nullptr;
 
   class VoiceCallback;
   VoiceCallback* voice_callback_ = nullptr;
 
   static const uint32_t frame_count_ = api::XE_XAUDIO2_MAX_QUEUED_BUFFERS;
-  static const uint32_t frame_channels_ = 6;
-  static const uint32_t channel_samples_ = 256;
+  static const uint32_t frame_channels_ = AudioFrameRing::kFrameChannels;
+  static const uint32_t channel_samples_ = AudioFrameRing::kChannelSamples;
   static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
   float frames_[frame_count_][frame_samples_];
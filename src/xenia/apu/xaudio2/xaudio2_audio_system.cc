@@ -29,10 +29,10 @@ XAudio2AudioSystem::~XAudio2AudioSystem() {}
 void XAudio2AudioSystem::Initialize() { AudioSystem::Initialize(); }
 
 X_STATUS XAudio2AudioSystem::CreateDriver(size_t index,
-                                          xe::threading::Semaphore* semaphore,
+                                          AudioFrameRing* frame_ring,
                                           AudioDriver** out_driver) {
   assert_not_null(out_driver);
-  auto driver = new XAudio2AudioDriver(memory_, semaphore);
+  auto driver = new XAudio2AudioDriver(memory_, frame_ring);
   if (!driver->Initialize()) {
     driver->Shutdown();
     return X_STATUS_UNSUCCESSFUL;
@@ -0,0 +1,198 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xenia/apu/xma_capture.h"
+#include "xenia/apu/xma_context.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace apu {
+
+DEFINE_transient_path(capture, "",
+                      "XMA capture to replay, recorded with "
+                      "--xma_capture_path.",
+                      "General");
+DEFINE_int32(bench_iterations, 1, "Number of times to replay the capture.",
+             "General");
+
+using Clock = std::chrono::steady_clock;
+
+// Output buffers hold at most 31 blocks of 256 bytes.
+constexpr uint32_t kOutputBufferSize = 32 * 256;
+
+// A captured context, with its buffers relocated into the replay memory.
+struct ReplayContext {
+  XmaContext context;
+  uint32_t input_buffer_addresses[2] = {};
+  uint32_t input_buffer_capacities[2] = {};
+  uint32_t output_buffer_address = 0;
+};
+
+struct ReplayResult {
+  uint64_t decode_count = 0;
+  Clock::duration decode_time = Clock::duration::zero();
+  XmaDecodeStats stats;
+  uint64_t pcm_hash = 0;
+};
+
+static double ToSeconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+static bool Replay(Memory* memory, ReplayResult* result) {
+  auto reader = XmaCaptureReader::Open(cvars::capture);
+  if (!reader) {
+    return false;
+  }
+
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+
+  std::map<uint32_t, std::unique_ptr<ReplayContext>> contexts;
+  XmaCaptureRecord record;
+  std::vector<uint8_t> input_buffers[2];
+  while (reader->Read(&record, input_buffers)) {
+    auto& replay = contexts[record.context_id];
+    if (!replay) {
+      replay = std::make_unique<ReplayContext>();
+      uint32_t guest_ptr = memory->SystemHeapAlloc(
+          sizeof(XMA_CONTEXT_DATA), 256, kSystemHeapPhysical);
+      if (replay->context.Setup(record.context_id, memory, guest_ptr)) {
+        return false;
+      }
+      replay->context.set_is_allocated(true);
+      replay->context.set_stats(&result->stats);
+      replay->output_buffer_address =
+          memory->SystemHeapAlloc(kOutputBufferSize, 256, kSystemHeapPhysical);
+    }
+
+    for (uint32_t i = 0; i < 2; ++i) {
+      if (!(record.flags & (XmaCaptureRecord::kInputBuffer0Data << i))) {
+        continue;
+      }
+      if (input_buffers[i].size() > replay->input_buffer_capacities[i]) {
+        memory->SystemHeapFree(replay->input_buffer_addresses[i]);
+        replay->input_buffer_capacities[i] =
+            uint32_t(input_buffers[i].size());
+        replay->input_buffer_addresses[i] = memory->SystemHeapAlloc(
+            replay->input_buffer_capacities[i], 256, kSystemHeapPhysical);
+      }
+      std::memcpy(memory->TranslateVirtual(replay->input_buffer_addresses[i]),
+                  input_buffers[i].data(), input_buffers[i].size());
+    }
+
+    // Restore the context as the game left it, pointing at our buffers.
+    uint8_t* context_ptr =
+        memory->TranslateVirtual(replay->context.guest_ptr());
+    std::memcpy(context_ptr, record.context_data, sizeof(XMA_CONTEXT_DATA));
+    XMA_CONTEXT_DATA data(context_ptr);
+    data.input_buffer_0_ptr =
+        memory->GetPhysicalAddress(replay->input_buffer_addresses[0]);
+    data.input_buffer_1_ptr =
+        memory->GetPhysicalAddress(replay->input_buffer_addresses[1]);
+    data.output_buffer_ptr =
+        memory->GetPhysicalAddress(replay->output_buffer_address);
+    data.Store(context_ptr);
+
+    uint64_t frame_count_before = result->stats.frame_count;
+    auto start = Clock::now();
+    replay->context.Enable();
+    replay->context.Work();
+    result->decode_time += Clock::now() - start;
+    ++result->decode_count;
+
+    // Hash the PCM written to the output ring buffer.
+    uint32_t output_capacity = data.output_buffer_block_count * 256;
+    uint32_t output_offset = data.output_buffer_write_offset * 256;
+    uint32_t output_size =
+        uint32_t(result->stats.frame_count - frame_count_before) *
+        (XmaContext::kBytesPerFrameChannel << data.is_stereo);
+    const uint8_t* output =
+        memory->TranslateVirtual(replay->output_buffer_address);
+    while (output_size && output_capacity) {
+      uint32_t chunk_size =
+          std::min(output_size, output_capacity - output_offset);
+      XXH3_64bits_update(&hash_state, output + output_offset, chunk_size);
+      output_size -= chunk_size;
+      output_offset = (output_offset + chunk_size) % output_capacity;
+    }
+  }
+
+  for (auto& it : contexts) {
+    memory->SystemHeapFree(it.second->input_buffer_addresses[0]);
+    memory->SystemHeapFree(it.second->input_buffer_addresses[1]);
+    memory->SystemHeapFree(it.second->output_buffer_address);
+    memory->SystemHeapFree(it.second->context.guest_ptr());
+  }
+  result->pcm_hash = XXH3_64bits_digest(&hash_state);
+  return true;
+}
+
+int xma_bench_main(const std::vector<std::string>& args) {
+  if (cvars::capture.empty()) {
+    XELOGE("Usage: {} [capture]", xe::path_to_utf8(args[0]));
+    return 1;
+  }
+
+  auto memory = std::make_unique<Memory>();
+  if (!memory->Initialize()) {
+    XELOGE("Failed to initialize guest memory");
+    return 1;
+  }
+
+  int iteration_count = std::max(cvars::bench_iterations, 1);
+  uint64_t first_pcm_hash = 0;
+  for (int i = 0; i < iteration_count; ++i) {
+    ReplayResult result;
+    if (!Replay(memory.get(), &result)) {
+      XELOGE("Failed to replay {}", xe::path_to_utf8(cvars::capture));
+      return 1;
+    }
+
+    double decode_s = ToSeconds(result.decode_time);
+    double frame_count = double(std::max(result.stats.frame_count, uint64_t(1)));
+    XELOGI(
+        "Replay {}: {} decodes, {} frames in {:.3f}s, {:.0f} frames/s; per "
+        "frame: parse {:.2f}us, FFmpeg decode {:.2f}us, ConvertFrame "
+        "{:.2f}us; PCM hash {:016X}",
+        i, result.decode_count, result.stats.frame_count, decode_s,
+        result.stats.frame_count / std::max(decode_s, 1e-9),
+        ToSeconds(result.stats.parse_time) * 1e6 / frame_count,
+        ToSeconds(result.stats.decode_time) * 1e6 / frame_count,
+        ToSeconds(result.stats.convert_time) * 1e6 / frame_count,
+        result.pcm_hash);
+
+    if (!i) {
+      first_pcm_hash = result.pcm_hash;
+    } else if (result.pcm_hash != first_pcm_hash) {
+      XELOGE("Replay {} produced different PCM than replay 0", i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace apu
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-apu-xma-bench", xe::apu::xma_bench_main,
+                      "[capture]", "capture");
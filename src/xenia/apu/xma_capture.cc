@@ -0,0 +1,120 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_capture.h"
+
+#include <cstring>
+
+#include "xenia/apu/xma_context.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+
+namespace xe {
+namespace apu {
+
+std::unique_ptr<XmaCaptureWriter> XmaCaptureWriter::Create(
+    const std::filesystem::path& path) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("XMA: Failed to create capture file {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  XmaCaptureHeader header = {kXmaCaptureSignature, kXmaCaptureVersion};
+  fwrite(&header, sizeof(header), 1, file);
+  XELOGI("XMA: Capturing decodes to {}", xe::path_to_utf8(path));
+  return std::unique_ptr<XmaCaptureWriter>(new XmaCaptureWriter(file));
+}
+
+XmaCaptureWriter::~XmaCaptureWriter() { fclose(file_); }
+
+void XmaCaptureWriter::WriteKick(uint32_t context_id,
+                                 const uint8_t* context_ptr, Memory* memory) {
+  XMA_CONTEXT_DATA data(context_ptr);
+  const uint8_t* input_buffers[2] = {};
+  XmaCaptureRecord record = {};
+  record.context_id = context_id;
+  std::memcpy(record.context_data, context_ptr, sizeof(record.context_data));
+  if (data.input_buffer_0_valid) {
+    input_buffers[0] = memory->TranslatePhysical(data.input_buffer_0_ptr);
+    record.input_buffer_sizes[0] =
+        data.input_buffer_0_packet_count * XmaContext::kBytesPerPacket;
+  }
+  if (data.input_buffer_1_valid) {
+    input_buffers[1] = memory->TranslatePhysical(data.input_buffer_1_ptr);
+    record.input_buffer_sizes[1] =
+        data.input_buffer_1_packet_count * XmaContext::kBytesPerPacket;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (context_id >= input_buffer_hashes_.size()) {
+    input_buffer_hashes_.resize(context_id + 1);
+  }
+  // Games usually kick a context many times over the same buffers, so only
+  // write the packets when they have changed.
+  auto& hashes = input_buffer_hashes_[context_id];
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (!record.input_buffer_sizes[i]) {
+      continue;
+    }
+    uint64_t hash = XXH3_64bits(input_buffers[i], record.input_buffer_sizes[i]);
+    if (hash != hashes[i]) {
+      hashes[i] = hash;
+      record.flags |= XmaCaptureRecord::kInputBuffer0Data << i;
+    }
+  }
+  fwrite(&record, sizeof(record), 1, file_);
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (record.flags & (XmaCaptureRecord::kInputBuffer0Data << i)) {
+      fwrite(input_buffers[i], 1, record.input_buffer_sizes[i], file_);
+    }
+  }
+}
+
+std::unique_ptr<XmaCaptureReader> XmaCaptureReader::Open(
+    const std::filesystem::path& path) {
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("XMA: Failed to open capture file {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  XmaCaptureHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.signature != kXmaCaptureSignature ||
+      header.version != kXmaCaptureVersion) {
+    XELOGE("XMA: {} is not a supported capture file",
+           xe::path_to_utf8(path));
+    fclose(file);
+    return nullptr;
+  }
+  return std::unique_ptr<XmaCaptureReader>(new XmaCaptureReader(file));
+}
+
+XmaCaptureReader::~XmaCaptureReader() { fclose(file_); }
+
+bool XmaCaptureReader::Read(XmaCaptureRecord* record,
+                            std::vector<uint8_t> input_buffers[2]) {
+  if (fread(record, sizeof(*record), 1, file_) != 1) {
+    return false;
+  }
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (!(record->flags & (XmaCaptureRecord::kInputBuffer0Data << i))) {
+      continue;
+    }
+    input_buffers[i].resize(record->input_buffer_sizes[i]);
+    if (fread(input_buffers[i].data(), 1, input_buffers[i].size(), file_) !=
+        input_buffers[i].size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_XMA_CAPTURE_H_
+#define XENIA_APU_XMA_CAPTURE_H_
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/memory.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace apu {
+
+// Recording of XMA context kicks, replayed by xenia-apu-xma-bench to measure
+// the decoder outside of a game.
+//
+// File layout (host byte order):
+//   XmaCaptureHeader
+//   For every decode:
+//     XmaCaptureRecord
+//     Input buffer 0 packets, if kInputBuffer0Data is set
+//     Input buffer 1 packets, if kInputBuffer1Data is set
+constexpr fourcc_t kXmaCaptureSignature = make_fourcc("XMAC");
+constexpr uint32_t kXmaCaptureVersion = 1;
+
+struct XmaCaptureHeader {
+  fourcc_t signature;
+  uint32_t version;
+};
+
+struct XmaCaptureRecord {
+  enum Flags : uint32_t {
+    // The packets follow the record. Otherwise the buffer is the same as in
+    // the previous record of the context.
+    kInputBuffer0Data = 1 << 0,
+    kInputBuffer1Data = 1 << 1,
+  };
+
+  uint32_t context_id;
+  uint32_t flags;
+  // Sizes in bytes, 0 if the buffer is not valid.
+  uint32_t input_buffer_sizes[2];
+  // XMA_CONTEXT_DATA as found in guest memory (big-endian).
+  uint8_t context_data[64];
+};
+static_assert_size(XmaCaptureRecord, 80);
+
+class XmaCaptureWriter {
+ public:
+  static std::unique_ptr<XmaCaptureWriter> Create(
+      const std::filesystem::path& path);
+  ~XmaCaptureWriter();
+
+  // Records the state of the context about to be decoded. Thread safe.
+  void WriteKick(uint32_t context_id, const uint8_t* context_ptr,
+                 Memory* memory);
+
+ private:
+  explicit XmaCaptureWriter(FILE* file) : file_(file) {}
+
+  std::mutex mutex_;
+  FILE* file_;
+  // Hashes of the input buffers last written for each context.
+  std::vector<std::array<uint64_t, 2>> input_buffer_hashes_;
+};
+
+class XmaCaptureReader {
+ public:
+  static std::unique_ptr<XmaCaptureReader> Open(
+      const std::filesystem::path& path);
+  ~XmaCaptureReader();
+
+  // Reads the next record, and the input buffer packets that follow it into
+  // input_buffers (left untouched for buffers without data). Returns false at
+  // the end of the file or if the record is truncated.
+  bool Read(XmaCaptureRecord* record, std::vector<uint8_t> input_buffers[2]);
+
+ private:
+  explicit XmaCaptureReader(FILE* file) : file_(file) {}
+
+  FILE* file_;
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_XMA_CAPTURE_H_
@@ -12,9 +12,10 @@
 #include <algorithm>
 #include <cstring>
 
+#include "xenia/apu/conversion.h"
+#include "xenia/apu/xma_capture.h"
 #include "xenia/apu/xma_decoder.h"
-#include "xenia/apu/xma_helpers.h"
-#include "xenia/base/bit_stream.h"
+#include "xenia/apu/xma_frame_parser.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
@@ -100,7 +101,20 @@ bool XmaContext::Work() {
 
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   XMA_CONTEXT_DATA data(context_ptr);
-  Decode(&data);
+  if (capture_) {
+    capture_->WriteKick(id(), context_ptr, memory());
+  }
+  if (stats_) {
+    // Everything besides the FFmpeg calls and conversion counts as parsing.
+    auto start = std::chrono::steady_clock::now();
+    auto other_time = stats_->decode_time + stats_->convert_time;
+    Decode(&data);
+    stats_->parse_time += std::chrono::steady_clock::now() - start -
+                          (stats_->decode_time + stats_->convert_time -
+                           other_time);
+  } else {
+    Decode(&data);
+  }
   data.Store(context_ptr);
   return true;
 }
@@ -225,56 +239,6 @@ int XmaContext::GetSampleRate(int id) {
   return 0;
 }
 
-bool XmaContext::ValidFrameOffset(uint8_t* block, size_t size_bytes,
-                                  size_t frame_offset_bits) {
-  uint32_t packet_num =
-      GetFramePacketNumber(block, size_bytes, frame_offset_bits);
-  if (packet_num == -1) {
-    // Invalid packet number
-    return false;
-  }
-
-  uint8_t* packet = block + (packet_num * kBytesPerPacket);
-  size_t relative_offset_bits = frame_offset_bits % kBitsPerPacket;
-
-  uint32_t first_frame_offset = xma::GetPacketFrameOffset(packet);
-  if (first_frame_offset == -1 || first_frame_offset > kBitsPerPacket) {
-    // Packet only contains a partial frame, so no frames can start here.
-    return false;
-  }
-
-  BitStream stream(packet, kBitsPerPacket);
-  stream.SetOffset(first_frame_offset);
-  while (true) {
-    if (stream.offset_bits() == relative_offset_bits) {
-      return true;
-    }
-
-    if (stream.BitsRemaining() < 15) {
-      // Not enough room for another frame header.
-      return false;
-    }
-
-    uint64_t size = stream.Read(15);
-    if ((size - 15) > stream.BitsRemaining()) {
-      // Last frame.
-      return false;
-    } else if (size == 0x7FFF) {
-      // Invalid frame (and last of this packet)
-      return false;
-    }
-
-    stream.Advance(size - 16);
-
-    // Read the trailing bit to see if frames follow
-    if (stream.Read(1) == 0) {
-      break;
-    }
-  }
-
-  return false;
-}
-
 static void dump_raw(AVFrame* frame, int id) {
   FILE* outfile = fopen(fmt::format("out{}.raw", id).c_str(), "ab");
   if (!outfile) {
@@ -384,6 +348,9 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
   assert_false(data->interrupt_when_done);
   static int total_samples = 0;
   bool reuse_input_buffer = false;
+  // The guest may have rewritten the packets since the last kick.
+  packet_frames_packet_ = nullptr;
+  using StatsClock = std::chrono::steady_clock;
   // Decode until we can't write any more data.
   while (output_remaining_bytes > 0) {
     if (!data->input_buffer_0_valid && !data->input_buffer_1_valid) {
@@ -404,9 +371,6 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
     uint8_t* packet;
     bool frame_last_split;
 
-    BitStream stream(current_input_buffer, current_input_size * 8);
-    stream.SetOffset(data->input_buffer_read_offset);
-
     // if we had a buffer swap try to skip packets first
     if (packets_skip_ > 0) {
       packet_idx =
@@ -431,43 +395,43 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       // continue;
     }
 
-    if (split_frame_len_) {
+    if (frame_assembler_.pending()) {
       // handle a frame that was split over two packages
       packet_idx =
           GetFramePacketNumber(current_input_buffer, current_input_size,
                                data->input_buffer_read_offset);
       packet = current_input_buffer + packet_idx * kBytesPerPacket;
-      std::tie(frame_count, frame_last_split) = GetPacketFrameCount(packet);
+      ParsePacketFrames(packet);
+      frame_count = int(packet_frames_.count);
+      frame_last_split = packet_frames_.last_split;
       frame_idx = -1;
 
-      stream =
-          BitStream(current_input_buffer, (packet_idx + 1) * kBitsPerPacket);
-      stream.SetOffset(packet_idx * kBitsPerPacket + 32);
-
-      if (split_frame_len_ > xma::kMaxFrameLength) {
-        // TODO write CopyPeekMethod
-        auto offset = stream.offset_bits();
-        stream.Copy(
-            xma_frame_.data() + 1 +
-                ((split_frame_len_partial_ + split_frame_padding_start_) / 8),
-            15 - split_frame_len_partial_);
-        stream.SetOffset(offset);
-        BitStream slen(xma_frame_.data() + 1, 15 + split_frame_padding_start_);
-        slen.Advance(split_frame_padding_start_);
-        split_frame_len_ = static_cast<int>(slen.Read(15));
-      }
-
+      uint32_t split_frame_len_rest = frame_assembler_.Continue(packet);
       if (frame_count > 0) {
         assert_true(xma::GetPacketFrameOffset(packet) - 32 ==
-                    split_frame_len_ - split_frame_len_partial_);
+                    split_frame_len_rest);
       }
 
-      auto offset = stream.Copy(
-          xma_frame_.data() + 1 +
-              ((split_frame_len_partial_ + split_frame_padding_start_) / 8),
-          split_frame_len_ - split_frame_len_partial_);
-      assert_true(offset ==
-                  (split_frame_padding_start_ + split_frame_len_partial_) % 8);
+      if (frame_assembler_.pending()) {
+        // The frame spans this whole packet, and continues in the next one.
+        packets_skip_ = xma::GetPacketSkipCount(packet) + 1;
+        while (packets_skip_ > 0) {
+          packets_skip_--;
+          packet_idx++;
+          if (packet_idx >= current_input_packet_count) {
+            if (!reuse_input_buffer) {
+              // Last packet. Try setup once more.
+              reuse_input_buffer = TrySetupNextLoop(data, true);
+            }
+            if (!reuse_input_buffer) {
+              SwapInputBuffer(data);
+            }
+            return;
+          }
+        }
+        data->input_buffer_read_offset = packet_idx * kBitsPerPacket;
+        continue;
+      }
     } else {
       if (data->input_buffer_read_offset % kBitsPerPacket == 0) {
         // Invalid offset. Go ahead and set it.
@@ -495,56 +459,36 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
         }
       }
 
-      if (!ValidFrameOffset(current_input_buffer, current_input_size,
-                            data->input_buffer_read_offset)) {
+      // Where are we in the buffer (in XMA jargon)
+      packet_idx =
+          GetFramePacketNumber(current_input_buffer, current_input_size,
+                               data->input_buffer_read_offset);
+      if (packet_idx >= 0) {
+        packet = current_input_buffer + packet_idx * kBytesPerPacket;
+        ParsePacketFrames(packet);
+        frame_idx = packet_frames_.Find(data->input_buffer_read_offset -
+                                        packet_idx * kBitsPerPacket);
+      } else {
+        frame_idx = -1;
+      }
+      if (frame_idx < 0) {
         XELOGAPU("XmaContext {}: Invalid read offset {}!", id(),
                  data->input_buffer_read_offset);
         SwapInputBuffer(data);
         return;
       }
-
-      // Where are we in the buffer (in XMA jargon)
-      std::tie(packet_idx, frame_idx) =
-          GetFrameNumber(current_input_buffer, current_input_size,
-                         data->input_buffer_read_offset);
-      // TODO handle
-      assert_true(packet_idx >= 0);
-      assert_true(frame_idx >= 0);
-      packet = current_input_buffer + packet_idx * kBytesPerPacket;
       // frames that belong to this packet
-      std::tie(frame_count, frame_last_split) = GetPacketFrameCount(packet);
-      assert_true(frame_count >= 0);  // TODO end
+      frame_count = int(packet_frames_.count);
+      frame_last_split = packet_frames_.last_split;
 
       PrepareDecoder(packet, data->sample_rate, bool(data->is_stereo));
 
       // Current frame is split to next packet:
       bool frame_is_split = frame_last_split && (frame_idx >= frame_count - 1);
 
-      stream =
-          BitStream(current_input_buffer, (packet_idx + 1) * kBitsPerPacket);
-      stream.SetOffset(data->input_buffer_read_offset);
-      // int frame_len;
-      // int frame_len_partial
-      split_frame_len_partial_ = static_cast<int>(stream.BitsRemaining());
-      if (split_frame_len_partial_ >= 15) {
-        split_frame_len_ = static_cast<int>(stream.Peek(15));
-      } else {
-        // assert_always();
-        split_frame_len_ = xma::kMaxFrameLength + 1;
-      }
-      assert_true(frame_is_split ==
-                  (split_frame_len_ > split_frame_len_partial_));
-
-      // TODO fix bitstream copy
-      std::memset(xma_frame_.data(), 0, xma_frame_.size());
-
-      {
-        auto offset =
-            stream.Copy(xma_frame_.data() + 1,
-                        std::min(split_frame_len_, split_frame_len_partial_));
-        assert_true(offset < 8);
-        split_frame_padding_start_ = static_cast<uint8_t>(offset);
-      }
+      frame_assembler_.Begin(packet, data->input_buffer_read_offset -
+                                         packet_idx * kBitsPerPacket);
+      assert_true(frame_is_split == frame_assembler_.pending());
 
       if (frame_is_split) {
         // go to next xma packet of this stream
@@ -570,20 +514,15 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       }
     }
 
-    av_packet_->data = xma_frame_.data();
-    av_packet_->size = static_cast<int>(
-        1 + ((split_frame_padding_start_ + split_frame_len_) / 8) +
-        (((split_frame_padding_start_ + split_frame_len_) % 8) ? 1 : 0));
-
-    auto padding_end = av_packet_->size * 8 -
-                       (8 + split_frame_padding_start_ + split_frame_len_);
-    assert_true(padding_end < 8);
-    xma_frame_[0] =
-        ((split_frame_padding_start_ & 7) << 5) | ((padding_end & 7) << 2);
+    frame_assembler_.Finish();
+    av_packet_->data = const_cast<uint8_t*>(frame_assembler_.data());
+    av_packet_->size = static_cast<int>(frame_assembler_.size());
+    frame_assembler_.Reset();
 
-    split_frame_len_ = 0;
-    split_frame_len_partial_ = 0;
-    split_frame_padding_start_ = 0;
+    StatsClock::time_point decode_start;
+    if (stats_) {
+      decode_start = StatsClock::now();
+    }
 
     auto ret = avcodec_send_packet(av_context_, av_packet_);
     if (ret < 0) {
@@ -615,6 +554,11 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       // assert_true(frame_is_split == (frame_idx == -1));
 
       //			dump_raw(av_frame_, id());
+      StatsClock::time_point convert_start;
+      if (stats_) {
+        convert_start = StatsClock::now();
+        stats_->decode_time += convert_start - decode_start;
+      }
       ConvertFrame((const uint8_t**)av_frame_->data, bool(data->is_stereo),
                    raw_frame_.data());
       // decoded_consumed_samples_ += kSamplesPerFrame;
@@ -624,15 +568,17 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       output_rb.Write(raw_frame_.data(), byte_count);
       output_remaining_bytes -= byte_count;
       data->output_buffer_write_offset = output_rb.write_offset() / 256;
+      if (stats_) {
+        stats_->convert_time += StatsClock::now() - convert_start;
+        ++stats_->frame_count;
+      }
 
       total_samples += id_ == 0 ? kSamplesPerFrame : 0;
 
-      uint32_t offset = data->input_buffer_read_offset;
-      // if (offset % (kBytesPerSample * 8) == 0) {
-      //  offset = xma::GetPacketFrameOffset(packet);
-      //}
-      offset = static_cast<uint32_t>(
-          GetNextFrame(current_input_buffer, current_input_size, offset));
+      uint32_t offset = packet_frames_.NextOffset(frame_idx);
+      if (offset) {
+        offset += packet_idx * kBitsPerPacket;
+      }
       // assert_true((offset == 0) ==
       //            (frame_is_split || (frame_idx + 1 >= frame_count)));
       if (frame_idx + 1 >= frame_count) {
@@ -688,49 +634,6 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
   }
 }
 
-size_t XmaContext::GetNextFrame(uint8_t* block, size_t size,
-                                size_t bit_offset) {
-  // offset = xma::GetPacketFrameOffset(packet);
-  // TODO meh
-  // auto next_packet = bit_offset - bit_offset % kBitsPerPacket +
-  // kBitsPerPacket;
-  auto packet_idx = GetFramePacketNumber(block, size, bit_offset);
-
-  BitStream stream(block, size * 8);
-  stream.SetOffset(bit_offset);
-
-  if (stream.BitsRemaining() < 15) {
-    return 0;
-  }
-
-  uint64_t len = stream.Read(15);
-  if ((len - 15) > stream.BitsRemaining()) {
-    assert_always("TODO");
-    // *bit_offset = next_packet;
-    // return false;
-    // return next_packet;
-    return 0;
-  } else if (len >= xma::kMaxFrameLength) {
-    assert_always("TODO");
-    // *bit_offset = next_packet;
-    // return false;
-    return 0;
-    // return next_packet;
-  }
-
-  stream.Advance(len - (15 + 1));
-  // Read the trailing bit to see if frames follow
-  if (stream.Read(1) == 0) {
-    return 0;
-  }
-
-  bit_offset += len;
-  if (packet_idx < GetFramePacketNumber(block, size, bit_offset)) {
-    return 0;
-  }
-  return bit_offset;
-}
-
 int XmaContext::GetFramePacketNumber(uint8_t* block, size_t size,
                                      size_t bit_offset) {
   size *= 8;
@@ -746,84 +649,10 @@ int XmaContext::GetFramePacketNumber(uint8_t* block, size_t size,
   return (uint32_t)packet_number;
 }
 
-std::tuple<int, int> XmaContext::GetFrameNumber(uint8_t* block, size_t size,
-                                                size_t bit_offset) {
-  auto packet_idx = GetFramePacketNumber(block, size, bit_offset);
-
-  if (packet_idx < 0 || (packet_idx + 1) * kBytesPerPacket > size) {
-    assert_always();
-    return {packet_idx, -2};
-  }
-
-  if (bit_offset == 0) {
-    return {packet_idx, -1};
-  }
-
-  uint8_t* packet = block + (packet_idx * kBytesPerPacket);
-  auto first_frame_offset = xma::GetPacketFrameOffset(packet);
-  BitStream stream(block, size * 8);
-  stream.SetOffset(packet_idx * kBitsPerPacket + first_frame_offset);
-
-  int frame_idx = 0;
-  while (true) {
-    if (stream.BitsRemaining() < 15) {
-      break;
-    }
-
-    if (stream.offset_bits() == bit_offset) {
-      break;
-    }
-
-    uint64_t size = stream.Read(15);
-    if ((size - 15) > stream.BitsRemaining()) {
-      // Last frame.
-      break;
-    } else if (size == 0x7FFF) {
-      // Invalid frame (and last of this packet)
-      break;
-    }
-
-    stream.Advance(size - (15 + 1));
-
-    // Read the trailing bit to see if frames follow
-    if (stream.Read(1) == 0) {
-      break;
-    }
-    frame_idx++;
-  }
-  return {packet_idx, frame_idx};
-}
-
-std::tuple<int, bool> XmaContext::GetPacketFrameCount(uint8_t* packet) {
-  auto first_frame_offset = xma::GetPacketFrameOffset(packet);
-  if (first_frame_offset > kBitsPerPacket - kBitsPerHeader) {
-    // frame offset is beyond packet end
-    return {0, false};
-  }
-
-  BitStream stream(packet, kBitsPerPacket);
-  stream.SetOffset(first_frame_offset);
-  int frame_count = 0;
-
-  while (true) {
-    frame_count++;
-    if (stream.BitsRemaining() < 15) {
-      return {frame_count, true};
-    }
-
-    uint64_t size = stream.Read(15);
-    if ((size - 15) > stream.BitsRemaining()) {
-      return {frame_count, true};
-    } else if (size == 0x7FFF) {
-      assert_always();
-      return {frame_count, true};
-    }
-
-    stream.Advance(size - (15 + 1));
-
-    if (stream.Read(1) == 0) {
-      return {frame_count, false};
-    }
+void XmaContext::ParsePacketFrames(uint8_t* packet) {
+  if (packet != packet_frames_packet_) {
+    xma::ParsePacketFrames(packet, &packet_frames_);
+    packet_frames_packet_ = packet;
   }
 }
 
@@ -856,79 +685,19 @@ int XmaContext::PrepareDecoder(uint8_t* packet, int sample_rate,
 
 void XmaContext::ConvertFrame(const uint8_t** samples, bool is_two_channel,
                               uint8_t* output_buffer) {
-  // Loop through every sample, convert and drop it into the output array.
-  // If more than one channel, we need to interleave the samples from each
-  // channel next to each other. Always saturate because FFmpeg output is
-  // not limited to [-1, 1] (for example 1.095 as seen in 5454082B).
-  constexpr float scale = (1 << 15) - 1;
-  auto out = reinterpret_cast<int16_t*>(output_buffer);
-
+  // Interleave the channels and convert to big-endian int16. The kernel
+  // always saturates because FFmpeg output is not limited to [-1, 1] (for
+  // example 1.095 as seen in 5454082B).
   // For testing of vectorized versions, stereo audio is common in 4D5307E6,
   // since the first menu frame; the intro cutscene also has more than 2
   // channels.
-#if XE_ARCH_AMD64
-  static_assert(kSamplesPerFrame % 8 == 0);
-  const auto in_channel_0 = reinterpret_cast<const float*>(samples[0]);
-  const __m128 scale_mm = _mm_set1_ps(scale);
-  if (is_two_channel) {
-    const auto in_channel_1 = reinterpret_cast<const float*>(samples[1]);
-    const __m128i shufmask =
-        _mm_set_epi8(14, 15, 6, 7, 12, 13, 4, 5, 10, 11, 2, 3, 8, 9, 0, 1);
-    for (uint32_t i = 0; i < kSamplesPerFrame; i += 4) {
-      // Load 8 samples, 4 for each channel.
-      __m128 in_mm0 = _mm_loadu_ps(&in_channel_0[i]);
-      __m128 in_mm1 = _mm_loadu_ps(&in_channel_1[i]);
-      // Rescale.
-      in_mm0 = _mm_mul_ps(in_mm0, scale_mm);
-      in_mm1 = _mm_mul_ps(in_mm1, scale_mm);
-      // Cast to int32.
-      __m128i out_mm0 = _mm_cvtps_epi32(in_mm0);
-      __m128i out_mm1 = _mm_cvtps_epi32(in_mm1);
-      // Saturated cast and pack to int16.
-      __m128i out_mm = _mm_packs_epi32(out_mm0, out_mm1);
-      // Interleave channels and byte swap.
-      out_mm = _mm_shuffle_epi8(out_mm, shufmask);
-      // Store, as [out + i * 4] movdqu.
-      _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i * 2]), out_mm);
-    }
-  } else {
-    const __m128i shufmask =
-        _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
-    for (uint32_t i = 0; i < kSamplesPerFrame; i += 8) {
-      // Load 8 samples, as [in_channel_0 + i * 4] and
-      // [in_channel_0 + i * 4 + 16] movups.
-      __m128 in_mm0 = _mm_loadu_ps(&in_channel_0[i]);
-      __m128 in_mm1 = _mm_loadu_ps(&in_channel_0[i + 4]);
-      // Rescale.
-      in_mm0 = _mm_mul_ps(in_mm0, scale_mm);
-      in_mm1 = _mm_mul_ps(in_mm1, scale_mm);
-      // Cast to int32.
-      __m128i out_mm0 = _mm_cvtps_epi32(in_mm0);
-      __m128i out_mm1 = _mm_cvtps_epi32(in_mm1);
-      // Saturated cast and pack to int16.
-      __m128i out_mm = _mm_packs_epi32(out_mm0, out_mm1);
-      // Byte swap.
-      out_mm = _mm_shuffle_epi8(out_mm, shufmask);
-      // Store, as [out + i * 2] movdqu.
-      _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]), out_mm);
-    }
-  }
-#else
-  uint32_t o = 0;
-  for (uint32_t i = 0; i < kSamplesPerFrame; i++) {
-    for (uint32_t j = 0; j <= uint32_t(is_two_channel); j++) {
-      // Select the appropriate array based on the current channel.
-      auto in = reinterpret_cast<const float*>(samples[j]);
-
-      // Raw samples sometimes aren't within [-1, 1]
-      float scaled_sample = xe::clamp_float(in[i], -1.0f, 1.0f) * scale;
-
-      // Convert the sample and output it in big endian.
-      auto sample = static_cast<int16_t>(scaled_sample);
-      out[o++] = xe::byte_swap(sample);
-    }
-  }
-#endif
+  static_assert(kSamplesPerFrame % 32 == 0);
+  const float* channels[2] = {
+      reinterpret_cast<const float*>(samples[0]),
+      reinterpret_cast<const float*>(samples[is_two_channel ? 1 : 0])};
+  conversion::planar_to_interleaved_int16_BE(
+      reinterpret_cast<int16_t*>(output_buffer), channels, is_two_channel,
+      kSamplesPerFrame);
 }
 
 }  // namespace apu
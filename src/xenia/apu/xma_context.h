@@ -12,10 +12,12 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <queue>
 //#include <vector>
 
+#include "xenia/apu/xma_frame_parser.h"
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -130,6 +132,21 @@ struct Xma2ExtraData {
 static_assert_size(Xma2ExtraData, 34);
 #pragma pack(pop)
 
+class XmaCaptureWriter;
+
+// Per-stage decode times, collected only when set with XmaContext::set_stats.
+// Not synchronized, so it must not be shared between contexts decoded on
+// different threads.
+struct XmaDecodeStats {
+  uint64_t frame_count = 0;
+  // Locating the next frame in the input packets and assembling split frames.
+  std::chrono::nanoseconds parse_time{0};
+  // FFmpeg send/receive of the assembled frame.
+  std::chrono::nanoseconds decode_time{0};
+  // ConvertFrame and the output ring buffer write.
+  std::chrono::nanoseconds convert_time{0};
+};
+
 class XmaContext {
  public:
   static const uint32_t kBytesPerPacket = 2048;
@@ -169,30 +186,27 @@ class XmaContext {
   void set_is_allocated(bool is_allocated) { is_allocated_ = is_allocated; }
   void set_is_enabled(bool is_enabled) { is_enabled_ = is_enabled; }
 
+  // Records the context state and input packets before each decode.
+  void set_capture(XmaCaptureWriter* capture) { capture_ = capture; }
+  void set_stats(XmaDecodeStats* stats) { stats_ = stats; }
+
  private:
   static void SwapInputBuffer(XMA_CONTEXT_DATA* data);
   static bool TrySetupNextLoop(XMA_CONTEXT_DATA* data,
                                bool ignore_input_buffer_offset);
   static void NextPacket(XMA_CONTEXT_DATA* data);
   static int GetSampleRate(int id);
-  // Get the offset of the next frame. Does not traverse packets.
-  static size_t GetNextFrame(uint8_t* block, size_t size, size_t bit_offset);
   // Get the containing packet number of the frame pointed to by the offset.
   static int GetFramePacketNumber(uint8_t* block, size_t size,
                                   size_t bit_offset);
-  // Get the packet number and the index of the frame inside that packet
-  static std::tuple<int, int> GetFrameNumber(uint8_t* block, size_t size,
-                                             size_t bit_offset);
-  // Get the number of frames contained in the packet (including truncated) and
-  // if the last frame is split.
-  static std::tuple<int, bool> GetPacketFrameCount(uint8_t* packet);
+  // Walks the frames of the packet into packet_frames_, unless they're there
+  // already.
+  void ParsePacketFrames(uint8_t* packet);
 
   // Convert sample format and swap bytes
   static void ConvertFrame(const uint8_t** samples, bool is_two_channel,
                            uint8_t* output_buffer);
 
-  bool ValidFrameOffset(uint8_t* block, size_t size_bytes,
-                        size_t frame_offset_bits);
   void Decode(XMA_CONTEXT_DATA* data);
   int PrepareDecoder(uint8_t* packet, int sample_rate, bool is_two_channel);
 
@@ -205,6 +219,9 @@ class XmaContext {
   bool is_enabled_ = false;
   // bool is_dirty_ = true;
 
+  XmaCaptureWriter* capture_ = nullptr;
+  XmaDecodeStats* stats_ = nullptr;
+
   // ffmpeg structures
   AVPacket* av_packet_ = nullptr;
   AVCodec* av_codec_ = nullptr;
@@ -221,12 +238,11 @@ class XmaContext {
   // std::vector<uint8_t> partial_frame_buffer_;
   uint32_t packets_skip_ = 0;
 
-  // bool split_frame_pending_ = false;
-  uint32_t split_frame_len_ = 0;
-  uint32_t split_frame_len_partial_ = 0;
-  uint8_t split_frame_padding_start_ = 0;
-  // first byte contains bit offset information
-  std::array<uint8_t, 1 + 4096> xma_frame_;
+  // Frames of the packet last walked in the current Decode.
+  xma::PacketFrames packet_frames_;
+  const uint8_t* packet_frames_packet_ = nullptr;
+  // The frame being decoded, possibly split over multiple packets.
+  xma::FrameAssembler frame_assembler_;
 
   // uint8_t* current_frame_ = nullptr;
   // conversion buffer for 2 channel frame
@@ -9,6 +9,9 @@
 
 #include "xenia/apu/xma_decoder.h"
 
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/apu/xma_context.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
@@ -50,6 +53,14 @@ extern "C" {
 
 DEFINE_bool(ffmpeg_verbose, false, "Verbose FFmpeg output (debug and above)",
             "APU");
+DEFINE_path(xma_capture_path, "",
+            "Records the state and input packets of every XMA context decode "
+            "to this file, for replay with xenia-apu-xma-bench.",
+            "APU");
+DEFINE_int32(xma_decoder_threads, 0,
+             "Number of threads decoding XMA contexts in parallel, 0 to pick "
+             "based on the number of host processors.",
+             "APU");
 
 namespace xe {
 namespace apu {
@@ -126,6 +137,10 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
   register_file_[XmaRegister::ContextArrayAddress] =
       memory()->GetPhysicalAddress(context_data_first_ptr_);
 
+  if (!cvars::xma_capture_path.empty()) {
+    capture_ = XmaCaptureWriter::Create(cvars::xma_capture_path);
+  }
+
   // Setup XMA contexts.
   for (int i = 0; i < kContextCount; ++i) {
     uint32_t guest_ptr = context_data_first_ptr_ + i * sizeof(XMA_CONTEXT_DATA);
@@ -133,77 +148,170 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
     if (context.Setup(i, memory(), guest_ptr)) {
       assert_always();
     }
+    context.set_capture(capture_.get());
   }
   register_file_[XmaRegister::NextContextIndex] = 1;
   context_bitmap_.Resize(kContextCount);
 
+  // Contexts are only decoded after the guest kicks them, so the workers
+  // sleep until WriteRegister queues one. Independent contexts (voices) are
+  // decoded in parallel.
+  uint32_t worker_count = uint32_t(cvars::xma_decoder_threads);
+  if (cvars::xma_decoder_threads <= 0) {
+    worker_count = std::clamp(xe::threading::logical_processor_count() / 4,
+                              uint32_t(1), uint32_t(4));
+  }
   worker_running_ = true;
-  work_event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  assert_not_null(work_event_);
-  worker_thread_ = kernel::object_ref<kernel::XHostThread>(
-      new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
-        WorkerThreadMain();
-        return 0;
-      }));
-  worker_thread_->set_name("XMA Decoder");
-  worker_thread_->set_can_debugger_suspend(true);
-  worker_thread_->Create();
+  workers_start_time_ = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    auto worker_thread = kernel::object_ref<kernel::XHostThread>(
+        new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
+          WorkerThreadMain();
+          return 0;
+        }));
+    worker_thread->set_name(
+        worker_count > 1 ? fmt::format("XMA Decoder {}", i) : "XMA Decoder");
+    worker_thread->set_can_debugger_suspend(true);
+    worker_thread->Create();
+    worker_threads_.push_back(std::move(worker_thread));
+  }
 
   return X_STATUS_SUCCESS;
 }
 
 void XmaDecoder::WorkerThreadMain() {
-  uint32_t idle_loop_count = 0;
-  while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      did_work = context.Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  while (true) {
+    work_cond_.wait(lock, [this] {
+      return !worker_running_ || paused_ || !ready_contexts_.empty();
+    });
+    if (!worker_running_) {
+      break;
     }
-
     if (paused_) {
-      pause_fence_.Signal();
-      resume_fence_.Wait();
+      ++paused_worker_count_;
+      pause_cond_.notify_all();
+      work_cond_.wait(lock, [this] { return !worker_running_ || !paused_; });
+      --paused_worker_count_;
+      continue;
     }
 
-    if (!did_work) {
-      idle_loop_count++;
-    } else {
-      idle_loop_count = 0;
+    uint32_t context_id = ready_contexts_.front();
+    ready_contexts_.pop_front();
+    context_work_states_[context_id] = ContextWorkState::kDecoding;
+    lock.unlock();
+
+    auto decode_start = std::chrono::steady_clock::now();
+    if (contexts_[context_id].Work()) {
+      RecordDecodeTime(std::chrono::steady_clock::now() - decode_start);
     }
 
-    if (idle_loop_count > 500) {
-      // Idle for an extended period. Introduce a 20ms wait.
-      xe::threading::Wait(work_event_.get(), false,
-                          std::chrono::milliseconds(20));
+    lock.lock();
+    if (context_work_states_[context_id] ==
+        ContextWorkState::kDecodingKicked) {
+      context_work_states_[context_id] = ContextWorkState::kQueued;
+      ready_contexts_.push_back(context_id);
+    } else {
+      context_work_states_[context_id] = ContextWorkState::kIdle;
     }
+  }
+}
+
+void XmaDecoder::QueueContext(uint32_t context_id) {
+  ContextWorkState& state = context_work_states_[context_id];
+  switch (state) {
+    case ContextWorkState::kIdle:
+      state = ContextWorkState::kQueued;
+      ready_contexts_.push_back(context_id);
+      work_cond_.notify_one();
+      break;
+    case ContextWorkState::kDecoding:
+      state = ContextWorkState::kDecodingKicked;
+      break;
+    default:
+      // Already going to be decoded again.
+      break;
+  }
+}
 
-    xe::threading::MaybeYield();
+void XmaDecoder::RecordDecodeTime(
+    std::chrono::steady_clock::duration duration) {
+  uint64_t us = uint64_t(
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+  size_t bucket = 0;
+  while (bucket + 1 < kDecodeTimeBucketCount && (uint64_t(1) << bucket) <= us) {
+    ++bucket;
   }
+  decode_time_buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  decode_time_total_us_.fetch_add(us, std::memory_order_relaxed);
+}
+
+void XmaDecoder::LogDecodeStats() {
+  uint64_t counts[kDecodeTimeBucketCount];
+  uint64_t decode_count = 0;
+  for (size_t i = 0; i < kDecodeTimeBucketCount; ++i) {
+    counts[i] = decode_time_buckets_[i].load(std::memory_order_relaxed);
+    decode_count += counts[i];
+  }
+  if (!decode_count) {
+    return;
+  }
+  // Upper bound of the bucket the given fraction of decodes falls in.
+  auto percentile_us = [&](double fraction) {
+    uint64_t target = std::max(uint64_t(1), uint64_t(decode_count * fraction));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kDecodeTimeBucketCount; ++i) {
+      seen += counts[i];
+      if (seen >= target) {
+        return uint64_t(1) << i;
+      }
+    }
+    return uint64_t(1) << (kDecodeTimeBucketCount - 1);
+  };
+  // The workers only use CPU time while there is something to decode; the
+  // polling loop they replace kept one host processor busy all the time.
+  std::chrono::nanoseconds worker_cpu_time(0);
+  for (auto& worker_thread : worker_threads_) {
+    worker_cpu_time += worker_thread->run_time();
+  }
+  double elapsed_s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - workers_start_time_)
+                         .count();
+  double worker_cpu_s =
+      std::chrono::duration<double>(worker_cpu_time).count();
+  XELOGI(
+      "XMA: {} decodes, mean {:.1f}us, p50 <{}us, p90 <{}us, p99 <{}us; {} "
+      "decoder threads used {:.3f}s of CPU time in {:.3f}s ({:.1f}% of one "
+      "processor)",
+      decode_count,
+      double(decode_time_total_us_.load(std::memory_order_relaxed)) /
+          decode_count,
+      percentile_us(0.5), percentile_us(0.9), percentile_us(0.99),
+      worker_threads_.size(), worker_cpu_s, elapsed_s,
+      elapsed_s > 0.0 ? worker_cpu_s / elapsed_s * 100.0 : 0.0);
 }
 
 void XmaDecoder::Shutdown() {
-  worker_running_ = false;
+  // Sample the CPU time of the workers while they're still alive.
+  LogDecodeStats();
 
-  if (work_event_) {
-    work_event_->Set();
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    worker_running_ = false;
+    paused_ = false;
   }
+  work_cond_.notify_all();
 
-  if (paused_) {
-    Resume();
+  for (auto& worker_thread : worker_threads_) {
+    // Wait for work thread.
+    xe::threading::Wait(worker_thread->thread(), false);
   }
+  worker_threads_.clear();
 
-  if (worker_thread_) {
-    // Wait for work thread.
-    xe::threading::Wait(worker_thread_->thread(), false);
-    worker_thread_.reset();
+  for (XmaContext& context : contexts_) {
+    context.set_capture(nullptr);
   }
+  capture_.reset();
 
   if (context_data_first_ptr_) {
     memory()->SystemHeapFree(context_data_first_ptr_);
@@ -308,15 +416,16 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
 
     // The context ID is a bit in the range of the entire context array.
     uint32_t base_context_id = (r - XmaRegister::Context0Kick) * 32;
+    std::lock_guard<std::mutex> lock(work_mutex_);
     for (int i = 0; value && i < 32; ++i, value >>= 1) {
       if (value & 1) {
         uint32_t context_id = base_context_id + i;
         auto& context = contexts_[context_id];
         context.Enable();
+        // Queue it for the decoder threads.
+        QueueContext(context_id);
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->Set();
   } else if (r >= XmaRegister::Context0Lock && r <= XmaRegister::Context9Lock) {
     // Context lock command.
     // This requests a lock by flagging the context.
@@ -329,8 +438,6 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Disable();
       }
     }
-    // Signal the decoder thread to start processing.
-    // work_event_->Set();
   } else if (r >= XmaRegister::Context0Clear &&
              r <= XmaRegister::Context9Clear) {
     // Context clear command.
@@ -363,21 +470,28 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
 }
 
 void XmaDecoder::Pause() {
+  std::unique_lock<std::mutex> lock(work_mutex_);
   if (paused_) {
     return;
   }
   paused_ = true;
+  work_cond_.notify_all();
 
-  pause_fence_.Wait();
+  // Wait for in-flight decodes to finish.
+  pause_cond_.wait(lock, [this] {
+    return !worker_running_ || paused_worker_count_ == worker_threads_.size();
+  });
 }
 
 void XmaDecoder::Resume() {
-  if (!paused_) {
-    return;
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    if (!paused_) {
+      return;
+    }
+    paused_ = false;
   }
-  paused_ = false;
-
-  resume_fence_.Signal();
+  work_cond_.notify_all();
 }
 
 }  // namespace apu
@@ -10,10 +10,16 @@
 #ifndef XENIA_APU_XMA_DECODER_H_
 #define XENIA_APU_XMA_DECODER_H_
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <queue>
+#include <vector>
 
+#include "xenia/apu/xma_capture.h"
 #include "xenia/apu/xma_context.h"
 #include "xenia/apu/xma_register_file.h"
 #include "xenia/base/bit_map.h"
@@ -55,7 +61,21 @@ class XmaDecoder {
   int GetContextId(uint32_t guest_ptr);
 
  private:
+  // Decode state of a context, guarded by work_mutex_. A kicked context is in
+  // the ready queue at most once and is decoded by one worker at a time; a
+  // kick during its decode queues it again once that decode is done.
+  enum class ContextWorkState : uint8_t {
+    kIdle,
+    kQueued,
+    kDecoding,
+    kDecodingKicked,
+  };
+
   void WorkerThreadMain();
+  // Must be called with work_mutex_ held.
+  void QueueContext(uint32_t context_id);
+  void RecordDecodeTime(std::chrono::steady_clock::duration duration);
+  void LogDecodeStats();
 
   static uint32_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
@@ -71,19 +91,34 @@ class XmaDecoder {
   cpu::Processor* processor_ = nullptr;
 
   std::atomic<bool> worker_running_ = {false};
-  kernel::object_ref<kernel::XHostThread> worker_thread_;
-  std::unique_ptr<xe::threading::Event> work_event_ = nullptr;
-
+  std::vector<kernel::object_ref<kernel::XHostThread>> worker_threads_;
+
+  std::mutex work_mutex_;
+  // Signaled when contexts are queued, and on pause, resume and shutdown.
+  std::condition_variable work_cond_;
+  // Signaled when a worker has paused.
+  std::condition_variable pause_cond_;
+  std::deque<uint32_t> ready_contexts_;
   bool paused_ = false;
-  xe::threading::Fence pause_fence_;   // Signaled when worker paused.
-  xe::threading::Fence resume_fence_;  // Signaled when resume requested.
+  uint32_t paused_worker_count_ = 0;
+
+  // Decode time histogram, bucket N counting decodes that took less than
+  // 2^N microseconds (the last bucket also counts anything longer).
+  static constexpr size_t kDecodeTimeBucketCount = 24;
+  std::array<std::atomic<uint64_t>, kDecodeTimeBucketCount>
+      decode_time_buckets_ = {};
+  std::atomic<uint64_t> decode_time_total_us_ = {0};
+  std::chrono::steady_clock::time_point workers_start_time_;
 
   XmaRegisterFile register_file_;
 
   static const uint32_t kContextCount = 320;
   XmaContext contexts_[kContextCount];
+  ContextWorkState context_work_states_[kContextCount] = {};
   BitMap context_bitmap_;
 
+  std::unique_ptr<XmaCaptureWriter> capture_;
+
   uint32_t context_data_first_ptr_ = 0;
   uint32_t context_data_last_ptr_ = 0;
 };
@@ -0,0 +1,161 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_frame_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace apu {
+namespace xma {
+
+// Reads up to 25 bits, most significant first, touching only the bytes
+// holding them.
+static uint32_t ReadBits(const uint8_t* data, uint32_t bit_offset,
+                         uint32_t bit_count) {
+  const uint8_t* bytes = data + (bit_offset >> 3);
+  uint32_t first_bit = bit_offset & 7;
+  uint32_t byte_count = (first_bit + bit_count + 7) >> 3;
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < byte_count; ++i) {
+    value = (value << 8) | bytes[i];
+  }
+  value >>= byte_count * 8 - (first_bit + bit_count);
+  return value & ((uint32_t(1) << bit_count) - 1);
+}
+
+int PacketFrames::Find(uint32_t bit_offset) const {
+  auto end = offsets.cbegin() + count;
+  auto it = std::lower_bound(offsets.cbegin(), end, bit_offset);
+  if (it == end || *it != bit_offset) {
+    return -1;
+  }
+  return int(it - offsets.cbegin());
+}
+
+uint32_t PacketFrames::NextOffset(int index) const {
+  if (index < 0 || uint32_t(index) + 1 >= count) {
+    return 0;
+  }
+  uint32_t offset = offsets[index + 1];
+  return offset < kBitsPerPacket ? offset : 0;
+}
+
+void ParsePacketFrames(const uint8_t* packet, PacketFrames* frames) {
+  frames->count = 0;
+  frames->last_split = false;
+  uint32_t offset = GetPacketFrameOffset(packet);
+  if (offset > kBitsPerPacket - (kBitsPerPacketHeader + 1)) {
+    // The frame offset is beyond the packet end, it only continues a frame.
+    return;
+  }
+  while (true) {
+    assert_true(frames->count < PacketFrames::kMaxCount);
+    frames->offsets[frames->count++] = uint16_t(offset);
+    uint32_t bits_remaining = kBitsPerPacket - offset;
+    if (bits_remaining < 15) {
+      frames->last_split = true;
+      return;
+    }
+    uint32_t length = ReadBits(packet, offset, 15);
+    if (length > bits_remaining || length == kMaxFrameLength) {
+      frames->last_split = true;
+      return;
+    }
+    if (length < 16) {
+      // Too short to hold the trailing bit, the rest of the packet is invalid.
+      frames->last_split = true;
+      return;
+    }
+    offset += length;
+    // Read the trailing bit to see if frames follow.
+    if (!ReadBits(packet, offset - 1, 1)) {
+      return;
+    }
+  }
+}
+
+void FrameAssembler::Begin(const uint8_t* packet, uint32_t bit_offset) {
+  assert_true(bit_offset < kBitsPerPacket);
+  started_ = true;
+  copied_ = 0;
+  padding_start_ = bit_offset & 7;
+  buffer_[1] = 0;
+  uint32_t bits_available = kBitsPerPacket - bit_offset;
+  length_known_ = bits_available >= 15;
+  length_ = length_known_ ? ReadBits(packet, bit_offset, 15) : 0;
+  Copy(packet, bit_offset,
+       length_known_ ? std::min(length_, bits_available) : bits_available);
+}
+
+uint32_t FrameAssembler::Continue(const uint8_t* packet) {
+  assert_true(pending());
+  uint32_t copied_before = copied_;
+  uint32_t source_bit = kBitsPerPacketHeader;
+  if (!length_known_) {
+    // The length itself was split.
+    uint32_t length_bits = 15 - copied_;
+    Copy(packet, source_bit, length_bits);
+    source_bit += length_bits;
+    length_known_ = true;
+    length_ = ReadBits(buffer_.data(), 8 + padding_start_, 15);
+  }
+  Copy(packet, source_bit,
+       std::min(length_ - std::min(copied_, length_),
+                kBitsPerPacket - source_bit));
+  return copied_ - copied_before;
+}
+
+void FrameAssembler::Finish() {
+  assert_true(started_ && !pending());
+  uint32_t bit_count = 8 + padding_start_ + copied_;
+  size_ = (bit_count + 7) >> 3;
+  uint32_t padding_end = uint32_t(size_ * 8) - bit_count;
+  buffer_[size_ - 1] &= uint8_t(0xFF << padding_end);
+  std::memset(buffer_.data() + size_, 0, kInputPaddingSize);
+  buffer_[0] = uint8_t((padding_start_ << 5) | (padding_end << 2));
+}
+
+void FrameAssembler::Copy(const uint8_t* source, uint32_t source_bit,
+                          uint32_t bit_count) {
+  // Frames keep their alignment, as packets are whole bytes.
+  uint32_t target_bit = 8 + padding_start_ + copied_;
+  assert_true((target_bit & 7) == (source_bit & 7));
+  assert_true(target_bit + bit_count <=
+              (buffer_.size() - kInputPaddingSize) * 8);
+  copied_ += bit_count;
+  while (bit_count) {
+    uint32_t first_bit = source_bit & 7;
+    if (!first_bit && bit_count >= 8) {
+      uint32_t byte_count = bit_count >> 3;
+      std::memcpy(buffer_.data() + (target_bit >> 3),
+                  source + (source_bit >> 3), byte_count);
+      source_bit += byte_count * 8;
+      target_bit += byte_count * 8;
+      bit_count -= byte_count * 8;
+      continue;
+    }
+    // Merge the bits into a partially written byte.
+    uint32_t byte_bit_count = std::min(8 - first_bit, bit_count);
+    uint8_t mask = uint8_t((0xFF >> first_bit) &
+                           (0xFF << (8 - first_bit - byte_bit_count)));
+    uint8_t& target = buffer_[target_bit >> 3];
+    target = (target & ~mask) | (source[source_bit >> 3] & mask);
+    source_bit += byte_bit_count;
+    target_bit += byte_bit_count;
+    bit_count -= byte_bit_count;
+  }
+}
+
+}  // namespace xma
+}  // namespace apu
+}  // namespace xe
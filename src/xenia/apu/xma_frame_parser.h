@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_XMA_FRAME_PARSER_H_
+#define XENIA_APU_XMA_FRAME_PARSER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "xenia/apu/xma_helpers.h"
+
+namespace xe {
+namespace apu {
+namespace xma {
+
+static const uint32_t kBytesPerPacket = 2048;
+static const uint32_t kBitsPerPacket = kBytesPerPacket * 8;
+// Frames begin after the packet header.
+static const uint32_t kBitsPerPacketHeader = 32;
+
+// The frames that begin in an XMA packet, found by walking the chain of frame
+// headers once. Each frame starts with its 15-bit length in bits (including
+// the length itself) and ends with a bit that is set if another frame follows
+// in the same packet.
+struct PacketFrames {
+  // Every frame but the last one is at least 16 bits long.
+  static const uint32_t kMaxCount =
+      (kBitsPerPacket - kBitsPerPacketHeader) / 16 + 1;
+
+  // Including the last frame even if it's split, like a frame beginning
+  // exactly at the end of the packet.
+  uint32_t count = 0;
+  // Whether the last frame continues in a later packet of the stream.
+  bool last_split = false;
+  // Frame offsets in bits from the start of the packet, ascending.
+  std::array<uint16_t, kMaxCount> offsets;
+
+  // Index of the frame beginning at bit_offset in the packet, or -1 if none
+  // does.
+  int Find(uint32_t bit_offset) const;
+  // Offset of the frame following the one at index in the same packet, or 0
+  // if that one is the last beginning in the packet (or index is -1).
+  uint32_t NextOffset(int index) const;
+};
+
+void ParsePacketFrames(const uint8_t* packet, PacketFrames* frames);
+
+// Collects the bits of one frame, which may be split across packets, in the
+// layout the FFmpeg XMA frame decoder takes: a byte holding the number of
+// padding bits before (bits 5-7) and after (bits 2-4) the frame, followed by
+// the frame at the same bit alignment as in the packet. The storage is reused
+// for every frame, and nothing but the frame itself is copied.
+class FrameAssembler {
+ public:
+  // FFmpeg may read this many bytes past the end of the data.
+  static const size_t kInputPaddingSize = 64;
+
+  // Starts a frame at bit_offset of the packet.
+  void Begin(const uint8_t* packet, uint32_t bit_offset);
+  // Adds the part of a split frame at the start of the next packet of the
+  // stream, returning the number of bits it had.
+  uint32_t Continue(const uint8_t* packet);
+  // Fills in the padding, after which data() and size() hold the whole frame.
+  void Finish();
+  void Reset() { started_ = false; }
+
+  // Whether the frame has been started, but continues in a later packet.
+  bool pending() const {
+    return started_ && (!length_known_ || copied_ < length_);
+  }
+  const uint8_t* data() const { return buffer_.data(); }
+  size_t size() const { return size_; }
+
+ private:
+  void Copy(const uint8_t* source, uint32_t source_bit, uint32_t bit_count);
+
+  bool started_ = false;
+  bool length_known_ = false;
+  uint32_t length_ = 0;
+  uint32_t copied_ = 0;
+  uint32_t padding_start_ = 0;
+  size_t size_ = 0;
+  // The padding byte, then up to 7 padding bits and a frame of up to
+  // kMaxFrameLength bits.
+  std::array<uint8_t, 1 + (7 + kMaxFrameLength + 7) / 8 + kInputPaddingSize>
+      buffer_;
+};
+
+}  // namespace xma
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_XMA_FRAME_PARSER_H_
@@ -10,6 +10,7 @@
 #include "xenia/base/clock.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <mutex>
 
@@ -24,6 +25,17 @@ DEFINE_bool(clock_source_raw, false,
             "Use the RDTSC instruction as the time source. "
             "Host CPU must support invariant TSC.",
             "CPU");
+DEFINE_bool(clock_frame_locked, false,
+            "Advance guest time by exactly one frame per emulated vblank "
+            "instead of following the host clock, so titles can run faster or "
+            "slower than real time without timing-induced divergence. Vblanks "
+            "are issued as soon as the guest presents a frame or its time for "
+            "the frame has run out. Has no effect with clock_no_scaling.",
+            "CPU");
+DEFINE_uint32(clock_frame_locked_rate, 60,
+              "Emulated vblanks per second of guest time with "
+              "clock_frame_locked.",
+              "CPU");
 
 namespace xe {
 
@@ -45,6 +57,25 @@ uint64_t last_host_tick_count_ = Clock::QueryHostTickCount();
 // Mutex to ensure last_host_tick_count_ and last_guest_tick_count_ are in sync
 std::mutex tick_mutex_;
 
+// Frames the frame-locked guest clock has advanced by. Only written by the
+// thread emulating vblanks, under tick_mutex_.
+std::atomic<uint64_t> guest_frame_count_{0};
+
+// Guest tick count at which a frame starts. Computed from the frame index
+// rather than accumulated so the frame length does not drift from rounding.
+uint64_t GuestFrameStartTick(uint64_t frame) {
+  return frame * guest_tick_frequency_ /
+         std::max<uint32_t>(cvars::clock_frame_locked_rate, 1);
+}
+
+uint64_t GuestTicksToFileTime(uint64_t guest_tick_count) {
+  uint64_t numerator = 10000000;  // 100ns/10MHz resolution
+  uint64_t denominator = guest_tick_frequency_;
+  reduce_fraction(numerator, denominator);
+
+  return guest_tick_count * numerator / denominator;
+}
+
 void RecomputeGuestTickScalar() {
   // Create a rational number with numerator (first) and denominator (second)
   auto frac =
@@ -85,6 +116,13 @@ uint64_t UpdateGuestClock() {
     uint64_t guest_tick_delta =
         host_tick_delta * guest_tick_ratio_.first / guest_tick_ratio_.second;
     last_guest_tick_count_ += guest_tick_delta;
+    if (cvars::clock_frame_locked) {
+      // Time runs out at the end of the frame, whatever the host does, until
+      // the next vblank moves it on.
+      last_guest_tick_count_ =
+          std::min(last_guest_tick_count_,
+                   GuestFrameStartTick(guest_frame_count_ + 1) - 1);
+    }
     return last_guest_tick_count_;
   } else {
     // Wait until another thread has finished updating the clock.
@@ -99,13 +137,7 @@ inline uint64_t QueryGuestSystemTimeOffset() {
     return Clock::QueryHostSystemTime() - guest_system_time_base_;
   }
 
-  auto guest_tick_count = UpdateGuestClock();
-
-  uint64_t numerator = 10000000;  // 100ns/10MHz resolution
-  uint64_t denominator = guest_tick_frequency_;
-  reduce_fraction(numerator, denominator);
-
-  return guest_tick_count * numerator / denominator;
+  return GuestTicksToFileTime(UpdateGuestClock());
 }
 
 uint64_t Clock::QueryHostTickFrequency() {
@@ -174,6 +206,35 @@ uint32_t Clock::QueryGuestUptimeMillis() {
                          std::numeric_limits<uint32_t>::max()));
 }
 
+bool Clock::guest_frame_locked() {
+  return cvars::clock_frame_locked && !cvars::clock_no_scaling;
+}
+
+uint64_t Clock::guest_frame_count() { return guest_frame_count_; }
+
+void Clock::AdvanceGuestFrame() {
+  std::lock_guard<std::mutex> lock(tick_mutex_);
+  uint64_t frame = guest_frame_count_ + 1;
+  guest_frame_count_ = frame;
+  // Guest time between the end of the last frame and the vblank (host time
+  // spent waiting for it) is dropped, the new frame starts right away.
+  last_guest_tick_count_ =
+      std::max(last_guest_tick_count_, GuestFrameStartTick(frame));
+  last_host_tick_count_ = Clock::QueryHostTickCount();
+}
+
+bool Clock::IsGuestFrameElapsed() {
+  if (!guest_frame_locked()) {
+    return false;
+  }
+  return UpdateGuestClock() + 1 >= GuestFrameStartTick(guest_frame_count_ + 1);
+}
+
+uint64_t Clock::QueryGuestFrameEndSystemTime() {
+  return guest_system_time_base_ +
+         GuestTicksToFileTime(GuestFrameStartTick(guest_frame_count_ + 1));
+}
+
 void Clock::SetGuestSystemTime(uint64_t system_time) {
   if (cvars::clock_no_scaling) {
     // Time is fixed to host time.
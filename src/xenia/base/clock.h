@@ -22,6 +22,8 @@
 
 DECLARE_bool(clock_no_scaling);
 DECLARE_bool(clock_source_raw);
+DECLARE_bool(clock_frame_locked);
+DECLARE_uint32(clock_frame_locked_rate);
 
 namespace xe {
 
@@ -78,6 +80,22 @@ class Clock {
   // Sets the system time of the guest.
   static void SetGuestSystemTime(uint64_t system_time);
 
+  // Whether guest time is frame-locked: it advances by exactly one frame per
+  // emulated vblank, and within a frame follows the host clock (scaled) but
+  // stops just short of the next vblank. Guest timing then only depends on the
+  // number of frames emulated, not on how fast the host runs them.
+  static bool guest_frame_locked();
+  // Number of frames the frame-locked guest clock has advanced by.
+  static uint64_t guest_frame_count();
+  // Moves frame-locked guest time to the start of the next frame. Called by
+  // the thread emulating vblanks, before the vblank interrupt.
+  static void AdvanceGuestFrame();
+  // Whether frame-locked guest time has reached the end of the current frame,
+  // so it will not advance until the next vblank.
+  static bool IsGuestFrameElapsed();
+  // Guest system time at which the current frame ends, in FILETIME format.
+  static uint64_t QueryGuestFrameEndSystemTime();
+
   // Scales a time duration in milliseconds, from guest time.
   static uint32_t ScaleGuestDurationMillis(uint32_t guest_ms);
   // Scales a time duration in 100ns ticks like FILETIME, from guest time.
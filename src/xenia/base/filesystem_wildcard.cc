@@ -100,6 +100,9 @@ void WildcardEngine::SetRule(const std::string_view pattern) {
 }
 
 bool WildcardEngine::Match(const std::string_view str) const {
+  if (matches_all()) {
+    return true;
+  }
   std::string str_lc = utf8::lower_ascii(str);
   std::string::size_type offset(0);
   for (const auto& rule : rules_) {
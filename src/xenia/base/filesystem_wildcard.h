@@ -51,6 +51,10 @@ class WildcardEngine {
   // Always ignoring case
   bool Match(const std::string_view str) const;
 
+  // Whether the pattern matches any name, as * does, so that callers can skip
+  // Match altogether.
+  bool matches_all() const { return rules_.empty(); }
+
  private:
   std::vector<WildcardRule> rules_;
   void PreparePattern(const std::string_view pattern);
@@ -10,6 +10,8 @@
 #ifndef XENIA_BASE_MEMORY_H_
 #define XENIA_BASE_MEMORY_H_
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
@@ -177,6 +179,42 @@ inline void* low_address(void* address) {
 
 void copy_128_aligned(void* dest, const void* src, size_t count);
 
+// Copies count bytes from src to dest one block_size aligned block of dest at a
+// time, leaving blocks that already hold the same data untouched. Calls
+// on_changed(offset, length) after each run of blocks that had to be written,
+// and returns the number of bytes that were already the same.
+template <typename F>
+size_t copy_changed_blocks(void* dest, const void* src, size_t count,
+                           size_t block_size, F&& on_changed) {
+  auto d = static_cast<uint8_t*>(dest);
+  auto s = static_cast<const uint8_t*>(src);
+  size_t unchanged = 0;
+  size_t run_start = SIZE_MAX;
+  for (size_t offset = 0; offset < count;) {
+    size_t length =
+        std::min(block_size - reinterpret_cast<uintptr_t>(d + offset) %
+                                  block_size,
+                 count - offset);
+    if (std::memcmp(d + offset, s + offset, length)) {
+      std::memcpy(d + offset, s + offset, length);
+      if (run_start == SIZE_MAX) {
+        run_start = offset;
+      }
+    } else {
+      unchanged += length;
+      if (run_start != SIZE_MAX) {
+        on_changed(run_start, offset - run_start);
+        run_start = SIZE_MAX;
+      }
+    }
+    offset += length;
+  }
+  if (run_start != SIZE_MAX) {
+    on_changed(run_start, count - run_start);
+  }
+  return unchanged;
+}
+
 void copy_and_swap_16_aligned(void* dest, const void* src, size_t count);
 void copy_and_swap_16_unaligned(void* dest, const void* src, size_t count);
 void copy_and_swap_32_aligned(void* dest, const void* src, size_t count);
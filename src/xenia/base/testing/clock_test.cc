@@ -0,0 +1,55 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <thread>
+
+#include "xenia/base/clock.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Frame-locked guest clock", "[clock]") {
+  using namespace std::chrono_literals;
+  cvars::clock_frame_locked = true;
+  REQUIRE(Clock::guest_frame_locked());
+
+  uint64_t frequency = Clock::guest_tick_frequency();
+  uint64_t rate = cvars::clock_frame_locked_rate;
+  auto frame_start = [frequency, rate](uint64_t frame) {
+    return frame * frequency / rate;
+  };
+
+  // Guest time is within the current frame, and stalls at its end while no
+  // vblank comes.
+  uint64_t frame = Clock::guest_frame_count();
+  REQUIRE(Clock::QueryGuestTickCount() < frame_start(frame + 1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000 / rate));
+  REQUIRE(Clock::IsGuestFrameElapsed());
+  REQUIRE(Clock::QueryGuestTickCount() == frame_start(frame + 1) - 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000 / rate));
+  REQUIRE(Clock::QueryGuestTickCount() == frame_start(frame + 1) - 1);
+
+  // Every vblank moves guest time to the start of the next frame however
+  // little host time passed.
+  for (uint64_t i = 1; i <= 100; ++i) {
+    Clock::AdvanceGuestFrame();
+    REQUIRE(Clock::guest_frame_count() == frame + i);
+    uint64_t tick_count = Clock::QueryGuestTickCount();
+    REQUIRE(tick_count >= frame_start(frame + i));
+    REQUIRE(tick_count < frame_start(frame + i + 1));
+  }
+  REQUIRE(Clock::QueryGuestFrameEndSystemTime() >
+          Clock::QueryGuestSystemTime());
+
+  cvars::clock_frame_locked = false;
+  REQUIRE_FALSE(Clock::IsGuestFrameElapsed());
+}
+
+}  // namespace xe::base::test
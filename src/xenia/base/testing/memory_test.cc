@@ -15,6 +15,9 @@
 #include "xenia/base/clock.h"
 
 #include <array>
+#include <chrono>
+#include <utility>
+#include <vector>
 
 namespace xe {
 namespace base {
@@ -592,6 +595,99 @@ TEST_CASE("make_fourcc", "[fourcc]") {
   }
 }
 
+TEST_CASE("copy_changed_blocks", "[copy_changed_blocks]") {
+  constexpr size_t kBlockSize = 4096;
+  alignas(kBlockSize) static uint8_t dest[kBlockSize * 8];
+  static uint8_t src[kBlockSize * 8];
+  for (size_t i = 0; i < sizeof(src); ++i) {
+    src[i] = uint8_t(i * 13);
+  }
+  std::memcpy(dest, src, sizeof(dest));
+  // Change blocks 2, 3 and 6 of the destination range starting mid-block 1.
+  src[kBlockSize * 2 + 5] ^= 1;
+  src[kBlockSize * 4 - 1] ^= 1;
+  src[kBlockSize * 6 + 100] ^= 1;
+
+  std::vector<std::pair<size_t, size_t>> runs;
+  size_t offset = kBlockSize + 10;
+  size_t length = kBlockSize * 6;
+  size_t unchanged = copy_changed_blocks(
+      dest + offset, src + offset, length, kBlockSize,
+      [&](size_t run_offset, size_t run_length) {
+        runs.emplace_back(run_offset, run_length);
+      });
+  REQUIRE(!std::memcmp(dest + offset, src + offset, length));
+  REQUIRE(runs.size() == 2);
+  REQUIRE(runs[0] == std::make_pair(kBlockSize * 2 - offset, kBlockSize * 2));
+  REQUIRE(runs[1] == std::make_pair(kBlockSize * 6 - offset, kBlockSize));
+  REQUIRE(unchanged == length - kBlockSize * 3);
+
+  // Nothing left to change.
+  runs.clear();
+  REQUIRE(copy_changed_blocks(dest, src, sizeof(src), kBlockSize,
+                              [&](size_t run_offset, size_t run_length) {
+                                runs.emplace_back(run_offset, run_length);
+                              }) == sizeof(src));
+  REQUIRE(runs.empty());
+
+  // A final partial block.
+  src[sizeof(src) - 1] ^= 1;
+  REQUIRE(copy_changed_blocks(dest + kBlockSize * 7, src + kBlockSize * 7,
+                              kBlockSize - 1, kBlockSize,
+                              [&](size_t run_offset, size_t run_length) {
+                                runs.emplace_back(run_offset, run_length);
+                              }) == kBlockSize - 1);
+  REQUIRE(runs.empty());
+  REQUIRE(copy_changed_blocks(dest + kBlockSize * 7, src + kBlockSize * 7,
+                              kBlockSize, kBlockSize,
+                              [&](size_t run_offset, size_t run_length) {
+                                runs.emplace_back(run_offset, run_length);
+                              }) == 0);
+  REQUIRE(runs == decltype(runs){{0, kBlockSize}});
+}
+
+TEST_CASE("copy_changed_blocks benchmark",
+          "[copy_changed_blocks][.benchmark]") {
+  // Streaming the same 16 MiB of texture data over itself, as games do when
+  // reloading a level, with a single page actually differing each time.
+  constexpr size_t kSize = 16 * 1024 * 1024;
+  constexpr size_t kBlockSize = 4096;
+  constexpr int kIterations = 20;
+  std::vector<uint8_t> src(kSize + kBlockSize), dest(kSize + kBlockSize);
+  auto dest_aligned = reinterpret_cast<uint8_t*>(
+      (reinterpret_cast<uintptr_t>(dest.data()) + kBlockSize - 1) &
+      ~uintptr_t(kBlockSize - 1));
+  for (size_t i = 0; i < kSize; ++i) {
+    src[i] = uint8_t(i * 7);
+  }
+
+  size_t invalidated_pages[2] = {};
+  double milliseconds[2];
+  for (int variant = 0; variant < 2; ++variant) {
+    std::memcpy(dest_aligned, src.data(), kSize);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      src[(i % 64) * kBlockSize * 64] ^= 1;
+      if (variant) {
+        copy_changed_blocks(dest_aligned, src.data(), kSize, kBlockSize,
+                            [&](size_t offset, size_t length) {
+                              invalidated_pages[1] += length / kBlockSize;
+                            });
+      } else {
+        std::memcpy(dest_aligned, src.data(), kSize);
+        invalidated_pages[0] += kSize / kBlockSize;
+      }
+    }
+    milliseconds[variant] = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+  }
+  WARN(kIterations << " 16 MiB reads: copying all " << milliseconds[0]
+                   << "ms invalidating " << invalidated_pages[0]
+                   << " pages, copying changes " << milliseconds[1]
+                   << "ms invalidating " << invalidated_pages[1] << " pages");
+}
+
 }  // namespace test
 }  // namespace base
 }  // namespace xe
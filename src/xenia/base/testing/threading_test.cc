@@ -7,7 +7,10 @@
 ******************************************************************************
 */
 
+#include <algorithm>
 #include <array>
+#include <mutex>
+#include <vector>
 
 #include "xenia/base/threading.h"
 
@@ -115,6 +118,15 @@ TEST_CASE("Enable process to set thread affinity") {
   EnableAffinityConfiguration();
 }
 
+TEST_CASE("Query processor topology") {
+  auto processors = QueryProcessorTopology();
+  REQUIRE(!processors.empty());
+  REQUIRE(processors.size() <= logical_processor_count());
+  for (size_t i = 1; i < processors.size(); ++i) {
+    REQUIRE(processors[i - 1].index < processors[i].index);
+  }
+}
+
 TEST_CASE("Yield Current Thread", "[maybe_yield]") {
   // Run to see if there are any errors
   MaybeYield();
@@ -303,6 +315,155 @@ TEST_CASE("HighResolutionTimer") {
   }
 }
 
+TEST_CASE("Timer queue", "[timer_queue]") {
+  using clock = TimerQueueHandle::clock;
+
+  // Fire in due order, including timers far enough out to be cascaded from
+  // the upper levels of the wheel
+  {
+    const std::array<std::chrono::milliseconds, 8> delays = {
+        40ms, 0ms, 300ms, 26ms, 5ms, 120ms, 1ms, 60ms};
+    struct Fired {
+      std::mutex mutex;
+      std::vector<size_t> order;
+      std::vector<bool> early;
+    } fired;
+    std::vector<clock::time_point> due(delays.size());
+    auto start = clock::now();
+    for (size_t i = 0; i < delays.size(); ++i) {
+      due[i] = start + delays[i];
+      QueueTimerOnce(
+          [&fired, &due, i](void*) {
+            std::lock_guard<std::mutex> lock(fired.mutex);
+            fired.order.push_back(i);
+            fired.early.push_back(clock::now() < due[i]);
+          },
+          nullptr, due[i]);
+    }
+    REQUIRE(spin_wait_for(2s, [&] {
+      std::lock_guard<std::mutex> lock(fired.mutex);
+      return fired.order.size() == delays.size();
+    }));
+    REQUIRE(std::is_sorted(
+        fired.order.cbegin(), fired.order.cend(),
+        [&](size_t left, size_t right) { return due[left] < due[right]; }));
+    REQUIRE(std::none_of(fired.early.cbegin(), fired.early.cend(),
+                         [](bool early) { return early; }));
+  }
+
+  // Disarm before the due time, and through a stale handle
+  {
+    std::atomic<uint32_t> counter(0);
+    auto callback = [](void* userdata) {
+      ++*static_cast<std::atomic<uint32_t>*>(userdata);
+    };
+    auto handle = QueueTimerOnce(callback, &counter, clock::now() + 50ms);
+    REQUIRE(handle);
+    handle.Disarm();
+    auto fired = QueueTimerOnce(callback, &counter, clock::now());
+    REQUIRE(spin_wait_for(1s, [&] { return counter == 1; }));
+    // The wait item of the fired timer may have been reused by now.
+    auto reused = QueueTimerOnce(callback, &counter, clock::now() + 20ms);
+    fired.Disarm();
+    handle.Disarm();
+    Sleep(100ms);
+    REQUIRE(counter == 2);
+    reused.Disarm();
+  }
+
+  // Recurring timer disarming itself from its callback
+  {
+    struct State {
+      TimerQueueHandle handle;
+      std::atomic<uint32_t> counter{0};
+    } state;
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    state.handle = QueueTimerRecurring(
+        [&mutex](void* userdata) {
+          auto state = static_cast<State*>(userdata);
+          if (++state->counter == 3) {
+            std::lock_guard<std::mutex> lock(mutex);
+            state->handle.Disarm();
+          }
+        },
+        &state, clock::now(), 5ms);
+    lock.unlock();
+    REQUIRE(spin_wait_for(1s, [&] { return state.counter == 3; }));
+    Sleep(50ms);
+    REQUIRE(state.counter == 3);
+  }
+}
+
+TEST_CASE("Timer queue with many periodic timers",
+          "[timer_queue][.benchmark]") {
+  using clock = TimerQueueHandle::clock;
+  constexpr size_t kTimerCount = 10000;
+  const auto run_time = 2s;
+
+  struct Timer {
+    TimerQueueHandle handle;
+    clock::time_point expected;
+    clock::duration interval;
+    uint64_t fire_count = 0;
+    clock::duration lateness_sum{};
+    clock::duration lateness_max{};
+  };
+  std::vector<Timer> timers(kTimerCount);
+  auto callback = [](void* userdata) {
+    auto& timer = *static_cast<Timer*>(userdata);
+    auto lateness = clock::now() - timer.expected;
+    timer.lateness_sum += lateness;
+    timer.lateness_max = std::max(timer.lateness_max, lateness);
+    ++timer.fire_count;
+    timer.expected += timer.interval;
+  };
+
+  // Periods from 1ms to 64ms, staggered so expirations spread over ticks.
+  auto start = clock::now();
+  for (size_t i = 0; i < kTimerCount; ++i) {
+    auto& timer = timers[i];
+    timer.interval = std::chrono::microseconds(1000 + (i * 6301) % 63000);
+    timer.expected = start + timer.interval;
+    timer.handle =
+        QueueTimerRecurring(callback, &timer, timer.expected, timer.interval);
+  }
+  auto arm_time = clock::now() - start;
+
+  Sleep(run_time);
+
+  auto disarm_start = clock::now();
+  for (auto& timer : timers) {
+    timer.handle.Disarm();
+  }
+  auto disarm_time = clock::now() - disarm_start;
+
+  uint64_t fire_count = 0;
+  clock::duration lateness_sum{};
+  clock::duration lateness_max{};
+  for (const auto& timer : timers) {
+    fire_count += timer.fire_count;
+    lateness_sum += timer.lateness_sum;
+    lateness_max = std::max(lateness_max, timer.lateness_max);
+  }
+  REQUIRE(fire_count);
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  using std::chrono::nanoseconds;
+  WARN(kTimerCount
+       << " periodic timers: arm "
+       << duration_cast<nanoseconds>(arm_time).count() / kTimerCount
+       << "ns/timer, disarm "
+       << duration_cast<nanoseconds>(disarm_time).count() / kTimerCount
+       << "ns/timer, " << fire_count << " callbacks in "
+       << duration_cast<std::chrono::milliseconds>(run_time).count()
+       << "ms, lateness mean "
+       << duration_cast<microseconds>(lateness_sum).count() / fire_count
+       << "us max " << duration_cast<microseconds>(lateness_max).count()
+       << "us");
+}
+
 TEST_CASE("Wait on Multiple Handles", "[wait]") {
   auto mutant = Mutant::Create(true);
   REQUIRE(mutant);
@@ -475,6 +636,62 @@ TEST_CASE("Wait on Multiple Events", "[event]") {
   REQUIRE(order[3] == '3');
 }
 
+TEST_CASE("Wake latency with many idle waiters", "[wait][.benchmark]") {
+  constexpr size_t kIdleWaiterCount = 64;
+  constexpr size_t kRoundTripCount = 10000;
+
+  // Park a large number of threads on objects that are never signaled while
+  // the round trips run, so any wakeup of unrelated waiters shows up as
+  // additional latency.
+  auto idle_stop = Event::CreateManualResetEvent(false);
+  REQUIRE(idle_stop);
+  std::vector<std::unique_ptr<Event>> idle_events;
+  std::vector<std::thread> idle_threads;
+  std::atomic_uint idle_started(0);
+  for (size_t i = 0; i < kIdleWaiterCount; ++i) {
+    idle_events.push_back(Event::CreateAutoResetEvent(false));
+    REQUIRE(idle_events.back());
+  }
+  for (size_t i = 0; i < kIdleWaiterCount; ++i) {
+    idle_threads.emplace_back([&idle_stop, &idle_events, &idle_started, i] {
+      idle_started++;
+      WaitAny({idle_events[i].get(), idle_stop.get()}, false);
+    });
+  }
+  REQUIRE(spin_wait_for(1s, [&] { return idle_started == kIdleWaiterCount; }));
+
+  auto ping = Event::CreateAutoResetEvent(false);
+  auto pong = Event::CreateAutoResetEvent(false);
+  REQUIRE(ping);
+  REQUIRE(pong);
+  auto echo = std::thread([&ping, &pong] {
+    for (size_t i = 0; i < kRoundTripCount; ++i) {
+      REQUIRE(Wait(ping.get(), false, 1s) == WaitResult::kSuccess);
+      pong->Set();
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kRoundTripCount; ++i) {
+    ping->Set();
+    REQUIRE(Wait(pong.get(), false, 1s) == WaitResult::kSuccess);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  echo.join();
+
+  idle_stop->Set();
+  for (auto& t : idle_threads) {
+    t.join();
+  }
+
+  auto round_trip_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+      kRoundTripCount;
+  WARN("Average wake round trip with " << kIdleWaiterCount
+                                       << " idle waiters: " << round_trip_ns
+                                       << "ns");
+}
+
 TEST_CASE("Wait on Semaphore", "[semaphore]") {
   WaitResult result;
   std::unique_ptr<Semaphore> sem;
@@ -844,6 +1061,27 @@ TEST_CASE("Wait on Timer", "[timer]") {
   REQUIRE(result == WaitResult::kSuccess);  // Signal from Set Once
   result = Wait(timer.get(), false, 20ms);
   REQUIRE(result == WaitResult::kTimeout);  // No more signals from repeating
+
+  // Disarm, unlike Cancel, resets a signaled timer
+  timer = Timer::CreateManualResetTimer();
+  REQUIRE(timer->SetOnceAfter(1ms));
+  result = Wait(timer.get(), false, 20ms);
+  REQUIRE(result == WaitResult::kSuccess);
+  REQUIRE(timer->Cancel());
+  result = Wait(timer.get(), false, 1ms);
+  REQUIRE(result == WaitResult::kSuccess);  // Still signaled
+  REQUIRE(timer->Disarm());
+  result = Wait(timer.get(), false, 1ms);
+  REQUIRE(result == WaitResult::kTimeout);
+  // And stops it before it is due
+  REQUIRE(timer->SetRepeatingAfter(5ms, 5ms));
+  REQUIRE(timer->Disarm());
+  result = Wait(timer.get(), false, 30ms);
+  REQUIRE(result == WaitResult::kTimeout);
+  // Until it is set again
+  REQUIRE(timer->SetOnceAfter(1ms));
+  result = Wait(timer.get(), false, 20ms);
+  REQUIRE(result == WaitResult::kSuccess);
 }
 
 TEST_CASE("Wait on Multiple Timers", "[timer]") {
@@ -1000,6 +1238,18 @@ TEST_CASE("Create and Run Thread", "[thread]") {
     REQUIRE(result == WaitResult::kSuccess);
   }
 
+  SECTION("Query CPU time of a running thread") {
+    fence = 0;
+    thread = Thread::Create(params, [&fence] {
+      while (fence == 0) {
+      }
+    });
+    REQUIRE(spin_wait_for(1s, [&] { return thread->QueryCpuTime() > 0ns; }));
+    fence++;
+    result = Wait(thread.get(), false, 1s);
+    REQUIRE(result == WaitResult::kSuccess);
+  }
+
   // TODO(bwrsandman): Test with different priorities
   // TODO(bwrsandman): Test setting and getting thread affinity
 }
@@ -90,6 +90,24 @@ class Fence {
 // Returns the total number of logical processors in the host system.
 uint32_t logical_processor_count();
 
+// Describes one logical processor of the host system.
+struct ProcessorInfo {
+  // Logical processor number, as used in affinity masks.
+  uint32_t index;
+  // Physical core the processor belongs to. Logical processors sharing a core
+  // (SMT siblings) have the same core_id and package_id.
+  uint32_t core_id;
+  uint32_t package_id;
+  // Relative performance of the core, higher is faster. Only meaningful for
+  // comparing processors of the same host (big/little cores); 0 if unknown.
+  uint32_t capacity;
+};
+
+// Queries the topology of the logical processors available to the process,
+// ordered by index. Processors the topology can't be determined for are
+// reported as cores of their own.
+std::vector<ProcessorInfo> QueryProcessorTopology();
+
 // Enables the current process to set thread affinity.
 // Must be called at startup before attempting to set thread affinity.
 void EnableAffinityConfiguration();
@@ -154,15 +172,11 @@ class HighResolutionTimer {
     assert_not_null(callback);
     wait_item_ = QueueTimerRecurring(
         [callback = std::move(callback)](void*) { callback(); }, nullptr,
-        TimerQueueWaitItem::clock::now(), interval);
+        TimerQueueHandle::clock::now(), interval);
   }
 
  public:
-  ~HighResolutionTimer() {
-    if (auto wait_item = wait_item_.lock()) {
-      wait_item->Disarm();
-    }
-  }
+  ~HighResolutionTimer() { wait_item_.Disarm(); }
 
   // Creates a new repeating timer with the given period.
   // The given function will be called back as close to the given period as
@@ -174,7 +188,7 @@ class HighResolutionTimer {
   }
 
  private:
-  std::weak_ptr<TimerQueueWaitItem> wait_item_;
+  TimerQueueHandle wait_item_;
 };
 
 // Results for a WaitHandle operation.
@@ -387,6 +401,11 @@ class Timer : public WaitHandle {
   // remains in that state.
   // Returns true on success.
   virtual bool Cancel() = 0;
+
+  // Stops the timer like Cancel(), but also sets it to the nonsignaled state,
+  // in which it stays until it is activated again.
+  // Returns true on success.
+  virtual bool Disarm() = 0;
 };
 
 struct ThreadPriority {
@@ -395,6 +414,10 @@ struct ThreadPriority {
   static const int32_t kNormal = 0;
   static const int32_t kAboveNormal = 1;
   static const int32_t kHighest = 2;
+  // Realtime scheduling (SCHED_RR / time critical), for host threads with hard
+  // deadlines. May be refused by the host, in which case the priority is left
+  // unchanged.
+  static const int32_t kRealtime = 3;
 };
 
 // Models a Win32-like thread object.
@@ -446,6 +469,9 @@ class Thread : public WaitHandle {
   // process of a thread.
   virtual void set_affinity_mask(uint64_t new_affinity_mask) = 0;
 
+  // Returns the processor time consumed by the thread so far.
+  virtual std::chrono::nanoseconds QueryCpuTime() = 0;
+
   // Adds a user-mode asynchronous procedure call request to the thread queue.
   // When a user-mode APC is queued, the thread is not directed to call the APC
   // function unless it is in an alertable state. After the thread is in an
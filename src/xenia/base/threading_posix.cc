@@ -18,6 +18,7 @@
 #include <sched.h>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -25,7 +26,9 @@
 #include <array>
 #include <cstddef>
 #include <ctime>
+#include <fstream>
 #include <memory>
+#include <string>
 
 #if XE_PLATFORM_ANDROID
 #include <dlfcn.h>
@@ -132,6 +135,51 @@ void install_signal_handler(SignalType type) {
 // TODO(dougvj)
 void EnableAffinityConfiguration() {}
 
+static bool ReadSysfsValue(const std::string& path, uint32_t* value_out) {
+  std::ifstream file(path);
+  uint64_t value;
+  if (!(file >> value)) {
+    return false;
+  }
+  *value_out = static_cast<uint32_t>(value);
+  return true;
+}
+
+std::vector<ProcessorInfo> QueryProcessorTopology() {
+  std::vector<ProcessorInfo> processors;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0) {
+    for (uint32_t i = 0; i < logical_processor_count(); ++i) {
+      CPU_SET(i, &cpu_set);
+    }
+  }
+  for (uint32_t i = 0; i < CPU_SETSIZE; ++i) {
+    if (!CPU_ISSET(i, &cpu_set)) {
+      continue;
+    }
+    ProcessorInfo info = {i, i, 0, 0};
+    std::string cpu_path = "/sys/devices/system/cpu/cpu" + std::to_string(i);
+    uint32_t core_id;
+    if (ReadSysfsValue(cpu_path + "/topology/core_id", &core_id)) {
+      // Core IDs are only unique within a package.
+      ReadSysfsValue(cpu_path + "/topology/physical_package_id",
+                     &info.package_id);
+      info.core_id = core_id;
+    } else {
+      // Treat it as a core of its own, in a package no real core is in.
+      info.package_id = UINT32_MAX;
+    }
+    // cpu_capacity is provided on asymmetric (big.LITTLE) hosts, otherwise the
+    // maximum frequency is the best indication of a faster core.
+    if (!ReadSysfsValue(cpu_path + "/cpu_capacity", &info.capacity)) {
+      ReadSysfsValue(cpu_path + "/cpufreq/cpuinfo_max_freq", &info.capacity);
+    }
+    processors.push_back(info);
+  }
+  return processors;
+}
+
 // uint64_t ticks() { return mach_absolute_time(); }
 
 uint32_t current_thread_system_id() {
@@ -190,93 +238,114 @@ bool SetTlsValue(TlsHandle handle, uintptr_t value) {
                              reinterpret_cast<void*>(value)) == 0;
 }
 
+// Every blocked thread parks on its own Waiter which is registered with each
+// object it is waiting on, so signaling an object only wakes the threads that
+// are actually waiting for it instead of every waiter in the process. The
+// mutex is still shared by all objects so that WaitAll can test and acquire
+// several objects atomically.
 class PosixConditionBase {
  public:
+  struct Waiter {
+    std::condition_variable cond;
+  };
+
   virtual bool Signal() = 0;
 
   WaitResult Wait(std::chrono::milliseconds timeout) {
-    bool executed;
-    auto predicate = [this] { return this->signaled(); };
-    auto lock = std::unique_lock<std::mutex>(mutex_);
-    if (predicate()) {
-      executed = true;
-    } else {
-      if (timeout == std::chrono::milliseconds::max()) {
-        cond_.wait(lock, predicate);
-        executed = true;  // Did not time out;
-      } else {
-        executed = cond_.wait_for(lock, timeout, predicate);
-      }
-    }
-    if (executed) {
-      post_execution();
-      return WaitResult::kSuccess;
-    } else {
-      return WaitResult::kTimeout;
-    }
+    PosixConditionBase* handle = this;
+    return WaitOn(&handle, 1, false, timeout).first;
   }
 
   static std::pair<WaitResult, size_t> WaitMultiple(
       std::vector<PosixConditionBase*>&& handles, bool wait_all,
       std::chrono::milliseconds timeout) {
-    assert_true(handles.size() > 0);
+    return WaitOn(handles.data(), handles.size(), wait_all, timeout);
+  }
 
-    // Construct a condition for all or any depending on wait_all
-    std::function<bool()> predicate;
-    {
-      using iter_t = std::vector<PosixConditionBase*>::const_iterator;
-      const auto predicate_inner = [](auto h) { return h->signaled(); };
-      const auto operation =
-          wait_all ? std::all_of<iter_t, decltype(predicate_inner)>
-                   : std::any_of<iter_t, decltype(predicate_inner)>;
-      predicate = [&handles, operation, predicate_inner] {
-        return operation(handles.cbegin(), handles.cend(), predicate_inner);
-      };
+  virtual void* native_handle() const {
+    return const_cast<PosixConditionBase*>(this);
+  }
+
+ protected:
+  inline virtual bool signaled() const = 0;
+  inline virtual void post_execution() = 0;
+
+  // Wakes the threads blocked on this object. Must be called with mutex_ held.
+  void NotifyWaiters() {
+    for (Waiter* waiter : waiters_) {
+      waiter->cond.notify_one();
     }
+  }
+
+  static std::mutex mutex_;
+
+ private:
+  static std::pair<WaitResult, size_t> WaitOn(
+      PosixConditionBase* const* handles, size_t handle_count, bool wait_all,
+      std::chrono::milliseconds timeout) {
+    assert_true(handle_count > 0);
+
+    auto predicate = [handles, handle_count, wait_all] {
+      for (size_t i = 0; i < handle_count; ++i) {
+        if (handles[i]->signaled() != wait_all) {
+          return !wait_all;
+        }
+      }
+      return wait_all;
+    };
 
     // TODO(bwrsandman, Triang3l) This is controversial, see issue #1677
     // This will probably cause a deadlock on the next thread doing any waiting
     // if the thread is suspended between locking and waiting
-    std::unique_lock<std::mutex> lock(PosixConditionBase::mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
 
     bool wait_success = true;
-    // If the timeout is infinite, wait without timeout.
-    // The predicate will be checked before beginning the wait
-    if (timeout == std::chrono::milliseconds::max()) {
-      PosixConditionBase::cond_.wait(lock, predicate);
-    } else {
-      // Wait with timeout.
-      wait_success =
-          PosixConditionBase::cond_.wait_for(lock, timeout, predicate);
+    if (!predicate()) {
+      Waiter waiter;
+      for (size_t i = 0; i < handle_count; ++i) {
+        handles[i]->waiters_.push_back(&waiter);
+      }
+      // If the timeout is infinite, wait without timeout.
+      if (timeout == std::chrono::milliseconds::max()) {
+        waiter.cond.wait(lock, predicate);
+      } else {
+        wait_success = waiter.cond.wait_until(
+            lock, std::chrono::steady_clock::now() + timeout, predicate);
+      }
+      for (size_t i = 0; i < handle_count; ++i) {
+        handles[i]->RemoveWaiter(&waiter);
+      }
     }
-    if (wait_success) {
-      auto first_signaled = std::numeric_limits<size_t>::max();
-      for (auto i = 0u; i < handles.size(); ++i) {
-        if (handles[i]->signaled()) {
-          if (first_signaled > i) {
-            first_signaled = i;
-          }
-          handles[i]->post_execution();
-          if (!wait_all) break;
+    if (!wait_success) {
+      return std::make_pair<WaitResult, size_t>(WaitResult::kTimeout, 0);
+    }
+
+    auto first_signaled = std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i < handle_count; ++i) {
+      if (handles[i]->signaled()) {
+        if (first_signaled > i) {
+          first_signaled = i;
         }
+        handles[i]->post_execution();
+        if (!wait_all) break;
       }
-      assert_true(std::numeric_limits<size_t>::max() != first_signaled);
-      return std::make_pair(WaitResult::kSuccess, first_signaled);
-    } else {
-      return std::make_pair<WaitResult, size_t>(WaitResult::kTimeout, 0);
     }
+    assert_true(std::numeric_limits<size_t>::max() != first_signaled);
+    return std::make_pair(WaitResult::kSuccess, first_signaled);
   }
 
-  virtual void* native_handle() const { return cond_.native_handle(); }
+  void RemoveWaiter(Waiter* waiter) {
+    auto it = std::find(waiters_.begin(), waiters_.end(), waiter);
+    if (it != waiters_.end()) {
+      *it = waiters_.back();
+      waiters_.pop_back();
+    }
+  }
 
- protected:
-  inline virtual bool signaled() const = 0;
-  inline virtual void post_execution() = 0;
-  static std::condition_variable cond_;
-  static std::mutex mutex_;
+  // Threads currently blocked on this object, guarded by mutex_.
+  std::vector<Waiter*> waiters_;
 };
 
-std::condition_variable PosixConditionBase::cond_;
 std::mutex PosixConditionBase::mutex_;
 
 // There really is no native POSIX handle for a single wait/signal construct
@@ -296,7 +365,7 @@ class PosixCondition<Event> : public PosixConditionBase {
   bool Signal() override {
     auto lock = std::unique_lock<std::mutex>(mutex_);
     signal_ = true;
-    cond_.notify_all();
+    NotifyWaiters();
     return true;
   }
 
@@ -329,7 +398,7 @@ class PosixCondition<Semaphore> : public PosixConditionBase {
       auto lock = std::unique_lock<std::mutex>(mutex_);
       if (out_previous_count) *out_previous_count = count_;
       count_ += release_count;
-      cond_.notify_all();
+      NotifyWaiters();
       return true;
     }
     return false;
@@ -337,10 +406,7 @@ class PosixCondition<Semaphore> : public PosixConditionBase {
 
  private:
   inline bool signaled() const override { return count_ > 0; }
-  inline void post_execution() override {
-    count_--;
-    cond_.notify_all();
-  }
+  inline void post_execution() override { count_--; }
   uint32_t count_;
   const uint32_t maximum_count_;
 };
@@ -363,7 +429,7 @@ class PosixCondition<Mutant> : public PosixConditionBase {
       --count_;
       // Free to be acquired by another thread
       if (count_ == 0) {
-        cond_.notify_all();
+        NotifyWaiters();
       }
       return true;
     }
@@ -395,7 +461,7 @@ class PosixCondition<Timer> : public PosixConditionBase {
   bool Signal() override {
     std::lock_guard<std::mutex> lock(mutex_);
     signal_ = true;
-    cond_.notify_all();
+    NotifyWaiters();
     return true;
   }
 
@@ -423,10 +489,15 @@ class PosixCondition<Timer> : public PosixConditionBase {
         QueueTimerRecurring(&CompletionRoutine, this, due_time, period);
   }
 
-  void Cancel() {
-    if (auto wait_item = wait_item_.lock()) {
-      wait_item->Disarm();
-    }
+  void Cancel() { wait_item_.Disarm(); }
+
+  void Disarm() {
+    Cancel();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    callback_ = nullptr;
+    signal_ = false;
   }
 
   void* native_handle() const override {
@@ -457,7 +528,7 @@ class PosixCondition<Timer> : public PosixConditionBase {
       signal_ = false;
     }
   }
-  std::weak_ptr<TimerQueueWaitItem> wait_item_;
+  TimerQueueHandle wait_item_;
   std::function<void()> callback_;
   volatile bool signal_;
   const bool manual_reset_;
@@ -617,8 +688,9 @@ class PosixCondition<Thread> : public PosixConditionBase {
     uint64_t result = 0;
     auto cpu_count = std::min(CPU_SETSIZE, 64);
     for (auto i = 0u; i < cpu_count; i++) {
-      auto set = CPU_ISSET(i, &cpu_set);
-      result |= set << i;
+      if (CPU_ISSET(i, &cpu_set)) {
+        result |= uint64_t(1) << i;
+      }
     }
     return result;
   }
@@ -628,7 +700,7 @@ class PosixCondition<Thread> : public PosixConditionBase {
     cpu_set_t cpu_set;
     CPU_ZERO(&cpu_set);
     for (auto i = 0u; i < 64; i++) {
-      if (mask & (1 << i)) {
+      if (mask & (uint64_t(1) << i)) {
         CPU_SET(i, &cpu_set);
       }
     }
@@ -646,22 +718,42 @@ class PosixCondition<Thread> : public PosixConditionBase {
 
   int priority() {
     WaitStarted();
-    int policy;
-    sched_param param{};
-    int ret = pthread_getschedparam(thread_, &policy, &param);
-    if (ret != 0) {
-      return -1;
-    }
-
-    return param.sched_priority;
+    return priority_;
   }
 
   void set_priority(int new_priority) {
     WaitStarted();
+    // Realtime priority needs CAP_SYS_NICE or an RLIMIT_RTPRIO allowance, and
+    // raising the nice value above normal is similarly restricted. Failures
+    // leave the thread as it was.
     sched_param param{};
-    param.sched_priority = new_priority;
-    if (pthread_setschedparam(thread_, SCHED_FIFO, &param) != 0)
-      assert_always();
+    int policy = SCHED_OTHER;
+    if (new_priority >= ThreadPriority::kRealtime) {
+      policy = SCHED_RR;
+      param.sched_priority = sched_get_priority_min(SCHED_RR);
+    }
+    if (pthread_setschedparam(thread_, policy, &param) != 0) {
+      return;
+    }
+    // Under SCHED_OTHER the relative priority is the per-thread nice value,
+    // spread over the same range as Windows thread priorities.
+    if (policy == SCHED_OTHER && tid_ &&
+        setpriority(PRIO_PROCESS, tid_, -5 * new_priority) != 0) {
+      return;
+    }
+    priority_ = new_priority;
+  }
+
+  std::chrono::nanoseconds QueryCpuTime() {
+    WaitStarted();
+    clockid_t clock_id;
+    timespec ts;
+    if (pthread_getcpuclockid(thread_, &clock_id) != 0 ||
+        clock_gettime(clock_id, &ts) != 0) {
+      return std::chrono::nanoseconds::zero();
+    }
+    return std::chrono::seconds(ts.tv_sec) +
+           std::chrono::nanoseconds(ts.tv_nsec);
   }
 
   void QueueUserCallback(std::function<void()> callback) {
@@ -739,7 +831,7 @@ class PosixCondition<Thread> : public PosixConditionBase {
 
       exit_code_ = exit_code;
       signaled_ = true;
-      cond_.notify_all();
+      NotifyWaiters();
     }
     if (is_current_thread) {
       pthread_exit(reinterpret_cast<void*>(exit_code));
@@ -783,6 +875,9 @@ class PosixCondition<Thread> : public PosixConditionBase {
     }
   }
   pthread_t thread_;
+  // Kernel thread ID, 0 if the thread wasn't started by us.
+  pid_t tid_ = 0;
+  int priority_ = ThreadPriority::kNormal;
   bool signaled_;
   int exit_code_;
   volatile State state_;
@@ -1003,6 +1098,10 @@ class PosixTimer : public PosixConditionHandle<Timer> {
     handle_.Cancel();
     return true;
   }
+  bool Disarm() override {
+    handle_.Disarm();
+    return true;
+  }
 };
 
 std::unique_ptr<Timer> Timer::CreateManualResetTimer() {
@@ -1047,6 +1146,10 @@ class PosixThread : public PosixConditionHandle<Thread> {
     handle_.set_priority(new_priority);
   }
 
+  std::chrono::nanoseconds QueryCpuTime() override {
+    return handle_.QueryCpuTime();
+  }
+
   void QueueUserCallback(std::function<void()> callback) override {
     handle_.QueueUserCallback(std::move(callback));
   }
@@ -1086,6 +1189,7 @@ void* PosixCondition<Thread>::ThreadStartRoutine(void* parameter) {
   current_thread_ = thread;
   {
     std::unique_lock<std::mutex> lock(thread->handle_.state_mutex_);
+    thread->handle_.tid_ = static_cast<pid_t>(current_thread_system_id());
     thread->handle_.state_ =
         create_suspended ? State::kSuspended : State::kRunning;
     thread->handle_.state_signal_.notify_all();
@@ -1108,7 +1212,7 @@ void* PosixCondition<Thread>::ThreadStartRoutine(void* parameter) {
   std::unique_lock<std::mutex> lock(mutex_);
   thread->handle_.exit_code_ = 0;
   thread->handle_.signaled_ = true;
-  cond_.notify_all();
+  thread->handle_.NotifyWaiters();
 
   current_thread_ = nullptr;
   return nullptr;
@@ -8,205 +8,387 @@
  */
 
 #include <algorithm>
-#include <forward_list>
-
-#include "third_party/disruptorplus/include/disruptorplus/multi_threaded_claim_strategy.hpp"
-#include "third_party/disruptorplus/include/disruptorplus/ring_buffer.hpp"
-#include "third_party/disruptorplus/include/disruptorplus/sequence_barrier.hpp"
-#include "third_party/disruptorplus/include/disruptorplus/spin_wait.hpp"
-#include "third_party/disruptorplus/include/disruptorplus/spin_wait_strategy.hpp"
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/math.h"
 #include "xenia/base/threading.h"
 #include "xenia/base/threading_timer_queue.h"
 
-namespace dp = disruptorplus;
-
 namespace xe {
 namespace threading {
 
+struct TimerQueueWaitItem {
+  enum class State : uint8_t {
+    kFree = 0,              // In the pool
+    kIdle,                  // Waiting for the due time or in the expired batch
+    kInCallback,            // Callback is being executed
+    kInCallbackDisarmed,    // Callback is being executed and was disarmed
+  };
+
+  std::function<void(void*)> callback;
+  void* userdata = nullptr;
+  TimerQueueHandle::clock::time_point due;
+  TimerQueueHandle::clock::duration interval;  // zero if not recurring
+  uint64_t tick = 0;
+
+  // Intrusive list links: wheel slot, overflow list, expired batch or the free
+  // list of the pool. pprev points at the next field of the previous item or
+  // at the list head, so unlinking needs no search.
+  TimerQueueWaitItem* next = nullptr;
+  TimerQueueWaitItem** pprev = nullptr;
+  uint32_t list = 0;
+
+  // Incremented whenever the item goes back to the pool, invalidating handles.
+  uint32_t generation = 0;
+  State state = State::kFree;
+};
+
 using WaitItem = TimerQueueWaitItem;
 
+// Hierarchical timing wheel (Varghese & Lauck). Level 0 has one slot per tick,
+// each level above it one slot per full rotation of the level below. A timer is
+// placed on the lowest level on which its expiry tick shares all higher digits
+// with the current tick, and is cascaded one level down when the wheel enters
+// its slot, so arming and cancelling are O(1) and a timer is moved at most
+// kLevels times before it fires. Timers too far out for the top level wait in
+// an overflow list that is reinserted once per top level rotation.
 class TimerQueue {
  public:
-  using clock = WaitItem::clock;
+  using clock = TimerQueueHandle::clock;
   static_assert(clock::is_steady);
 
- public:
-  TimerQueue()
-      : buffer_(kWaitCount),
-        wait_strategy_(),
-        claim_strategy_(kWaitCount, wait_strategy_),
-        consumed_(wait_strategy_),
-        shutdown_(false) {
-    claim_strategy_.add_claim_barrier(consumed_);
+  TimerQueue() : current_tick_(FloorTick(clock::now())) {
+    std::fill(std::begin(heads_), std::end(heads_), nullptr);
+    expired_tail_ = &heads_[kExpiredList];
     dispatch_thread_ = std::thread(&TimerQueue::TimerThreadMain, this);
   }
 
   ~TimerQueue() {
-    shutdown_.store(true, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    wake_cv_.notify_one();
+    dispatch_thread_.join();
+  }
 
-    // Kick dispatch thread to check shutdown flag
-    auto wait_item = std::make_shared<WaitItem>(nullptr, nullptr, this,
-                                                clock::time_point::min(),
-                                                clock::duration::zero());
-    wait_item->Disarm();
-    QueueTimer(std::move(wait_item));
+  TimerQueueHandle QueueTimer(std::function<void(void*)> callback,
+                              void* userdata, clock::time_point due,
+                              clock::duration interval) {
+    assert_not_null(callback);
+    // Mitigate callback flooding
+    due = std::max(clock::now() - interval, due);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    WaitItem* item = Allocate();
+    item->callback = std::move(callback);
+    item->userdata = userdata;
+    item->due = due;
+    item->interval = interval;
+    item->tick = CeilTick(due);
+    item->state = WaitItem::State::kIdle;
+    Insert(item);
+    // Only wake the dispatch thread if it sleeps past the new expiry.
+    if (item->tick < wake_tick_) {
+      wake_cv_.notify_one();
+    }
+    return TimerQueueHandle(item, item->generation);
+  }
 
-    dispatch_thread_.join();
+  void Disarm(WaitItem* item, uint32_t generation) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (item->generation != generation) {
+      // Already fired for the last time or disarmed.
+      return;
+    }
+    if (item->state == WaitItem::State::kIdle) {
+      Unlink(item);
+      Free(item);
+      return;
+    }
+    item->state = WaitItem::State::kInCallbackDisarmed;
+    // Special case for calling from a callback itself: the dispatch thread
+    // frees the item once the callback returns.
+    if (std::this_thread::get_id() == dispatch_thread_.get_id()) {
+      return;
+    }
+    // Classes which hold wait items will often disarm them during destruction.
+    // This may lead to race conditions when the dispatch thread executes a
+    // callback which accesses memory that is freed simultaneously due to this.
+    // Therefore, we need to guarantee that no callbacks will be running once
+    // Disarm() has returned.
+    callback_done_cv_.wait(
+        lock, [item, generation] { return item->generation != generation; });
   }
 
-  void TimerThreadMain() {
-    dp::sequence_t next_sequence = 0;
-    const auto comp = [](const std::shared_ptr<WaitItem>& left,
-                         const std::shared_ptr<WaitItem>& right) {
-      return left->due_ < right->due_;
-    };
+ private:
+  // 100us ticks: level 0 spans 25.6ms, level 1 6.5s, level 2 28min and level 3
+  // about 5 days.
+  using Tick = std::chrono::duration<int64_t, std::ratio<1, 10000>>;
+  static constexpr uint32_t kLevels = 4;
+  static constexpr uint32_t kSlotBits = 8;
+  static constexpr uint32_t kSlotCount = 1 << kSlotBits;
+  static constexpr uint32_t kSlotMask = kSlotCount - 1;
+  static constexpr uint32_t kWheelBits = kLevels * kSlotBits;
+  static constexpr uint32_t kOverflowList = kLevels * kSlotCount;
+  static constexpr uint32_t kExpiredList = kOverflowList + 1;
+  static constexpr uint32_t kFreeList = kOverflowList + 2;
+  static constexpr uint32_t kListCount = kOverflowList + 3;
+  static constexpr uint64_t kNoTick = std::numeric_limits<uint64_t>::max();
+  static constexpr size_t kPoolChunkSize = 256;
+
+  static uint64_t FloorTick(clock::time_point time) {
+    return uint64_t(std::chrono::floor<Tick>(time.time_since_epoch()).count());
+  }
+  static uint64_t CeilTick(clock::time_point time) {
+    return uint64_t(std::chrono::ceil<Tick>(time.time_since_epoch()).count());
+  }
+  static clock::time_point TickTime(uint64_t tick) {
+    return clock::time_point(
+        std::chrono::duration_cast<clock::duration>(Tick(int64_t(tick))));
+  }
 
+  void TimerThreadMain() {
     xe::threading::set_name("xe::threading::TimerQueue");
 
-    while (!shutdown_.load(std::memory_order_relaxed)) {
-      {
-        // Consume new wait items and add them to sorted wait queue
-        dp::sequence_t available = claim_strategy_.wait_until_published(
-            next_sequence, next_sequence - 1,
-            wait_queue_.empty() ? clock::time_point::max()
-                                : wait_queue_.front()->due_);
-
-        // Check for timeout
-        if (available != next_sequence - 1) {
-          std::forward_list<std::shared_ptr<WaitItem>> wait_items;
-          do {
-            wait_items.push_front(std::move(buffer_[next_sequence]));
-          } while (next_sequence++ != available);
-
-          consumed_.publish(available);
-
-          wait_items.sort(comp);
-          wait_queue_.merge(wait_items, comp);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!shutdown_) {
+      CollectExpired(FloorTick(clock::now()));
+
+      // Invoke callbacks for the whole batch and reschedule. The lock is only
+      // dropped around the callback itself, which may arm and disarm timers.
+      while (WaitItem* item = heads_[kExpiredList]) {
+        Unlink(item);
+        item->state = WaitItem::State::kInCallback;
+        lock.unlock();
+        // Possibility to dispatch to a thread pool here
+        item->callback(item->userdata);
+        lock.lock();
+        if (item->interval != clock::duration::zero() &&
+            item->state == WaitItem::State::kInCallback) {
+          // Item is recurring and wasn't disarmed during the callback.
+          item->due += item->interval;
+          item->tick = CeilTick(item->due);
+          item->state = WaitItem::State::kIdle;
+          Insert(item);
+        } else {
+          bool waited_on = item->state == WaitItem::State::kInCallbackDisarmed;
+          Free(item);
+          if (waited_on) {
+            callback_done_cv_.notify_all();
+          }
         }
       }
 
-      {
-        // Check wait queue, invoke callbacks and reschedule
-        std::forward_list<std::shared_ptr<WaitItem>> wait_items;
-        while (!wait_queue_.empty() &&
-               wait_queue_.front()->due_ <= clock::now()) {
-          auto wait_item = std::move(wait_queue_.front());
-          wait_queue_.pop_front();
-
-          // Ensure that it isn't disarmed
-          auto state = WaitItem::State::kIdle;
-          if (wait_item->state_.compare_exchange_strong(
-                  state, WaitItem::State::kInCallback,
-                  std::memory_order_acq_rel)) {
-            // Possibility to dispatch to a thread pool here
-            assert_not_null(wait_item->callback_);
-            wait_item->callback_(wait_item->userdata_);
-
-            if (wait_item->interval_ != clock::duration::zero() &&
-                wait_item->state_.load(std::memory_order_acquire) !=
-                    WaitItem::State::kInCallbackSelfDisarmed) {
-              // Item is recurring and didn't self-disarm during callback:
-              wait_item->due_ += wait_item->interval_;
-              wait_item->state_.store(WaitItem::State::kIdle,
-                                      std::memory_order_release);
-              wait_items.push_front(std::move(wait_item));
-            } else {
-              wait_item->state_.store(WaitItem::State::kDisarmed,
-                                      std::memory_order_release);
-            }
-          } else {
-            // Specifically, kInCallback is illegal here
-            assert_true(WaitItem::State::kDisarmed == state);
-          }
-        }
-        wait_items.sort(comp);
-        wait_queue_.merge(wait_items, comp);
+      uint64_t next_tick = NextTick();
+      wake_tick_ = next_tick;
+      if (next_tick == kNoTick) {
+        wake_cv_.wait(lock);
+      } else {
+        wake_cv_.wait_until(lock, TickTime(next_tick));
       }
+      wake_tick_ = 0;
     }
   }
 
-  std::weak_ptr<WaitItem> QueueTimer(std::shared_ptr<WaitItem> wait_item) {
-    auto wait_item_weak = std::weak_ptr<WaitItem>(wait_item);
+  WaitItem* Allocate() {
+    WaitItem* item = heads_[kFreeList];
+    if (!item) {
+      auto chunk = std::make_unique<WaitItem[]>(kPoolChunkSize);
+      for (size_t i = 0; i < kPoolChunkSize; ++i) {
+        Link(&chunk[i], kFreeList);
+      }
+      pool_.push_back(std::move(chunk));
+      item = heads_[kFreeList];
+    }
+    Unlink(item);
+    return item;
+  }
 
-    // Mitigate callback flooding
-    wait_item->due_ =
-        std::max(clock::now() - wait_item->interval_, wait_item->due_);
+  void Free(WaitItem* item) {
+    item->callback = nullptr;
+    item->userdata = nullptr;
+    item->state = WaitItem::State::kFree;
+    ++item->generation;
+    Link(item, kFreeList);
+  }
 
-    auto sequence = claim_strategy_.claim_one();
-    buffer_[sequence] = std::move(wait_item);
-    claim_strategy_.publish(sequence);
+  void Link(WaitItem* item, uint32_t list) {
+    WaitItem*& head = heads_[list];
+    item->next = head;
+    if (head) {
+      head->pprev = &item->next;
+    }
+    head = item;
+    item->pprev = &head;
+    item->list = list;
+    if (list < kOverflowList) {
+      occupied_[list >> 6] |= uint64_t(1) << (list & 63);
+    }
+  }
 
-    return wait_item_weak;
+  void Unlink(WaitItem* item) {
+    *item->pprev = item->next;
+    if (item->next) {
+      item->next->pprev = item->pprev;
+    } else if (item->list == kExpiredList) {
+      expired_tail_ = item->pprev;
+    }
+    if (item->list < kOverflowList && !heads_[item->list]) {
+      occupied_[item->list >> 6] &= ~(uint64_t(1) << (item->list & 63));
+    }
+    item->next = nullptr;
+    item->pprev = nullptr;
   }
 
-  const std::thread& dispatch_thread() const { return dispatch_thread_; }
+  // Appends to the expired batch, keeping it in expiry order.
+  void AppendExpired(WaitItem* item) {
+    item->next = nullptr;
+    item->pprev = expired_tail_;
+    item->list = kExpiredList;
+    *expired_tail_ = item;
+    expired_tail_ = &item->next;
+  }
 
- private:
-  // This ring buffer will be used to introduce timers queued by the public API
-  static constexpr size_t kWaitCount = 512;
-  dp::ring_buffer<std::shared_ptr<WaitItem>> buffer_;
-  dp::spin_wait_strategy wait_strategy_;
-  dp::multi_threaded_claim_strategy<dp::spin_wait_strategy> claim_strategy_;
-  dp::sequence_barrier<dp::spin_wait_strategy> consumed_;
-
-  // This is a _sorted_ (ascending due_) list of active timers managed by a
-  // dedicated thread
-  std::forward_list<std::shared_ptr<WaitItem>> wait_queue_;
-  std::atomic_bool shutdown_;
-  std::thread dispatch_thread_;
-};
+  void Insert(WaitItem* item) {
+    item->tick = std::max(item->tick, current_tick_);
+    uint64_t diff = item->tick ^ current_tick_;
+    uint32_t level =
+        diff ? (63 - xe::lzcnt(diff)) / kSlotBits : 0;
+    if (level >= kLevels) {
+      Link(item, kOverflowList);
+      return;
+    }
+    uint32_t slot = uint32_t(item->tick >> (level * kSlotBits)) & kSlotMask;
+    Link(item, level * kSlotCount + slot);
+  }
 
-xe::threading::TimerQueue timer_queue_;
+  // Returns the first occupied slot of a level at or after first, or
+  // kSlotCount.
+  uint32_t FindOccupiedSlot(uint32_t level, uint32_t first) const {
+    for (uint32_t i = first; i < kSlotCount; i = (i | 63) + 1) {
+      uint64_t bits = occupied_[(level * kSlotCount + i) >> 6] >> (i & 63);
+      if (bits) {
+        return i + xe::tzcnt(bits);
+      }
+    }
+    return kSlotCount;
+  }
 
-void TimerQueueWaitItem::Disarm() {
-  State state;
+  // Earliest tick at which a timer expires or has to be cascaded. The wheel
+  // is empty between the current tick and the returned one.
+  uint64_t NextTick() const {
+    for (uint32_t level = 0; level < kLevels; ++level) {
+      uint32_t shift = level * kSlotBits;
+      uint32_t index = uint32_t(current_tick_ >> shift) & kSlotMask;
+      // The slot of the current tick is always empty above level 0.
+      uint32_t slot = FindOccupiedSlot(level, level ? index + 1 : index);
+      if (slot < kSlotCount) {
+        uint64_t base = current_tick_ >> (shift + kSlotBits)
+                                            << (shift + kSlotBits);
+        return base | (uint64_t(slot) << shift);
+      }
+    }
+    if (heads_[kOverflowList]) {
+      return ((current_tick_ >> kWheelBits) + 1) << kWheelBits;
+    }
+    return kNoTick;
+  }
 
-  // Special case for calling from a callback itself
-  if (std::this_thread::get_id() == parent_queue_->dispatch_thread().get_id()) {
-    state = State::kInCallback;
-    if (state_.compare_exchange_strong(state, State::kInCallbackSelfDisarmed,
-                                       std::memory_order_acq_rel)) {
-      // If we are self disarming from the callback set this special state and
-      // exit
+  // Moves the current tick forward to a tick no later than NextTick() + 1,
+  // cascading the slots entered on the upper levels.
+  void AdvanceTo(uint64_t tick) {
+    uint64_t changed = tick ^ current_tick_;
+    if (!changed) {
       return;
     }
-    // Normal case can handle the rest
+    WaitItem* cascade = nullptr;
+    auto take_list = [this, &cascade](uint32_t list) {
+      while (WaitItem* item = heads_[list]) {
+        Unlink(item);
+        item->next = cascade;
+        cascade = item;
+      }
+    };
+    if (changed >> kWheelBits) {
+      take_list(kOverflowList);
+    }
+    for (uint32_t level = kLevels - 1; level; --level) {
+      uint32_t shift = level * kSlotBits;
+      if (changed >> shift) {
+        take_list(level * kSlotCount + (uint32_t(tick >> shift) & kSlotMask));
+      }
+    }
+    current_tick_ = tick;
+    while (cascade) {
+      WaitItem* item = cascade;
+      cascade = item->next;
+      Insert(item);
+    }
   }
 
-  dp::spin_wait spinner;
-  state = State::kIdle;
-  // Classes which hold WaitItems will often call Disarm() to cancel them during
-  // destruction. This may lead to race conditions when the dispatch thread
-  // executes a callback which accesses memory that is freed simultaneously due
-  // to this. Therefore, we need to guarantee that no callbacks will be running
-  // once Disarm() has returned.
-  while (!state_.compare_exchange_weak(state, State::kDisarmed,
-                                       std::memory_order_acq_rel)) {
-    if (state == State::kDisarmed) {
-      // Do not break for kInCallbackSelfDisarmed and keep spinning in order to
-      // meet guarantees
-      break;
+  // Moves every timer expiring at or before now_tick to the expired batch.
+  void CollectExpired(uint64_t now_tick) {
+    while (current_tick_ <= now_tick) {
+      uint64_t next_tick = NextTick();
+      if (next_tick > now_tick) {
+        AdvanceTo(now_tick + 1);
+        break;
+      }
+      AdvanceTo(next_tick);
+      uint32_t list = uint32_t(next_tick) & kSlotMask;
+      while (WaitItem* item = heads_[list]) {
+        Unlink(item);
+        AppendExpired(item);
+      }
+      AdvanceTo(next_tick + 1);
     }
-    state = State::kIdle;
-    spinner.spin_once();
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_cv_;
+  std::condition_variable callback_done_cv_;
+  bool shutdown_ = false;
+
+  // Wheel slots followed by the overflow, expired and free lists.
+  WaitItem* heads_[kListCount];
+  uint64_t occupied_[kLevels * kSlotCount / 64] = {};
+  WaitItem** expired_tail_;
+  // First tick not processed yet.
+  uint64_t current_tick_;
+  // Tick the dispatch thread sleeps until, 0 while it is running.
+  uint64_t wake_tick_ = 0;
+  std::vector<std::unique_ptr<WaitItem[]>> pool_;
+
+  std::thread dispatch_thread_;
+};
+
+xe::threading::TimerQueue timer_queue_;
+
+void TimerQueueHandle::Disarm() {
+  if (item_) {
+    timer_queue_.Disarm(item_, generation_);
   }
 }
 
-std::weak_ptr<WaitItem> QueueTimerOnce(std::function<void(void*)> callback,
-                                       void* userdata,
-                                       WaitItem::clock::time_point due) {
-  return timer_queue_.QueueTimer(
-      std::make_shared<WaitItem>(std::move(callback), userdata, &timer_queue_,
-                                 due, WaitItem::clock::duration::zero()));
+TimerQueueHandle QueueTimerOnce(std::function<void(void*)> callback,
+                                void* userdata,
+                                TimerQueueHandle::clock::time_point due) {
+  return timer_queue_.QueueTimer(std::move(callback), userdata, due,
+                                 TimerQueueHandle::clock::duration::zero());
 }
 
-std::weak_ptr<WaitItem> QueueTimerRecurring(
+TimerQueueHandle QueueTimerRecurring(
     std::function<void(void*)> callback, void* userdata,
-    WaitItem::clock::time_point due, WaitItem::clock::duration interval) {
-  return timer_queue_.QueueTimer(std::make_shared<WaitItem>(
-      std::move(callback), userdata, &timer_queue_, due, interval));
+    TimerQueueHandle::clock::time_point due,
+    TimerQueueHandle::clock::duration interval) {
+  return timer_queue_.QueueTimer(std::move(callback), userdata, due, interval);
 }
 
 }  // namespace threading
@@ -32,6 +32,48 @@ void EnableAffinityConfiguration() {
   SetProcessAffinityMask(process_handle, system_affinity_mask);
 }
 
+std::vector<ProcessorInfo> QueryProcessorTopology() {
+  std::vector<ProcessorInfo> processors;
+  DWORD length = 0;
+  GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+  std::vector<uint8_t> buffer(length);
+  if (!length ||
+      !GetLogicalProcessorInformationEx(
+          RelationProcessorCore,
+          reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+              buffer.data()),
+          &length)) {
+    uint32_t count = std::min(logical_processor_count(), uint32_t(64));
+    for (uint32_t i = 0; i < count; ++i) {
+      processors.push_back({i, i, 0, 0});
+    }
+    return processors;
+  }
+  // Affinity masks only address the first processor group.
+  uint32_t core_id = 0;
+  for (DWORD offset = 0; offset < length;) {
+    auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+        buffer.data() + offset);
+    offset += info->Size;
+    const GROUP_AFFINITY& group_mask = info->Processor.GroupMask[0];
+    if (group_mask.Group == 0) {
+      for (uint32_t i = 0; i < 64; ++i) {
+        if (group_mask.Mask & (KAFFINITY(1) << i)) {
+          // Higher efficiency classes are the faster cores.
+          processors.push_back(
+              {i, core_id, 0, uint32_t(info->Processor.EfficiencyClass) + 1});
+        }
+      }
+    }
+    ++core_id;
+  }
+  std::sort(processors.begin(), processors.end(),
+            [](const ProcessorInfo& a, const ProcessorInfo& b) {
+              return a.index < b.index;
+            });
+  return processors;
+}
+
 uint32_t current_thread_system_id() {
   return static_cast<uint32_t>(GetCurrentThreadId());
 }
@@ -343,6 +385,19 @@ class Win32Timer : public Win32Handle<Timer> {
     return CancelWaitableTimer(handle_) ? true : false;
   }
 
+  bool Disarm() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_ = nullptr;
+    // Setting the timer resets it to nonsignaled, and canceling it long before
+    // it is due leaves it so.
+    LARGE_INTEGER due_time_li;
+    due_time_li.QuadPart = INT64_MAX;
+    if (!SetWaitableTimer(handle_, &due_time_li, 0, NULL, NULL, FALSE)) {
+      return false;
+    }
+    return CancelWaitableTimer(handle_) ? true : false;
+  }
+
  private:
   static void CompletionRoutine(Win32Timer* timer, DWORD timer_low,
                                 DWORD timer_high) {
@@ -389,11 +444,32 @@ class Win32Thread : public Win32Handle<Thread> {
     Thread::set_name(name);
   }
 
-  int32_t priority() override { return GetThreadPriority(handle_); }
+  int32_t priority() override {
+    int32_t priority = GetThreadPriority(handle_);
+    return priority == THREAD_PRIORITY_TIME_CRITICAL
+               ? ThreadPriority::kRealtime
+               : priority;
+  }
   uint32_t system_id() const override { return GetThreadId(handle_); }
 
   void set_priority(int32_t new_priority) override {
-    SetThreadPriority(handle_, new_priority);
+    SetThreadPriority(handle_, new_priority >= ThreadPriority::kRealtime
+                                   ? THREAD_PRIORITY_TIME_CRITICAL
+                                   : new_priority);
+  }
+
+  std::chrono::nanoseconds QueryCpuTime() override {
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(handle_, &creation_time, &exit_time, &kernel_time,
+                        &user_time)) {
+      return std::chrono::nanoseconds::zero();
+    }
+    uint64_t ticks =
+        ((uint64_t(kernel_time.dwHighDateTime) << 32) |
+         kernel_time.dwLowDateTime) +
+        ((uint64_t(user_time.dwHighDateTime) << 32) | user_time.dwLowDateTime);
+    // 100ns units.
+    return std::chrono::nanoseconds(ticks * 100);
   }
 
   uint64_t affinity_mask() override {
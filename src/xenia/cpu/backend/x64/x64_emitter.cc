@@ -527,6 +527,16 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     auto extern_function = static_cast<const GuestFunction*>(function);
     if (extern_function->extern_handler()) {
       undefined = false;
+      Xbyak::Label slow_path;
+      Xbyak::Label done;
+      bool has_fast_path = extern_function->export_data() &&
+                           EmitExternFastPath(
+                               extern_function->export_data()->fast_path,
+                               slow_path);
+      if (has_fast_path) {
+        jmp(done, T_NEAR);
+        L(slow_path);
+      }
       // rcx = target function
       // rdx = arg0
       // r8  = arg1
@@ -538,6 +548,9 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(rax);
       // rax = host return
+      if (has_fast_path) {
+        L(done);
+      }
     }
   }
   if (undefined) {
@@ -545,6 +558,90 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
   }
 }
 
+// Emits the uncontended case of an export inline, operating directly on the
+// guest structure. Control falls through if the fast path completed and jumps
+// to slow_path (with guest state untouched) if the export must be called.
+// Only rax, rcx, rdx and r8 are clobbered, as with a regular extern call.
+bool X64Emitter::EmitExternFastPath(ExportFastPath fast_path,
+                                    Xbyak::Label& slow_path) {
+  if (!cvars::inline_critical_sections) {
+    return false;
+  }
+
+  // X_RTL_CRITICAL_SECTION, see xboxkrnl_rtl.cc. lock_count is kept in host
+  // byte order to allow host atomics, the rest is big-endian.
+  const uint32_t kLockCountOffset = 0x10;
+  const uint32_t kRecursionCountOffset = 0x14;
+  const uint32_t kOwningThreadOffset = 0x18;
+  const uint32_t kRecursionCountOne = 0x01000000;  // byte_swap(1)
+  // X_KPCR::current_thread.
+  const uint32_t kPcrCurrentThreadOffset = 0x100;
+
+  auto guest_gpr = [this](uint32_t index) {
+    return dword[GetContextReg() + offsetof(ppc::PPCContext, r) +
+                 index * sizeof(uint64_t)];
+  };
+  // rdx = host address of the critical section in r3. Addresses in the
+  // 0xE0000000+ range may need a host offset, leave those to the export.
+  auto load_critical_section = [this, &guest_gpr, &slow_path]() {
+    mov(ecx, guest_gpr(3));
+    cmp(ecx, 0xE0000000);
+    jae(slow_path, T_NEAR);
+    lea(rdx, ptr[GetMembaseReg() + rcx]);
+  };
+  // ecx = current guest thread object (big-endian, as stored in the PCR).
+  auto load_current_thread = [this, &guest_gpr]() {
+    mov(ecx, guest_gpr(13));
+    mov(ecx, dword[GetMembaseReg() + rcx + kPcrCurrentThreadOffset]);
+  };
+
+  switch (fast_path) {
+    case ExportFastPath::kRtlEnterCriticalSection:
+    case ExportFastPath::kRtlTryEnterCriticalSection: {
+      // Acquire if unowned: lock_count -1 -> 0.
+      load_critical_section();
+      mov(eax, -1);
+      xor_(r8d, r8d);
+      lock();
+      cmpxchg(dword[rdx + kLockCountOffset], r8d);
+      jne(slow_path, T_NEAR);
+      load_current_thread();
+      mov(dword[rdx + kOwningThreadOffset], ecx);
+      mov(dword[rdx + kRecursionCountOffset], kRecursionCountOne);
+      if (fast_path == ExportFastPath::kRtlTryEnterCriticalSection) {
+        mov(qword[GetContextReg() + offsetof(ppc::PPCContext, r) +
+                  3 * sizeof(uint64_t)],
+            1);
+      }
+      return true;
+    }
+    case ExportFastPath::kRtlLeaveCriticalSection: {
+      // Release if held exactly once with no waiters: lock_count 0 -> -1.
+      // Ownership must be cleared before the lock becomes available, and is
+      // restored if there turn out to be waiters to wake.
+      Xbyak::Label released;
+      load_critical_section();
+      cmp(dword[rdx + kRecursionCountOffset], kRecursionCountOne);
+      jne(slow_path, T_NEAR);
+      mov(ecx, dword[rdx + kOwningThreadOffset]);
+      mov(dword[rdx + kRecursionCountOffset], 0);
+      mov(dword[rdx + kOwningThreadOffset], 0);
+      xor_(eax, eax);
+      mov(r8d, -1);
+      lock();
+      cmpxchg(dword[rdx + kLockCountOffset], r8d);
+      je(released, T_NEAR);
+      mov(dword[rdx + kOwningThreadOffset], ecx);
+      mov(dword[rdx + kRecursionCountOffset], kRecursionCountOne);
+      jmp(slow_path, T_NEAR);
+      L(released);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
 void X64Emitter::CallNative(void* fn) { CallNativeSafe(fn); }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context)) {
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_trace_data.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -203,6 +204,7 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void Call(const hir::Instr* instr, GuestFunction* function);
   void CallIndirect(const hir::Instr* instr, const Xbyak::Reg64& reg);
   void CallExtern(const hir::Instr* instr, const Function* function);
+  bool EmitExternFastPath(ExportFastPath fast_path, Xbyak::Label& slow_path);
   void CallNative(void* fn);
   void CallNative(uint64_t (*fn)(void* raw_context));
   void CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0));
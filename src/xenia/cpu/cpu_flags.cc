@@ -35,6 +35,12 @@ DEFINE_bool(
     "Disables global lock usage in guest code. Does not affect host code.",
     "CPU");
 
+DEFINE_bool(inline_critical_sections, true,
+            "Emit the uncontended case of RtlEnterCriticalSection, "
+            "RtlTryEnterCriticalSection and RtlLeaveCriticalSection inline, "
+            "calling the kernel export only on contention.",
+            "CPU");
+
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
@@ -24,6 +24,8 @@ DECLARE_bool(trace_function_data);
 
 DECLARE_bool(disable_global_lock);
 
+DECLARE_bool(inline_critical_sections);
+
 DECLARE_bool(validate_hir);
 
 DECLARE_uint64(pvr);
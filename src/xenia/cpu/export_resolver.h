@@ -65,6 +65,15 @@ struct ExportTag {
   static const type kLogResult = 1u << 31;
 };
 
+// Exports with a well-known guest-visible effect that the JIT may emit inline,
+// only calling into the export when the inline sequence can't complete.
+enum class ExportFastPath : uint8_t {
+  kNone = 0,
+  kRtlEnterCriticalSection,
+  kRtlTryEnterCriticalSection,
+  kRtlLeaveCriticalSection,
+};
+
 // DEPRECATED
 typedef void (*xe_kernel_export_shim_fn)(void*, void*);
 
@@ -82,6 +91,7 @@ class Export {
       : ordinal(ordinal),
         type(type),
         tags(tags),
+        fast_path(ExportFastPath::kNone),
         function_data({nullptr, nullptr, 0}) {
     std::strncpy(this->name, name, xe::countof(this->name));
   }
@@ -90,6 +100,7 @@ class Export {
   Type type;
   char name[96];
   ExportTag::type tags;
+  ExportFastPath fast_path;
 
   bool is_implemented() const {
     return (tags & ExportTag::kImplemented) == ExportTag::kImplemented;
@@ -937,6 +937,8 @@ bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingBuffer* reader,
   IssueSwap(frontbuffer_ptr, frontbuffer_width, frontbuffer_height);
 
   ++counter_;
+  swap_count_.fetch_add(1, std::memory_order_relaxed);
+  graphics_system_->OnGuestSwap();
   return true;
 }
 
@@ -9,6 +9,7 @@
 
 #include "xenia/gpu/graphics_system.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -23,6 +24,7 @@
 #include "xenia/base/threading.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/gpu_flags.h"
+#include "xenia/kernel/kernel_state.h"
 #include "xenia/ui/graphics_provider.h"
 #include "xenia/ui/window.h"
 #include "xenia/ui/windowed_app_context.h"
@@ -96,8 +98,13 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
 
   // 60hz vsync timer.
   vsync_worker_running_ = true;
+  vsync_worker_wake_event_ = xe::threading::Event::CreateAutoResetEvent(false);
   vsync_worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(kernel_state_, 128 * 1024, 0, [this]() {
+        if (Clock::guest_frame_locked()) {
+          FrameLockedVsyncLoop();
+          return 0;
+        }
         uint64_t vsync_duration = cvars::vsync ? 16 : 1;
         uint64_t last_frame_time = Clock::QueryGuestTickCount();
         while (vsync_worker_running_) {
@@ -107,8 +114,15 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
           if (elapsed >= vsync_duration) {
             MarkVblank();
             last_frame_time = current_time;
+            elapsed = 0;
           }
-          xe::threading::Sleep(std::chrono::milliseconds(1));
+          // Sleep until the next vblank is due, unless woken to shut down.
+          xe::threading::Wait(
+              vsync_worker_wake_event_.get(), false,
+              std::chrono::milliseconds(std::max<uint32_t>(
+                  Clock::ScaleGuestDurationMillis(
+                      uint32_t(vsync_duration - elapsed)),
+                  1)));
         }
         return 0;
       }));
@@ -116,6 +130,7 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
   vsync_worker_thread_->set_can_debugger_suspend(true);
   vsync_worker_thread_->set_name("GPU VSync");
   vsync_worker_thread_->Create();
+  vsync_worker_thread_->SetRealtimePriority();
 
   if (cvars::trace_gpu_stream) {
     BeginTracing();
@@ -133,6 +148,7 @@ void GraphicsSystem::Shutdown() {
 
   if (vsync_worker_thread_) {
     vsync_worker_running_ = false;
+    vsync_worker_wake_event_->Set();
     vsync_worker_thread_->Wait(0, 0, 0, nullptr);
     vsync_worker_thread_.reset();
   }
@@ -260,6 +276,42 @@ void GraphicsSystem::DispatchInterruptCallback(uint32_t source, uint32_t cpu) {
                                args, xe::countof(args));
 }
 
+void GraphicsSystem::OnGuestSwap() {
+  if (vsync_worker_wake_event_) {
+    vsync_worker_wake_event_->Set();
+  }
+}
+
+void GraphicsSystem::FrameLockedVsyncLoop() {
+  // Guest time only moves to the next frame here. Issue the vblank as soon as
+  // the guest has presented a frame, so a fast host runs ahead of real time,
+  // or once guest time has stalled at the end of the frame waiting for it.
+  uint32_t last_swap_count = command_processor_->swap_count();
+  while (vsync_worker_running_) {
+    uint32_t swap_count = command_processor_->swap_count();
+    if (swap_count != last_swap_count || Clock::IsGuestFrameElapsed()) {
+      last_swap_count = swap_count;
+      kernel_state_->AdvanceGuestFrame();
+      MarkVblank();
+      continue;
+    }
+    // Sleep until the next swap, or until guest time reaches the end of the
+    // frame (rounded up, so it has stalled by then).
+    uint64_t frame_end_time = Clock::QueryGuestFrameEndSystemTime();
+    uint64_t guest_time = Clock::QueryGuestSystemTime();
+    uint64_t remaining_ms = 0;
+    if (frame_end_time > guest_time) {
+      remaining_ms = (frame_end_time - guest_time + 9999) / 10000;
+    }
+    xe::threading::Wait(
+        vsync_worker_wake_event_.get(), false,
+        std::chrono::milliseconds(std::max<uint32_t>(
+            Clock::ScaleGuestDurationMillis(uint32_t(
+                std::min<uint64_t>(remaining_ms, UINT32_MAX))),
+            1)));
+  }
+}
+
 void GraphicsSystem::MarkVblank() {
   SCOPE_profile_cpu_f("gpu");
 
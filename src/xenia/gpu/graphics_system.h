@@ -18,6 +18,7 @@
 #include <string>
 #include <thread>
 
+#include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/kernel/xthread.h"
@@ -70,6 +71,9 @@ class GraphicsSystem {
   virtual void SetInterruptCallback(uint32_t callback, uint32_t user_data);
   void DispatchInterruptCallback(uint32_t source, uint32_t cpu);
 
+  // Called by the command processor once the guest has presented a frame.
+  void OnGuestSwap();
+
   virtual void ClearCaches();
 
   void InitializeShaderStorage(const std::filesystem::path& cache_root,
@@ -98,6 +102,7 @@ class GraphicsSystem {
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
 
+  void FrameLockedVsyncLoop();
   void MarkVblank();
 
   Memory* memory_ = nullptr;
@@ -111,6 +116,9 @@ class GraphicsSystem {
 
   std::atomic<bool> vsync_worker_running_;
   kernel::object_ref<kernel::XHostThread> vsync_worker_thread_;
+  // Wakes the vsync worker before its next vblank is due, on a guest swap or
+  // to shut down.
+  std::unique_ptr<xe::threading::Event> vsync_worker_wake_event_;
 
   RegisterFile register_file_;
   std::unique_ptr<CommandProcessor> command_processor_;
@@ -35,6 +35,9 @@ void SharedMemory::InitializeCommon() {
   memory_invalidation_callback_handle_ =
       memory_.RegisterPhysicalMemoryInvalidationCallback(
           MemoryInvalidationCallbackThunk, this);
+  memory_host_write_callback_handle_ =
+      memory_.RegisterPhysicalMemoryHostWriteCallback(
+          MemoryHostWriteCallbackThunk, this);
 }
 
 void SharedMemory::InitializeSparseHostGpuMemory(uint32_t granularity_log2) {
@@ -71,6 +74,11 @@ void SharedMemory::ShutdownCommon() {
         memory_invalidation_callback_handle_);
     memory_invalidation_callback_handle_ = nullptr;
   }
+  if (memory_host_write_callback_handle_ != nullptr) {
+    memory_.UnregisterPhysicalMemoryHostWriteCallback(
+        memory_host_write_callback_handle_);
+    memory_host_write_callback_handle_ = nullptr;
+  }
 
   if (host_gpu_memory_sparse_used_bytes_) {
     host_gpu_memory_sparse_used_bytes_ = 0;
@@ -421,6 +429,38 @@ std::pair<uint32_t, uint32_t> SharedMemory::MemoryInvalidationCallbackThunk(
       ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
 }
 
+bool SharedMemory::IsRangeWrittenByGpu(uint32_t start, uint32_t length) {
+  if (length == 0 || start >= kBufferSize) {
+    return false;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t block = system_page_flags_[i].valid_and_gpu_written;
+    if (i == block_first) {
+      block &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      block &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    if (block) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SharedMemory::MemoryHostWriteCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length) {
+  return reinterpret_cast<SharedMemory*>(context_ptr)
+      ->IsRangeWrittenByGpu(physical_address_start, length);
+}
+
 std::pair<uint32_t, uint32_t> SharedMemory::MemoryInvalidationCallback(
     uint32_t physical_address_start, uint32_t length, bool exact_range) {
   if (length == 0 || physical_address_start >= kBufferSize) {
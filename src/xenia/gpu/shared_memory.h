@@ -170,6 +170,7 @@ class SharedMemory {
   uint32_t host_gpu_memory_sparse_used_bytes_ = 0;
 
   void* memory_invalidation_callback_handle_ = nullptr;
+  void* memory_host_write_callback_handle_ = nullptr;
   void* memory_data_provider_handle_ = nullptr;
 
   // Ranges that need to be uploaded, generated by GetRangesToUpload (a
@@ -203,6 +204,12 @@ class SharedMemory {
   static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
       void* context_ptr, uint32_t physical_address_start, uint32_t length,
       bool exact_range);
+  // Whether any page in the range is valid because the GPU wrote it, so guest
+  // memory doesn't hold its current contents.
+  bool IsRangeWrittenByGpu(uint32_t start, uint32_t length);
+  static bool MemoryHostWriteCallbackThunk(void* context_ptr,
+                                           uint32_t physical_address_start,
+                                           uint32_t length);
 
   struct GlobalWatch {
     GlobalWatchCallback callback;
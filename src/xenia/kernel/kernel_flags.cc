@@ -14,3 +14,28 @@ DEFINE_bool(headless, false,
             "UI");
 DEFINE_bool(log_high_frequency_kernel_calls, false,
             "Log kernel calls with the kHighFrequency tag.", "Kernel");
+DEFINE_int32(async_io_threads, 2,
+             "Number of host threads completing overlapped guest file reads. "
+             "0 completes all reads synchronously on the calling thread.",
+             "Kernel");
+DEFINE_int32(async_io_queue_depth, 32,
+             "Maximum number of overlapped guest file reads in flight at "
+             "once. Further reads complete synchronously. Read-ahead has a "
+             "queue of the same depth of its own.",
+             "Kernel");
+DEFINE_int32(read_ahead_budget_mb, 64,
+             "Memory used to prefetch guest files read sequentially, shared "
+             "by all open files. 0 disables read-ahead, as does disabling "
+             "async_io_threads.",
+             "Kernel");
+DEFINE_int32(read_ahead_max_kb, 1024,
+             "Largest single read-ahead of a sequentially read guest file.",
+             "Kernel");
+DEFINE_bool(read_skip_unchanged_pages, true,
+            "When a guest file read lands on physical memory watched by the "
+            "GPU, only invalidate the pages whose contents actually change.",
+            "Kernel");
+DEFINE_bool(query_directory_batch, false,
+            "Return as many entries as fit in the buffer from each "
+            "NtQueryDirectoryFile call, rather than one.",
+            "Kernel");
@@ -13,5 +13,11 @@
 
 DECLARE_bool(headless);
 DECLARE_bool(log_high_frequency_kernel_calls);
+DECLARE_int32(async_io_threads);
+DECLARE_int32(async_io_queue_depth);
+DECLARE_int32(read_ahead_budget_mb);
+DECLARE_int32(read_ahead_max_kb);
+DECLARE_bool(read_skip_unchanged_pages);
+DECLARE_bool(query_directory_batch);
 
 #endif  // XENIA_KERNEL_KERNEL_FLAGS_H_
@@ -9,24 +9,29 @@
 
 #include "xenia/kernel/kernel_state.h"
 
+#include <algorithm>
 #include <string>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
+#include "xenia/kernel/kernel_flags.h"
 #include "xenia/kernel/user_module.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_module.h"
 #include "xenia/kernel/xevent.h"
+#include "xenia/kernel/xfile.h"
 #include "xenia/kernel/xmodule.h"
 #include "xenia/kernel/xnotifylistener.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
+#include "xenia/kernel/xtimer.h"
 
 namespace xe {
 namespace kernel {
@@ -63,6 +68,20 @@ KernelState::KernelState(Emulator* emulator)
   // Hardcoded maximum of 2048 TLS slots.
   tls_bitmap_.Resize(2048);
 
+  if (cvars::async_io_threads > 0) {
+    size_t queue_depth = size_t(std::max(cvars::async_io_queue_depth, 1));
+    io_worker_pool_ = std::make_unique<vfs::IOWorkerPool>(
+        "Kernel I/O", size_t(cvars::async_io_threads), queue_depth);
+    if (cvars::read_ahead_budget_mb > 0) {
+      read_ahead_io_worker_pool_ = std::make_unique<vfs::IOWorkerPool>(
+          "Kernel read-ahead", size_t(cvars::async_io_threads), queue_depth);
+      read_ahead_pool_ = std::make_unique<vfs::ReadAheadPool>(
+          read_ahead_io_worker_pool_.get(),
+          size_t(cvars::read_ahead_budget_mb) << 20,
+          size_t(std::max(cvars::read_ahead_max_kb, 4)) << 10);
+    }
+  }
+
   xam::AppManager::RegisterApps(this, app_manager_.get());
 }
 
@@ -75,6 +94,43 @@ KernelState::~KernelState() {
     dispatch_thread_->Wait(0, 0, 0, nullptr);
   }
 
+  // Finish in-flight reads while the objects they reference are still alive.
+  if (io_worker_pool_) {
+    io_worker_pool_->WaitIdle();
+    XELOGI(
+        "Overlapped reads: {} completed by I/O threads, {} completed "
+        "synchronously with the queue full, peak {} in flight",
+        io_worker_pool_->completed_count(), io_worker_pool_->rejected_count(),
+        io_worker_pool_->peak_pending_count());
+  }
+  io_worker_pool_.reset();
+  read_ahead_io_worker_pool_.reset();
+
+  if (read_ahead_pool_) {
+    auto statistics = read_ahead_pool_->statistics();
+    XELOGI(
+        "Read-ahead: {} of {} reads hit ({:.1f}%), {} bytes prefetched, {} "
+        "bytes served, peak {} bytes buffered, {} prefetches over budget, {} "
+        "with the queue full",
+        statistics.hit_count, statistics.read_count,
+        statistics.read_count
+            ? 100.0 * statistics.hit_count / statistics.read_count
+            : 0.0,
+        statistics.bytes_prefetched, statistics.bytes_served,
+        statistics.peak_bytes_in_use, statistics.budget_rejections,
+        statistics.queue_rejections);
+  }
+
+  auto watched_reads = XFile::physical_read_statistics();
+  if (watched_reads.watched_read_count) {
+    XELOGI(
+        "Reads into watched physical memory: {} ({} from mappings), {} of {} "
+        "bytes unchanged and left watched, {} invalidations",
+        watched_reads.watched_read_count, watched_reads.mapped_read_count,
+        watched_reads.bytes_unchanged, watched_reads.bytes_compared,
+        watched_reads.invalidation_count);
+  }
+
   executable_module_.reset();
   user_modules_.clear();
   kernel_modules_.clear();
@@ -689,6 +745,41 @@ void KernelState::BroadcastNotification(XNotificationID id, uint32_t data) {
   }
 }
 
+void KernelState::DeferTimerToGuestFrame(XTimer* timer) {
+  std::lock_guard<std::mutex> lock(deferred_timers_mutex_);
+  if (std::find(deferred_timers_.cbegin(), deferred_timers_.cend(), timer) ==
+      deferred_timers_.cend()) {
+    deferred_timers_.push_back(timer);
+  }
+}
+
+void KernelState::CancelDeferredTimer(XTimer* timer) {
+  std::lock_guard<std::mutex> lock(deferred_timers_mutex_);
+  auto it = std::find(deferred_timers_.begin(), deferred_timers_.end(), timer);
+  if (it != deferred_timers_.end()) {
+    *it = deferred_timers_.back();
+    deferred_timers_.pop_back();
+  }
+}
+
+void KernelState::AdvanceGuestFrame() {
+  Clock::AdvanceGuestFrame();
+  uint64_t frame_end_time = Clock::QueryGuestFrameEndSystemTime();
+  // Arm under the lock so a timer can't be destroyed or reset meanwhile. Timers
+  // waiting here are not armed, so none of their callbacks can be running.
+  std::lock_guard<std::mutex> lock(deferred_timers_mutex_);
+  for (size_t i = 0; i < deferred_timers_.size();) {
+    XTimer* timer = deferred_timers_[i];
+    if (timer->due_system_time() < frame_end_time) {
+      timer->Arm();
+      deferred_timers_[i] = deferred_timers_.back();
+      deferred_timers_.pop_back();
+    } else {
+      ++i;
+    }
+  }
+}
+
 void KernelState::CompleteOverlapped(uint32_t overlapped_ptr, X_RESULT result) {
   CompleteOverlappedEx(overlapped_ptr, result, result, 0);
 }
@@ -799,6 +890,32 @@ void KernelState::CompleteOverlappedDeferredEx(
   dispatch_cond_.notify_all();
 }
 
+void KernelState::QueueDpcDelivery() {
+  if (dpc_delivery_queued_) {
+    return;
+  }
+  dpc_delivery_queued_ = true;
+  dispatch_queue_.push_back([this]() { DeliverDpcs(); });
+  dispatch_cond_.notify_all();
+}
+
+void KernelState::DeliverDpcs() {
+  auto thread_state = XThread::GetCurrentThread()->thread_state();
+  auto global_lock = global_critical_region_.Acquire();
+  dpc_delivery_queued_ = false;
+  while (dpc_list_.HasPending()) {
+    // Cache what we need, the routine may reinsert or free the DPC.
+    uint32_t dpc_ptr = dpc_list_.Shift() - 4;
+    auto dpc = memory()->TranslateVirtual<XDPC*>(dpc_ptr);
+    uint32_t routine = dpc->routine;
+    // routine(dpc, context, system_arg1, system_arg2)
+    uint64_t args[] = {dpc_ptr, dpc->context, dpc->arg1, dpc->arg2};
+    global_lock.unlock();
+    processor()->Execute(thread_state, routine, args, xe::countof(args));
+    global_lock.lock();
+  }
+}
+
 bool KernelState::Save(ByteStream* stream) {
   XELOGD("Serializing the kernel...");
   stream->Write(kKernelSaveSignature);
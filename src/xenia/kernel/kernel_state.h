@@ -15,6 +15,7 @@
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "xenia/base/bit_map.h"
@@ -28,6 +29,8 @@
 #include "xenia/kernel/xam/content_manager.h"
 #include "xenia/kernel/xam/user_profile.h"
 #include "xenia/memory.h"
+#include "xenia/vfs/io_worker_pool.h"
+#include "xenia/vfs/read_ahead_buffer.h"
 #include "xenia/vfs/virtual_file_system.h"
 #include "xenia/xbox.h"
 
@@ -50,6 +53,7 @@ class KernelModule;
 class XModule;
 class XNotifyListener;
 class XThread;
+class XTimer;
 class UserModule;
 
 // (?), used by KeGetCurrentProcessType
@@ -168,6 +172,24 @@ class KernelState {
   void BroadcastNotification(XNotificationID id, uint32_t data);
 
   util::NativeList* dpc_list() { return &dpc_list_; }
+  // Has the dispatch thread run the queued DPCs. Called with the global lock
+  // held after inserting into dpc_list; any number of insertions before the
+  // dispatch thread gets to them are delivered as one batch.
+  void QueueDpcDelivery();
+
+  // With frame-locked guest time (see Clock::guest_frame_locked), timers due
+  // in a later frame are only armed once guest time reaches that frame, so
+  // they never fire early when the host is slow nor late when it is fast.
+  void DeferTimerToGuestFrame(XTimer* timer);
+  void CancelDeferredTimer(XTimer* timer);
+  // Advances frame-locked guest time by one frame and arms the deferred timers
+  // that are due in it. Called for every emulated vblank.
+  void AdvanceGuestFrame();
+
+  // Host threads for overlapped file I/O, null if disabled.
+  vfs::IOWorkerPool* io_worker_pool() const { return io_worker_pool_.get(); }
+  // Shared by the read-ahead buffers of open files, null if disabled.
+  vfs::ReadAheadPool* read_ahead_pool() const { return read_ahead_pool_.get(); }
 
   void CompleteOverlapped(uint32_t overlapped_ptr, X_RESULT result);
   void CompleteOverlappedEx(uint32_t overlapped_ptr, X_RESULT result,
@@ -201,6 +223,7 @@ class KernelState {
 
  private:
   void LoadKernelModule(object_ref<KernelModule> kernel_module);
+  void DeliverDpcs();
 
   Emulator* emulator_;
   Memory* memory_;
@@ -231,9 +254,21 @@ class KernelState {
   object_ref<XHostThread> dispatch_thread_;
   // Must be guarded by the global critical region.
   util::NativeList dpc_list_;
+  bool dpc_delivery_queued_ = false;
   std::condition_variable_any dispatch_cond_;
   std::list<std::function<void()>> dispatch_queue_;
 
+  // Not the global critical region, timer callbacks take that one.
+  std::mutex deferred_timers_mutex_;
+  std::vector<XTimer*> deferred_timers_;
+
+  // Outlives the I/O worker pools, prefetches hold on to it until they finish.
+  std::unique_ptr<vfs::ReadAheadPool> read_ahead_pool_;
+  // Prefetches have their own threads and queue, so that they never hold up
+  // overlapped guest reads or make them complete synchronously.
+  std::unique_ptr<vfs::IOWorkerPool> read_ahead_io_worker_pool_;
+  std::unique_ptr<vfs::IOWorkerPool> io_worker_pool_;
+
   BitMap tls_bitmap_;
 
   friend class XObject;
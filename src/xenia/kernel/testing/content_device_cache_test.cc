@@ -0,0 +1,144 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/xam/content_device_cache.h"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::kernel::xam::test {
+
+static std::filesystem::path PackagePath() {
+  return std::filesystem::temp_directory_path() /
+         fmt::format("xenia_content_{}", std::random_device()());
+}
+
+static void WriteHostFile(const std::filesystem::path& path) {
+  std::filesystem::create_directories(path.parent_path());
+  auto file = xe::filesystem::OpenFile(path, "wb");
+  REQUIRE(file);
+  fclose(file);
+}
+
+// Mounts the package like ContentPackage does, with the cached device if
+// there is one.
+struct Mount {
+  Mount(ContentDeviceCache* cache, const std::filesystem::path& package_path)
+      : cache(cache), package_path(package_path) {
+    device = cache->Acquire(package_path, &write_generation);
+    reused = device != nullptr;
+    if (!device) {
+      device = std::make_unique<vfs::HostPathDevice>("\\Device\\Content\\1\\",
+                                                     package_path, false);
+      REQUIRE(device->Initialize());
+    }
+  }
+  void Close() {
+    cache->Release(package_path, write_generation, std::move(device));
+  }
+
+  ContentDeviceCache* cache;
+  std::filesystem::path package_path;
+  uint64_t write_generation = 0;
+  std::unique_ptr<vfs::HostPathDevice> device;
+  bool reused = false;
+};
+
+TEST_CASE("Content device cache reuses closed packages", "[content]") {
+  auto path = PackagePath();
+  WriteHostFile(path / "save.bin");
+  {
+    ContentDeviceCache cache(4);
+    Mount first(&cache, path);
+    REQUIRE_FALSE(first.reused);
+    REQUIRE(first.device->ResolvePath("save.bin"));
+    auto device = first.device.get();
+    first.Close();
+    REQUIRE(cache.size() == 1);
+
+    Mount second(&cache, path);
+    REQUIRE(second.reused);
+    REQUIRE(second.device.get() == device);
+    second.Close();
+
+    ContentDeviceCache disabled(0);
+    Mount third(&disabled, path);
+    third.Close();
+    REQUIRE(disabled.size() == 0);
+  }
+  std::filesystem::remove_all(path);
+}
+
+TEST_CASE("Content device cache with a package opened twice", "[content]") {
+  auto path = PackagePath();
+  WriteHostFile(path / "save.bin");
+  ContentDeviceCache cache(4);
+
+  SECTION("Reading mount closed while another is open") {
+    Mount reading(&cache, path);
+    Mount writing(&cache, path);
+    REQUIRE(reading.device.get() != writing.device.get());
+    REQUIRE(reading.device->ResolvePath("save.bin"));
+    // The other mount may still change the package.
+    reading.Close();
+    REQUIRE(cache.size() == 0);
+    writing.Close();
+    REQUIRE(cache.size() == 1);
+  }
+  SECTION("Reading mount closed after a writing one") {
+    Mount reading(&cache, path);
+    Mount writing(&cache, path);
+    REQUIRE(reading.device->ResolvePath("save.bin"));
+    // What ContentManager does when files were written through the device.
+    cache.Invalidate(path);
+    writing.device.reset();
+    writing.Close();
+    // The listing of the reading mount predates the writes.
+    reading.Close();
+    REQUIRE(cache.size() == 0);
+
+    Mount next(&cache, path);
+    REQUIRE_FALSE(next.reused);
+    next.Close();
+    REQUIRE(cache.size() == 1);
+  }
+  std::filesystem::remove_all(path);
+}
+
+TEST_CASE("Content device cache detects changes in subdirectories",
+          "[content]") {
+  auto path = PackagePath();
+  WriteHostFile(path / "a" / "b" / "save.bin");
+  {
+    ContentDeviceCache cache(4);
+    Mount first(&cache, path);
+    REQUIRE(first.device->ResolvePath("a\\b\\save.bin"));
+    first.Close();
+    REQUIRE(cache.size() == 1);
+
+    // Not every file system updates times at a finer granularity.
+    std::filesystem::last_write_time(
+        path / "a" / "b",
+        std::filesystem::last_write_time(path / "a" / "b") +
+            std::chrono::seconds(2));
+    Mount second(&cache, path);
+    REQUIRE_FALSE(second.reused);
+    REQUIRE(cache.size() == 0);
+    second.Close();
+  }
+  std::filesystem::remove_all(path);
+}
+
+}  // namespace xe::kernel::xam::test
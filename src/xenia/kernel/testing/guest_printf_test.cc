@@ -0,0 +1,1155 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/guest_printf.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::kernel::util::test {
+
+// The character-at-a-time formatter that xboxkrnl_strings.cc used before the
+// spec list based one, kept as the reference for the differential tests. Only
+// guest memory access has been adapted; %n is left out of the comparison as the
+// old implementation treated the character after it as a conversion type.
+namespace legacy {
+
+enum FormatState {
+  FS_Invalid = 0,
+  FS_Unknown,
+  FS_Start,
+  FS_Flags,
+  FS_Width,
+  FS_PrecisionStart,
+  FS_Precision,
+  FS_Size,
+  FS_Type,
+  FS_End,
+};
+
+enum FormatFlags {
+  FF_LeftJustify = 1 << 0,
+  FF_AddLeadingZeros = 1 << 1,
+  FF_AddPositive = 1 << 2,
+  FF_AddPositiveAsSpace = 1 << 3,
+  FF_AddNegative = 1 << 4,
+  FF_AddPrefix = 1 << 5,
+  FF_IsShort = 1 << 6,
+  FF_IsLong = 1 << 7,
+  FF_IsLongLong = 1 << 8,
+  FF_IsWide = 1 << 9,
+  FF_IsSigned = 1 << 10,
+  FF_ForceLeadingZero = 1 << 11,
+  FF_InvertWide = 1 << 12,
+};
+
+enum ArgumentSize {
+  AS_Default = 0,
+  AS_Short,
+  AS_Long,
+  AS_LongLong,
+};
+
+class FormatData {
+ public:
+  virtual uint16_t get() = 0;
+  virtual uint16_t peek(int32_t offset) = 0;
+  virtual void skip(int32_t count) = 0;
+  virtual bool put(uint16_t c) = 0;
+};
+
+class ArgList {
+ public:
+  virtual uint32_t get32() = 0;
+  virtual uint64_t get64() = 0;
+};
+
+// Making the assumption that the Xbox 360's implementation of the
+// printf-functions matches what is described on MSDN's documentation for the
+// Windows CRT:
+//
+// "Format Specification Syntax: printf and wprintf Functions"
+// https://msdn.microsoft.com/en-us/library/56e442dc.aspx
+
+std::string format_double(double value, int32_t precision, uint16_t c,
+                          uint32_t flags) {
+  if (precision < 0) {
+    precision = 6;
+  } else if (precision == 0 && c == 'g') {
+    precision = 1;
+  }
+
+  std::ostringstream temp;
+  temp << std::setprecision(precision);
+
+  if (c == 'f') {
+    temp << std::fixed;
+  } else if (c == 'e' || c == 'E') {
+    temp << std::scientific;
+  } else if (c == 'a' || c == 'A') {
+    temp << std::hexfloat;
+  } else if (c == 'g' || c == 'G') {
+    temp << std::defaultfloat;
+  }
+
+  if (c == 'E' || c == 'G' || c == 'A') {
+    temp << std::uppercase;
+  }
+
+  if (flags & FF_AddPrefix) {
+    temp << std::showpoint;
+  }
+
+  temp << value;
+  return temp.str();
+}
+
+int32_t format_core(const PrintfMemory& memory, FormatData& data, ArgList& args,
+                    const bool wide) {
+  int32_t count = 0;
+
+  char work8[512];
+  char16_t work16[4];
+
+  struct {
+    const void* buffer;
+    int32_t length;
+    bool is_wide;
+    bool swap_wide;
+  } text;
+
+  struct {
+    char buffer[2];
+    int32_t length;
+  } prefix;
+
+  auto state = FS_Unknown;
+  uint32_t flags = 0;
+  int32_t width = 0;
+  int32_t precision = -1;
+  ArgumentSize size = AS_Default;
+  int32_t radix = 0;
+  const char* digits = nullptr;
+
+  text.buffer = nullptr;
+  text.is_wide = false;
+  text.swap_wide = true;
+  text.length = 0;
+  prefix.buffer[0] = '\0';
+  prefix.length = 0;
+
+  for (uint16_t c = data.get();; c = data.get()) {
+    if (state == FS_Unknown) {
+      if (!c) {  // the end
+        return count;
+      } else if (c != '%') {
+      output:
+        if (!data.put(c)) {
+          return -1;
+        }
+        ++count;
+        continue;
+      }
+
+      state = FS_Start;
+      c = data.get();
+      // fall through
+    }
+
+    // in any state, if c is \0, it's bad
+    if (!c) {
+      return -1;
+    }
+
+  restart:
+    switch (state) {
+      case FS_Invalid:
+      case FS_Unknown:
+      case FS_End:
+      default: {
+        assert_always();
+      }
+
+      case FS_Start: {
+        if (c == '%') {
+          state = FS_Unknown;
+          goto output;
+        }
+
+        state = FS_Flags;
+
+        // reset to defaults
+        flags = 0;
+        width = 0;
+        precision = -1;
+        size = AS_Default;
+        radix = 0;
+        digits = nullptr;
+
+        text.buffer = nullptr;
+        text.is_wide = false;
+        text.swap_wide = true;
+        text.length = 0;
+        prefix.buffer[0] = '\0';
+        prefix.length = 0;
+
+        // fall through, don't need to goto restart
+      }
+
+      // https://msdn.microsoft.com/en-us/library/8aky45ct.aspx
+      case FS_Flags: {
+        if (c == '-') {
+          flags |= FF_LeftJustify;
+          continue;
+        } else if (c == '+') {
+          flags |= FF_AddPositive;
+          continue;
+        } else if (c == '0') {
+          flags |= FF_AddLeadingZeros;
+          continue;
+        } else if (c == ' ') {
+          flags |= FF_AddPositiveAsSpace;
+          continue;
+        } else if (c == '#') {
+          flags |= FF_AddPrefix;
+          continue;
+        }
+        state = FS_Width;
+        // fall through, don't need to goto restart
+      }
+
+      // https://msdn.microsoft.com/en-us/library/25366k66.aspx
+      case FS_Width: {
+        if (c == '*') {
+          width = (int32_t)args.get32();
+          if (width < 0) {
+            flags |= FF_LeftJustify;
+            width = -width;
+          }
+          state = FS_PrecisionStart;
+          continue;
+        } else if (c >= '0' && c <= '9') {
+          width *= 10;
+          width += c - '0';
+          continue;
+        }
+        state = FS_PrecisionStart;
+        // fall through, don't need to goto restart
+      }
+
+      // https://msdn.microsoft.com/en-us/library/0ecbz014.aspx
+      case FS_PrecisionStart: {
+        if (c == '.') {
+          state = FS_Precision;
+          precision = 0;
+          continue;
+        }
+        state = FS_Size;
+        goto restart;
+      }
+
+      // https://msdn.microsoft.com/en-us/library/0ecbz014.aspx
+      case FS_Precision: {
+        if (c == '*') {
+          precision = (int32_t)args.get32();
+          if (precision < 0) {
+            precision = -1;
+          }
+          state = FS_Size;
+          continue;
+        } else if (c >= '0' && c <= '9') {
+          precision *= 10;
+          precision += c - '0';
+          continue;
+        }
+        state = FS_Size;
+        // fall through
+      }
+
+      // https://msdn.microsoft.com/en-us/library/tcxf1dw6.aspx
+      case FS_Size: {
+        if (c == 'l') {
+          if (data.peek(0) == 'l') {
+            data.skip(1);
+            flags |= FF_IsLongLong;
+          } else {
+            flags |= FF_IsLong;
+          }
+          state = FS_Type;
+          continue;
+        } else if (c == 'L') {
+          // 58410826 incorrectly uses 'L' instead of 'l'.
+          // TODO(gibbed): L appears to be treated as an invalid token by
+          // xboxkrnl, investigate how invalid tokens are processed in xboxkrnl
+          // formatting when state FF_Type is reached.
+          state = FS_Type;
+          continue;
+        } else if (c == 'h') {
+          flags |= FF_IsShort;
+          state = FS_Type;
+          continue;
+        } else if (c == 'w') {
+          flags |= FF_IsWide;
+          state = FS_Type;
+          continue;
+        } else if (c == 'I') {
+          if (data.peek(0) == '6' && data.peek(1) == '4') {
+            data.skip(2);
+            flags |= FF_IsLongLong;
+            state = FS_Type;
+            continue;
+          } else if (data.peek(0) == '3' && data.peek(1) == '2') {
+            data.skip(2);
+            state = FS_Type;
+            continue;
+          } else {
+            state = FS_Type;
+            continue;
+          }
+        }
+        // fall through
+      }
+
+      // https://msdn.microsoft.com/en-us/library/hf4y5e3w.aspx
+      case FS_Type: {
+        // wide character
+        switch (c) {
+          case 'C': {
+            flags |= FF_InvertWide;
+            // fall through
+          }
+
+          // character
+          case 'c': {
+            bool is_wide;
+            if (flags & (FF_IsLong | FF_IsWide)) {
+              // "An lc, lC, wc or wC type specifier is synonymous with C in
+              // printf functions and with c in wprintf functions."
+              is_wide = true;
+            } else if (flags & FF_IsShort) {
+              // "An hc or hC type specifier is synonymous with c in printf
+              // functions and with C in wprintf functions."
+              is_wide = false;
+            } else {
+              is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
+            }
+
+            auto value = args.get32();
+
+            if (!is_wide) {
+              work8[0] = (uint8_t)value;
+              text.buffer = &work8[0];
+              text.length = 1;
+              text.is_wide = false;
+            } else {
+              work16[0] = (uint16_t)value;
+              text.buffer = &work16[0];
+              text.length = 1;
+              text.is_wide = true;
+              text.swap_wide = false;
+            }
+
+            break;
+          }
+
+          // signed decimal integer
+          case 'd':
+          case 'i': {
+            flags |= FF_IsSigned;
+            digits = "0123456789";
+            radix = 10;
+
+          integer:
+            assert_not_null(digits);
+            assert_not_zero(radix);
+
+            int64_t value;
+
+            if (flags & FF_IsLongLong) {
+              value = (int64_t)args.get64();
+            } else if (flags & FF_IsLong) {
+              value = (int32_t)args.get32();
+            } else if (flags & FF_IsShort) {
+              value = (int16_t)args.get32();
+            } else {
+              value = (int32_t)args.get32();
+            }
+
+            if (precision >= 0) {
+              precision = std::min(precision, (int32_t)xe::countof(work8));
+            } else {
+              precision = 1;
+            }
+
+            if ((flags & FF_IsSigned) && value < 0) {
+              value = -value;
+              flags |= FF_AddNegative;
+            }
+
+            if (!(flags & FF_IsLongLong)) {
+              value &= UINT32_MAX;
+            }
+
+            if (value == 0) {
+              prefix.length = 0;
+            }
+
+            char* end = &work8[xe::countof(work8) - 1];
+            char* start = end;
+            start[0] = '\0';
+
+            while (precision-- > 0 || value != 0) {
+              auto digit = (int32_t)(value % radix);
+              value /= radix;
+              assert_true(digit < strlen(digits));
+              *--start = digits[digit];
+            }
+
+            if ((flags & FF_ForceLeadingZero) &&
+                (start == end || *start != '0')) {
+              *--start = '0';
+            }
+
+            text.buffer = start;
+            text.length = (int32_t)(end - start);
+            text.is_wide = false;
+            break;
+          }
+
+          // unsigned octal integer
+          case 'o': {
+            digits = "01234567";
+            radix = 8;
+            if (flags & FF_AddPrefix) {
+              flags |= FF_ForceLeadingZero;
+            }
+            goto integer;
+          }
+
+          // unsigned decimal integer
+          case 'u': {
+            digits = "0123456789";
+            radix = 10;
+            goto integer;
+          }
+
+          // unsigned hexadecimal integer
+          case 'x':
+          case 'X': {
+            digits = c == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+            radix = 16;
+
+            if (flags & FF_AddPrefix) {
+              prefix.buffer[0] = '0';
+              prefix.buffer[1] = c == 'x' ? 'x' : 'X';
+              prefix.length = 2;
+            }
+
+            goto integer;
+          }
+
+          // floating-point with exponent
+          case 'e':
+          case 'E': {
+            // fall through
+          }
+
+          // floating-point without exponent
+          case 'f': {
+          floatingpoint:
+            flags |= FF_IsSigned;
+
+            int64_t dummy = args.get64();
+            double value = *(double*)&dummy;
+
+            if (value < 0) {
+              value = -value;
+              flags |= FF_AddNegative;
+            }
+
+            auto s = format_double(value, precision, c, flags);
+            auto length = (int32_t)s.size();
+            assert_true(length < xe::countof(work8));
+
+            auto start = &work8[0];
+            auto end = &start[length];
+
+            std::memcpy(start, s.c_str(), length);
+            end[0] = '\0';
+
+            text.buffer = start;
+            text.length = (int32_t)(end - start);
+            text.is_wide = false;
+            break;
+          }
+
+          // floating-point with or without exponent
+          case 'g':
+          case 'G': {
+            goto floatingpoint;
+          }
+
+          // floating-point in hexadecimal
+          case 'a':
+          case 'A': {
+            goto floatingpoint;
+          }
+
+          // pointer to integer
+          case 'n': {
+            auto pointer = (uint32_t)args.get32();
+            if (flags & FF_IsShort) {
+              xe::store_and_swap<uint16_t>(memory.TranslateVirtual(pointer),
+                                           (uint16_t)count);
+            } else {
+              xe::store_and_swap<uint32_t>(memory.TranslateVirtual(pointer),
+                                           (uint32_t)count);
+            }
+            continue;
+          }
+
+          // pointer
+          case 'p': {
+            digits = "0123456789ABCDEF";
+            radix = 16;
+            precision = 8;
+            flags &= ~(FF_IsLongLong | FF_IsShort);
+            flags |= FF_IsLong;
+            goto integer;
+          }
+
+          // wide string
+          case 'S': {
+            flags |= FF_InvertWide;
+            // fall through
+          }
+
+          // string
+          case 's': {
+            uint32_t pointer = args.get32();
+            int32_t cap = precision < 0 ? INT32_MAX : precision;
+
+            if (pointer == 0) {
+              auto nullstr = "(null)";
+              text.buffer = nullstr;
+              text.length = std::min((int32_t)strlen(nullstr), cap);
+              text.is_wide = false;
+            } else {
+              void* str = memory.TranslateVirtual(pointer);
+              bool is_wide;
+              if (flags & (FF_IsLong | FF_IsWide)) {
+                // "An ls, lS, ws or wS type specifier is synonymous with S in
+                // printf functions and with s in wprintf functions."
+                is_wide = true;
+              } else if (flags & FF_IsShort) {
+                // "An hs or hS type specifier is synonymous with s in printf
+                // functions and with S in wprintf functions."
+                is_wide = false;
+              } else {
+                is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
+              }
+              int32_t length;
+
+              if (!is_wide) {
+                length = 0;
+                for (auto s = (const uint8_t*)str; cap > 0 && *s; ++s, cap--) {
+                  length++;
+                }
+              } else {
+                length = 0;
+                for (auto s = (const uint16_t*)str; cap > 0 && *s; ++s, cap--) {
+                  length++;
+                }
+              }
+
+              text.buffer = str;
+              text.length = length;
+              text.is_wide = is_wide;
+            }
+            break;
+          }
+
+          // ANSI_STRING / UNICODE_STRING
+          case 'Z': {
+            assert_always();
+            break;
+          }
+
+          default: {
+            assert_always();
+          }
+        }
+      }
+    }
+
+    if (flags & FF_IsSigned) {
+      if (flags & FF_AddNegative) {
+        prefix.buffer[0] = '-';
+        prefix.length = 1;
+      } else if (flags & FF_AddPositive) {
+        prefix.buffer[0] = '+';
+        prefix.length = 1;
+      } else if (flags & FF_AddPositiveAsSpace) {
+        prefix.buffer[0] = ' ';
+        prefix.length = 1;
+      }
+    }
+
+    int32_t padding = width - text.length - prefix.length;
+
+    if (!(flags & (FF_LeftJustify | FF_AddLeadingZeros)) && padding > 0) {
+      count += padding;
+      while (padding-- > 0) {
+        if (!data.put(' ')) {
+          return -1;
+        }
+      }
+    }
+
+    if (prefix.length > 0) {
+      int32_t remaining = prefix.length;
+      count += prefix.length;
+      auto b = &prefix.buffer[0];
+      while (remaining-- > 0) {
+        if (!data.put(*b++)) {
+          return -1;
+        }
+      }
+    }
+
+    if ((flags & FF_AddLeadingZeros) && !(flags & (FF_LeftJustify)) &&
+        padding > 0) {
+      count += padding;
+      while (padding-- > 0) {
+        if (!data.put('0')) {
+          return -1;
+        }
+      }
+    }
+
+    int32_t remaining = text.length;
+    if (!text.is_wide) {
+      // it's a const char*
+      auto b = (const uint8_t*)text.buffer;
+      while (remaining-- > 0) {
+        if (!data.put(*b++)) {
+          return -1;
+        }
+      }
+    } else {
+      // it's a const char16_t*
+      auto b = (const uint16_t*)text.buffer;
+      if (text.swap_wide) {
+        while (remaining-- > 0) {
+          if (!data.put(xe::byte_swap(*b++))) {
+            return -1;
+          }
+        }
+      } else {
+        while (remaining-- > 0) {
+          if (!data.put(*b++)) {
+            return -1;
+          }
+        }
+      }
+    }
+    count += text.length;
+
+    // right padding
+    if ((flags & FF_LeftJustify) && padding > 0) {
+      count += padding;
+      while (padding-- > 0) {
+        if (!data.put(' ')) {
+          return -1;
+        }
+      }
+    }
+
+    state = FS_Unknown;
+  }
+
+  return count;
+}
+
+class ArrayArgList : public ArgList {
+ public:
+  ArrayArgList(const PrintfMemory& memory, uint32_t arg_ptr)
+      : memory(memory), arg_ptr_(arg_ptr), index_(0) {}
+
+  uint32_t get32() { return (uint32_t)get64(); }
+
+  uint64_t get64() {
+    auto value = xe::load_and_swap<uint64_t>(
+        memory.TranslateVirtual(arg_ptr_ + (8 * index_)));
+    ++index_;
+    return value;
+  }
+
+ private:
+  const PrintfMemory& memory;
+  uint32_t arg_ptr_;
+  int32_t index_;
+};
+
+class StringFormatData : public FormatData {
+ public:
+  StringFormatData(const uint8_t* input) : input_(input) {}
+
+  uint16_t get() {
+    uint16_t result = *input_;
+    if (result) {
+      input_++;
+    }
+    return result;
+  }
+
+  uint16_t peek(int32_t offset) { return input_[offset]; }
+
+  void skip(int32_t count) {
+    while (count-- > 0) {
+      if (!get()) {
+        break;
+      }
+    }
+  }
+
+  bool put(uint16_t c) {
+    if (c >= 0x100) {
+      return false;
+    }
+    output_.push_back(char(c));
+    return true;
+  }
+
+  const std::string& str() const { return output_; }
+
+ private:
+  const uint8_t* input_;
+  std::string output_;
+};
+
+class WideStringFormatData : public FormatData {
+ public:
+  WideStringFormatData(const uint16_t* input) : input_(input) {}
+
+  uint16_t get() {
+    uint16_t result = *input_;
+    if (result) {
+      input_++;
+    }
+    return xe::byte_swap(result);
+  }
+
+  uint16_t peek(int32_t offset) { return xe::byte_swap(input_[offset]); }
+
+  void skip(int32_t count) {
+    while (count-- > 0) {
+      if (!get()) {
+        break;
+      }
+    }
+  }
+
+  bool put(uint16_t c) {
+    output_.push_back(char16_t(c));
+    return true;
+  }
+
+  const std::u16string& wstr() const { return output_; }
+
+ private:
+  const uint16_t* input_;
+  std::u16string output_;
+};
+
+class WideCountFormatData : public FormatData {
+ public:
+  WideCountFormatData(const uint16_t* input) : input_(input), count_(0) {}
+
+  uint16_t get() {
+    uint16_t result = *input_;
+    if (result) {
+      input_++;
+    }
+    return xe::byte_swap(result);
+  }
+
+  uint16_t peek(int32_t offset) { return xe::byte_swap(input_[offset]); }
+
+  void skip(int32_t count) {
+    while (count-- > 0) {
+      if (!get()) {
+        break;
+      }
+    }
+  }
+
+  bool put(uint16_t c) {
+    ++count_;
+    return true;
+  }
+
+  const int32_t count() const { return count_; }
+
+ private:
+  const uint16_t* input_;
+  int32_t count_;
+};
+
+
+}  // namespace legacy
+
+// Flat host buffer standing in for guest memory, with a bump allocator.
+class TestMemory : public PrintfMemory {
+ public:
+  TestMemory() : data_(1024 * 1024) {}
+
+  uint8_t* TranslateVirtual(uint32_t guest_address) const override {
+    return guest_address ? const_cast<uint8_t*>(&data_[guest_address])
+                         : nullptr;
+  }
+
+  uint32_t Alloc(size_t size) {
+    uint32_t address = next_;
+    next_ += uint32_t(xe::round_up(size, size_t(8)));
+    REQUIRE(next_ <= data_.size());
+    return address;
+  }
+
+  uint32_t PutString(const std::string& value) {
+    uint32_t address = Alloc(value.size() + 1);
+    std::memcpy(&data_[address], value.c_str(), value.size() + 1);
+    return address;
+  }
+
+  uint32_t PutWideString(const std::u16string& value) {
+    uint32_t address = Alloc((value.size() + 1) * 2);
+    for (size_t i = 0; i <= value.size(); ++i) {
+      xe::store_and_swap<uint16_t>(&data_[address + i * 2],
+                                   i < value.size() ? value[i] : 0);
+    }
+    return address;
+  }
+
+  uint32_t PutArgs(const std::vector<uint64_t>& args) {
+    uint32_t address = Alloc(std::max(size_t(1), args.size()) * 8);
+    for (size_t i = 0; i < args.size(); ++i) {
+      xe::store_and_swap<uint64_t>(&data_[address + i * 8], args[i]);
+    }
+    return address;
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+  uint32_t next_ = 0x1000;
+};
+
+static uint64_t DoubleBits(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static std::u16string Widen(const std::string& value) {
+  return std::u16string(value.begin(), value.end());
+}
+
+static std::vector<uint64_t> GatherArgs(const TestMemory& memory,
+                                        uint32_t arg_ptr, uint32_t count) {
+  std::vector<uint64_t> args(std::max(count, 1u));
+  for (uint32_t i = 0; i < count; ++i) {
+    args[i] =
+        xe::load_and_swap<uint64_t>(memory.TranslateVirtual(arg_ptr + i * 8));
+  }
+  return args;
+}
+
+struct FormatCase {
+  std::string format;
+  std::vector<uint64_t> args;
+};
+
+// Formats with both implementations, through the narrow (vsprintf) and wide
+// (vswprintf and _vscwprintf) paths, and checks the results agree.
+static void CheckCase(TestMemory& memory, const FormatCase& test) {
+  INFO("format: \"" << test.format << "\"");
+  uint32_t arg_ptr = memory.PutArgs(test.args);
+
+  {
+    uint32_t format_ptr = memory.PutString(test.format);
+    legacy::ArrayArgList legacy_args(memory, arg_ptr);
+    legacy::StringFormatData legacy_data(
+        memory.TranslateVirtual(format_ptr));
+    int32_t legacy_count =
+        legacy::format_core(memory, legacy_data, legacy_args, false);
+
+    auto format = GetPrintfFormat(memory, format_ptr, false);
+    auto args = GatherArgs(memory, arg_ptr, format->arg_count);
+    std::string output;
+    int32_t count = FormatPrintf(*format, memory, args.data(), false, &output);
+
+    REQUIRE(count == legacy_count);
+    if (count >= 0) {
+      REQUIRE(output == legacy_data.str());
+    }
+  }
+
+  {
+    uint32_t format_ptr = memory.PutWideString(Widen(test.format));
+    auto format_host = reinterpret_cast<const uint16_t*>(
+        memory.TranslateVirtual(format_ptr));
+    legacy::ArrayArgList legacy_args(memory, arg_ptr);
+    legacy::WideStringFormatData legacy_data(format_host);
+    int32_t legacy_count =
+        legacy::format_core(memory, legacy_data, legacy_args, true);
+
+    auto format = GetPrintfFormat(memory, format_ptr, true);
+    auto args = GatherArgs(memory, arg_ptr, format->arg_count);
+    std::u16string output;
+    int32_t count = FormatPrintf(*format, memory, args.data(), true, &output);
+
+    REQUIRE(count == legacy_count);
+    if (count >= 0) {
+      REQUIRE(output == legacy_data.wstr());
+    }
+
+    legacy::ArrayArgList legacy_count_args(memory, arg_ptr);
+    legacy::WideCountFormatData legacy_count_data(format_host);
+    REQUIRE(CountPrintf(*format, memory, args.data(), true) ==
+            legacy::format_core(memory, legacy_count_data, legacy_count_args,
+                                true));
+  }
+}
+
+TEST_CASE("Guest printf matches the legacy formatter", "[guest_printf]") {
+  TestMemory memory;
+  uint32_t narrow_str = memory.PutString("narrow");
+  uint32_t wide_str = memory.PutWideString(u"wide");
+  uint32_t empty_str = memory.PutString("");
+  uint32_t high_str = memory.PutWideString(u"smile \u263A");
+
+  const double kNan = std::numeric_limits<double>::quiet_NaN();
+  const double kInf = std::numeric_limits<double>::infinity();
+
+  std::vector<FormatCase> cases = {
+      // Literals and escapes.
+      {"", {}},
+      {"plain text", {}},
+      {"100%% done", {}},
+      {"%%%%", {}},
+      // Truncated conversions fail.
+      {"abc%", {}},
+      {"%-", {}},
+      {"%08.3", {}},
+      {"%l", {}},
+      // Signed integers, flags, width and precision.
+      {"%d %i", {42, uint64_t(-42)}},
+      {"[%5d] [%-5d] [%05d] [%+d] [% d] [%+ d]", {7, 7, 7, 7, 7, 7}},
+      {"[%+05d] [%-+5d] [%- 5d] [%0-5d]", {uint64_t(-3), 3, 3, 3}},
+      {"[%.3d] [%8.3d] [%-8.3d] [%08.3d]", {5, uint64_t(-5), 5, 5}},
+      {"[%.0d] [%.0d] [%5.0d]", {0, 1, 0}},
+      {"%d %d", {0x7FFFFFFF, 0x80000000}},
+      {"%d", {0x123456789ull}},
+      {"%hd %hd %hi", {0x12345, 0xFFFF, 0x8000}},
+      {"%ld %li", {uint64_t(-1), 0x80000000}},
+      {"%lld %I64d %I64i", {0x123456789ull, uint64_t(-5), 1ull << 40}},
+      {"%I32d %Id", {uint64_t(-7), 9}},
+      // Unsigned integers.
+      {"%u %u %u", {0, 4294967295u, uint64_t(-1)}},
+      {"%hu %lu %llu %I64u", {0xFFFF, 0xFFFFFFFF, 1ull << 40, 1ull << 62}},
+      {"[%10u] [%-10u] [%010u] [%.12u]", {123, 123, 123, 123}},
+      {"%o %#o %#o %#.4o %#5o", {8, 8, 0, 8, 0}},
+      {"%llo %I64o", {0x7FFFFFFFFFFFFFFFull, 0777}},
+      {"%x %X %#x %#X %#x", {0xBEEF, 0xBEEF, 0xBEEF, 0xBEEF, 0}},
+      {"[%08x] [%#010x] [%-#10x] [%.6x] [%#.6X]",
+       {0xABC, 0xABC, 0xABC, 0xABC, 0xABC}},
+      {"%llx %I64X %hx", {0x123456789ABCDEFull, 0x7FFFFFFFFFFFFFFFull, 0x12345}},
+      {"%p %p %#p %20p %-12p|", {0x82001234, 0, 0x10, 0xDEAD, 0xBEEF}},
+      {"%lp %hp %llp", {0x1234, 0x5678, 0x1234567890ull}},
+      // Width and precision from arguments.
+      {"[%*d] [%-*d] [%*d]", {6, 42, 6, 42, uint64_t(-6), 42}},
+      {"[%.*d] [%.*d] [%*.*x]", {4, 7, uint64_t(-1), 7, 8, 3, 0xA}},
+      {"[%5*d]", {3, 9}},
+      {"[%.*s] [%*.*s]", {3, narrow_str, 10, 2, narrow_str}},
+      // Characters.
+      {"[%c] [%3c] [%-3c] [%c]", {'a', 'b', 'c', 0x141}},
+      {"[%hc] [%lc] [%wc] [%C]", {'x', 'y', 'z', 'w'}},
+      {"[%hC] [%lC] [%wC]", {'x', 'y', 'z'}},
+      {"[%lc]", {0x263A}},
+      // Strings.
+      {"[%s] [%10s] [%-10s] [%.3s]",
+       {narrow_str, narrow_str, narrow_str, narrow_str}},
+      {"[%s] [%.2s] [%8s] [%S] [%.0s]", {0, 0, 0, 0, 0}},
+      {"[%s]", {empty_str}},
+      {"[%hs] [%hS]", {narrow_str, narrow_str}},
+      {"[%ls] [%ws] [%lS] [%wS] [%.2ls]",
+       {wide_str, wide_str, wide_str, wide_str, wide_str}},
+      {"[%S] [%-8S]", {wide_str, wide_str}},
+      {"[%ls]", {high_str}},
+      // Floating point.
+      {"%f %f %f %f", {DoubleBits(0.0), DoubleBits(1.5), DoubleBits(-2.25),
+                       DoubleBits(123456.789)}},
+      {"[%.0f] [%.1f] [%.10f] [%#.0f]",
+       {DoubleBits(2.5), DoubleBits(0.05), DoubleBits(1.0 / 3),
+        DoubleBits(3.0)}},
+      {"[%10.2f] [%-10.2f] [%010.2f] [%+f] [% f] [%+010.1f]",
+       {DoubleBits(3.14159), DoubleBits(3.14159), DoubleBits(-3.14159),
+        DoubleBits(1.0), DoubleBits(1.0), DoubleBits(-0.5)}},
+      {"%e %E %.2e %.0E %#.0e",
+       {DoubleBits(12345.678), DoubleBits(0.000123), DoubleBits(-1e100),
+        DoubleBits(5e-300), DoubleBits(7.0)}},
+      {"%g %G %g %g %.3g %.0g %.0G %#g %#.3G",
+       {DoubleBits(100000.0), DoubleBits(1000000.0), DoubleBits(1e-5),
+        DoubleBits(0.0001), DoubleBits(3.14159), DoubleBits(2.5),
+        DoubleBits(2.5), DoubleBits(1.0), DoubleBits(0.5)}},
+      {"%a %A %a %#a",
+       {DoubleBits(1.0), DoubleBits(-0.375), DoubleBits(0.1),
+        DoubleBits(2.0)}},
+      {"%f %e %g", {DoubleBits(kInf), DoubleBits(-kInf), DoubleBits(kNan)}},
+      {"%E %G %10f|%-10e|", {DoubleBits(kInf), DoubleBits(kNan),
+                              DoubleBits(kInf), DoubleBits(-kInf)}},
+      {"%lf %Lf %llf %hf", {DoubleBits(1.25), DoubleBits(2.5),
+                            DoubleBits(3.75), DoubleBits(4.0)}},
+      {"%.20f %.17g", {DoubleBits(0.1), DoubleBits(0.1)}},
+      // Mixed.
+      {"%s: %d/%d (%5.1f%%) [%08X]",
+       {narrow_str, 3, 4, DoubleBits(75.0), 0xC0FFEE}},
+  };
+
+  for (const auto& test : cases) {
+    CheckCase(memory, test);
+  }
+}
+
+TEST_CASE("Guest printf narrow output rejects wide characters",
+          "[guest_printf]") {
+  TestMemory memory;
+  uint32_t high_str = memory.PutWideString(u"smile \u263A");
+  uint32_t format_ptr = memory.PutString("[%S]");
+  auto format = GetPrintfFormat(memory, format_ptr, false);
+  uint64_t args[] = {high_str};
+  std::string output;
+  REQUIRE(FormatPrintf(*format, memory, args, false, &output) == -1);
+}
+
+TEST_CASE("Guest printf handles the full 64-bit range", "[guest_printf]") {
+  // The legacy formatter kept 64-bit values signed while generating digits,
+  // so it could not print values with the top bit set.
+  TestMemory memory;
+  uint32_t format_ptr = memory.PutString("%llu %I64x %llo %lld");
+  auto format = GetPrintfFormat(memory, format_ptr, false);
+  uint64_t args[] = {uint64_t(-1), 1ull << 63, uint64_t(-1),
+                     0x8000000000000000ull};
+  std::string output;
+  REQUIRE(FormatPrintf(*format, memory, args, false, &output) > 0);
+  REQUIRE(output ==
+          "18446744073709551615 8000000000000000 1777777777777777777777 "
+          "-9223372036854775808");
+}
+
+TEST_CASE("Guest printf %n stores the count so far", "[guest_printf]") {
+  TestMemory memory;
+  uint32_t count_ptr = memory.Alloc(8);
+  uint32_t short_count_ptr = memory.Alloc(8);
+  uint32_t format_ptr = memory.PutString("abc%nde%hnf");
+  auto format = GetPrintfFormat(memory, format_ptr, false);
+  REQUIRE(format->arg_count == 2);
+  uint64_t args[] = {count_ptr, short_count_ptr};
+  std::string output;
+  REQUIRE(FormatPrintf(*format, memory, args, false, &output) == 6);
+  REQUIRE(output == "abcdef");
+  REQUIRE(xe::load_and_swap<uint32_t>(memory.TranslateVirtual(count_ptr)) ==
+          3);
+  REQUIRE(xe::load_and_swap<uint16_t>(
+              memory.TranslateVirtual(short_count_ptr)) == 5);
+}
+
+TEST_CASE("Guest printf cache notices rewritten formats", "[guest_printf]") {
+  TestMemory memory;
+  uint32_t format_ptr = memory.Alloc(64);
+  uint64_t args[] = {42, 43};
+
+  auto format_host = reinterpret_cast<char*>(memory.TranslateVirtual(format_ptr));
+  std::strcpy(format_host, "value %d");
+  auto format = GetPrintfFormat(memory, format_ptr, false);
+  REQUIRE(GetPrintfFormat(memory, format_ptr, false) == format);
+  std::string output;
+  REQUIRE(FormatPrintf(*format, memory, args, false, &output) == 8);
+  REQUIRE(output == "value 42");
+
+  // Same address, same length, different contents.
+  std::strcpy(format_host, "value %x");
+  format = GetPrintfFormat(memory, format_ptr, false);
+  output.clear();
+  REQUIRE(FormatPrintf(*format, memory, args, false, &output) == 8);
+  REQUIRE(output == "value 2a");
+
+  // Shorter string at the same address.
+  std::strcpy(format_host, "%d");
+  format = GetPrintfFormat(memory, format_ptr, false);
+  output.clear();
+  REQUIRE(FormatPrintf(*format, memory, args, false, &output) == 2);
+  REQUIRE(output == "42");
+}
+
+TEST_CASE("Guest printf throughput", "[guest_printf][.benchmark]") {
+  constexpr int kIterationCount = 200000;
+  TestMemory memory;
+  uint32_t name_str = memory.PutString("player");
+  uint32_t format_ptr =
+      memory.PutString("[%8.3f] %s: frame %u, %d objects, 0x%08X (%5.1f%%)\n");
+  uint32_t arg_ptr = memory.PutArgs({DoubleBits(12.3456), name_str, 1234, 567,
+                                     0xDEADBEEF, DoubleBits(42.5)});
+
+  size_t legacy_total = 0;
+  auto legacy_start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterationCount; ++i) {
+    legacy::ArrayArgList args(memory, arg_ptr);
+    legacy::StringFormatData data(memory.TranslateVirtual(format_ptr));
+    legacy::format_core(memory, data, args, false);
+    legacy_total += data.str().size();
+  }
+  auto legacy_elapsed = std::chrono::steady_clock::now() - legacy_start;
+
+  size_t total = 0;
+  std::string output;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterationCount; ++i) {
+    auto format = GetPrintfFormat(memory, format_ptr, false);
+    auto args = GatherArgs(memory, arg_ptr, format->arg_count);
+    output.clear();
+    FormatPrintf(*format, memory, args.data(), false, &output);
+    total += output.size();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  REQUIRE(total == legacy_total);
+
+  auto to_ns = [](auto duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+               .count() /
+           kIterationCount;
+  };
+  WARN("legacy: " << to_ns(legacy_elapsed) << "ns/call, spec list: "
+                  << to_ns(elapsed) << "ns/call");
+}
+
+}  // namespace xe::kernel::util::test
@@ -0,0 +1,179 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/host_apc_queue.h"
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::kernel::util::test {
+
+// Delivers APCs the way XThread::DeliverAPCs does, with guest_list standing
+// in for the guest KAPC list. APCs are identified by their normal context,
+// and on_deliver runs as the routine of each.
+static std::vector<uint32_t> Deliver(
+    HostApcQueue* queue, std::deque<uint32_t>* guest_list,
+    const std::function<void(uint32_t)>& on_deliver = nullptr) {
+  std::vector<uint32_t> delivered;
+  while (true) {
+    queue->Take();
+    uint64_t guest_sequence =
+        queue->GuestApcSequence(guest_list->empty() ? 0 : guest_list->front());
+    if (queue->FrontPrecedes(guest_sequence)) {
+      while (queue->FrontPrecedes(guest_sequence)) {
+        uint32_t context = queue->Pop().normal_context;
+        delivered.push_back(context);
+        if (on_deliver) {
+          on_deliver(context);
+        }
+      }
+      continue;
+    }
+    if (guest_list->empty()) {
+      break;
+    }
+    uint32_t apc_ptr = guest_list->front();
+    guest_list->pop_front();
+    queue->RemoveGuestApc(apc_ptr);
+    delivered.push_back(apc_ptr);
+    if (on_deliver) {
+      on_deliver(apc_ptr);
+    }
+  }
+  return delivered;
+}
+
+static void InsertGuestApc(HostApcQueue* queue, std::deque<uint32_t>* list,
+                           uint32_t apc_ptr) {
+  queue->InsertGuestApc(apc_ptr);
+  list->push_back(apc_ptr);
+}
+
+TEST_CASE("HostApcQueue takes APCs in push order", "[apc]") {
+  HostApcQueue queue;
+  queue.Push(0x82000000, 1, 0, 0);
+  queue.Push(0x82000000, 2, 0, 0);
+  // Nothing is visible before being taken.
+  REQUIRE(queue.front() == nullptr);
+  queue.Take();
+  queue.Push(0x82000000, 3, 0, 0);
+  REQUIRE(queue.front()->normal_context == 1);
+  REQUIRE(queue.Pop().normal_context == 1);
+  queue.Take();
+  auto second = queue.Pop();
+  auto third = queue.Pop();
+  REQUIRE(second.normal_context == 2);
+  REQUIRE(third.normal_context == 3);
+  REQUIRE(second.sequence < third.sequence);
+  REQUIRE(queue.front() == nullptr);
+  REQUIRE_FALSE(queue.FrontPrecedes(UINT64_MAX));
+
+  queue.Push(0x82000000, 4, 0, 0);
+  queue.Clear();
+  queue.Take();
+  REQUIRE(queue.front() == nullptr);
+}
+
+TEST_CASE("Host and guest APCs are delivered in queue order", "[apc]") {
+  HostApcQueue queue;
+  std::deque<uint32_t> guest_list;
+
+  SECTION("Interleaved") {
+    queue.Push(0x82000000, 1, 0, 0);
+    InsertGuestApc(&queue, &guest_list, 0x40001000);
+    queue.Push(0x82000000, 2, 0, 0);
+    queue.Push(0x82000000, 3, 0, 0);
+    InsertGuestApc(&queue, &guest_list, 0x40002000);
+    InsertGuestApc(&queue, &guest_list, 0x40003000);
+    queue.Push(0x82000000, 4, 0, 0);
+    REQUIRE(Deliver(&queue, &guest_list) ==
+            std::vector<uint32_t>{1, 0x40001000, 2, 3, 0x40002000, 0x40003000,
+                                  4});
+  }
+  SECTION("Removed guest APC") {
+    InsertGuestApc(&queue, &guest_list, 0x40001000);
+    queue.Push(0x82000000, 1, 0, 0);
+    queue.RemoveGuestApc(0x40001000);
+    guest_list.pop_front();
+    REQUIRE(Deliver(&queue, &guest_list) == std::vector<uint32_t>{1});
+  }
+  SECTION("Guest APCs restored from a save") {
+    queue.Push(0x82000000, 1, 0, 0);
+    // Not inserted through the queue, so its number is unknown.
+    guest_list.push_back(0x40001000);
+    REQUIRE(Deliver(&queue, &guest_list) ==
+            std::vector<uint32_t>{0x40001000, 1});
+  }
+  SECTION("Queued while delivering") {
+    queue.Push(0x82000000, 1, 0, 0);
+    queue.Push(0x82000000, 2, 0, 0);
+    InsertGuestApc(&queue, &guest_list, 0x40001000);
+    auto delivered = Deliver(&queue, &guest_list, [&](uint32_t id) {
+      // The routines of APCs may queue more, which come after the ones
+      // already queued, host or guest.
+      if (id == 1) {
+        queue.Push(0x82000000, 3, 0, 0);
+        InsertGuestApc(&queue, &guest_list, 0x40002000);
+        queue.Push(0x82000000, 4, 0, 0);
+      } else if (id == 0x40001000) {
+        InsertGuestApc(&queue, &guest_list, 0x40003000);
+        queue.Push(0x82000000, 5, 0, 0);
+      }
+    });
+    REQUIRE(delivered == std::vector<uint32_t>{1, 2, 0x40001000, 3, 0x40002000,
+                                               4, 0x40003000, 5});
+  }
+}
+
+TEST_CASE("HostApcQueue pushes from several threads", "[apc]") {
+  constexpr uint32_t kThreadCount = 4;
+  constexpr uint32_t kApcCount = 10000;
+  HostApcQueue queue;
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&queue, i]() {
+      for (uint32_t j = 0; j < kApcCount; ++j) {
+        queue.Push(0x82000000, (i << 16) | j, 0, 0);
+      }
+    });
+  }
+
+  // Pushes racing each other may be taken in either order, but those of each
+  // thread come in order.
+  std::vector<uint32_t> next(kThreadCount, 0);
+  std::vector<uint64_t> last_sequence(kThreadCount, 0);
+  uint32_t taken = 0;
+  bool in_order = true;
+  auto take_all = [&]() {
+    queue.Take();
+    while (queue.front()) {
+      auto apc = queue.Pop();
+      uint32_t thread = apc.normal_context >> 16;
+      in_order &= (apc.normal_context & 0xFFFF) == next[thread]++ &&
+                  apc.sequence > last_sequence[thread];
+      last_sequence[thread] = apc.sequence;
+      ++taken;
+    }
+  };
+  while (taken < kThreadCount * kApcCount / 2) {
+    take_all();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  take_all();
+  REQUIRE(in_order);
+  REQUIRE(taken == kThreadCount * kApcCount);
+}
+
+}  // namespace xe::kernel::util::test
@@ -0,0 +1,218 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/object_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::kernel::util::test {
+
+// Host-only object that does not register itself with a kernel state, so it
+// can be placed in a standalone table.
+class TestObject : public XObject {
+ public:
+  static constexpr Type kObjectType = Type::Event;
+
+  explicit TestObject(std::atomic<int>* destroyed_count)
+      : XObject(kObjectType), destroyed_count_(destroyed_count) {}
+  ~TestObject() override {
+    if (destroyed_count_) {
+      ++*destroyed_count_;
+    }
+  }
+
+ private:
+  std::atomic<int>* destroyed_count_;
+};
+
+TEST_CASE("ObjectTable add, lookup and remove", "[object_table]") {
+  std::atomic<int> destroyed_count(0);
+  ObjectTable table;
+
+  auto object = new TestObject(&destroyed_count);
+  X_HANDLE handle = 0;
+  REQUIRE(table.AddHandle(object, &handle) == X_STATUS_SUCCESS);
+  REQUIRE(handle >= XObject::kHandleBase);
+  REQUIRE(object->handles().size() == 1);
+  REQUIRE(object->handles()[0] == handle);
+
+  {
+    auto ref = table.LookupObject<TestObject>(handle);
+    REQUIRE(ref.get() == object);
+  }
+  REQUIRE(!table.LookupObject<XObject>(handle + 4));
+  REQUIRE(!table.LookupObject<XObject>(0x12345678));
+
+  X_HANDLE duplicate_handle = 0;
+  REQUIRE(table.DuplicateHandle(handle, &duplicate_handle) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(duplicate_handle != handle);
+  REQUIRE(table.LookupObject<XObject>(duplicate_handle).get() == object);
+
+  REQUIRE(table.ReleaseHandle(duplicate_handle) == X_STATUS_SUCCESS);
+  REQUIRE(!table.LookupObject<XObject>(duplicate_handle));
+  REQUIRE(table.ReleaseHandle(handle) == X_STATUS_SUCCESS);
+  REQUIRE(!table.LookupObject<XObject>(handle));
+  REQUIRE(object->handles().empty());
+
+  REQUIRE(destroyed_count == 0);
+  object->Release();
+  REQUIRE(destroyed_count == 1);
+}
+
+TEST_CASE("ObjectTable grows past one segment", "[object_table]") {
+  std::atomic<int> destroyed_count(0);
+  constexpr int kObjectCount = 20000;
+  {
+    ObjectTable table;
+    std::vector<X_HANDLE> handles;
+    for (int i = 0; i < kObjectCount; ++i) {
+      auto object = new TestObject(&destroyed_count);
+      X_HANDLE handle = 0;
+      REQUIRE(table.AddHandle(object, &handle) == X_STATUS_SUCCESS);
+      object->Release();
+      handles.push_back(handle);
+    }
+    for (int i = 0; i < kObjectCount; ++i) {
+      REQUIRE(table.LookupObject<XObject>(handles[i]));
+    }
+    REQUIRE(table.GetObjectsByType<TestObject>().size() == kObjectCount);
+    // Objects still in the table are released with it.
+    REQUIRE(table.ReleaseHandle(handles[0]) == X_STATUS_SUCCESS);
+    REQUIRE(destroyed_count == 1);
+  }
+  REQUIRE(destroyed_count == kObjectCount);
+}
+
+TEST_CASE("ObjectTable lookups race with removal", "[object_table]") {
+  std::atomic<int> destroyed_count(0);
+  ObjectTable table;
+
+  constexpr int kHandleCount = 64;
+  constexpr int kRoundCount = 2000;
+  std::vector<std::atomic<X_HANDLE>> handles(kHandleCount);
+  for (auto& handle : handles) {
+    auto object = new TestObject(&destroyed_count);
+    X_HANDLE new_handle = 0;
+    REQUIRE(table.AddHandle(object, &new_handle) == X_STATUS_SUCCESS);
+    object->Release();
+    handle = new_handle;
+  }
+
+  // Readers retain whatever currently lives in each slot while the main thread
+  // keeps replacing the objects; a lookup that retains a destroyed object is
+  // caught by the destroyed count check below (or by the address sanitizer).
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> hits(0);
+  std::atomic<uint64_t> bad_hits(0);
+  std::atomic<unsigned int> started(0);
+  std::vector<std::thread> readers;
+  // More readers than cores, so that some are preempted mid-lookup and
+  // removals have to block until they drain.
+  auto reader_count = std::max(4u, std::thread::hardware_concurrency() * 2);
+  for (unsigned int i = 0; i < reader_count; ++i) {
+    readers.emplace_back([&, i] {
+      ++started;
+      uint64_t local_hits = 0;
+      for (uint32_t n = i; !stop; ++n) {
+        auto object =
+            table.LookupObject<TestObject>(handles[n % kHandleCount]);
+        if (object) {
+          if (object->type() != TestObject::kObjectType) {
+            ++bad_hits;
+          }
+          ++local_hits;
+        }
+      }
+      hits += local_hits;
+    });
+  }
+
+  while (started != reader_count) {
+    std::this_thread::yield();
+  }
+  for (int round = 0; round < kRoundCount; ++round) {
+    int index = round % kHandleCount;
+    REQUIRE(table.ReleaseHandle(handles[index]) == X_STATUS_SUCCESS);
+    auto object = new TestObject(&destroyed_count);
+    X_HANDLE new_handle = 0;
+    REQUIRE(table.AddHandle(object, &new_handle) == X_STATUS_SUCCESS);
+    object->Release();
+    handles[index] = new_handle;
+  }
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  REQUIRE(destroyed_count == kRoundCount);
+  REQUIRE(table.contention_stats().reclaims == uint64_t(kRoundCount));
+  REQUIRE(hits > 0);
+  REQUIRE(bad_hits == 0);
+}
+
+TEST_CASE("ObjectTable concurrent lookup throughput",
+          "[object_table][.benchmark]") {
+  constexpr int kHandleCount = 256;
+  constexpr uint64_t kLookupsPerThread = 4000000;
+
+  ObjectTable table;
+  std::vector<X_HANDLE> handles;
+  for (int i = 0; i < kHandleCount; ++i) {
+    auto object = new TestObject(nullptr);
+    X_HANDLE handle = 0;
+    REQUIRE(table.AddHandle(object, &handle) == X_STATUS_SUCCESS);
+    object->Release();
+    handles.push_back(handle);
+  }
+
+  for (unsigned int thread_count = 1;
+       thread_count <= std::max(1u, std::thread::hardware_concurrency());
+       thread_count *= 2) {
+    std::atomic<bool> go(false);
+    std::atomic<uint64_t> misses(0);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < thread_count; ++i) {
+      threads.emplace_back([&table, &handles, &go, &misses, i] {
+        while (!go) {
+          std::this_thread::yield();
+        }
+        for (uint64_t n = 0; n < kLookupsPerThread; ++n) {
+          if (!table.LookupObject<XObject>(handles[(n + i) % kHandleCount])) {
+            ++misses;
+          }
+        }
+      });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    REQUIRE(misses == 0);
+    auto lookups_per_second =
+        double(kLookupsPerThread * thread_count) /
+        std::chrono::duration<double>(elapsed).count();
+    WARN(thread_count << " threads: " << uint64_t(lookups_per_second)
+                      << " lookups/s");
+  }
+
+  auto stats = table.contention_stats();
+  WARN("Lookup retries: " << stats.lookup_retries
+                          << ", reclaim waits: " << stats.reclaim_waits
+                          << ", blocked: " << stats.reclaim_blocks);
+}
+
+}  // namespace xe::kernel::util::test
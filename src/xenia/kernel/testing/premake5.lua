@@ -0,0 +1,14 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+test_suite("xenia-kernel-tests", project_root, ".", {
+  links = {
+    "fmt",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-kernel",
+    "xenia-ui", -- needed by xenia-base
+    "xenia-vfs",
+  },
+})
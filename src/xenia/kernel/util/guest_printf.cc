@@ -0,0 +1,825 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/guest_printf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/memory.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+enum FormatState {
+  FS_Invalid = 0,
+  FS_Unknown,
+  FS_Start,
+  FS_Flags,
+  FS_Width,
+  FS_PrecisionStart,
+  FS_Precision,
+  FS_Size,
+  FS_Type,
+  FS_End,
+};
+
+enum FormatFlags {
+  FF_LeftJustify = 1 << 0,
+  FF_AddLeadingZeros = 1 << 1,
+  FF_AddPositive = 1 << 2,
+  FF_AddPositiveAsSpace = 1 << 3,
+  FF_AddNegative = 1 << 4,
+  FF_AddPrefix = 1 << 5,
+  FF_IsShort = 1 << 6,
+  FF_IsLong = 1 << 7,
+  FF_IsLongLong = 1 << 8,
+  FF_IsWide = 1 << 9,
+  FF_IsSigned = 1 << 10,
+  FF_ForceLeadingZero = 1 << 11,
+  FF_InvertWide = 1 << 12,
+};
+
+// Integer precision is capped to this many digits.
+constexpr int32_t kMaxIntegerPrecision = 512;
+
+// Number of parsed formats kept per thread before the cache is flushed.
+constexpr size_t kFormatCacheSize = 256;
+
+static bool ConsumesArg(uint16_t type) {
+  switch (type) {
+    case 'c':
+    case 'C':
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+    case 'n':
+    case 'p':
+    case 's':
+    case 'S':
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void ReadFormatSource(const PrintfMemory& memory, uint32_t format_ptr,
+                             bool format_is_wide,
+                             std::vector<uint16_t>* source) {
+  source->clear();
+  if (format_is_wide) {
+    auto input =
+        reinterpret_cast<const uint16_t*>(memory.TranslateVirtual(format_ptr));
+    uint16_t c;
+    do {
+      c = xe::byte_swap(*input++);
+      source->push_back(c);
+    } while (c);
+  } else {
+    auto input = memory.TranslateVirtual(format_ptr);
+    auto length = std::strlen(reinterpret_cast<const char*>(input));
+    source->assign(input, input + length + 1);
+  }
+}
+
+static bool MatchesFormatSource(const PrintfMemory& memory,
+                                uint32_t format_ptr, bool format_is_wide,
+                                const std::vector<uint16_t>& source) {
+  // Stops at the first difference, so this never reads past the guest string.
+  if (format_is_wide) {
+    auto input =
+        reinterpret_cast<const uint16_t*>(memory.TranslateVirtual(format_ptr));
+    for (size_t i = 0; i < source.size(); ++i) {
+      if (xe::byte_swap(input[i]) != source[i]) {
+        return false;
+      }
+    }
+  } else {
+    auto input = memory.TranslateVirtual(format_ptr);
+    for (size_t i = 0; i < source.size(); ++i) {
+      if (input[i] != source[i]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+PrintfFormat ParsePrintfFormat(const PrintfMemory& memory, uint32_t format_ptr,
+                               bool format_is_wide) {
+  PrintfFormat format;
+  ReadFormatSource(memory, format_ptr, format_is_wide, &format.source);
+
+  const uint16_t* input = format.source.data();
+  auto get = [&input]() {
+    uint16_t c = *input;
+    if (c) {
+      input++;
+    }
+    return c;
+  };
+  auto peek = [&input](int32_t offset) { return input[offset]; };
+  auto skip = [&get](int32_t count) {
+    while (count-- > 0) {
+      if (!get()) {
+        break;
+      }
+    }
+  };
+
+  PrintfSpec spec;
+  auto end_spec = [&format, &spec]() {
+    if (spec.has_conversion || spec.literal_length) {
+      format.specs.push_back(spec);
+    }
+    spec = PrintfSpec();
+    spec.literal_offset = uint32_t(format.literals.size());
+  };
+
+  auto state = FS_Unknown;
+  for (uint16_t c = get();; c = get()) {
+    if (state == FS_Unknown) {
+      if (!c) {  // the end
+        end_spec();
+        return format;
+      } else if (c != '%') {
+      output:
+        format.literals.push_back(c);
+        spec.literal_length++;
+        continue;
+      }
+
+      state = FS_Start;
+      c = get();
+      // fall through
+    }
+
+    // in any state, if c is \0, it's bad
+    if (!c) {
+      spec.has_conversion = false;
+      end_spec();
+      format.truncated = true;
+      return format;
+    }
+
+  restart:
+    switch (state) {
+      case FS_Invalid:
+      case FS_Unknown:
+      case FS_End:
+      default: {
+        assert_always();
+      }
+
+      case FS_Start: {
+        if (c == '%') {
+          state = FS_Unknown;
+          goto output;
+        }
+
+        state = FS_Flags;
+
+        // reset to defaults
+        spec.flags = 0;
+        spec.width = 0;
+        spec.precision = -1;
+        spec.width_from_arg = false;
+        spec.precision_from_arg = false;
+
+        // fall through, don't need to goto restart
+      }
+
+      // https://msdn.microsoft.com/en-us/library/8aky45ct.aspx
+      case FS_Flags: {
+        if (c == '-') {
+          spec.flags |= FF_LeftJustify;
+          continue;
+        } else if (c == '+') {
+          spec.flags |= FF_AddPositive;
+          continue;
+        } else if (c == '0') {
+          spec.flags |= FF_AddLeadingZeros;
+          continue;
+        } else if (c == ' ') {
+          spec.flags |= FF_AddPositiveAsSpace;
+          continue;
+        } else if (c == '#') {
+          spec.flags |= FF_AddPrefix;
+          continue;
+        }
+        state = FS_Width;
+        // fall through, don't need to goto restart
+      }
+
+      // https://msdn.microsoft.com/en-us/library/25366k66.aspx
+      case FS_Width: {
+        if (c == '*') {
+          spec.width_from_arg = true;
+          format.arg_count++;
+          state = FS_PrecisionStart;
+          continue;
+        } else if (c >= '0' && c <= '9') {
+          spec.width *= 10;
+          spec.width += c - '0';
+          continue;
+        }
+        state = FS_PrecisionStart;
+        // fall through, don't need to goto restart
+      }
+
+      // https://msdn.microsoft.com/en-us/library/0ecbz014.aspx
+      case FS_PrecisionStart: {
+        if (c == '.') {
+          state = FS_Precision;
+          spec.precision = 0;
+          continue;
+        }
+        state = FS_Size;
+        goto restart;
+      }
+
+      // https://msdn.microsoft.com/en-us/library/0ecbz014.aspx
+      case FS_Precision: {
+        if (c == '*') {
+          spec.precision_from_arg = true;
+          format.arg_count++;
+          state = FS_Size;
+          continue;
+        } else if (c >= '0' && c <= '9') {
+          spec.precision *= 10;
+          spec.precision += c - '0';
+          continue;
+        }
+        state = FS_Size;
+        // fall through
+      }
+
+      // https://msdn.microsoft.com/en-us/library/tcxf1dw6.aspx
+      case FS_Size: {
+        if (c == 'l') {
+          if (peek(0) == 'l') {
+            skip(1);
+            spec.flags |= FF_IsLongLong;
+          } else {
+            spec.flags |= FF_IsLong;
+          }
+          state = FS_Type;
+          continue;
+        } else if (c == 'L') {
+          // 58410826 incorrectly uses 'L' instead of 'l'.
+          // TODO(gibbed): L appears to be treated as an invalid token by
+          // xboxkrnl, investigate how invalid tokens are processed in xboxkrnl
+          // formatting when state FF_Type is reached.
+          state = FS_Type;
+          continue;
+        } else if (c == 'h') {
+          spec.flags |= FF_IsShort;
+          state = FS_Type;
+          continue;
+        } else if (c == 'w') {
+          spec.flags |= FF_IsWide;
+          state = FS_Type;
+          continue;
+        } else if (c == 'I') {
+          if (peek(0) == '6' && peek(1) == '4') {
+            skip(2);
+            spec.flags |= FF_IsLongLong;
+          } else if (peek(0) == '3' && peek(1) == '2') {
+            skip(2);
+          }
+          state = FS_Type;
+          continue;
+        }
+        // fall through
+      }
+
+      // https://msdn.microsoft.com/en-us/library/hf4y5e3w.aspx
+      case FS_Type: {
+        spec.type = c;
+        spec.has_conversion = true;
+        if (ConsumesArg(c)) {
+          format.arg_count++;
+        }
+        break;
+      }
+    }
+
+    end_spec();
+    state = FS_Unknown;
+  }
+}
+
+const PrintfFormat* GetPrintfFormat(const PrintfMemory& memory,
+                                    uint32_t format_ptr, bool format_is_wide) {
+  thread_local std::unordered_map<uint64_t, std::unique_ptr<PrintfFormat>>
+      cache;
+  uint64_t key = uint64_t(format_ptr) | (uint64_t(format_is_wide) << 32);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    if (MatchesFormatSource(memory, format_ptr, format_is_wide,
+                            it->second->source)) {
+      return it->second.get();
+    }
+    // The guest reused the address for a different string.
+    *it->second = ParsePrintfFormat(memory, format_ptr, format_is_wide);
+    return it->second.get();
+  }
+  if (cache.size() >= kFormatCacheSize) {
+    cache.clear();
+  }
+  auto format = std::make_unique<PrintfFormat>(
+      ParsePrintfFormat(memory, format_ptr, format_is_wide));
+  auto result = format.get();
+  cache.emplace(key, std::move(format));
+  return result;
+}
+
+namespace {
+
+class NarrowOutput {
+ public:
+  explicit NarrowOutput(std::string* output) : output_(output) {}
+  bool put(uint16_t c) {
+    if (c >= 0x100) {
+      return false;
+    }
+    output_->push_back(char(c));
+    return true;
+  }
+  bool fill(uint16_t c, int32_t count) {
+    output_->append(size_t(count), char(c));
+    return true;
+  }
+  bool append(const char* text, int32_t length) {
+    output_->append(text, size_t(length));
+    return true;
+  }
+  bool append(const uint16_t* text, int32_t length, bool swap) {
+    for (int32_t i = 0; i < length; ++i) {
+      if (!put(swap ? xe::byte_swap(text[i]) : text[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::string* output_;
+};
+
+class WideOutput {
+ public:
+  explicit WideOutput(std::u16string* output) : output_(output) {}
+  bool fill(uint16_t c, int32_t count) {
+    output_->append(size_t(count), char16_t(c));
+    return true;
+  }
+  bool append(const char* text, int32_t length) {
+    for (int32_t i = 0; i < length; ++i) {
+      output_->push_back(char16_t(uint8_t(text[i])));
+    }
+    return true;
+  }
+  bool append(const uint16_t* text, int32_t length, bool swap) {
+    if (!swap) {
+      output_->append(reinterpret_cast<const char16_t*>(text), size_t(length));
+      return true;
+    }
+    for (int32_t i = 0; i < length; ++i) {
+      output_->push_back(char16_t(xe::byte_swap(text[i])));
+    }
+    return true;
+  }
+
+ private:
+  std::u16string* output_;
+};
+
+class CountOutput {
+ public:
+  bool fill(uint16_t c, int32_t count) { return true; }
+  bool append(const char* text, int32_t length) { return true; }
+  bool append(const uint16_t* text, int32_t length, bool swap) {
+    return true;
+  }
+};
+
+// Renders a non-negative double the way the legacy ostream based formatter
+// did, which matches the host printf for the same conversion.
+template <typename OutputIt>
+OutputIt FormatDouble(OutputIt out, double value, int32_t precision,
+                      uint16_t c, uint32_t flags) {
+  if (precision < 0) {
+    precision = 6;
+  } else if (precision == 0 && (c == 'g' || c == 'G')) {
+    precision = 1;
+  }
+  bool alternate = (flags & FF_AddPrefix) != 0;
+  switch (c) {
+    case 'f':
+      return alternate ? fmt::format_to(out, "{:#.{}f}", value, precision)
+                       : fmt::format_to(out, "{:.{}f}", value, precision);
+    case 'e':
+      return alternate ? fmt::format_to(out, "{:#.{}e}", value, precision)
+                       : fmt::format_to(out, "{:.{}e}", value, precision);
+    case 'E':
+      return alternate ? fmt::format_to(out, "{:#.{}E}", value, precision)
+                       : fmt::format_to(out, "{:.{}E}", value, precision);
+    case 'g':
+      return alternate ? fmt::format_to(out, "{:#.{}g}", value, precision)
+                       : fmt::format_to(out, "{:.{}g}", value, precision);
+    case 'G':
+      return alternate ? fmt::format_to(out, "{:#.{}G}", value, precision)
+                       : fmt::format_to(out, "{:.{}G}", value, precision);
+    // Hexadecimal output ignores the precision, like std::hexfloat.
+    case 'a':
+      return alternate ? fmt::format_to(out, "{:#a}", value)
+                       : fmt::format_to(out, "{:a}", value);
+    case 'A':
+      return alternate ? fmt::format_to(out, "{:#A}", value)
+                       : fmt::format_to(out, "{:A}", value);
+    default:
+      assert_always();
+      return out;
+  }
+}
+
+template <typename Output>
+int32_t Render(const PrintfFormat& format, const PrintfMemory& memory,
+               const uint64_t* args, const bool wide, Output& output) {
+  int32_t count = 0;
+  fmt::memory_buffer work8;
+  uint16_t work16[1];
+
+  for (const auto& spec : format.specs) {
+    if (spec.literal_length) {
+      if (!output.append(&format.literals[spec.literal_offset],
+                         int32_t(spec.literal_length), false)) {
+        return -1;
+      }
+      count += int32_t(spec.literal_length);
+    }
+    if (!spec.has_conversion) {
+      continue;
+    }
+
+    uint32_t flags = spec.flags;
+    int32_t width = spec.width;
+    int32_t precision = spec.precision;
+    if (spec.width_from_arg) {
+      width = int32_t(uint32_t(*args++));
+      if (width < 0) {
+        flags |= FF_LeftJustify;
+        width = -width;
+      }
+    }
+    if (spec.precision_from_arg) {
+      precision = int32_t(uint32_t(*args++));
+      if (precision < 0) {
+        precision = -1;
+      }
+    }
+
+    struct {
+      const void* buffer;
+      int32_t length;
+      bool is_wide;
+      bool swap_wide;
+    } text = {nullptr, 0, false, true};
+
+    struct {
+      char buffer[2];
+      int32_t length;
+    } prefix = {{'\0', '\0'}, 0};
+
+    work8.clear();
+    uint16_t c = spec.type;
+    switch (c) {
+      // wide character
+      case 'C':
+        flags |= FF_InvertWide;
+        [[fallthrough]];
+      // character
+      case 'c': {
+        bool is_wide;
+        if (flags & (FF_IsLong | FF_IsWide)) {
+          // "An lc, lC, wc or wC type specifier is synonymous with C in
+          // printf functions and with c in wprintf functions."
+          is_wide = true;
+        } else if (flags & FF_IsShort) {
+          // "An hc or hC type specifier is synonymous with c in printf
+          // functions and with C in wprintf functions."
+          is_wide = false;
+        } else {
+          is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
+        }
+
+        auto value = uint32_t(*args++);
+        if (!is_wide) {
+          work8.push_back(char(uint8_t(value)));
+          text.buffer = work8.data();
+          text.length = 1;
+        } else {
+          work16[0] = uint16_t(value);
+          text.buffer = work16;
+          text.length = 1;
+          text.is_wide = true;
+          text.swap_wide = false;
+        }
+        break;
+      }
+
+      // signed decimal integer
+      case 'd':
+      case 'i':
+      // unsigned octal integer
+      case 'o':
+      // unsigned decimal integer
+      case 'u':
+      // unsigned hexadecimal integer
+      case 'x':
+      case 'X':
+      // pointer
+      case 'p': {
+        if (c == 'd' || c == 'i') {
+          flags |= FF_IsSigned;
+        } else if (c == 'o') {
+          if (flags & FF_AddPrefix) {
+            flags |= FF_ForceLeadingZero;
+          }
+        } else if (c == 'x' || c == 'X') {
+          if (flags & FF_AddPrefix) {
+            prefix.buffer[0] = '0';
+            prefix.buffer[1] = char(c);
+            prefix.length = 2;
+          }
+        } else if (c == 'p') {
+          precision = 8;
+          flags &= ~(FF_IsLongLong | FF_IsShort);
+          flags |= FF_IsLong;
+        }
+
+        int64_t value;
+        if (flags & FF_IsLongLong) {
+          value = int64_t(*args++);
+        } else if (flags & FF_IsShort) {
+          value = int16_t(uint32_t(*args++));
+        } else {
+          value = int32_t(uint32_t(*args++));
+        }
+
+        if (precision >= 0) {
+          precision = std::min(precision, kMaxIntegerPrecision);
+        } else {
+          precision = 1;
+        }
+
+        uint64_t magnitude = uint64_t(value);
+        if ((flags & FF_IsSigned) && value < 0) {
+          magnitude = 0 - magnitude;
+          flags |= FF_AddNegative;
+        }
+        if (!(flags & FF_IsLongLong)) {
+          magnitude &= UINT32_MAX;
+        }
+
+        if (magnitude == 0) {
+          prefix.length = 0;
+        }
+
+        char digits[24];
+        char* digits_end = digits;
+        if (magnitude) {
+          switch (c) {
+            case 'o':
+              digits_end = fmt::format_to(digits, "{:o}", magnitude);
+              break;
+            case 'x':
+              digits_end = fmt::format_to(digits, "{:x}", magnitude);
+              break;
+            case 'X':
+            case 'p':
+              digits_end = fmt::format_to(digits, "{:X}", magnitude);
+              break;
+            default:
+              digits_end = fmt::format_to(digits, "{}", magnitude);
+              break;
+          }
+        }
+        auto digit_count = int32_t(digits_end - digits);
+
+        // Digits never start with a zero, so the forced leading zero is only
+        // needed when the precision did not already add one.
+        if ((flags & FF_ForceLeadingZero) && precision <= digit_count) {
+          work8.push_back('0');
+        }
+        for (int32_t i = digit_count; i < precision; ++i) {
+          work8.push_back('0');
+        }
+        work8.append(digits, digits_end);
+
+        text.buffer = work8.data();
+        text.length = int32_t(work8.size());
+        break;
+      }
+
+      // floating-point with exponent
+      case 'e':
+      case 'E':
+      // floating-point without exponent
+      case 'f':
+      // floating-point with or without exponent
+      case 'g':
+      case 'G':
+      // floating-point in hexadecimal
+      case 'a':
+      case 'A': {
+        flags |= FF_IsSigned;
+
+        uint64_t bits = *args++;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+
+        if (value < 0) {
+          value = -value;
+          flags |= FF_AddNegative;
+        }
+
+        FormatDouble(std::back_inserter(work8), value, precision, c, flags);
+        text.buffer = work8.data();
+        text.length = int32_t(work8.size());
+        break;
+      }
+
+      // pointer to integer
+      case 'n': {
+        auto pointer = uint32_t(*args++);
+        auto target = memory.TranslateVirtual(pointer);
+        if (target) {
+          if (flags & FF_IsShort) {
+            xe::store_and_swap<uint16_t>(target, uint16_t(count));
+          } else {
+            xe::store_and_swap<uint32_t>(target, uint32_t(count));
+          }
+        }
+        continue;
+      }
+
+      // wide string
+      case 'S':
+        flags |= FF_InvertWide;
+        [[fallthrough]];
+      // string
+      case 's': {
+        auto pointer = uint32_t(*args++);
+        int32_t cap = precision < 0 ? INT32_MAX : precision;
+
+        if (pointer == 0) {
+          static const char nullstr[] = "(null)";
+          text.buffer = nullstr;
+          text.length = std::min(int32_t(sizeof(nullstr) - 1), cap);
+        } else {
+          const void* str = memory.TranslateVirtual(pointer);
+          bool is_wide;
+          if (flags & (FF_IsLong | FF_IsWide)) {
+            // "An ls, lS, ws or wS type specifier is synonymous with S in
+            // printf functions and with s in wprintf functions."
+            is_wide = true;
+          } else if (flags & FF_IsShort) {
+            // "An hs or hS type specifier is synonymous with s in printf
+            // functions and with S in wprintf functions."
+            is_wide = false;
+          } else {
+            is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
+          }
+
+          int32_t length = 0;
+          if (!is_wide) {
+            auto s = reinterpret_cast<const uint8_t*>(str);
+            while (length < cap && s[length]) {
+              length++;
+            }
+          } else {
+            auto s = reinterpret_cast<const uint16_t*>(str);
+            while (length < cap && s[length]) {
+              length++;
+            }
+          }
+
+          text.buffer = str;
+          text.length = length;
+          text.is_wide = is_wide;
+        }
+        break;
+      }
+
+      // ANSI_STRING / UNICODE_STRING
+      case 'Z': {
+        assert_always();
+        break;
+      }
+
+      default: {
+        assert_always();
+        break;
+      }
+    }
+
+    if (flags & FF_IsSigned) {
+      if (flags & FF_AddNegative) {
+        prefix.buffer[0] = '-';
+        prefix.length = 1;
+      } else if (flags & FF_AddPositive) {
+        prefix.buffer[0] = '+';
+        prefix.length = 1;
+      } else if (flags & FF_AddPositiveAsSpace) {
+        prefix.buffer[0] = ' ';
+        prefix.length = 1;
+      }
+    }
+
+    int32_t padding = width - text.length - prefix.length;
+
+    if (!(flags & (FF_LeftJustify | FF_AddLeadingZeros)) && padding > 0) {
+      output.fill(' ', padding);
+      count += padding;
+    }
+
+    if (prefix.length > 0) {
+      output.append(prefix.buffer, prefix.length);
+      count += prefix.length;
+    }
+
+    if ((flags & FF_AddLeadingZeros) && !(flags & FF_LeftJustify) &&
+        padding > 0) {
+      output.fill('0', padding);
+      count += padding;
+    }
+
+    if (!text.is_wide) {
+      // it's a const char*
+      output.append(reinterpret_cast<const char*>(text.buffer), text.length);
+    } else {
+      // it's a const char16_t*
+      if (!output.append(reinterpret_cast<const uint16_t*>(text.buffer),
+                         text.length, text.swap_wide)) {
+        return -1;
+      }
+    }
+    count += text.length;
+
+    // right padding
+    if ((flags & FF_LeftJustify) && padding > 0) {
+      output.fill(' ', padding);
+      count += padding;
+    }
+  }
+
+  return format.truncated ? -1 : count;
+}
+
+}  // namespace
+
+int32_t FormatPrintf(const PrintfFormat& format, const PrintfMemory& memory,
+                     const uint64_t* args, bool wide, std::string* out) {
+  NarrowOutput output(out);
+  return Render(format, memory, args, wide, output);
+}
+
+int32_t FormatPrintf(const PrintfFormat& format, const PrintfMemory& memory,
+                     const uint64_t* args, bool wide, std::u16string* out) {
+  WideOutput output(out);
+  return Render(format, memory, args, wide, output);
+}
+
+int32_t CountPrintf(const PrintfFormat& format, const PrintfMemory& memory,
+                    const uint64_t* args, bool wide) {
+  CountOutput output;
+  return Render(format, memory, args, wide, output);
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
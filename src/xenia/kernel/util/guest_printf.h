@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_GUEST_PRINTF_H_
+#define XENIA_KERNEL_UTIL_GUEST_PRINTF_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// Making the assumption that the Xbox 360's implementation of the
+// printf-functions matches what is described on MSDN's documentation for the
+// Windows CRT:
+//
+// "Format Specification Syntax: printf and wprintf Functions"
+// https://msdn.microsoft.com/en-us/library/56e442dc.aspx
+
+// Translates guest addresses for the formatter (format strings, %s arguments
+// and %n targets), so that it can also run against plain host buffers.
+class PrintfMemory {
+ public:
+  virtual ~PrintfMemory() = default;
+  virtual uint8_t* TranslateVirtual(uint32_t guest_address) const = 0;
+};
+
+// One piece of a parsed format string: literal text followed by an optional
+// conversion.
+struct PrintfSpec {
+  uint32_t literal_offset = 0;
+  uint32_t literal_length = 0;
+  // Conversion type character, 0 if there is only literal text. Unknown type
+  // characters are kept and render as padding only.
+  uint16_t type = 0;
+  bool has_conversion = false;
+  bool width_from_arg = false;
+  bool precision_from_arg = false;
+  // Flags and size prefixes, see FormatFlags in guest_printf.cc.
+  uint32_t flags = 0;
+  int32_t width = 0;
+  int32_t precision = -1;
+};
+
+// A guest format string parsed into a spec list. The number of 64-bit argument
+// slots it consumes is known up front so varargs can be gathered in one go.
+struct PrintfFormat {
+  // Code units of the format string as found in guest memory, including the
+  // terminator, used to validate cache hits.
+  std::vector<uint16_t> source;
+  std::vector<uint16_t> literals;
+  std::vector<PrintfSpec> specs;
+  uint32_t arg_count = 0;
+  // The format ended in the middle of a conversion; formatting fails after
+  // the preceding specs have been rendered.
+  bool truncated = false;
+};
+
+// Parses the format string at format_ptr, or returns the cached parse of it
+// from a previous call on this thread if the string is unchanged. The result
+// is valid until the next call on the same thread.
+const PrintfFormat* GetPrintfFormat(const PrintfMemory& memory,
+                                    uint32_t format_ptr, bool format_is_wide);
+PrintfFormat ParsePrintfFormat(const PrintfMemory& memory,
+                               uint32_t format_ptr, bool format_is_wide);
+
+// Renders a parsed format with the gathered argument slots (at least
+// format.arg_count of them). `wide` selects the default width of %c and %s as
+// for wprintf. Returns the number of code units produced, or -1 on failure, in
+// which case the output is unspecified. Narrow output fails on characters that
+// do not fit in a byte.
+int32_t FormatPrintf(const PrintfFormat& format, const PrintfMemory& memory,
+                     const uint64_t* args, bool wide, std::string* out);
+int32_t FormatPrintf(const PrintfFormat& format, const PrintfMemory& memory,
+                     const uint64_t* args, bool wide, std::u16string* out);
+// Same as above, only counting the code units that would be produced.
+int32_t CountPrintf(const PrintfFormat& format, const PrintfMemory& memory,
+                    const uint64_t* args, bool wide);
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_GUEST_PRINTF_H_
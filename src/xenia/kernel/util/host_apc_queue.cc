@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/host_apc_queue.h"
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+void HostApcQueue::Push(uint32_t normal_routine, uint32_t normal_context,
+                        uint32_t arg1, uint32_t arg2) {
+  auto node = new Node;
+  // Numbered before being published, so that a guest KAPC inserted after the
+  // owning thread took this one always gets a higher number.
+  node->apc.sequence = next_sequence_.fetch_add(1);
+  node->apc.normal_routine = normal_routine;
+  node->apc.normal_context = normal_context;
+  node->apc.arg1 = arg1;
+  node->apc.arg2 = arg2;
+  node->apc.enqueue_time = std::chrono::steady_clock::now();
+  node->next = pushed_.load(std::memory_order_relaxed);
+  while (!pushed_.compare_exchange_weak(node->next, node,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+void HostApcQueue::Take() {
+  Node* node = pushed_.exchange(nullptr, std::memory_order_acquire);
+  if (!node) {
+    return;
+  }
+  // The stack is newest first; reverse it to deliver in push order.
+  Node* first = nullptr;
+  Node* last = node;
+  while (node) {
+    Node* next = node->next;
+    node->next = first;
+    first = node;
+    node = next;
+  }
+  if (last_) {
+    last_->next = first;
+  } else {
+    first_ = first;
+  }
+  last_ = last;
+}
+
+HostApcQueue::Apc HostApcQueue::Pop() {
+  assert_not_null(first_);
+  Node* node = first_;
+  first_ = node->next;
+  if (!first_) {
+    last_ = nullptr;
+  }
+  Apc apc = node->apc;
+  delete node;
+  return apc;
+}
+
+void HostApcQueue::Clear() {
+  Take();
+  while (first_) {
+    Pop();
+  }
+}
+
+void HostApcQueue::InsertGuestApc(uint32_t apc_ptr) {
+  guest_sequences_[apc_ptr] = next_sequence_.fetch_add(1);
+}
+
+void HostApcQueue::RemoveGuestApc(uint32_t apc_ptr) {
+  guest_sequences_.erase(apc_ptr);
+}
+
+uint64_t HostApcQueue::GuestApcSequence(uint32_t apc_ptr) const {
+  if (!apc_ptr) {
+    return UINT64_MAX;
+  }
+  auto it = guest_sequences_.find(apc_ptr);
+  return it != guest_sequences_.end() ? it->second : 0;
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_HOST_APC_QUEUE_H_
+#define XENIA_KERNEL_UTIL_HOST_APC_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// User APCs queued for a guest thread by the host (I/O completions,
+// NtQueueApcThread), kept out of guest memory so that any thread may push them
+// without taking the APC lock.
+//
+// Guest KAPCs stay in the guest list of the thread, but take their sequence
+// numbers from the same counter when inserted, so that the owning thread can
+// deliver both kinds in the order they were queued.
+class HostApcQueue {
+ public:
+  struct Apc {
+    uint64_t sequence;
+    uint32_t normal_routine;
+    uint32_t normal_context;
+    uint32_t arg1;
+    uint32_t arg2;
+    std::chrono::steady_clock::time_point enqueue_time;
+  };
+
+  HostApcQueue() = default;
+  HostApcQueue(const HostApcQueue&) = delete;
+  HostApcQueue& operator=(const HostApcQueue&) = delete;
+  ~HostApcQueue() { Clear(); }
+
+  // May be called from any thread.
+  void Push(uint32_t normal_routine, uint32_t normal_context, uint32_t arg1,
+            uint32_t arg2);
+
+  // The rest must only be called by the owning thread, or while it is
+  // suspended.
+
+  // Makes the APCs pushed so far available through front(), in push order
+  // after the ones taken before.
+  void Take();
+  const Apc* front() const { return first_ ? &first_->apc : nullptr; }
+  // Whether front() was queued before the APC with the given sequence number.
+  bool FrontPrecedes(uint64_t sequence) const {
+    return first_ && first_->apc.sequence < sequence;
+  }
+  Apc Pop();
+  void Clear();
+
+  // Guest KAPCs, by guest address, with the APC lock held.
+  void InsertGuestApc(uint32_t apc_ptr);
+  void RemoveGuestApc(uint32_t apc_ptr);
+  // The sequence number of the guest KAPC at apc_ptr, 0 if it was not
+  // inserted through InsertGuestApc (restored from a save), or UINT64_MAX for
+  // a null pointer, standing for none.
+  uint64_t GuestApcSequence(uint32_t apc_ptr) const;
+
+ private:
+  struct Node {
+    Apc apc;
+    Node* next;
+  };
+
+  std::atomic<uint64_t> next_sequence_ = {1};
+  // Pushed onto a lock-free stack, newest first, then moved to the list of
+  // taken APCs, oldest first.
+  std::atomic<Node*> pushed_ = {nullptr};
+  Node* first_ = nullptr;
+  Node* last_ = nullptr;
+  std::unordered_map<uint32_t, uint64_t> guest_sequences_;
+};
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_HOST_APC_QUEUE_H_
@@ -27,6 +27,26 @@ void NativeList::Insert(uint32_t ptr) {
   head_ = ptr;
 }
 
+void NativeList::Append(uint32_t ptr) {
+  if (!head_ || !HasPending()) {
+    Insert(ptr);
+    return;
+  }
+  uint32_t tail = head_;
+  uint32_t flink;
+  while (true) {
+    flink = xe::load_and_swap<uint32_t>(memory_->TranslateVirtual(tail + 0));
+    if (!flink || flink == kInvalidPointer) {
+      break;
+    }
+    tail = flink;
+  }
+  // Keep whatever terminated the list.
+  xe::store_and_swap<uint32_t>(memory_->TranslateVirtual(ptr + 0), flink);
+  xe::store_and_swap<uint32_t>(memory_->TranslateVirtual(ptr + 4), tail);
+  xe::store_and_swap<uint32_t>(memory_->TranslateVirtual(tail + 0), ptr);
+}
+
 bool NativeList::IsQueued(uint32_t ptr) {
   uint32_t flink =
       xe::load_and_swap<uint32_t>(memory_->TranslateVirtual(ptr + 0));
@@ -33,6 +33,8 @@ class NativeList {
   explicit NativeList(Memory* memory);
 
   void Insert(uint32_t list_entry_ptr);
+  // Inserts at the end, so that Shift returns entries in the order appended.
+  void Append(uint32_t list_entry_ptr);
   bool IsQueued(uint32_t list_entry_ptr);
   void Remove(uint32_t list_entry_ptr);
   uint32_t Shift();
@@ -10,10 +10,12 @@
 #include "xenia/kernel/util/object_table.h"
 
 #include <algorithm>
-#include <cstring>
+#include <new>
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
 
@@ -21,6 +23,15 @@ namespace xe {
 namespace kernel {
 namespace util {
 
+namespace {
+// Reader stripe of the calling thread, handed out round-robin on first use.
+uint32_t GetReaderStripeIndex() {
+  static std::atomic<uint32_t> next_stripe_index{0};
+  thread_local uint32_t stripe_index = next_stripe_index++;
+  return stripe_index;
+}
+}  // namespace
+
 ObjectTable::ObjectTable() {}
 
 ObjectTable::~ObjectTable() { Reset(); }
@@ -28,18 +39,38 @@ ObjectTable::~ObjectTable() { Reset(); }
 void ObjectTable::Reset() {
   auto global_lock = global_critical_region_.Acquire();
 
-  // Release all objects.
+  // Unpublish all objects before releasing them so that no lookup can retain
+  // one that is being destroyed.
+  std::vector<XObject*> objects;
   for (uint32_t n = 0; n < table_capacity_; n++) {
-    ObjectTableEntry& entry = table_[n];
-    if (entry.object) {
-      entry.object->Release();
+    ObjectTableEntry& entry = *LookupSlot(n);
+    auto object = entry.object.exchange(nullptr, std::memory_order_relaxed);
+    if (object) {
+      objects.push_back(object);
     }
   }
+  Synchronize();
+
+  // Release all objects.
+  for (auto object : objects) {
+    object->Release();
+  }
+  reclaim_count_ += objects.size();
 
+  for (uint32_t n = 0; n < kMaxSegmentCount; n++) {
+    delete[] segments_[n].exchange(nullptr, std::memory_order_relaxed);
+  }
   table_capacity_ = 0;
   last_free_entry_ = 0;
-  free(table_);
-  table_ = nullptr;
+
+  if (reclaim_wait_count_ || lookup_retry_count_) {
+    auto stats = contention_stats();
+    XELOGI(
+        "ObjectTable: {} objects reclaimed, {} reclaims waited on lookups ({} "
+        "blocked), {} lookups retried",
+        stats.reclaims, stats.reclaim_waits, stats.reclaim_blocks,
+        stats.lookup_retries);
+  }
 }
 
 X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
@@ -47,8 +78,8 @@ X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
   uint32_t slot = last_free_entry_;
   uint32_t scan_count = 0;
   while (scan_count < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (!entry.object) {
+    ObjectTableEntry& entry = *LookupSlot(slot);
+    if (!entry.object.load(std::memory_order_relaxed)) {
       *out_slot = slot;
       return X_STATUS_SUCCESS;
     }
@@ -68,34 +99,104 @@ X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
   }
 
   // Never allow 0 handles.
-  slot = ++last_free_entry_;
+  slot = std::max(last_free_entry_, 1u);
   *out_slot = slot;
 
   return X_STATUS_SUCCESS;
 }
 
 bool ObjectTable::Resize(uint32_t new_capacity) {
-  uint32_t new_size = new_capacity * sizeof(ObjectTableEntry);
-  uint32_t old_size = table_capacity_ * sizeof(ObjectTableEntry);
-  auto new_table =
-      reinterpret_cast<ObjectTableEntry*>(realloc(table_, new_size));
-  if (!new_table) {
+  new_capacity = std::min(xe::round_up(new_capacity, kSegmentSize),
+                          kMaxSlotCount);
+  if (new_capacity <= table_capacity_) {
     return false;
   }
 
-  // Zero out new entries.
-  if (new_size > old_size) {
-    std::memset(reinterpret_cast<uint8_t*>(new_table) + old_size, 0,
-                new_size - old_size);
-  }
-
+  // Existing segments stay where they are; new ones are zeroed before being
+  // published to lookups.
   last_free_entry_ = table_capacity_;
-  table_capacity_ = new_capacity;
-  table_ = new_table;
+  for (uint32_t n = table_capacity_ >> kSegmentShift;
+       n < new_capacity >> kSegmentShift; n++) {
+    auto segment = new (std::nothrow) ObjectTableEntry[kSegmentSize]();
+    if (!segment) {
+      return false;
+    }
+    segments_[n].store(segment, std::memory_order_release);
+    table_capacity_ = (n + 1) << kSegmentShift;
+  }
 
   return true;
 }
 
+ObjectTable::ObjectTableEntry* ObjectTable::LookupSlot(uint32_t slot) const {
+  uint32_t segment_index = slot >> kSegmentShift;
+  if (segment_index >= kMaxSegmentCount) {
+    return nullptr;
+  }
+  auto segment = segments_[segment_index].load(std::memory_order_acquire);
+  if (!segment) {
+    return nullptr;
+  }
+  return &segment[slot & (kSegmentSize - 1)];
+}
+
+void ObjectTable::Synchronize() {
+  // Lookups that start after the epoch flip can no longer observe anything
+  // unpublished before it, so only the ones announced under the old epoch need
+  // to drain.
+  uint32_t old_parity = epoch_.fetch_add(1) & 1;
+  bool waited = false;
+  for (auto& stripe : reader_stripes_) {
+    auto& count = stripe.count[old_parity];
+    uint32_t spin_count = 0;
+    while (count.load()) {
+      waited = true;
+      if (++spin_count < kSynchronizeSpinCount) {
+        xe::threading::MaybeYield();
+        continue;
+      }
+      // The lookup's thread is likely preempted, so don't burn the time slice
+      // it needs to finish. Registered before checking the count again, and
+      // lookups check for waiters after leaving, so the last one to leave
+      // either sees this waiter or is seen as gone.
+      std::unique_lock<std::mutex> lock(drain_mutex_);
+      ++drain_waiter_count_;
+      drain_cond_.wait(lock, [&count] { return !count.load(); });
+      --drain_waiter_count_;
+      ++reclaim_block_count_;
+    }
+  }
+  if (waited) {
+    ++reclaim_wait_count_;
+  }
+}
+
+void ObjectTable::EndLookup(ReaderStripe& stripe, uint32_t parity) {
+  if (stripe.count[parity].fetch_sub(1) == 1 && drain_waiter_count_.load()) {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain_cond_.notify_all();
+  }
+}
+
+void ObjectTable::ReclaimEntry(ObjectTableEntry& entry) {
+  auto object = entry.object.exchange(nullptr, std::memory_order_relaxed);
+  if (!object) {
+    return;
+  }
+  Synchronize();
+  object->Release();
+  ++reclaim_count_;
+}
+
+ObjectTable::ContentionStats ObjectTable::contention_stats() const {
+  ContentionStats stats;
+  stats.lookup_retries = lookup_retry_count_.load(std::memory_order_relaxed);
+  stats.reclaims = reclaim_count_.load(std::memory_order_relaxed);
+  stats.reclaim_waits = reclaim_wait_count_.load(std::memory_order_relaxed);
+  stats.reclaim_blocks = reclaim_block_count_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
 
@@ -109,14 +210,14 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
     // Stash.
     if (XSUCCEEDED(result)) {
-      ObjectTableEntry& entry = table_[slot];
-      entry.object = object;
+      ObjectTableEntry& entry = *LookupSlot(slot);
       entry.handle_ref_count = 1;
       handle = XObject::kHandleBase + (slot << 2);
       object->handles().push_back(handle);
 
       // Retain so long as the object is in the table.
       object->Retain();
+      entry.object.store(object, std::memory_order_release);
 
       XELOGI("Added handle:{:08X} for {}", handle, typeid(*object).name());
     }
@@ -135,10 +236,10 @@ X_STATUS ObjectTable::DuplicateHandle(X_HANDLE handle, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
   handle = TranslateHandle(handle);
 
-  XObject* object = LookupObject(handle, false);
+  XObject* object = LookupAndRetainObject(handle);
   if (object) {
     result = AddHandle(object, out_handle);
-    object->Release();  // Release the ref that LookupObject took
+    object->Release();  // Release the ref that LookupAndRetainObject took
   } else {
     result = X_STATUS_INVALID_HANDLE;
   }
@@ -177,22 +278,19 @@ X_STATUS ObjectTable::ReleaseHandle(X_HANDLE handle) {
 }
 
 X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
-  X_STATUS result = X_STATUS_SUCCESS;
-
   handle = TranslateHandle(handle);
   if (!handle) {
     return X_STATUS_INVALID_HANDLE;
   }
 
+  auto global_lock = global_critical_region_.Acquire();
   ObjectTableEntry* entry = LookupTable(handle);
   if (!entry) {
     return X_STATUS_INVALID_HANDLE;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-  if (entry->object) {
-    auto object = entry->object;
-    entry->object = nullptr;
+  auto object = entry->object.load(std::memory_order_relaxed);
+  if (object) {
     assert_zero(entry->handle_ref_count);
     entry->handle_ref_count = 0;
 
@@ -209,8 +307,8 @@ X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
     if (!object->name().empty()) {
       RemoveNameMapping(object->name());
     }
-    // Release now that the object has been removed from the table.
-    object->Release();
+    // Release once no lookup can still be retaining it.
+    ReclaimEntry(*entry);
   }
 
   return X_STATUS_SUCCESS;
@@ -221,11 +319,11 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
   std::vector<object_ref<XObject>> results;
 
   for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+    auto object = LookupSlot(slot)->object.load(std::memory_order_relaxed);
+    if (object &&
+        std::find(results.begin(), results.end(), object) == results.end()) {
+      object->Retain();
+      results.push_back(object_ref<XObject>(object));
     }
   }
 
@@ -234,15 +332,21 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
 
 void ObjectTable::PurgeAllObjects() {
   auto lock = global_critical_region_.Acquire();
+  std::vector<XObject*> objects;
   for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && !entry.object->is_host_object()) {
+    auto& entry = *LookupSlot(slot);
+    auto object = entry.object.load(std::memory_order_relaxed);
+    if (object && !object->is_host_object()) {
       entry.handle_ref_count = 0;
-      entry.object->Release();
-
-      entry.object = nullptr;
+      entry.object.store(nullptr, std::memory_order_relaxed);
+      objects.push_back(object);
     }
   }
+  Synchronize();
+  for (auto object : objects) {
+    object->Release();
+  }
+  reclaim_count_ += objects.size();
 }
 
 ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
@@ -251,45 +355,45 @@ ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
     return nullptr;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-
   // Lower 2 bits are ignored.
-  uint32_t slot = GetHandleSlot(handle);
-  if (slot <= table_capacity_) {
-    return &table_[slot];
-  }
-
-  return nullptr;
+  return LookupSlot(GetHandleSlot(handle));
 }
 
 // Generic lookup
 template <>
 object_ref<XObject> ObjectTable::LookupObject<XObject>(X_HANDLE handle) {
-  auto object = ObjectTable::LookupObject(handle, false);
+  auto object = ObjectTable::LookupAndRetainObject(handle);
   auto result = object_ref<XObject>(reinterpret_cast<XObject*>(object));
   return result;
 }
 
-XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
+XObject* ObjectTable::LookupAndRetainObject(X_HANDLE handle) {
   handle = TranslateHandle(handle);
   if (!handle) {
     return nullptr;
   }
 
-  XObject* object = nullptr;
-  if (!already_locked) {
-    global_critical_region_.mutex().lock();
+  // Announce the lookup under the current epoch so that a concurrent removal
+  // waits for it before releasing the object. If the epoch moved while doing
+  // so, the removal may have already checked this stripe, so try again.
+  auto& stripe = reader_stripes_[GetReaderStripeIndex() % kReaderStripeCount];
+  uint32_t epoch = epoch_.load();
+  while (true) {
+    stripe.count[epoch & 1].fetch_add(1);
+    uint32_t current_epoch = epoch_.load();
+    if (current_epoch == epoch) {
+      break;
+    }
+    EndLookup(stripe, epoch & 1);
+    lookup_retry_count_.fetch_add(1, std::memory_order_relaxed);
+    epoch = current_epoch;
   }
 
   // Lower 2 bits are ignored.
-  uint32_t slot = GetHandleSlot(handle);
-
-  // Verify slot.
-  if (slot < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (entry.object) {
-      object = entry.object;
-    }
+  XObject* object = nullptr;
+  ObjectTableEntry* entry = LookupSlot(GetHandleSlot(handle));
+  if (entry) {
+    object = entry->object.load(std::memory_order_acquire);
   }
 
   // Retain the object pointer.
@@ -297,10 +401,7 @@ XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
     object->Retain();
   }
 
-  if (!already_locked) {
-    global_critical_region_.mutex().unlock();
-  }
-
+  EndLookup(stripe, epoch & 1);
   return object;
 }
 
@@ -308,11 +409,11 @@ void ObjectTable::GetObjectsByType(XObject::Type type,
                                    std::vector<object_ref<XObject>>* results) {
   auto global_lock = global_critical_region_.Acquire();
   for (uint32_t slot = 0; slot < table_capacity_; ++slot) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
+    auto object = LookupSlot(slot)->object.load(std::memory_order_relaxed);
+    if (object) {
+      if (object->type() == type) {
+        object->Retain();
+        results->push_back(object_ref<XObject>(object));
       }
     }
   }
@@ -333,7 +434,7 @@ X_HANDLE ObjectTable::TranslateHandle(X_HANDLE handle) {
 
 X_STATUS ObjectTable::AddNameMapping(const std::string_view name,
                                      X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(name_table_mutex_);
   if (name_table_.count(string_key_case(name))) {
     return X_STATUS_OBJECT_NAME_COLLISION;
   }
@@ -343,7 +444,7 @@ X_STATUS ObjectTable::AddNameMapping(const std::string_view name,
 
 void ObjectTable::RemoveNameMapping(const std::string_view name) {
   // Names are case-insensitive.
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(name_table_mutex_);
   auto it = name_table_.find(string_key_case(name));
   if (it != name_table_.end()) {
     name_table_.erase(it);
@@ -353,16 +454,20 @@ void ObjectTable::RemoveNameMapping(const std::string_view name) {
 X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
                                       X_HANDLE* out_handle) {
   // Names are case-insensitive.
-  auto global_lock = global_critical_region_.Acquire();
-  auto it = name_table_.find(string_key_case(name));
-  if (it == name_table_.end()) {
-    *out_handle = X_INVALID_HANDLE_VALUE;
-    return X_STATUS_OBJECT_NAME_NOT_FOUND;
+  X_HANDLE handle;
+  {
+    std::lock_guard<std::mutex> lock(name_table_mutex_);
+    auto it = name_table_.find(string_key_case(name));
+    if (it == name_table_.end()) {
+      *out_handle = X_INVALID_HANDLE_VALUE;
+      return X_STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+    handle = it->second;
   }
-  *out_handle = it->second;
+  *out_handle = handle;
 
   // We need to ref the handle. I think.
-  auto obj = LookupObject(it->second, true);
+  auto obj = LookupAndRetainObject(handle);
   if (obj) {
     obj->RetainHandle();
     obj->Release();
@@ -374,7 +479,7 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
 bool ObjectTable::Save(ByteStream* stream) {
   stream->Write<uint32_t>(table_capacity_);
   for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
+    auto& entry = *LookupSlot(i);
     stream->Write<int32_t>(entry.handle_ref_count);
   }
 
@@ -384,7 +489,7 @@ bool ObjectTable::Save(ByteStream* stream) {
 bool ObjectTable::Restore(ByteStream* stream) {
   Resize(stream->Read<uint32_t>());
   for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
+    auto& entry = *LookupSlot(i);
     // entry.object = nullptr;
     entry.handle_ref_count = stream->Read<int32_t>();
   }
@@ -394,12 +499,12 @@ bool ObjectTable::Restore(ByteStream* stream) {
 
 X_STATUS ObjectTable::RestoreHandle(X_HANDLE handle, XObject* object) {
   uint32_t slot = GetHandleSlot(handle);
-  assert_true(table_capacity_ >= slot);
+  assert_true(table_capacity_ > slot);
 
-  if (table_capacity_ >= slot) {
-    auto& entry = table_[slot];
-    entry.object = object;
+  if (table_capacity_ > slot) {
+    auto& entry = *LookupSlot(slot);
     object->Retain();
+    entry.object.store(object, std::memory_order_release);
   }
 
   return X_STATUS_SUCCESS;
@@ -10,6 +10,9 @@
 #ifndef XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 #define XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -47,9 +50,11 @@ class ObjectTable {
   // not use.
   X_STATUS RestoreHandle(X_HANDLE handle, XObject* object);
 
+  // Lookups do not take any lock and may run concurrently with each other and
+  // with handle insertion and removal.
   template <typename T>
   object_ref<T> LookupObject(X_HANDLE handle) {
-    auto object = LookupObject(handle, false);
+    auto object = LookupAndRetainObject(handle);
     if (object) {
       assert_true(object->type() == T::kObjectType);
     }
@@ -80,14 +85,50 @@ class ObjectTable {
   std::vector<object_ref<XObject>> GetAllObjects();
   void PurgeAllObjects();  // Purges the object table of all guest objects
 
+  struct ContentionStats {
+    // Lookups that raced with a removal and had to re-enter the table.
+    uint64_t lookup_retries;
+    // Objects removed from the table and released once no lookup could still
+    // be reading them.
+    uint64_t reclaims;
+    // Times a removal had to wait for in-flight lookups to drain.
+    uint64_t reclaim_waits;
+    // Waits that outlasted the spin and blocked, as a lookup was preempted.
+    uint64_t reclaim_blocks;
+  };
+  ContentionStats contention_stats() const;
+
  private:
+  // The table is an array of fixed-size segments that are never moved or freed
+  // while the table is live, so a lookup can index it without a lock. Slots
+  // hold the object pointer atomically; the handle reference count is only
+  // touched with the global lock held.
+  static constexpr uint32_t kSegmentShift = 12;
+  static constexpr uint32_t kSegmentSize = 1u << kSegmentShift;
+  static constexpr uint32_t kMaxSlotCount =
+      (0xFFFFFFFFu - XObject::kHandleBase + 1) >> 2;
+  static constexpr uint32_t kMaxSegmentCount = kMaxSlotCount / kSegmentSize;
+  // Lookups announce themselves in one of these stripes, picked per thread, so
+  // that concurrent lookups on different threads do not share a cache line.
+  static constexpr uint32_t kReaderStripeCount = 16;
+  // A lookup takes nanoseconds unless its thread is preempted, so a removal
+  // spins briefly before blocking until lookups drain.
+  static constexpr uint32_t kSynchronizeSpinCount = 64;
+
   struct ObjectTableEntry {
     int handle_ref_count = 0;
-    XObject* object = nullptr;
+    std::atomic<XObject*> object{nullptr};
+  };
+  struct alignas(64) ReaderStripe {
+    std::atomic<uint32_t> count[2] = {};
   };
 
   ObjectTableEntry* LookupTable(X_HANDLE handle);
-  XObject* LookupObject(X_HANDLE handle, bool already_locked);
+  ObjectTableEntry* LookupSlot(uint32_t slot) const;
+  XObject* LookupAndRetainObject(X_HANDLE handle);
+  // Leaves a lookup announced in the stripe under the given epoch parity,
+  // waking a removal blocked on it if it was the last one.
+  void EndLookup(ReaderStripe& stripe, uint32_t parity);
   void GetObjectsByType(XObject::Type type,
                         std::vector<object_ref<XObject>>* results);
 
@@ -98,10 +139,30 @@ class ObjectTable {
   X_STATUS FindFreeSlot(uint32_t* out_slot);
   bool Resize(uint32_t new_capacity);
 
+  // Waits until no lookup that may have observed a slot before it was cleared
+  // is still running. Must be called with the global lock held.
+  void Synchronize();
+  // Clears the slot and drops the table's reference to the object once it is
+  // safe to do so. Must be called with the global lock held.
+  void ReclaimEntry(ObjectTableEntry& entry);
+
   xe::global_critical_region global_critical_region_;
   uint32_t table_capacity_ = 0;
-  ObjectTableEntry* table_ = nullptr;
+  std::atomic<ObjectTableEntry*> segments_[kMaxSegmentCount] = {};
   uint32_t last_free_entry_ = 0;
+
+  std::atomic<uint32_t> epoch_{0};
+  ReaderStripe reader_stripes_[kReaderStripeCount];
+  std::atomic<uint64_t> lookup_retry_count_{0};
+  std::atomic<uint64_t> reclaim_count_{0};
+  std::atomic<uint64_t> reclaim_wait_count_{0};
+  std::atomic<uint64_t> reclaim_block_count_{0};
+  // Removals blocked until lookups drain, which lookups check when leaving.
+  std::atomic<uint32_t> drain_waiter_count_{0};
+  std::mutex drain_mutex_;
+  std::condition_variable drain_cond_;
+
+  std::mutex name_table_mutex_;
   std::unordered_map<string_key_case, X_HANDLE> name_table_;
 };
 
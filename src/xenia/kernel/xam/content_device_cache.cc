@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/xam/content_device_cache.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace kernel {
+namespace xam {
+
+// The last time anything was created, deleted or renamed in the package
+// directory or any directory in it, or min() if it could not be listed.
+static std::filesystem::file_time_type GetPackageWriteTime(
+    const std::filesystem::path& package_path) {
+  std::error_code ec;
+  auto write_time = std::filesystem::last_write_time(package_path, ec);
+  std::filesystem::recursive_directory_iterator it(package_path, ec), end;
+  for (; !ec && it != end; it.increment(ec)) {
+    if (it->is_directory(ec)) {
+      write_time = std::max(write_time, it->last_write_time(ec));
+    }
+    if (ec) {
+      break;
+    }
+  }
+  return ec ? std::filesystem::file_time_type::min() : write_time;
+}
+
+std::unique_ptr<vfs::HostPathDevice> ContentDeviceCache::Acquire(
+    const std::filesystem::path& package_path, uint64_t* write_generation) {
+  auto& open_package = open_packages_[package_path];
+  ++open_package.mount_count;
+  *write_generation = open_package.write_generation;
+
+  auto it = std::find_if(
+      devices_.begin(), devices_.end(),
+      [&](const auto& cached) { return cached.package_path == package_path; });
+  if (it == devices_.end()) {
+    return nullptr;
+  }
+  std::unique_ptr<vfs::HostPathDevice> device;
+  if (it->write_time == GetPackageWriteTime(package_path)) {
+    device = std::move(it->device);
+  }
+  devices_.erase(it);
+  return device;
+}
+
+void ContentDeviceCache::Release(const std::filesystem::path& package_path,
+                                 uint64_t write_generation,
+                                 std::unique_ptr<vfs::HostPathDevice> device) {
+  auto open_it = open_packages_.find(package_path);
+  assert_true(open_it != open_packages_.end());
+  if (open_it == open_packages_.end()) {
+    return;
+  }
+  // Another mount may still write to the package, or has written to it since
+  // this device listed it.
+  bool device_valid = !--open_it->second.mount_count &&
+                      open_it->second.write_generation == write_generation;
+  if (!open_it->second.mount_count) {
+    // No generation taken before is compared against anymore.
+    open_packages_.erase(open_it);
+  }
+  if (!device || !device_valid || !capacity_) {
+    return;
+  }
+  // Taken now, after any entries the title created or deleted, so that only
+  // changes made behind its back invalidate the listing.
+  auto write_time = GetPackageWriteTime(package_path);
+  if (write_time == std::filesystem::file_time_type::min()) {
+    return;
+  }
+  devices_.push_front({package_path, write_time, std::move(device)});
+  while (devices_.size() > capacity_) {
+    devices_.pop_back();
+  }
+}
+
+void ContentDeviceCache::Invalidate(const std::filesystem::path& package_path) {
+  devices_.remove_if(
+      [&](const auto& cached) { return cached.package_path == package_path; });
+  auto open_it = open_packages_.find(package_path);
+  if (open_it != open_packages_.end()) {
+    ++open_it->second.write_generation;
+  }
+}
+
+}  // namespace xam
+}  // namespace kernel
+}  // namespace xe
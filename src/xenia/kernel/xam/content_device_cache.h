@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_XAM_CONTENT_DEVICE_CACHE_H_
+#define XENIA_KERNEL_XAM_CONTENT_DEVICE_CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+
+#include "xenia/vfs/devices/host_path_device.h"
+
+namespace xe {
+namespace kernel {
+namespace xam {
+
+// Devices of closed content packages, so that opening a package again does
+// not list it again. A device is only kept if nothing could have changed the
+// package behind the entries it listed: no other mount of the same package
+// was open when it was closed, nothing invalidated the package while it was
+// mounted, and no directory in the package has been written on the host
+// since. Not thread-safe, the owner must serialize access.
+class ContentDeviceCache {
+ public:
+  explicit ContentDeviceCache(size_t capacity) : capacity_(capacity) {}
+
+  // Called before mounting the package at package_path, returning the device
+  // it was last closed with, if it is still valid, and the write generation to
+  // pass to Release when the package is closed.
+  std::unique_ptr<vfs::HostPathDevice> Acquire(
+      const std::filesystem::path& package_path, uint64_t* write_generation);
+  // Called after unmounting a package mounted after Acquire, with its device
+  // unless files were written through it (in which case the package must
+  // have been invalidated) or it is not to be kept.
+  void Release(const std::filesystem::path& package_path,
+               uint64_t write_generation,
+               std::unique_ptr<vfs::HostPathDevice> device);
+  // Drops the device of the package at package_path, and prevents the devices
+  // of its mounts open now from being kept.
+  void Invalidate(const std::filesystem::path& package_path);
+
+  size_t size() const { return devices_.size(); }
+
+ private:
+  struct OpenPackage {
+    uint32_t mount_count = 0;
+    uint64_t write_generation = 0;
+  };
+  struct CachedDevice {
+    std::filesystem::path package_path;
+    std::filesystem::file_time_type write_time;
+    std::unique_ptr<vfs::HostPathDevice> device;
+  };
+
+  size_t capacity_;
+  // Packages mounted now, by path.
+  std::map<std::filesystem::path, OpenPackage> open_packages_;
+  // Most recently closed first, with the last write time of the package
+  // directories when it was closed.
+  std::list<CachedDevice> devices_;
+};
+
+}  // namespace xam
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_XAM_CONTENT_DEVICE_CACHE_H_
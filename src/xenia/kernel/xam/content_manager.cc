@@ -9,9 +9,11 @@
 
 #include "xenia/kernel/xam/content_manager.h"
 
+#include <algorithm>
 #include <string>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/string.h"
 #include "xenia/kernel/kernel_state.h"
@@ -19,6 +21,12 @@
 #include "xenia/kernel/xobject.h"
 #include "xenia/vfs/devices/host_path_device.h"
 
+DEFINE_int32(content_device_cache_size, 8,
+             "Number of closed content packages to keep the file listings of, "
+             "so that opening them again does not list them again. 0 "
+             "disables the cache.",
+             "Content");
+
 namespace xe {
 namespace kernel {
 namespace xam {
@@ -29,31 +37,62 @@ static const char* kGameUserContentDirName = "profile";
 
 static int content_device_id_ = 0;
 
+// The last time anything directly in the directory at path was created,
+// deleted or renamed, or min() if it does not exist.
+static std::filesystem::file_time_type GetWriteTime(
+    const std::filesystem::path& path) {
+  std::error_code ec;
+  auto write_time = std::filesystem::last_write_time(path, ec);
+  return ec ? std::filesystem::file_time_type::min() : write_time;
+}
+
 ContentPackage::ContentPackage(KernelState* kernel_state,
                                const std::string_view root_name,
                                const XCONTENT_AGGREGATE_DATA& data,
-                               const std::filesystem::path& package_path)
-    : kernel_state_(kernel_state), root_name_(root_name) {
-  device_path_ = fmt::format("\\Device\\Content\\{0}\\", ++content_device_id_);
+                               const std::filesystem::path& package_path,
+                               std::unique_ptr<vfs::HostPathDevice> device,
+                               uint64_t write_generation)
+    : kernel_state_(kernel_state),
+      root_name_(root_name),
+      package_path_(package_path),
+      write_generation_(write_generation) {
   content_data_ = data;
 
+  if (device) {
+    device_path_ = device->mount_path();
+  } else {
+    device_path_ =
+        fmt::format("\\Device\\Content\\{0}\\", ++content_device_id_);
+    device = std::make_unique<vfs::HostPathDevice>(device_path_, package_path,
+                                                   false);
+    device->Initialize();
+  }
+
   auto fs = kernel_state_->file_system();
-  auto device =
-      std::make_unique<vfs::HostPathDevice>(device_path_, package_path, false);
-  device->Initialize();
   fs->RegisterDevice(std::move(device));
   fs->RegisterSymbolicLink(root_name_ + ":", device_path_);
 }
 
-ContentPackage::~ContentPackage() {
+ContentPackage::~ContentPackage() { Unmount(); }
+
+std::unique_ptr<vfs::HostPathDevice> ContentPackage::Unmount() {
+  if (!mounted_) {
+    return nullptr;
+  }
+  mounted_ = false;
   auto fs = kernel_state_->file_system();
   fs->UnregisterSymbolicLink(root_name_ + ":");
-  fs->UnregisterDevice(device_path_);
+  auto device = fs->DetachDevice(device_path_);
+  return std::unique_ptr<vfs::HostPathDevice>(
+      static_cast<vfs::HostPathDevice*>(device.release()));
 }
 
 ContentManager::ContentManager(KernelState* kernel_state,
                                const std::filesystem::path& root_path)
-    : kernel_state_(kernel_state), root_path_(root_path) {}
+    : kernel_state_(kernel_state),
+      root_path_(root_path),
+      package_device_cache_(
+          size_t(std::max(cvars::content_device_cache_size, 0))) {}
 
 ContentManager::~ContentManager() = default;
 
@@ -89,6 +128,24 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
   // Search path:
   // content_root/title_id/type_name/*
   auto package_root = ResolvePackageRoot(content_type, title_id);
+
+  // Titles enumerate their content over and over, so keep the listing until
+  // a package is created or deleted in the directory. The directory is listed
+  // without the lock held, so the result is only stored if nothing was
+  // invalidated in the meantime.
+  auto cache_key = std::make_tuple(device_id, uint32_t(content_type), title_id);
+  auto write_time = GetWriteTime(package_root);
+  uint64_t cache_generation;
+  {
+    std::lock_guard<std::mutex> cache_lock(content_list_cache_mutex_);
+    auto cached = content_list_cache_.find(cache_key);
+    if (cached != content_list_cache_.end() &&
+        cached->second.write_time == write_time) {
+      return cached->second.content;
+    }
+    cache_generation = content_list_cache_generation_;
+  }
+
   auto file_infos = xe::filesystem::ListFiles(package_root);
   for (const auto& file_info : file_infos) {
     if (file_info.type != xe::filesystem::FileInfo::Type::kDirectory) {
@@ -104,6 +161,10 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
     result.emplace_back(std::move(content_data));
   }
 
+  std::lock_guard<std::mutex> cache_lock(content_list_cache_mutex_);
+  if (content_list_cache_generation_ == cache_generation) {
+    content_list_cache_[cache_key] = {write_time, result};
+  }
   return result;
 }
 
@@ -116,8 +177,12 @@ std::unique_ptr<ContentPackage> ContentManager::ResolvePackage(
 
   auto global_lock = global_critical_region_.Acquire();
 
-  auto package = std::make_unique<ContentPackage>(kernel_state_, root_name,
-                                                  data, package_path);
+  // Released again in CachePackageDevice when the package is closed.
+  uint64_t write_generation;
+  auto device = package_device_cache_.Acquire(package_path, &write_generation);
+  auto package = std::make_unique<ContentPackage>(
+      kernel_state_, root_name, data, package_path, std::move(device),
+      write_generation);
   return package;
 }
 
@@ -144,6 +209,7 @@ X_RESULT ContentManager::CreateContent(const std::string_view root_name,
   if (!std::filesystem::create_directories(package_path)) {
     return X_ERROR_ACCESS_DENIED;
   }
+  InvalidateContent(package_path);
 
   auto package = ResolvePackage(root_name, data);
   assert_not_null(package);
@@ -188,6 +254,7 @@ X_RESULT ContentManager::CloseContent(const std::string_view root_name) {
 
   auto package = it->second;
   open_packages_.erase(it);
+  CachePackageDevice(package);
   delete package;
 
   return X_ERROR_SUCCESS;
@@ -217,6 +284,7 @@ X_RESULT ContentManager::SetContentThumbnail(
   auto global_lock = global_critical_region_.Acquire();
   auto package_path = ResolvePackagePath(data);
   std::filesystem::create_directories(package_path);
+  InvalidateContent(package_path);
   if (std::filesystem::exists(package_path)) {
     auto thumb_path = package_path / kThumbnailFileName;
     auto file = xe::filesystem::OpenFile(thumb_path, "wb");
@@ -237,6 +305,7 @@ X_RESULT ContentManager::DeleteContent(const XCONTENT_AGGREGATE_DATA& data) {
   }
 
   auto package_path = ResolvePackagePath(data);
+  InvalidateContent(package_path);
   if (std::filesystem::remove_all(package_path) > 0) {
     return X_ERROR_SUCCESS;
   } else {
@@ -260,6 +329,27 @@ bool ContentManager::IsContentOpen(const XCONTENT_AGGREGATE_DATA& data) const {
                      });
 }
 
+void ContentManager::CachePackageDevice(ContentPackage* package) {
+  auto device = package->Unmount();
+  // Files written through the device may have changed size since listed, and
+  // other mounts of the same package may have listed them before.
+  if (device && device->files_written()) {
+    InvalidateContent(package->package_path());
+    device.reset();
+  }
+  package_device_cache_.Release(package->package_path(),
+                                package->write_generation(),
+                                std::move(device));
+}
+
+void ContentManager::InvalidateContent(
+    const std::filesystem::path& package_path) {
+  package_device_cache_.Invalidate(package_path);
+  std::lock_guard<std::mutex> cache_lock(content_list_cache_mutex_);
+  content_list_cache_.clear();
+  ++content_list_cache_generation_;
+}
+
 void ContentManager::CloseOpenedFilesFromContent(
     const std::string_view root_name) {
   // TODO(Gliniak): Cleanup this code to care only about handles
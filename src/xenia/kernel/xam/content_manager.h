@@ -10,8 +10,12 @@
 #ifndef XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 #define XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 
+#include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -19,6 +23,8 @@
 #include "xenia/base/mutex.h"
 #include "xenia/base/string_key.h"
 #include "xenia/base/string_util.h"
+#include "xenia/kernel/xam/content_device_cache.h"
+#include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -119,20 +125,34 @@ static_assert_size(XCONTENT_AGGREGATE_DATA, 0x148);
 
 class ContentPackage {
  public:
+  // Mounts device, which must have been unmounted from a package at
+  // package_path before, or a new host path device if it is null.
   ContentPackage(KernelState* kernel_state, const std::string_view root_name,
                  const XCONTENT_AGGREGATE_DATA& data,
-                 const std::filesystem::path& package_path);
+                 const std::filesystem::path& package_path,
+                 std::unique_ptr<vfs::HostPathDevice> device = nullptr,
+                 uint64_t write_generation = 0);
   ~ContentPackage();
 
   const XCONTENT_AGGREGATE_DATA& GetPackageContentData() const {
     return content_data_;
   }
+  const std::filesystem::path& package_path() const { return package_path_; }
+  // The write generation of the package in the device cache when mounted.
+  uint64_t write_generation() const { return write_generation_; }
+
+  // Unmounts the package, returning its device with the entries listed so far
+  // so that it can be mounted again.
+  std::unique_ptr<vfs::HostPathDevice> Unmount();
 
  private:
   KernelState* kernel_state_;
   std::string root_name_;
   std::string device_path_;
+  std::filesystem::path package_path_;
   XCONTENT_AGGREGATE_DATA content_data_;
+  uint64_t write_generation_;
+  bool mounted_ = true;
 };
 
 class ContentManager {
@@ -168,12 +188,35 @@ class ContentManager {
                                            uint32_t title_id = -1);
   std::filesystem::path ResolvePackagePath(const XCONTENT_AGGREGATE_DATA& data);
 
+  // Unmounts a closed package, keeping its device for the next open of the
+  // same package if possible.
+  void CachePackageDevice(ContentPackage* package);
+  // Forgets anything cached about the package at package_path and about the
+  // packages around it.
+  void InvalidateContent(const std::filesystem::path& package_path);
+
   KernelState* kernel_state_;
   std::filesystem::path root_path_;
 
   // TODO(benvanik): remove use of global lock, it's bad here!
   xe::global_critical_region global_critical_region_;
   std::unordered_map<string_key, ContentPackage*> open_packages_;
+
+  // Devices of closed packages.
+  ContentDeviceCache package_device_cache_;
+
+  // ListContent results by device ID, content type and title ID, with the time
+  // the directory listed was last written. Guarded by its own mutex rather than
+  // the global lock, as listing may block on the host file system for a while.
+  struct CachedContentList {
+    std::filesystem::file_time_type write_time;
+    std::vector<XCONTENT_AGGREGATE_DATA> content;
+  };
+  std::mutex content_list_cache_mutex_;
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, CachedContentList>
+      content_list_cache_;
+  // Incremented whenever the listings are invalidated.
+  uint64_t content_list_cache_generation_ = 0;
 };
 
 }  // namespace xam
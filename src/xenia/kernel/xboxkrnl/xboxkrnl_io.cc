@@ -7,6 +7,8 @@
  ******************************************************************************
  */
 
+#include <functional>
+
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
@@ -181,97 +183,49 @@ dword_result_t NtOpenFile_entry(
 }
 DECLARE_XBOXKRNL_EXPORT1(NtOpenFile, kFileSystem, kImplemented);
 
-dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
-                                lpvoid_t apc_routine_ptr, lpvoid_t apc_context,
-                                pointer_t<X_IO_STATUS_BLOCK> io_status_block,
-                                lpvoid_t buffer, dword_t buffer_length,
-                                lpqword_t byte_offset_ptr) {
-  X_STATUS result = X_STATUS_SUCCESS;
-
-  bool signal_event = false;
-  auto ev = kernel_state()->object_table()->LookupObject<XEvent>(event_handle);
-  if (event_handle && !ev) {
-    result = X_STATUS_INVALID_HANDLE;
-  }
-
-  auto file = kernel_state()->object_table()->LookupObject<XFile>(file_handle);
-  if (!file) {
-    result = X_STATUS_INVALID_HANDLE;
+// Reports a finished read the way the guest asked for it. The read itself
+// doesn't notify anyone, so that nothing waiting on the file or its I/O
+// completion ports wakes up before the status block is written.
+static void CompleteFileRead(XThread* thread, XFile* file, XEvent* ev,
+                             uint32_t apc_routine, uint32_t apc_context,
+                             uint32_t io_status_block_ptr, X_STATUS result,
+                             uint32_t bytes_read) {
+  if (io_status_block_ptr) {
+    auto io_status_block =
+        kernel_memory()->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+            io_status_block_ptr);
+    io_status_block->status = result;
+    io_status_block->information = XSUCCEEDED(result) ? bytes_read : 0;
   }
 
-  if (XSUCCEEDED(result)) {
-    if (true || file->is_synchronous()) {
-      // Synchronous.
-      uint32_t bytes_read = 0;
-      result = file->Read(
-          buffer.guest_address(), buffer_length,
-          byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1,
-          &bytes_read, apc_context);
-      if (io_status_block) {
-        io_status_block->status = result;
-        io_status_block->information = bytes_read;
-      }
-
-      // Queue the APC callback. It must be delivered via the APC mechanism even
-      // though were are completing immediately.
-      // Low bit probably means do not queue to IO ports.
-      if ((uint32_t)apc_routine_ptr & ~1) {
-        if (apc_context) {
-          auto thread = XThread::GetCurrentThread();
-          thread->EnqueueApc(static_cast<uint32_t>(apc_routine_ptr) & ~1u,
-                             apc_context, io_status_block, 0);
-        }
-      }
-
-      if (!file->is_synchronous()) {
-        result = X_STATUS_PENDING;
-      }
-
-      // Mark that we should signal the event now. We do this after
-      // we have written the info out.
-      signal_event = true;
-    } else {
-      // TODO(benvanik): async.
+  file->NotifyCompletion(apc_context, bytes_read, result);
 
-      // X_STATUS_PENDING if not returning immediately.
-      // XFile is waitable and signalled after each async req completes.
-      // reset the input event (->Reset())
-      /*xeNtReadFileState* call_state = new xeNtReadFileState();
-      XAsyncRequest* request = new XAsyncRequest(
-      state, file,
-      (XAsyncRequest::CompletionCallback)xeNtReadFileCompleted,
-      call_state);*/
-      // result = file->Read(buffer.guest_address(), buffer_length, byte_offset,
-      //                     request);
-      if (io_status_block) {
-        io_status_block->status = X_STATUS_PENDING;
-        io_status_block->information = 0;
-      }
-
-      result = X_STATUS_PENDING;
-    }
+  // Queue the APC callback. It must be delivered via the APC mechanism even
+  // if the read completed immediately.
+  // Low bit probably means do not queue to IO ports.
+  if ((apc_routine & ~1u) && apc_context) {
+    thread->EnqueueApc(apc_routine & ~1u, apc_context, io_status_block_ptr, 0);
   }
 
-  if (XFAILED(result) && io_status_block) {
-    io_status_block->status = result;
-    io_status_block->information = 0;
-  }
-
-  if (ev && signal_event) {
+  // Signal the event after the status block has been written.
+  if (ev) {
     ev->Set(0, false);
   }
-
-  return result;
 }
-DECLARE_XBOXKRNL_EXPORT2(NtReadFile, kFileSystem, kImplemented, kHighFrequency);
 
-dword_result_t NtReadFileScatter_entry(
-    dword_t file_handle, dword_t event_handle, lpvoid_t apc_routine_ptr,
-    lpvoid_t apc_context, pointer_t<X_IO_STATUS_BLOCK> io_status_block,
-    lpdword_t segment_array, dword_t length, lpqword_t byte_offset_ptr) {
+using FileReadFunction = std::function<X_STATUS(XFile* file,
+                                                uint32_t* out_bytes_read)>;
+
+// Performs a read for NtReadFile/NtReadFileScatter. Reads on files opened for
+// overlapped I/O are handed to the kernel I/O worker pool and return
+// X_STATUS_PENDING right away; everything else (and overlapped reads when the
+// pool is disabled or full) completes on the calling thread.
+static X_STATUS xeNtReadFile(uint32_t file_handle, uint32_t event_handle,
+                             uint32_t apc_routine, uint32_t apc_context,
+                             uint32_t io_status_block_ptr,
+                             FileReadFunction read) {
   X_STATUS result = X_STATUS_SUCCESS;
 
-  bool signal_event = false;
   auto ev = kernel_state()->object_table()->LookupObject<XEvent>(event_handle);
   if (event_handle && !ev) {
     result = X_STATUS_INVALID_HANDLE;
@@ -282,72 +236,92 @@ dword_result_t NtReadFileScatter_entry(
     result = X_STATUS_INVALID_HANDLE;
   }
 
-  if (XSUCCEEDED(result)) {
-    if (true || file->is_synchronous()) {
-      // Synchronous.
-      uint32_t bytes_read = 0;
-      result = file->ReadScatter(
-          segment_array.guest_address(), length,
-          byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1,
-          &bytes_read, apc_context);
-      if (io_status_block) {
-        io_status_block->status = result;
-        io_status_block->information = bytes_read;
-      }
-
-      // Queue the APC callback. It must be delivered via the APC mechanism even
-      // though were are completing immediately.
-      // Low bit probably means do not queue to IO ports.
-      if ((uint32_t)apc_routine_ptr & ~1) {
-        if (apc_context) {
-          auto thread = XThread::GetCurrentThread();
-          thread->EnqueueApc(static_cast<uint32_t>(apc_routine_ptr) & ~1u,
-                             apc_context, io_status_block, 0);
-        }
-      }
-
-      if (!file->is_synchronous()) {
-        result = X_STATUS_PENDING;
-      }
-
-      // Mark that we should signal the event now. We do this after
-      // we have written the info out.
-      signal_event = true;
-    } else {
-      // TODO(benvanik): async.
-
-      // TODO: On Windows it might be worth trying to use Win32 ReadFileScatter
-      // here instead of handling it ourselves
-
-      // X_STATUS_PENDING if not returning immediately.
-      // XFile is waitable and signalled after each async req completes.
-      // reset the input event (->Reset())
-      /*xeNtReadFileState* call_state = new xeNtReadFileState();
-      XAsyncRequest* request = new XAsyncRequest(
-      state, file,
-      (XAsyncRequest::CompletionCallback)xeNtReadFileCompleted,
-      call_state);*/
-      // result = file->Read(buffer.guest_address(), buffer_length, byte_offset,
-      //                     request);
-      if (io_status_block) {
-        io_status_block->status = X_STATUS_PENDING;
-        io_status_block->information = 0;
-      }
-
-      result = X_STATUS_PENDING;
+  if (XFAILED(result)) {
+    if (io_status_block_ptr) {
+      auto io_status_block =
+          kernel_memory()->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+              io_status_block_ptr);
+      io_status_block->status = result;
+      io_status_block->information = 0;
+    }
+    return result;
+  }
+
+  auto thread = retain_object(XThread::GetCurrentThread());
+  auto io_worker_pool = kernel_state()->io_worker_pool();
+  if (!file->is_synchronous() && io_worker_pool) {
+    if (io_status_block_ptr) {
+      auto io_status_block =
+          kernel_memory()->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+              io_status_block_ptr);
+      io_status_block->status = X_STATUS_PENDING;
+      io_status_block->information = 0;
+    }
+    if (ev) {
+      ev->Reset();
+    }
+    if (io_worker_pool->Submit([thread, ev, file, apc_routine, apc_context,
+                                io_status_block_ptr, read]() {
+          uint32_t bytes_read = 0;
+          X_STATUS read_result = read(file.get(), &bytes_read);
+          CompleteFileRead(thread.get(), file.get(), ev.get(), apc_routine,
+                           apc_context, io_status_block_ptr, read_result,
+                           bytes_read);
+        })) {
+      return X_STATUS_PENDING;
     }
   }
 
-  if (XFAILED(result) && io_status_block) {
-    io_status_block->status = result;
-    io_status_block->information = 0;
+  uint32_t bytes_read = 0;
+  result = read(file.get(), &bytes_read);
+  CompleteFileRead(thread.get(), file.get(), ev.get(), apc_routine,
+                   apc_context, io_status_block_ptr, result, bytes_read);
+  if (!file->is_synchronous()) {
+    result = X_STATUS_PENDING;
   }
+  return result;
+}
 
-  if (ev && signal_event) {
-    ev->Set(0, false);
-  }
+dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
+                                lpvoid_t apc_routine_ptr, lpvoid_t apc_context,
+                                pointer_t<X_IO_STATUS_BLOCK> io_status_block,
+                                lpvoid_t buffer, dword_t buffer_length,
+                                lpqword_t byte_offset_ptr) {
+  uint32_t buffer_ptr = buffer.guest_address();
+  uint32_t length = buffer_length;
+  uint32_t context = apc_context.guest_address();
+  uint64_t byte_offset =
+      byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1;
+  return xeNtReadFile(
+      file_handle, event_handle, apc_routine_ptr.guest_address(), context,
+      io_status_block.guest_address(),
+      [buffer_ptr, length, byte_offset, context](XFile* file,
+                                                 uint32_t* out_bytes_read) {
+        return file->Read(buffer_ptr, length, byte_offset, out_bytes_read,
+                          context, false);
+      });
+}
+DECLARE_XBOXKRNL_EXPORT2(NtReadFile, kFileSystem, kImplemented, kHighFrequency);
 
-  return result;
+dword_result_t NtReadFileScatter_entry(
+    dword_t file_handle, dword_t event_handle, lpvoid_t apc_routine_ptr,
+    lpvoid_t apc_context, pointer_t<X_IO_STATUS_BLOCK> io_status_block,
+    lpdword_t segment_array, dword_t length, lpqword_t byte_offset_ptr) {
+  // TODO: On Windows it might be worth trying to use Win32 ReadFileScatter
+  // here instead of handling it ourselves
+  uint32_t segments_ptr = segment_array.guest_address();
+  uint32_t total_length = length;
+  uint32_t context = apc_context.guest_address();
+  uint64_t byte_offset =
+      byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1;
+  return xeNtReadFile(
+      file_handle, event_handle, apc_routine_ptr.guest_address(), context,
+      io_status_block.guest_address(),
+      [segments_ptr, total_length, byte_offset, context](
+          XFile* file, uint32_t* out_bytes_read) {
+        return file->ReadScatter(segments_ptr, total_length, byte_offset,
+                                 out_bytes_read, context, false);
+      });
 }
 DECLARE_XBOXKRNL_EXPORT1(NtReadFileScatter, kFileSystem, kImplemented);
 
@@ -565,12 +539,8 @@ dword_result_t NtQueryDirectoryFile_entry(
   }
 
   if (file) {
-    X_FILE_DIRECTORY_INFORMATION dir_info = {0};
-    result =
-        file->QueryDirectory(file_info_ptr, length, name, restart_scan != 0);
-    if (XSUCCEEDED(result)) {
-      info = length;
-    }
+    result = file->QueryDirectory(file_info_ptr, length, name,
+                                  restart_scan != 0, &info);
   } else {
     result = X_STATUS_NO_SUCH_FILE;
   }
@@ -10,7 +10,10 @@
 #include "xenia/kernel/xboxkrnl/xboxkrnl_rtl.h"
 
 #include <algorithm>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "xenia/base/atomic.h"
 #include "xenia/base/chrono.h"
@@ -25,6 +28,12 @@
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xthread.h"
 
+DEFINE_bool(profile_critical_sections, false,
+            "Track how often each guest critical section reaches the kernel "
+            "export and has to wait, and log the most contended ones on "
+            "shutdown.",
+            "Kernel");
+
 namespace xe {
 namespace kernel {
 namespace xboxkrnl {
@@ -418,6 +427,64 @@ dword_result_t RtlInitializeCriticalSectionAndSpinCount_entry(
 DECLARE_XBOXKRNL_EXPORT1(RtlInitializeCriticalSectionAndSpinCount, kNone,
                          kImplemented);
 
+// Contention statistics per critical section guest address. With the JIT
+// handling the uncontended case inline (see cvars::inline_critical_sections)
+// only recursive or contended enters reach the export.
+struct CriticalSectionProfile {
+  uint64_t recursive_enters = 0;
+  uint64_t spin_acquires = 0;
+  uint64_t waits = 0;
+};
+static std::mutex critical_section_profile_mutex_;
+static std::unordered_map<uint32_t, CriticalSectionProfile>
+    critical_section_profile_;
+
+enum class CriticalSectionEnterKind { kRecursive, kSpin, kWait };
+
+static void ProfileCriticalSectionEnter(uint32_t cs_ptr,
+                                        CriticalSectionEnterKind kind) {
+  if (!cvars::profile_critical_sections) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(critical_section_profile_mutex_);
+  auto& profile = critical_section_profile_[cs_ptr];
+  switch (kind) {
+    case CriticalSectionEnterKind::kRecursive:
+      ++profile.recursive_enters;
+      break;
+    case CriticalSectionEnterKind::kSpin:
+      ++profile.spin_acquires;
+      break;
+    case CriticalSectionEnterKind::kWait:
+      ++profile.waits;
+      break;
+  }
+}
+
+void DumpCriticalSectionProfile() {
+  if (!cvars::profile_critical_sections) {
+    return;
+  }
+  std::vector<std::pair<uint32_t, CriticalSectionProfile>> entries;
+  {
+    std::lock_guard<std::mutex> lock(critical_section_profile_mutex_);
+    entries.assign(critical_section_profile_.begin(),
+                   critical_section_profile_.end());
+  }
+  std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) {
+    return a.second.waits > b.second.waits;
+  });
+  const size_t kMaxLoggedEntries = 32;
+  XELOGI("Critical section contention ({} sections, top {}):", entries.size(),
+         std::min(entries.size(), kMaxLoggedEntries));
+  for (size_t i = 0; i < std::min(entries.size(), kMaxLoggedEntries); ++i) {
+    auto& profile = entries[i].second;
+    XELOGI("  {:08X}: {} waits, {} spin acquires, {} recursive enters",
+           entries[i].first, profile.waits, profile.spin_acquires,
+           profile.recursive_enters);
+  }
+}
+
 void RtlEnterCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
   uint32_t cur_thread = XThread::GetCurrentThread()->guest_object();
   uint32_t spin_count = cs->header.absolute * 256;
@@ -426,6 +493,8 @@ void RtlEnterCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
     // We already own the lock.
     xe::atomic_inc(&cs->lock_count);
     cs->recursion_count++;
+    ProfileCriticalSectionEnter(cs.guest_address(),
+                                CriticalSectionEnterKind::kRecursive);
     return;
   }
 
@@ -435,12 +504,16 @@ void RtlEnterCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
       // Acquired.
       cs->owning_thread = cur_thread;
       cs->recursion_count = 1;
+      ProfileCriticalSectionEnter(cs.guest_address(),
+                                  CriticalSectionEnterKind::kSpin);
       return;
     }
   }
 
   if (xe::atomic_inc(&cs->lock_count) != 0) {
     // Create a full waiter.
+    ProfileCriticalSectionEnter(cs.guest_address(),
+                                CriticalSectionEnterKind::kWait);
     xeKeWaitForSingleObject(reinterpret_cast<void*>(cs.host_address()), 8, 0, 0,
                             nullptr);
   }
@@ -628,8 +701,18 @@ dword_result_t RtlComputeCrc32_entry(dword_t seed, lpvoid_t buffer,
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlComputeCrc32, kNone, kImplemented);
 
+void RegisterRtlExports(xe::cpu::ExportResolver* export_resolver,
+                        KernelState* kernel_state) {
+  // Let the JIT emit the uncontended paths inline. The guest-visible layout of
+  // X_RTL_CRITICAL_SECTION above must match X64Emitter::EmitExternFastPath.
+  EXPORT_xboxkrnl_RtlEnterCriticalSection->fast_path =
+      xe::cpu::ExportFastPath::kRtlEnterCriticalSection;
+  EXPORT_xboxkrnl_RtlTryEnterCriticalSection->fast_path =
+      xe::cpu::ExportFastPath::kRtlTryEnterCriticalSection;
+  EXPORT_xboxkrnl_RtlLeaveCriticalSection->fast_path =
+      xe::cpu::ExportFastPath::kRtlLeaveCriticalSection;
+}
+
 }  // namespace xboxkrnl
 }  // namespace kernel
 }  // namespace xe
-
-DECLARE_XBOXKRNL_EMPTY_REGISTER_EXPORTS(Rtl);
@@ -24,6 +24,10 @@ X_STATUS xeRtlInitializeCriticalSectionAndSpinCount(X_RTL_CRITICAL_SECTION* cs,
                                                     uint32_t cs_ptr,
                                                     uint32_t spin_count);
 
+// Logs the per-address contention statistics collected with
+// --profile_critical_sections.
+void DumpCriticalSectionProfile();
+
 }  // namespace xboxkrnl
 }  // namespace kernel
 }  // namespace xe
@@ -1069,10 +1069,7 @@ dword_result_t KeInsertQueueApc_entry(pointer_t<XAPC> apc, lpvoid_t arg1,
   apc->arg2 = arg2.guest_address();
   apc->enqueued = 1;
 
-  auto apc_list = thread->apc_list();
-
-  uint32_t list_entry_ptr = apc.guest_address() + 8;
-  apc_list->Insert(list_entry_ptr);
+  thread->InsertApc(apc.guest_address());
 
   // Unlock thread.
   thread->UnlockApc(true);
@@ -1098,12 +1095,7 @@ dword_result_t KeRemoveQueueApc_entry(pointer_t<XAPC> apc) {
     return 0;
   }
 
-  auto apc_list = thread->apc_list();
-  uint32_t list_entry_ptr = apc.guest_address() + 8;
-  if (apc_list->IsQueued(list_entry_ptr)) {
-    apc_list->Remove(list_entry_ptr);
-    result = true;
-  }
+  result = thread->RemoveApc(apc.guest_address());
 
   thread->UnlockApc(true);
 
@@ -1117,16 +1109,6 @@ dword_result_t KiApcNormalRoutineNop_entry(dword_t unk0 /* output? */,
 }
 DECLARE_XBOXKRNL_EXPORT1(KiApcNormalRoutineNop, kThreading, kStub);
 
-typedef struct {
-  xe::be<uint32_t> unknown;
-  xe::be<uint32_t> flink;
-  xe::be<uint32_t> blink;
-  xe::be<uint32_t> routine;
-  xe::be<uint32_t> context;
-  xe::be<uint32_t> arg1;
-  xe::be<uint32_t> arg2;
-} XDPC;
-
 void KeInitializeDpc_entry(pointer_t<XDPC> dpc, lpvoid_t routine,
                            lpvoid_t context) {
   // KDPC (maybe) 0x18 bytes?
@@ -1145,8 +1127,6 @@ DECLARE_XBOXKRNL_EXPORT2(KeInitializeDpc, kThreading, kImplemented, kSketchy);
 
 dword_result_t KeInsertQueueDpc_entry(pointer_t<XDPC> dpc, dword_t arg1,
                                       dword_t arg2) {
-  assert_always("DPC does not dispatch yet; going to hang!");
-
   uint32_t list_entry_ptr = dpc.guest_address() + 4;
 
   // Lock dispatcher.
@@ -1163,10 +1143,11 @@ dword_result_t KeInsertQueueDpc_entry(pointer_t<XDPC> dpc, dword_t arg1,
   dpc->arg2 = (uint32_t)arg2;
 
   dpc_list->Insert(list_entry_ptr);
+  kernel_state()->QueueDpcDelivery();
 
   return 1;
 }
-DECLARE_XBOXKRNL_EXPORT2(KeInsertQueueDpc, kThreading, kStub, kSketchy);
+DECLARE_XBOXKRNL_EXPORT2(KeInsertQueueDpc, kThreading, kImplemented, kSketchy);
 
 dword_result_t KeRemoveQueueDpc_entry(pointer_t<XDPC> dpc) {
   bool result = false;
@@ -10,10 +10,18 @@
 #include "xenia/kernel/xfile.h"
 #include "xenia/vfs/virtual_file_system.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/kernel/kernel_flags.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/xevent.h"
 #include "xenia/memory.h"
@@ -21,12 +29,23 @@
 namespace xe {
 namespace kernel {
 
+namespace {
+struct {
+  std::atomic<uint64_t> watched_read_count;
+  std::atomic<uint64_t> mapped_read_count;
+  std::atomic<uint64_t> bytes_compared;
+  std::atomic<uint64_t> bytes_unchanged;
+  std::atomic<uint64_t> invalidation_count;
+} watched_read_counters;
+}  // namespace
+
 XFile::XFile(KernelState* kernel_state, vfs::File* file, bool synchronous)
     : XObject(kernel_state, kObjectType),
       file_(file),
       is_synchronous_(synchronous) {
   async_event_ = threading::Event::CreateAutoResetEvent(false);
   assert_not_null(async_event_);
+  InitializeReadAhead();
 }
 
 XFile::XFile() : XObject(kObjectType) {
@@ -37,58 +56,90 @@ XFile::XFile() : XObject(kObjectType) {
 XFile::~XFile() {
   // TODO(benvanik): signal that the file is closing?
   async_event_->Set();
+  read_ahead_.reset();
   file_->Destroy();
 }
 
+void XFile::InitializeReadAhead() {
+  // Prefetched data would go stale if the file could be written through
+  // another handle, so only files on read-only devices are read ahead.
+  auto read_ahead_pool = kernel_state_->read_ahead_pool();
+  if (!read_ahead_pool ||
+      file_->entry()->attributes() & vfs::kFileAttributeDirectory ||
+      !file_->entry()->is_read_only()) {
+    return;
+  }
+  read_ahead_ = std::make_unique<vfs::ReadAheadBuffer>(
+      read_ahead_pool, file_, file_->entry()->size());
+}
+
 X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
                                size_t length, const std::string_view file_name,
-                               bool restart) {
+                               bool restart, uint32_t* out_length) {
   assert_not_null(out_info);
 
-  vfs::Entry* entry = nullptr;
-
   if (!file_name.empty()) {
     // Only queries in the current directory are supported for now.
     assert_true(utf8::find_any_of(file_name, "\\") == std::string_view::npos);
 
-    find_engine_.SetRule(file_name);
-
     // Always restart the search?
-    find_index_ = 0;
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
-    if (!entry) {
+    find_cursor_.SetPattern(file_name);
+    find_cursor_.Scan(file_->entry());
+    if (!find_cursor_.Peek()) {
       return X_STATUS_NO_SUCH_FILE;
     }
   } else {
-    if (restart) {
-      find_index_ = 0;
+    if (restart || !find_cursor_.scanned()) {
+      find_cursor_.Scan(file_->entry());
     }
-
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
-    if (!entry) {
+    if (!find_cursor_.Peek()) {
       return X_STATUS_NO_MORE_FILES;
     }
   }
 
-  auto end = reinterpret_cast<uint8_t*>(out_info) + length;
-  const auto& entry_name = entry->name();
-  if (reinterpret_cast<uint8_t*>(&out_info->file_name[0]) + entry_name.size() >
-      end) {
-    assert_always("Buffer overflow?");
-    return X_STATUS_NO_SUCH_FILE;
-  }
+  auto base = reinterpret_cast<uint8_t*>(out_info);
+  size_t offset = 0;
+  X_FILE_DIRECTORY_INFORMATION* previous_info = nullptr;
+  while (auto match = find_cursor_.Peek()) {
+    size_t info_length =
+        offsetof(X_FILE_DIRECTORY_INFORMATION, file_name) + match->name.size();
+    if (offset + info_length > length) {
+      if (!previous_info) {
+        assert_always("Buffer overflow?");
+        return X_STATUS_NO_SUCH_FILE;
+      }
+      break;
+    }
+    find_cursor_.Next();
 
-  out_info->next_entry_offset = 0;
-  out_info->file_index = static_cast<uint32_t>(find_index_);
-  out_info->creation_time = entry->create_timestamp();
-  out_info->last_access_time = entry->access_timestamp();
-  out_info->last_write_time = entry->write_timestamp();
-  out_info->change_time = entry->write_timestamp();
-  out_info->end_of_file = entry->size();
-  out_info->allocation_size = entry->allocation_size();
-  out_info->attributes = entry->attributes();
-  out_info->file_name_length = static_cast<uint32_t>(entry_name.size());
-  std::memcpy(out_info->file_name, entry_name.data(), entry_name.size());
+    auto info = reinterpret_cast<X_FILE_DIRECTORY_INFORMATION*>(base + offset);
+    if (previous_info) {
+      previous_info->next_entry_offset = uint32_t(
+          base + offset - reinterpret_cast<uint8_t*>(previous_info));
+    }
+    info->next_entry_offset = 0;
+    info->file_index = static_cast<uint32_t>(find_cursor_.position());
+    info->creation_time = match->create_timestamp;
+    info->last_access_time = match->access_timestamp;
+    info->last_write_time = match->write_timestamp;
+    info->change_time = match->write_timestamp;
+    info->end_of_file = match->size;
+    info->allocation_size = match->allocation_size;
+    info->attributes = match->attributes;
+    info->file_name_length = static_cast<uint32_t>(match->name.size());
+    std::memcpy(info->file_name, match->name.data(), match->name.size());
+    previous_info = info;
+
+    if (out_length) {
+      *out_length = uint32_t(offset + info_length);
+    }
+    // The Xbox kernel has no ReturnSingleEntry argument, and XAPI expects a
+    // single entry per call, so batching is opt-in.
+    if (!cvars::query_directory_batch) {
+      break;
+    }
+    offset = xe::round_up(offset + info_length, size_t(8));
+  }
 
   return X_STATUS_SUCCESS;
 }
@@ -142,15 +193,37 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                 memory::PageAccess::kReadWrite) {
           result = X_STATUS_ACCESS_VIOLATION;
         } else {
-          result = file_->ReadSync(
+          void* buffer =
               buffer_physical_heap
                   ? memory()->TranslatePhysical(
                         buffer_physical_heap->GetPhysicalAddress(
                             buffer_guest_address))
-                  : memory()->TranslateVirtual(buffer_guest_address),
-              buffer_length, size_t(byte_offset), &bytes_read);
+                  : memory()->TranslateVirtual(buffer_guest_address);
+          // Guest memory only reflects what the host has written - if any of
+          // the pages contain newer data written by the GPU, comparing against
+          // RAM would wrongly keep them valid, so read them fully instead.
+          bool watched = false;
+          if (buffer_physical_heap && cvars::read_skip_unchanged_pages) {
+            auto global_lock = global_critical_region::AcquireDirect();
+            watched = buffer_physical_heap->IsRangeWatched(
+                          buffer_guest_address, buffer_length) &&
+                      !buffer_physical_heap->IsRangeWrittenByHost(
+                          buffer_guest_address, buffer_length);
+          }
+          if (watched) {
+            result = ReadWatched(buffer_physical_heap, buffer_guest_address,
+                                 buffer, buffer_length, byte_offset,
+                                 &bytes_read);
+          } else {
+            result = read_ahead_ ? read_ahead_->Read(buffer, buffer_length,
+                                                     size_t(byte_offset),
+                                                     &bytes_read)
+                                 : file_->ReadSync(buffer, buffer_length,
+                                                   size_t(byte_offset),
+                                                   &bytes_read);
+          }
           if (XSUCCEEDED(result)) {
-            if (buffer_physical_heap) {
+            if (buffer_physical_heap && !watched) {
               buffer_physical_heap->TriggerCallbacks(
                   xe::global_critical_region::AcquireDirect(),
                   buffer_guest_address, buffer_length, true, true);
@@ -167,22 +240,93 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
   }
 
   if (notify_completion) {
-    XIOCompletion::IONotification notify;
-    notify.apc_context = apc_context;
-    notify.num_bytes = uint32_t(bytes_read);
-    notify.status = result;
+    NotifyCompletion(apc_context, uint32_t(bytes_read), result);
+  }
 
-    NotifyIOCompletionPorts(notify);
+  return result;
+}
 
-    async_event_->Set();
+X_STATUS XFile::ReadWatched(xe::PhysicalHeap* heap,
+                            uint32_t buffer_guest_address, void* buffer,
+                            uint32_t buffer_length, uint64_t byte_offset,
+                            size_t* out_bytes_read) {
+  ++watched_read_counters.watched_read_count;
+
+  // Files on read-only devices that can be mapped are compared straight
+  // against the mapping, anything else is read into a staging buffer first -
+  // a mapping kept for the lifetime of the handle would go out of sync with
+  // files resized through other handles. The staging buffer is kept around,
+  // as watched reads tend to be large and frequent.
+  auto entry = file_->entry();
+  // Overlapped reads of the same file may run concurrently on the I/O pool,
+  // so the mapping is opened exactly once and never replaced afterwards.
+  std::call_once(watched_read_mapping_once_, [this, entry]() {
+    if (!entry->is_read_only() || !entry->can_map()) {
+      return;
+    }
+    auto mapping = entry->OpenMapped(MappedMemory::Mode::kRead);
+    if (mapping && mapping->size() >= entry->size()) {
+      watched_read_mapping_ = std::move(mapping);
+    }
+  });
+  thread_local std::vector<uint8_t> staging;
+  const uint8_t* source;
+  size_t bytes_read = 0;
+  X_STATUS result = X_STATUS_SUCCESS;
+  if (watched_read_mapping_) {
+    size_t file_size = std::min(entry->size(), watched_read_mapping_->size());
+    if (byte_offset >= file_size) {
+      return X_STATUS_END_OF_FILE;
+    }
+    bytes_read =
+        std::min(size_t(buffer_length), file_size - size_t(byte_offset));
+    source = watched_read_mapping_->data() + byte_offset;
+    ++watched_read_counters.mapped_read_count;
+  } else {
+    if (staging.size() < buffer_length) {
+      staging.resize(buffer_length);
+    }
+    result = read_ahead_ ? read_ahead_->Read(staging.data(), buffer_length,
+                                             size_t(byte_offset), &bytes_read)
+                         : file_->ReadSync(staging.data(), buffer_length,
+                                           size_t(byte_offset), &bytes_read);
+    if (XFAILED(result)) {
+      return result;
+    }
+    source = staging.data();
   }
 
+  // Like a plain read, each run is invalidated after being written.
+  size_t bytes_unchanged = xe::copy_changed_blocks(
+      buffer, source, bytes_read, xe::memory::page_size(),
+      [&](size_t offset, size_t length) {
+        heap->TriggerCallbacks(xe::global_critical_region::AcquireDirect(),
+                               buffer_guest_address + uint32_t(offset),
+                               uint32_t(length), true, true);
+        ++watched_read_counters.invalidation_count;
+      });
+  watched_read_counters.bytes_compared += bytes_read;
+  watched_read_counters.bytes_unchanged += bytes_unchanged;
+
+  *out_bytes_read = bytes_read;
   return result;
 }
 
+XFile::PhysicalReadStatistics XFile::physical_read_statistics() {
+  PhysicalReadStatistics statistics;
+  statistics.watched_read_count =
+      watched_read_counters.watched_read_count;
+  statistics.mapped_read_count = watched_read_counters.mapped_read_count;
+  statistics.bytes_compared = watched_read_counters.bytes_compared;
+  statistics.bytes_unchanged = watched_read_counters.bytes_unchanged;
+  statistics.invalidation_count =
+      watched_read_counters.invalidation_count;
+  return statistics;
+}
+
 X_STATUS XFile::ReadScatter(uint32_t segments_guest_address, uint32_t length,
                             uint64_t byte_offset, uint32_t* out_bytes_read,
-                            uint32_t apc_context) {
+                            uint32_t apc_context, bool notify_completion) {
   X_STATUS result = X_STATUS_SUCCESS;
 
   // segments points to an array of buffer pointers of type
@@ -224,16 +368,23 @@ X_STATUS XFile::ReadScatter(uint32_t segments_guest_address, uint32_t length,
     *out_bytes_read = uint32_t(read_total);
   }
 
+  if (notify_completion) {
+    NotifyCompletion(apc_context, uint32_t(read_total), result);
+  }
+
+  return result;
+}
+
+void XFile::NotifyCompletion(uint32_t apc_context, uint32_t num_bytes,
+                             X_STATUS status) {
   XIOCompletion::IONotification notify;
   notify.apc_context = apc_context;
-  notify.num_bytes = uint32_t(read_total);
-  notify.status = result;
+  notify.num_bytes = num_bytes;
+  notify.status = status;
 
   NotifyIOCompletionPorts(notify);
 
   async_event_->Set();
-
-  return result;
 }
 
 X_STATUS XFile::Write(uint32_t buffer_guest_address, uint32_t buffer_length,
@@ -336,6 +487,7 @@ object_ref<XFile> XFile::Restore(KernelState* kernel_state,
   file->file_ = vfs_file;
   file->position_ = position;
   file->is_synchronous_ = is_synchronous;
+  file->InitializeReadAhead();
 
   return object_ref<XFile>(file);
 }
@@ -10,14 +10,18 @@
 #ifndef XENIA_KERNEL_XFILE_H_
 #define XENIA_KERNEL_XFILE_H_
 
+#include <mutex>
 #include <string>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xiocompletion.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/vfs/device.h"
+#include "xenia/vfs/directory_cursor.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
+#include "xenia/vfs/read_ahead_buffer.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -91,8 +95,11 @@ class XFile : public XObject {
   uint64_t position() const { return position_; }
   void set_position(uint64_t value) { position_ = value; }
 
+  // Fills out_info with the next entry matching file_name, or with as many as
+  // fit if query_directory_batch is enabled, chained by next_entry_offset.
   X_STATUS QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info, size_t length,
-                          const std::string_view file_name, bool restart);
+                          const std::string_view file_name, bool restart,
+                          uint32_t* out_length = nullptr);
 
   // Don't do within the global critical region because invalidation callbacks
   // may be triggered (as per the usual rule of not doing I/O within the global
@@ -103,7 +110,13 @@ class XFile : public XObject {
 
   X_STATUS ReadScatter(uint32_t segments_guest_address, uint32_t length,
                        uint64_t byte_offset, uint32_t* out_bytes_read,
-                       uint32_t apc_context);
+                       uint32_t apc_context, bool notify_completion = true);
+
+  // Posts a finished operation to the I/O completion ports and signals the
+  // file, for callers that passed notify_completion = false and have to
+  // report the result to the guest first.
+  void NotifyCompletion(uint32_t apc_context, uint32_t num_bytes,
+                        X_STATUS status);
 
   X_STATUS Write(uint32_t buffer_guess_address, uint32_t buffer_length,
                  uint64_t byte_offset, uint32_t* out_bytes_written,
@@ -120,6 +133,20 @@ class XFile : public XObject {
 
   bool is_synchronous() const { return is_synchronous_; }
 
+  struct PhysicalReadStatistics {
+    // Reads into physical memory with invalidation watches in range.
+    uint64_t watched_read_count;
+    // Of those, reads copied straight from a mapped file.
+    uint64_t mapped_read_count;
+    uint64_t bytes_compared;
+    // Bytes that already held the data read, so they stayed watched.
+    uint64_t bytes_unchanged;
+    // Runs of changed pages invalidation callbacks were triggered for.
+    uint64_t invalidation_count;
+  };
+  // Totals over all files.
+  static PhysicalReadStatistics physical_read_statistics();
+
  protected:
   void NotifyIOCompletionPorts(XIOCompletion::IONotification& notification);
 
@@ -130,7 +157,20 @@ class XFile : public XObject {
  private:
   XFile();
 
+  // Read-only files get a read-ahead buffer if the kernel has one configured.
+  void InitializeReadAhead();
+
+  // Reads into physical memory that the GPU is watching, writing and
+  // invalidating only the pages whose contents change.
+  X_STATUS ReadWatched(xe::PhysicalHeap* heap, uint32_t buffer_guest_address,
+                       void* buffer, uint32_t buffer_length,
+                       uint64_t byte_offset, size_t* out_bytes_read);
+
   vfs::File* file_ = nullptr;
+  std::unique_ptr<vfs::ReadAheadBuffer> read_ahead_;
+  // The whole entry, mapped by the first watched read of a read-only file.
+  std::unique_ptr<MappedMemory> watched_read_mapping_;
+  std::once_flag watched_read_mapping_once_;
   std::unique_ptr<threading::Event> async_event_ = nullptr;
 
   std::mutex completion_port_lock_;
@@ -140,8 +180,7 @@ class XFile : public XObject {
 
   uint64_t position_ = 0;
 
-  xe::filesystem::WildcardEngine find_engine_;
-  size_t find_index_ = 0;
+  vfs::DirectoryCursor find_cursor_;
 
   bool is_synchronous_ = false;
 };
@@ -204,6 +204,7 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
                         TimeoutTicksToMs(*opt_timeout)))
                   : std::chrono::milliseconds::max();
 
+  XThread::WaitTimer wait_timer;
   auto result =
       xe::threading::Wait(wait_handle, alertable ? true : false, timeout_ms);
   switch (result) {
@@ -231,6 +232,7 @@ X_STATUS XObject::SignalAndWait(XObject* signal_object, XObject* wait_object,
                         TimeoutTicksToMs(*opt_timeout)))
                   : std::chrono::milliseconds::max();
 
+  XThread::WaitTimer wait_timer;
   auto result = xe::threading::SignalAndWait(
       signal_object->GetWaitHandle(), wait_object->GetWaitHandle(),
       alertable ? true : false, timeout_ms);
@@ -266,6 +268,7 @@ X_STATUS XObject::WaitMultiple(uint32_t count, XObject** objects,
                         TimeoutTicksToMs(*opt_timeout)))
                   : std::chrono::milliseconds::max();
 
+  XThread::WaitTimer wait_timer;
   if (wait_type) {
     auto result = xe::threading::WaitAny(std::move(wait_handles),
                                          alertable ? true : false, timeout_ms);
@@ -9,6 +9,7 @@
 
 #include "xenia/kernel/xthread.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "third_party/fmt/include/fmt/format.h"
@@ -32,6 +33,20 @@ DEFINE_bool(ignore_thread_priorities, true,
             "Ignores game-specified thread priorities.", "Kernel");
 DEFINE_bool(ignore_thread_affinities, true,
             "Ignores game-specified thread affinities.", "Kernel");
+DEFINE_string(
+    thread_placement, "topology",
+    "How guest hardware threads are placed on host processors when thread "
+    "affinities are not ignored.\n"
+    " topology: Each Xenon core (hardware threads 0/1, 2/3 and 4/5) gets a "
+    "physical host core of its own, preferring the fastest ones, and host "
+    "service threads (GPU, audio, XMA) run on the remaining cores.\n"
+    " direct: Hardware thread N runs on host logical processor N.",
+    "Kernel");
+DEFINE_bool(realtime_service_threads, false,
+            "Runs the audio and vsync host threads with realtime scheduling. "
+            "On Linux this requires CAP_SYS_NICE or an RLIMIT_RTPRIO "
+            "allowance.",
+            "Kernel");
 
 namespace xe {
 namespace kernel {
@@ -155,6 +170,92 @@ void XThread::set_name(const std::string_view name) {
   }
 }
 
+// Host logical processors the guest hardware threads and the host service
+// threads are allowed to run on. A zero mask leaves the thread unpinned.
+struct HostThreadLayout {
+  uint64_t guest_masks[6] = {};
+  uint64_t service_mask = 0;
+};
+
+static HostThreadLayout ComputeHostThreadLayout() {
+  HostThreadLayout layout;
+  if (cvars::thread_placement == "direct") {
+    if (xe::threading::logical_processor_count() < 6) {
+      XELOGW("Too few processor cores - scheduling will be wonky");
+      return layout;
+    }
+    for (uint32_t i = 0; i < 6; ++i) {
+      layout.guest_masks[i] = uint64_t(1) << i;
+    }
+    return layout;
+  }
+  if (cvars::thread_placement != "topology") {
+    XELOGW("Unknown thread_placement {}, using topology",
+           cvars::thread_placement);
+  }
+
+  struct HostCore {
+    uint32_t package_id;
+    uint32_t core_id;
+    uint32_t capacity;
+    uint64_t mask;
+  };
+  std::vector<HostCore> cores;
+  for (const auto& processor : xe::threading::QueryProcessorTopology()) {
+    if (processor.index >= 64) {
+      continue;
+    }
+    auto it = std::find_if(cores.begin(), cores.end(), [&](const HostCore& c) {
+      return c.package_id == processor.package_id &&
+             c.core_id == processor.core_id;
+    });
+    if (it == cores.end()) {
+      cores.push_back({processor.package_id, processor.core_id, 0, 0});
+      it = cores.end() - 1;
+    }
+    it->capacity = std::max(it->capacity, processor.capacity);
+    it->mask |= uint64_t(1) << processor.index;
+  }
+  if (cores.empty()) {
+    return layout;
+  }
+
+  // Fastest cores go to the guest, keeping the host order among equals so
+  // that the layout is the same from run to run.
+  std::stable_sort(cores.begin(), cores.end(),
+                   [](const HostCore& a, const HostCore& b) {
+                     return a.capacity > b.capacity;
+                   });
+  // Both hardware threads of a Xenon core share a host core, running on its
+  // SMT siblings if it has any, like they share a core on the console.
+  size_t guest_core_count = std::min(cores.size(), size_t(3));
+  if (guest_core_count < 3) {
+    XELOGW("Too few processor cores - scheduling will be wonky");
+  }
+  for (uint32_t i = 0; i < 6; ++i) {
+    layout.guest_masks[i] = cores[(i / 2) % guest_core_count].mask;
+  }
+  // Without spare cores the service threads are left to the host scheduler.
+  for (size_t i = guest_core_count; i < cores.size(); ++i) {
+    layout.service_mask |= cores[i].mask;
+  }
+  return layout;
+}
+
+static const HostThreadLayout& GetHostThreadLayout() {
+  static const HostThreadLayout layout = [] {
+    HostThreadLayout layout = ComputeHostThreadLayout();
+    XELOGI(
+        "Host thread layout ({}): hardware threads 0-5 on {:X} {:X} {:X} {:X} "
+        "{:X} {:X}, service threads on {:X}",
+        cvars::thread_placement, layout.guest_masks[0], layout.guest_masks[1],
+        layout.guest_masks[2], layout.guest_masks[3], layout.guest_masks[4],
+        layout.guest_masks[5], layout.service_mask);
+    return layout;
+  }();
+  return layout;
+}
+
 static uint8_t next_cpu = 0;
 static uint8_t GetFakeCpuNumber(uint8_t proc_mask) {
   // NOTE: proc_mask is logical processors, not physical processors or cores.
@@ -391,6 +492,7 @@ X_STATUS XThread::Create() {
     running_ = true;
     Execute();
     running_ = false;
+    LogThreadTimes();
     current_thread_ = nullptr;
     current_xthread_tls_ = nullptr;
 
@@ -447,6 +549,8 @@ X_STATUS XThread::Exit(int exit_code) {
   // Notify processor of our exit.
   emulator()->processor()->OnThreadExit(thread_id_);
 
+  LogThreadTimes();
+
   // NOTE: unless PlatformExit fails, expect it to never return!
   current_xthread_tls_ = nullptr;
   current_thread_ = nullptr;
@@ -588,44 +692,130 @@ void XThread::UnlockApc(bool queue_delivery) {
   bool needs_apc = apc_list_.HasPending();
   global_critical_region_.mutex().unlock();
   if (needs_apc && queue_delivery) {
+    RequestApcDelivery();
+  }
+}
+
+void XThread::RequestApcDelivery() {
+  // Every request is a signal or a host APC, and DeliverAPCs drains everything
+  // that is pending anyway, so a burst of enqueues only needs the first one.
+  if (!apc_delivery_requested_.exchange(true)) {
     thread_->QueueUserCallback([this]() { DeliverAPCs(); });
   }
 }
 
-void XThread::EnqueueApc(uint32_t normal_routine, uint32_t normal_context,
-                         uint32_t arg1, uint32_t arg2) {
-  LockApc();
+void XThread::InsertApc(uint32_t apc_ptr) {
+  host_apcs_.InsertGuestApc(apc_ptr);
+  apc_list_.Append(apc_ptr + 8);
+}
 
-  // Allocate APC.
-  // We'll tag it as special and free it when dispatched.
-  uint32_t apc_ptr = memory()->SystemHeapAlloc(XAPC::kSize);
-  auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
+bool XThread::RemoveApc(uint32_t apc_ptr) {
+  host_apcs_.RemoveGuestApc(apc_ptr);
+  if (!apc_list_.IsQueued(apc_ptr + 8)) {
+    return false;
+  }
+  apc_list_.Remove(apc_ptr + 8);
+  return true;
+}
 
-  apc->Initialize();
-  apc->kernel_routine = XAPC::kDummyKernelRoutine;
-  apc->rundown_routine = XAPC::kDummyRundownRoutine;
-  apc->normal_routine = normal_routine;
-  apc->normal_context = normal_context;
-  apc->arg1 = arg1;
-  apc->arg2 = arg2;
-  apc->enqueued = 1;
+void XThread::EnqueueApc(uint32_t normal_routine, uint32_t normal_context,
+                         uint32_t arg1, uint32_t arg2) {
+  host_apcs_.Push(normal_routine, normal_context, arg1, arg2);
+  RequestApcDelivery();
+}
 
-  uint32_t list_entry_ptr = apc_ptr + 8;
-  apc_list_.Insert(list_entry_ptr);
+void XThread::SpillHostAPCs() {
+  host_apcs_.Take();
+  if (!host_apcs_.front()) {
+    return;
+  }
+  // Rebuild the guest list with the host APCs merged in.
+  std::vector<uint32_t> guest_apcs;
+  while (apc_list_.HasPending()) {
+    guest_apcs.push_back(apc_list_.Shift() - 8);
+  }
+  auto guest_it = guest_apcs.cbegin();
+  while (guest_it != guest_apcs.cend() || host_apcs_.front()) {
+    uint32_t guest_apc_ptr = guest_it != guest_apcs.cend() ? *guest_it : 0;
+    if (!host_apcs_.FrontPrecedes(
+            host_apcs_.GuestApcSequence(guest_apc_ptr))) {
+      apc_list_.Append(guest_apc_ptr + 8);
+      ++guest_it;
+      continue;
+    }
+    auto host_apc = host_apcs_.Pop();
+    // We'll tag it as special and free it when dispatched.
+    uint32_t apc_ptr = memory()->SystemHeapAlloc(XAPC::kSize);
+    auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
+    apc->Initialize();
+    apc->kernel_routine = XAPC::kDummyKernelRoutine;
+    apc->rundown_routine = XAPC::kDummyRundownRoutine;
+    apc->normal_routine = host_apc.normal_routine;
+    apc->normal_context = host_apc.normal_context;
+    apc->arg1 = host_apc.arg1;
+    apc->arg2 = host_apc.arg2;
+    apc->enqueued = 1;
+    apc_list_.Append(apc_ptr + 8);
+  }
+}
 
-  UnlockApc(true);
+void XThread::DeliverHostAPCs(uint64_t guest_sequence) {
+  auto kthread = guest_object<X_KTHREAD>();
+  auto processor = kernel_state()->processor();
+  uint32_t batch_size = 0;
+  while (host_apcs_.FrontPrecedes(guest_sequence) &&
+         kthread->apc_disable_count == 0) {
+    auto apc = host_apcs_.Pop();
+
+    auto latency = std::chrono::steady_clock::now() - apc.enqueue_time;
+    apc_total_latency_ += latency;
+    apc_max_latency_ = std::max<std::chrono::nanoseconds>(apc_max_latency_,
+                                                          latency);
+    ++batch_size;
+
+    XELOGD("Delivering APC to {:08X}", apc.normal_routine);
+    // normal_routine(normal_context, system_arg1, system_arg2)
+    uint64_t normal_args[] = {apc.normal_context, apc.arg1, apc.arg2};
+    processor->Execute(thread_state_, apc.normal_routine, normal_args,
+                       xe::countof(normal_args));
+  }
+  if (batch_size) {
+    apc_delivered_count_ += batch_size;
+    ++apc_batch_count_;
+    apc_max_batch_size_ = std::max(apc_max_batch_size_, batch_size);
+  }
 }
 
 void XThread::DeliverAPCs() {
   // https://www.drdobbs.com/inside-nts-asynchronous-procedure-call/184416590?pgno=1
   // https://www.drdobbs.com/inside-nts-asynchronous-procedure-call/184416590?pgno=7
+  // Clear the request first, anything enqueued from here on asks again.
+  apc_delivery_requested_ = false;
+
   auto processor = kernel_state()->processor();
   LockApc();
   auto kthread = guest_object<X_KTHREAD>();
-  while (apc_list_.HasPending() && kthread->apc_disable_count == 0) {
+  while (kthread->apc_disable_count == 0) {
+    // Deliver host and guest APCs in the order they were queued. Guest KAPCs
+    // inserted after the host APCs are taken here are numbered after them, so
+    // the ones taken can be delivered without the lock.
+    host_apcs_.Take();
+    uint64_t guest_sequence = host_apcs_.GuestApcSequence(
+        apc_list_.HasPending() ? apc_list_.head() - 8 : 0);
+    if (host_apcs_.FrontPrecedes(guest_sequence)) {
+      UnlockApc(false);
+      DeliverHostAPCs(guest_sequence);
+      LockApc();
+      continue;
+    }
+    if (!apc_list_.HasPending()) {
+      break;
+    }
+
     // Get APC entry (offset for LIST_ENTRY offset) and cache what we need.
     // Calling the routine may delete the memory/overwrite it.
     uint32_t apc_ptr = apc_list_.Shift() - 8;
+    host_apcs_.RemoveGuestApc(apc_ptr);
     auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
     bool needs_freeing = apc->kernel_routine == XAPC::kDummyKernelRoutine;
 
@@ -685,11 +875,15 @@ void XThread::DeliverAPCs() {
 
 void XThread::RundownAPCs() {
   assert_true(XThread::GetCurrentThread() == this);
+  // Host APCs have no rundown routine.
+  host_apcs_.Clear();
+
   LockApc();
   while (apc_list_.HasPending()) {
     // Get APC entry (offset for LIST_ENTRY offset) and cache what we need.
     // Calling the routine may delete the memory/overwrite it.
     uint32_t apc_ptr = apc_list_.Shift() - 8;
+    host_apcs_.RemoveGuestApc(apc_ptr);
     auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
     bool needs_freeing = apc->kernel_routine == XAPC::kDummyKernelRoutine;
 
@@ -758,12 +952,60 @@ void XThread::SetActiveCpu(uint8_t cpu_index) {
     thread_object.current_cpu = cpu_index;
   }
 
-  if (xe::threading::logical_processor_count() >= 6) {
-    if (!cvars::ignore_thread_affinities) {
-      thread_->set_affinity_mask(uint64_t(1) << cpu_index);
+  if (!cvars::ignore_thread_affinities) {
+    // Host threads keep off the processors reserved for the guest.
+    const HostThreadLayout& layout = GetHostThreadLayout();
+    uint64_t mask = is_guest_thread() ? layout.guest_masks[cpu_index]
+                                      : layout.service_mask;
+    if (mask) {
+      thread_->set_affinity_mask(mask);
     }
-  } else {
-    XELOGW("Too few processor cores - scheduling will be wonky");
+  }
+}
+
+void XThread::SetRealtimePriority() {
+  if (!cvars::realtime_service_threads) {
+    return;
+  }
+  thread_->set_priority(xe::threading::ThreadPriority::kRealtime);
+  if (thread_->priority() != xe::threading::ThreadPriority::kRealtime) {
+    XELOGW("Realtime scheduling unavailable for thread '{}'", thread_name_);
+  }
+}
+
+std::chrono::nanoseconds XThread::run_time() const {
+  return thread_ ? thread_->QueryCpuTime() : std::chrono::nanoseconds::zero();
+}
+
+void XThread::AddWaitTime(std::chrono::nanoseconds duration) {
+  wait_time_ns_.fetch_add(uint64_t(duration.count()),
+                          std::memory_order_relaxed);
+}
+
+void XThread::LogThreadTimes() {
+  XELOGKERNEL("XThread {:08X} ('{}') ran for {:.3f}ms, waited for {:.3f}ms",
+              handle(), thread_name_,
+              std::chrono::duration<double, std::milli>(run_time()).count(),
+              std::chrono::duration<double, std::milli>(wait_time()).count());
+  if (apc_batch_count_) {
+    XELOGKERNEL(
+        "XThread {:08X} ('{}') delivered {} host APCs in {} batches (max {}), "
+        "latency {:.3f}ms average, {:.3f}ms max",
+        handle(), thread_name_, apc_delivered_count_, apc_batch_count_,
+        apc_max_batch_size_,
+        std::chrono::duration<double, std::milli>(apc_total_latency_).count() /
+            apc_delivered_count_,
+        std::chrono::duration<double, std::milli>(apc_max_latency_).count());
+  }
+}
+
+XThread::WaitTimer::WaitTimer()
+    : thread_(current_xthread_tls_),
+      start_(std::chrono::steady_clock::now()) {}
+
+XThread::WaitTimer::~WaitTimer() {
+  if (thread_) {
+    thread_->AddWaitTime(std::chrono::steady_clock::now() - start_);
   }
 }
 
@@ -834,6 +1076,7 @@ X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
     timeout_ms = 0;
   }
   timeout_ms = Clock::ScaleGuestDurationMillis(timeout_ms);
+  WaitTimer wait_timer;
   if (alertable) {
     auto result =
         xe::threading::AlertableSleep(std::chrono::milliseconds(timeout_ms));
@@ -912,7 +1155,10 @@ bool XThread::Save(ByteStream* stream) {
   state.thread_id = thread_id_;
   state.is_main_thread = main_thread_;
   state.is_running = running_;
+  LockApc();
+  SpillHostAPCs();
   state.apc_head = apc_list_.head();
+  UnlockApc(false);
   state.tls_static_address = tls_static_address_;
   state.tls_dynamic_address = tls_dynamic_address_;
   state.tls_total_size = tls_total_size_;
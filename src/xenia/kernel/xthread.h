@@ -11,12 +11,14 @@
 #define XENIA_KERNEL_XTHREAD_H_
 
 #include <atomic>
+#include <chrono>
 #include <string>
 
 #include "xenia/base/mutex.h"
 #include "xenia/base/threading.h"
 #include "xenia/cpu/thread.h"
 #include "xenia/cpu/thread_state.h"
+#include "xenia/kernel/util/host_apc_queue.h"
 #include "xenia/kernel/util/native_list.h"
 #include "xenia/kernel/xmutant.h"
 #include "xenia/kernel/xobject.h"
@@ -69,6 +71,17 @@ struct XAPC {
   }
 };
 
+// KDPC, stored in guest memory.
+struct XDPC {
+  xe::be<uint32_t> unknown;  // +0 type, importance and number
+  xe::be<uint32_t> flink;    // +4
+  xe::be<uint32_t> blink;    // +8
+  xe::be<uint32_t> routine;  // +12
+  xe::be<uint32_t> context;  // +16
+  xe::be<uint32_t> arg1;     // +20
+  xe::be<uint32_t> arg2;     // +24
+};
+
 // Processor Control Region
 struct X_KPCR {
   xe::be<uint32_t> tls_ptr;         // 0x0
@@ -206,6 +219,16 @@ class XThread : public XObject, public cpu::Thread {
   void LockApc();
   void UnlockApc(bool queue_delivery);
   util::NativeList* apc_list() { return &apc_list_; }
+  // Queues a guest KAPC behind every APC queued before it. The APC lock must
+  // be held.
+  void InsertApc(uint32_t apc_ptr);
+  // Dequeues a guest KAPC, returning whether it was queued. The APC lock must
+  // be held.
+  bool RemoveApc(uint32_t apc_ptr);
+  // Queues a user APC on behalf of the host (I/O completions, timers). Unlike
+  // guest KAPCs this takes no lock and allocates no guest memory, so it may be
+  // called from any thread; the owning thread delivers them in batches, in
+  // order with the guest KAPCs.
   void EnqueueApc(uint32_t normal_routine, uint32_t normal_context,
                   uint32_t arg1, uint32_t arg2);
 
@@ -224,6 +247,31 @@ class XThread : public XObject, public cpu::Thread {
   uint8_t active_cpu() const;
   void SetActiveCpu(uint8_t cpu_index);
 
+  // Runs the thread with realtime host scheduling if realtime_service_threads
+  // is set. For host threads with hard deadlines, such as audio and vsync.
+  void SetRealtimePriority();
+
+  // Host processor time the thread has consumed.
+  std::chrono::nanoseconds run_time() const;
+  // Host time the thread has spent blocked in kernel waits and delays.
+  std::chrono::nanoseconds wait_time() const {
+    return std::chrono::nanoseconds(
+        wait_time_ns_.load(std::memory_order_relaxed));
+  }
+  void AddWaitTime(std::chrono::nanoseconds duration);
+
+  // Adds the lifetime of the scope to the wait time of the calling thread, if
+  // it is an XThread.
+  class WaitTimer {
+   public:
+    WaitTimer();
+    ~WaitTimer();
+
+   private:
+    XThread* thread_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
   bool GetTLSValue(uint32_t slot, uint32_t* value_out);
   bool SetTLSValue(uint32_t slot, uint32_t value);
 
@@ -249,8 +297,19 @@ class XThread : public XObject, public cpu::Thread {
   void FreeStack();
   void InitializeGuestObject();
 
+  // Asks the host thread to run DeliverAPCs, unless a request is already
+  // outstanding.
+  void RequestApcDelivery();
   void DeliverAPCs();
+  // Delivers the host APCs taken so far that were queued before the guest
+  // KAPC with the given sequence number. Called without the APC lock held.
+  void DeliverHostAPCs(uint64_t guest_sequence);
   void RundownAPCs();
+  // Turns pending host APCs into guest KAPCs so that they survive a save,
+  // keeping the order they were queued in. The APC lock must be held.
+  void SpillHostAPCs();
+
+  void LogThreadTimes();
 
   xe::threading::WaitHandle* GetWaitHandle() override { return thread_.get(); }
 
@@ -274,10 +333,21 @@ class XThread : public XObject, public cpu::Thread {
   bool running_ = false;
 
   int32_t priority_ = 0;
+  std::atomic<uint64_t> wait_time_ns_ = {0};
 
   xe::global_critical_region global_critical_region_;
   std::atomic<uint32_t> irql_ = {0};
   util::NativeList apc_list_;
+
+  util::HostApcQueue host_apcs_;
+  std::atomic<bool> apc_delivery_requested_ = {false};
+
+  // Host APC delivery statistics, only touched by the owning thread.
+  uint64_t apc_delivered_count_ = 0;
+  uint64_t apc_batch_count_ = 0;
+  uint32_t apc_max_batch_size_ = 0;
+  std::chrono::nanoseconds apc_total_latency_ = {};
+  std::chrono::nanoseconds apc_max_latency_ = {};
 };
 
 class XHostThread : public XThread {
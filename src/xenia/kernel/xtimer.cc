@@ -12,6 +12,7 @@
 #include "xenia/base/chrono.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/xthread.h"
 
 namespace xe {
@@ -20,7 +21,11 @@ namespace kernel {
 XTimer::XTimer(KernelState* kernel_state)
     : XObject(kernel_state, kObjectType) {}
 
-XTimer::~XTimer() = default;
+XTimer::~XTimer() {
+  if (Clock::guest_frame_locked()) {
+    kernel_state()->CancelDeferredTimer(this);
+  }
+}
 
 void XTimer::Initialize(uint32_t timer_type) {
   assert_false(timer_);
@@ -40,30 +45,52 @@ void XTimer::Initialize(uint32_t timer_type) {
 
 X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
                           uint32_t routine, uint32_t routine_arg, bool resume) {
-  using xe::chrono::WinSystemClock;
   using xe::chrono::XSystemClock;
   // Caller is checking for STATUS_TIMER_RESUME_IGNORED.
   if (resume) {
     return X_STATUS_TIMER_RESUME_IGNORED;
   }
 
-  period_ms = Clock::ScaleGuestDurationMillis(period_ms);
-  WinSystemClock::time_point due_tp;
+  bool frame_locked = Clock::guest_frame_locked();
+  if (frame_locked) {
+    kernel_state()->CancelDeferredTimer(this);
+  }
+
   if (due_time < 0) {
     // Any timer implementation uses absolute times eventually, convert as early
     // as possible for increased accuracy
     auto after = xe::chrono::hundrednanoseconds(-due_time);
-    due_tp = date::clock_cast<WinSystemClock>(XSystemClock::now() + after);
+    due_system_time_ = XSystemClock::to_file_time(XSystemClock::now() + after);
   } else {
-    due_tp = date::clock_cast<WinSystemClock>(
-        XSystemClock::from_file_time(due_time));
+    due_system_time_ = uint64_t(due_time);
   }
+  period_ms_ = period_ms;
 
   // Stash routine for callback.
   callback_thread_ = XThread::GetCurrentThread();
   callback_routine_ = routine;
   callback_routine_arg_ = routine_arg;
 
+  if (frame_locked &&
+      due_system_time_ >= Clock::QueryGuestFrameEndSystemTime()) {
+    // Guest time may jump there at a vblank or stall before it, the host clock
+    // can't tell when. Armed by the kernel once the frame starts, until then
+    // only reset to nonsignaled like any other SetTimer.
+    timer_->Disarm();
+    kernel_state()->DeferTimerToGuestFrame(this);
+    return X_STATUS_SUCCESS;
+  }
+
+  return Arm() ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
+}
+
+bool XTimer::Arm() {
+  using xe::chrono::WinSystemClock;
+  using xe::chrono::XSystemClock;
+  uint32_t period_ms = Clock::ScaleGuestDurationMillis(period_ms_);
+  WinSystemClock::time_point due_tp = date::clock_cast<WinSystemClock>(
+      XSystemClock::from_file_time(due_system_time_));
+
   // This callback will only be issued when the timer is fired.
   std::function<void()> callback = nullptr;
   if (callback_routine_) {
@@ -88,11 +115,13 @@ X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
     result = timer_->SetRepeatingAt(
         due_tp, std::chrono::milliseconds(period_ms), std::move(callback));
   }
-
-  return result ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
+  return result;
 }
 
 X_STATUS XTimer::Cancel() {
+  if (Clock::guest_frame_locked()) {
+    kernel_state()->CancelDeferredTimer(this);
+  }
   return timer_->Cancel() ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
 }
 
@@ -32,12 +32,20 @@ class XTimer : public XObject {
                     uint32_t routine_arg, bool resume);
   X_STATUS Cancel();
 
+  // Absolute guest due time of the last SetTimer, in FILETIME format.
+  uint64_t due_system_time() const { return due_system_time_; }
+  // Arms the host timer for the due time and period of the last SetTimer.
+  bool Arm();
+
  protected:
   xe::threading::WaitHandle* GetWaitHandle() override { return timer_.get(); }
 
  private:
   std::unique_ptr<xe::threading::Timer> timer_;
 
+  uint64_t due_system_time_ = 0;
+  uint32_t period_ms_ = 0;
+
   XThread* callback_thread_ = nullptr;
   uint32_t callback_routine_ = 0;
   uint32_t callback_routine_arg_ = 0;
@@ -512,6 +512,31 @@ void Memory::UnregisterPhysicalMemoryInvalidationCallback(
   delete entry;
 }
 
+void* Memory::RegisterPhysicalMemoryHostWriteCallback(
+    PhysicalMemoryHostWriteCallback callback, void* callback_context) {
+  auto entry = new std::pair<PhysicalMemoryHostWriteCallback, void*>(
+      callback, callback_context);
+  auto lock = global_critical_region_.Acquire();
+  physical_memory_host_write_callbacks_.push_back(entry);
+  return entry;
+}
+
+void Memory::UnregisterPhysicalMemoryHostWriteCallback(void* callback_handle) {
+  auto entry =
+      reinterpret_cast<std::pair<PhysicalMemoryHostWriteCallback, void*>*>(
+          callback_handle);
+  {
+    auto lock = global_critical_region_.Acquire();
+    auto it = std::find(physical_memory_host_write_callbacks_.begin(),
+                        physical_memory_host_write_callbacks_.end(), entry);
+    assert_true(it != physical_memory_host_write_callbacks_.end());
+    if (it != physical_memory_host_write_callbacks_.end()) {
+      physical_memory_host_write_callbacks_.erase(it);
+    }
+  }
+  delete entry;
+}
+
 void Memory::EnablePhysicalMemoryAccessCallbacks(
     uint32_t physical_address, uint32_t length,
     bool enable_invalidation_notifications, bool enable_data_providers) {
@@ -1674,16 +1699,10 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
   }
 }
 
-bool PhysicalHeap::TriggerCallbacks(
-    std::unique_lock<std::recursive_mutex> global_lock_locked_once,
-    uint32_t virtual_address, uint32_t length, bool is_write,
-    bool unwatch_exact_range, bool unprotect) {
-  // TODO(Triang3l): Support read watches.
-  assert_true(is_write);
-  if (!is_write) {
-    return false;
-  }
-
+bool PhysicalHeap::GetSystemPageRange(uint32_t virtual_address,
+                                      uint32_t length,
+                                      uint32_t* system_page_first,
+                                      uint32_t* system_page_last) const {
   if (virtual_address < heap_base_) {
     if (heap_base_ - virtual_address >= length) {
       return false;
@@ -1700,18 +1719,20 @@ bool PhysicalHeap::TriggerCallbacks(
     return false;
   }
 
-  uint32_t system_page_first =
+  *system_page_first =
       (heap_relative_address + host_address_offset()) / system_page_size_;
-  uint32_t system_page_last =
+  *system_page_last =
       (heap_relative_address + length - 1 + host_address_offset()) /
       system_page_size_;
-  system_page_last = std::min(system_page_last, system_page_count_ - 1);
-  assert_true(system_page_first <= system_page_last);
+  *system_page_last = std::min(*system_page_last, system_page_count_ - 1);
+  assert_true(*system_page_first <= *system_page_last);
+  return true;
+}
+
+bool PhysicalHeap::IsAnySystemPageWatched(uint32_t system_page_first,
+                                          uint32_t system_page_last) const {
   uint32_t block_index_first = system_page_first >> 6;
   uint32_t block_index_last = system_page_last >> 6;
-
-  // Check if watching any page, whether need to call the callback at all.
-  bool any_watched = false;
   for (uint32_t i = block_index_first; i <= block_index_last; ++i) {
     uint64_t block = system_page_flags_[i].notify_on_invalidation;
     if (i == block_index_first) {
@@ -1721,11 +1742,76 @@ bool PhysicalHeap::TriggerCallbacks(
       block &= (uint64_t(1) << ((system_page_last & 63) + 1)) - 1;
     }
     if (block) {
-      any_watched = true;
-      break;
+      return true;
     }
   }
-  if (!any_watched) {
+  return false;
+}
+
+bool PhysicalHeap::IsRangeWatched(uint32_t virtual_address,
+                                  uint32_t length) const {
+  uint32_t system_page_first, system_page_last;
+  return GetSystemPageRange(virtual_address, length, &system_page_first,
+                            &system_page_last) &&
+         IsAnySystemPageWatched(system_page_first, system_page_last);
+}
+
+void PhysicalHeap::GetPhysicalRange(uint32_t system_page_first,
+                                    uint32_t system_page_last,
+                                    uint32_t* physical_address_start,
+                                    uint32_t* physical_length) const {
+  uint32_t physical_address_offset = GetPhysicalAddress(heap_base_);
+  *physical_address_start =
+      xe::sat_sub(system_page_first * system_page_size_,
+                  host_address_offset()) +
+      physical_address_offset;
+  *physical_length = std::min(
+      xe::sat_sub(system_page_last * system_page_size_ + system_page_size_,
+                  host_address_offset()) +
+          physical_address_offset - *physical_address_start,
+      heap_size_ - (*physical_address_start - physical_address_offset));
+}
+
+bool PhysicalHeap::IsRangeWrittenByHost(uint32_t virtual_address,
+                                        uint32_t length) const {
+  uint32_t system_page_first, system_page_last;
+  if (!GetSystemPageRange(virtual_address, length, &system_page_first,
+                          &system_page_last)) {
+    return false;
+  }
+  uint32_t physical_address_start, physical_length;
+  GetPhysicalRange(system_page_first, system_page_last,
+                   &physical_address_start, &physical_length);
+  for (auto host_write_callback :
+       memory_->physical_memory_host_write_callbacks_) {
+    if (host_write_callback->first(host_write_callback->second,
+                                   physical_address_start, physical_length)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PhysicalHeap::TriggerCallbacks(
+    std::unique_lock<std::recursive_mutex> global_lock_locked_once,
+    uint32_t virtual_address, uint32_t length, bool is_write,
+    bool unwatch_exact_range, bool unprotect) {
+  // TODO(Triang3l): Support read watches.
+  assert_true(is_write);
+  if (!is_write) {
+    return false;
+  }
+
+  uint32_t system_page_first, system_page_last;
+  if (!GetSystemPageRange(virtual_address, length, &system_page_first,
+                          &system_page_last)) {
+    return false;
+  }
+  uint32_t block_index_first = system_page_first >> 6;
+  uint32_t block_index_last = system_page_last >> 6;
+
+  // Check if watching any page, whether need to call the callback at all.
+  if (!IsAnySystemPageWatched(system_page_first, system_page_last)) {
     return false;
   }
 
@@ -1736,15 +1822,9 @@ bool PhysicalHeap::TriggerCallbacks(
     unwatch_exact_range = true;
   }
   uint32_t physical_address_offset = GetPhysicalAddress(heap_base_);
-  uint32_t physical_address_start =
-      xe::sat_sub(system_page_first * system_page_size_,
-                  host_address_offset()) +
-      physical_address_offset;
-  uint32_t physical_length = std::min(
-      xe::sat_sub(system_page_last * system_page_size_ + system_page_size_,
-                  host_address_offset()) +
-          physical_address_offset - physical_address_start,
-      heap_size_ - (physical_address_start - physical_address_offset));
+  uint32_t physical_address_start, physical_length;
+  GetPhysicalRange(system_page_first, system_page_last,
+                   &physical_address_start, &physical_length);
   uint32_t unwatch_first = 0;
   uint32_t unwatch_last = UINT32_MAX;
   for (auto invalidation_callback :
@@ -255,6 +255,13 @@ class PhysicalHeap : public BaseHeap {
   void EnableAccessCallbacks(uint32_t physical_address, uint32_t length,
                              bool enable_invalidation_notifications,
                              bool enable_data_providers);
+  // Whether writing to any page in the range would trigger invalidation
+  // callbacks. Requires the global critical region to be held.
+  bool IsRangeWatched(uint32_t virtual_address, uint32_t length) const;
+  // Whether any page in the range holds data written on the host side, such
+  // as by GPU resolves, that guest memory does not contain. Requires the
+  // global critical region to be held.
+  bool IsRangeWrittenByHost(uint32_t virtual_address, uint32_t length) const;
   // Returns true if any page in the range was watched.
   bool TriggerCallbacks(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
@@ -264,6 +271,17 @@ class PhysicalHeap : public BaseHeap {
   uint32_t GetPhysicalAddress(uint32_t address) const;
 
  protected:
+  // Clamps the range to the heap, returning false if nothing is left.
+  bool GetSystemPageRange(uint32_t virtual_address, uint32_t length,
+                          uint32_t* system_page_first,
+                          uint32_t* system_page_last) const;
+  bool IsAnySystemPageWatched(uint32_t system_page_first,
+                              uint32_t system_page_last) const;
+  // The physical memory covered by a range of system pages of the heap.
+  void GetPhysicalRange(uint32_t system_page_first, uint32_t system_page_last,
+                        uint32_t* physical_address_start,
+                        uint32_t* physical_length) const;
+
   VirtualHeap* parent_heap_;
 
   uint32_t system_page_size_;
@@ -432,6 +450,15 @@ class Memory {
   // RegisterPhysicalMemoryInvalidationCallback.
   void UnregisterPhysicalMemoryInvalidationCallback(void* callback_handle);
 
+  // Returns whether any page of the physical memory region holds data written
+  // on the host side, such as by GPU resolves, that is newer than what guest
+  // memory contains. Called with the global critical region locked.
+  typedef bool (*PhysicalMemoryHostWriteCallback)(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length);
+  void* RegisterPhysicalMemoryHostWriteCallback(
+      PhysicalMemoryHostWriteCallback callback, void* callback_context);
+  void UnregisterPhysicalMemoryHostWriteCallback(void* callback_handle);
+
   // Enables physical memory access callbacks for the specified memory range,
   // snapped to system page boundaries.
   void EnablePhysicalMemoryAccessCallbacks(
@@ -536,6 +563,8 @@ class Memory {
   xe::global_critical_region global_critical_region_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+  std::vector<std::pair<PhysicalMemoryHostWriteCallback, void*>*>
+      physical_memory_host_write_callbacks_;
 };
 
 }  // namespace xe
@@ -0,0 +1,333 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/compressed_image.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+
+#include "third_party/snappy/snappy.h"
+
+namespace xe {
+namespace vfs {
+
+namespace {
+
+// Counts down the threads still decompressing chunks for a single read.
+class ChunkLatch {
+ public:
+  explicit ChunkLatch(size_t count) : count_(count) {}
+
+  void CountDown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --count_;
+    }
+    cond_.notify_all();
+  }
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !count_; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  size_t count_;
+};
+
+}  // namespace
+
+bool CompressedImage::IsCompressedImage(const uint8_t* data, size_t size) {
+  return size >= sizeof(Header) &&
+         !std::memcmp(data, kMagic, sizeof(kMagic));
+}
+
+std::unique_ptr<CompressedImage> CompressedImage::Open(
+    const std::filesystem::path& path, size_t cache_size,
+    size_t thread_count) {
+  auto mmap = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mmap || !IsCompressedImage(mmap->data(), mmap->size())) {
+    return nullptr;
+  }
+
+  Header header;
+  std::memcpy(&header, mmap->data(), sizeof(header));
+  if (header.version != kVersion || !header.chunk_size) {
+    XELOGE("Unsupported compressed image version {} (chunk size {})",
+           header.version, header.chunk_size);
+    return nullptr;
+  }
+  uint64_t chunk_count = header.uncompressed_size / header.chunk_size +
+                         (header.uncompressed_size % header.chunk_size != 0);
+  // The index has to fit in the file, which also keeps its size from
+  // overflowing.
+  if (chunk_count >= (mmap->size() - sizeof(Header)) / sizeof(uint64_t)) {
+    XELOGE("Compressed image index is out of bounds");
+    return nullptr;
+  }
+  size_t index_size = size_t(chunk_count + 1) * sizeof(uint64_t);
+  if (header.index_offset < sizeof(Header) ||
+      header.index_offset > mmap->size() ||
+      mmap->size() - header.index_offset < index_size) {
+    XELOGE("Compressed image index is out of bounds");
+    return nullptr;
+  }
+
+  // Chunks must follow each other without overlapping the header or index.
+  std::vector<uint64_t> chunk_offsets(chunk_count + 1);
+  std::memcpy(chunk_offsets.data(), mmap->data() + header.index_offset,
+              index_size);
+  if (chunk_offsets.front() < sizeof(Header) ||
+      chunk_offsets.back() > header.index_offset) {
+    XELOGE("Compressed image chunks are out of bounds");
+    return nullptr;
+  }
+  for (size_t i = 0; i < chunk_count; ++i) {
+    if (chunk_offsets[i] > chunk_offsets[i + 1]) {
+      XELOGE("Compressed image chunk {} is damaged", i);
+      return nullptr;
+    }
+  }
+
+  return std::unique_ptr<CompressedImage>(new CompressedImage(
+      std::move(mmap), header.chunk_size, size_t(header.uncompressed_size),
+      std::move(chunk_offsets), cache_size, thread_count));
+}
+
+bool CompressedImage::Compress(const std::filesystem::path& source_path,
+                               const std::filesystem::path& target_path,
+                               uint32_t chunk_size, size_t thread_count) {
+  if (!chunk_size) {
+    return false;
+  }
+  auto source = MappedMemory::Open(source_path, MappedMemory::Mode::kRead);
+  if (!source) {
+    XELOGE("Failed to map {}", xe::path_to_utf8(source_path));
+    return false;
+  }
+  auto file = xe::filesystem::OpenFile(target_path, "wb");
+  if (!file) {
+    XELOGE("Failed to create {}", xe::path_to_utf8(target_path));
+    return false;
+  }
+
+  size_t size = source->size();
+  size_t chunk_count = (size + chunk_size - 1) / chunk_size;
+  thread_count = std::max(thread_count, size_t(1));
+  IOWorkerPool pool("Image compressor", thread_count, thread_count * 4);
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.chunk_size = chunk_size;
+  header.uncompressed_size = size;
+  bool succeeded = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  // Compress a batch of chunks at a time on all threads, then write them out
+  // in order.
+  std::vector<uint64_t> chunk_offsets;
+  chunk_offsets.reserve(chunk_count + 1);
+  uint64_t offset = sizeof(header);
+  std::vector<std::vector<char>> batch(pool.queue_depth());
+  for (size_t first = 0; succeeded && first < chunk_count;
+       first += batch.size()) {
+    size_t batch_count = std::min(batch.size(), chunk_count - first);
+    for (size_t i = 0; i < batch_count; ++i) {
+      auto compress = [&, i]() {
+        size_t chunk_offset = (first + i) * chunk_size;
+        size_t length = std::min(size_t(chunk_size), size - chunk_offset);
+        auto input =
+            reinterpret_cast<const char*>(source->data() + chunk_offset);
+        auto& output = batch[i];
+        output.resize(snappy::MaxCompressedLength(length));
+        size_t compressed_length = 0;
+        snappy::RawCompress(input, length, output.data(), &compressed_length);
+        if (compressed_length < length) {
+          output.resize(compressed_length);
+        } else {
+          output.assign(input, input + length);
+        }
+      };
+      if (!pool.Submit(compress)) {
+        compress();
+      }
+    }
+    pool.WaitIdle();
+    for (size_t i = 0; i < batch_count; ++i) {
+      chunk_offsets.push_back(offset);
+      if (fwrite(batch[i].data(), 1, batch[i].size(), file) !=
+          batch[i].size()) {
+        succeeded = false;
+        break;
+      }
+      offset += batch[i].size();
+    }
+  }
+  chunk_offsets.push_back(offset);
+
+  if (succeeded) {
+    header.index_offset = offset;
+    succeeded = fwrite(chunk_offsets.data(), sizeof(uint64_t),
+                       chunk_offsets.size(),
+                       file) == chunk_offsets.size() &&
+                !fseek(file, 0, SEEK_SET) &&
+                fwrite(&header, sizeof(header), 1, file) == 1;
+  }
+  succeeded = !fclose(file) && succeeded;
+  if (!succeeded) {
+    XELOGE("Failed to write {}", xe::path_to_utf8(target_path));
+  }
+  return succeeded;
+}
+
+CompressedImage::CompressedImage(std::unique_ptr<MappedMemory> mmap,
+                                 uint32_t chunk_size, size_t size,
+                                 std::vector<uint64_t> chunk_offsets,
+                                 size_t cache_size, size_t thread_count)
+    : mmap_(std::move(mmap)),
+      chunk_size_(chunk_size),
+      size_(size),
+      chunk_offsets_(std::move(chunk_offsets)),
+      cache_capacity_(std::max(cache_size / chunk_size, size_t(1))) {
+  if (thread_count > 1) {
+    decompress_pool_ = std::make_unique<IOWorkerPool>(
+        "Image decompressor", thread_count, thread_count * 4);
+  }
+}
+
+CompressedImage::~CompressedImage() = default;
+
+bool CompressedImage::Read(size_t offset, size_t length, void* buffer) {
+  if (offset > size_ || length > size_ - offset) {
+    return false;
+  }
+  if (!length) {
+    return true;
+  }
+  size_t first_chunk = offset / chunk_size_;
+  size_t last_chunk = (offset + length - 1) / chunk_size_;
+  std::vector<ChunkData> chunks(last_chunk - first_chunk + 1);
+  std::vector<size_t> missing;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      auto it = cache_.find(first_chunk + i);
+      if (it == cache_.end()) {
+        missing.push_back(i);
+        continue;
+      }
+      lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+      chunks[i] = it->second.data;
+    }
+  }
+  cache_hits_ += chunks.size() - missing.size();
+  cache_misses_ += missing.size();
+
+  // Large reads are decompressed by as many threads as there are chunks
+  // missing, each taking the next chunk left, the reading thread included.
+  if (!missing.empty()) {
+    std::atomic<size_t> next_missing = 0;
+    auto decompress_missing = [&]() {
+      for (size_t i; (i = next_missing++) < missing.size();) {
+        chunks[missing[i]] = Decompress(first_chunk + missing[i]);
+      }
+    };
+    size_t helper_count = 0;
+    if (decompress_pool_) {
+      helper_count = std::min(missing.size() - 1,
+                              decompress_pool_->thread_count());
+    }
+    ChunkLatch latch(helper_count);
+    for (size_t i = 0; i < helper_count; ++i) {
+      if (!decompress_pool_->Submit([&]() {
+            decompress_missing();
+            latch.CountDown();
+          })) {
+        latch.CountDown();
+      }
+    }
+    decompress_missing();
+    latch.Wait();
+    for (size_t index : missing) {
+      if (!chunks[index]) {
+        XELOGE("Compressed image chunk {} is damaged", first_chunk + index);
+        return false;
+      }
+      InsertChunk(first_chunk + index, chunks[index]);
+    }
+  }
+
+  auto dest = static_cast<uint8_t*>(buffer);
+  size_t chunk_offset = offset - first_chunk * chunk_size_;
+  for (auto& chunk : chunks) {
+    size_t copy_length = std::min(length, chunk->size() - chunk_offset);
+    std::memcpy(dest, chunk->data() + chunk_offset, copy_length);
+    dest += copy_length;
+    length -= copy_length;
+    chunk_offset = 0;
+  }
+  return true;
+}
+
+CompressedImage::Statistics CompressedImage::statistics() const {
+  Statistics statistics;
+  statistics.cache_hits = cache_hits_;
+  statistics.cache_misses = cache_misses_;
+  statistics.bytes_decompressed = bytes_decompressed_;
+  return statistics;
+}
+
+CompressedImage::ChunkData CompressedImage::Decompress(size_t chunk_index) {
+  size_t length =
+      std::min(size_t(chunk_size_), size_ - chunk_index * chunk_size_);
+  auto input =
+      reinterpret_cast<const char*>(mmap_->data() + chunk_offsets_[chunk_index]);
+  size_t input_length =
+      size_t(chunk_offsets_[chunk_index + 1] - chunk_offsets_[chunk_index]);
+  auto data = std::make_shared<std::vector<uint8_t>>(length);
+  if (input_length == length) {
+    // Stored as is.
+    std::memcpy(data->data(), input, length);
+  } else {
+    size_t decompressed_length = 0;
+    if (!snappy::GetUncompressedLength(input, input_length,
+                                       &decompressed_length) ||
+        decompressed_length != length ||
+        !snappy::RawUncompress(input, input_length,
+                               reinterpret_cast<char*>(data->data()))) {
+      return nullptr;
+    }
+    bytes_decompressed_ += length;
+  }
+  return data;
+}
+
+void CompressedImage::InsertChunk(size_t chunk_index, ChunkData data) {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  auto it = cache_.find(chunk_index);
+  if (it != cache_.end()) {
+    // Another read decompressed it at the same time.
+    lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+    return;
+  }
+  while (cache_.size() >= cache_capacity_) {
+    cache_.erase(lru_.back());
+    lru_.pop_back();
+  }
+  lru_.push_front(chunk_index);
+  cache_.emplace(chunk_index, CachedChunk{std::move(data), lru_.begin()});
+}
+
+}  // namespace vfs
+}  // namespace xe
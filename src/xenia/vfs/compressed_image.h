@@ -0,0 +1,121 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_COMPRESSED_IMAGE_H_
+#define XENIA_VFS_COMPRESSED_IMAGE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/io_worker_pool.h"
+
+namespace xe {
+namespace vfs {
+
+// A disc image split into fixed size chunks that are compressed independently
+// with snappy, followed by an index of where each chunk starts, so that any
+// range can be read without decompressing the rest of the image.
+//
+// Layout, little endian:
+//   Header
+//   Compressed chunks, back to back. A chunk is stored as is when snappy
+//   cannot make it smaller.
+//   uint64_t chunk_offsets[chunk_count + 1], from the start of the file, the
+//   last one being the end of the final chunk.
+class CompressedImage {
+ public:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t chunk_size;
+    uint32_t reserved;
+    uint64_t uncompressed_size;
+    uint64_t index_offset;
+  };
+  static_assert(sizeof(Header) == 32);
+
+  static constexpr char kMagic[4] = {'X', 'C', 'Z', '1'};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kDefaultChunkSize = 64 * 1024;
+
+  struct Statistics {
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t bytes_decompressed;
+  };
+
+  // Whether data starts with a compressed image header.
+  static bool IsCompressedImage(const uint8_t* data, size_t size);
+
+  // Opens an image, keeping up to cache_size bytes of decompressed chunks and
+  // decompressing on up to thread_count threads at once.
+  static std::unique_ptr<CompressedImage> Open(
+      const std::filesystem::path& path, size_t cache_size,
+      size_t thread_count);
+
+  // Compresses the raw image at source_path into a new image at target_path.
+  static bool Compress(const std::filesystem::path& source_path,
+                       const std::filesystem::path& target_path,
+                       uint32_t chunk_size, size_t thread_count);
+
+  ~CompressedImage();
+
+  size_t size() const { return size_; }
+  uint32_t chunk_size() const { return chunk_size_; }
+  size_t chunk_count() const { return chunk_offsets_.size() - 1; }
+
+  // Reads length bytes at offset. Fails if the range is out of bounds or
+  // covers a damaged chunk.
+  bool Read(size_t offset, size_t length, void* buffer);
+
+  Statistics statistics() const;
+
+ private:
+  typedef std::shared_ptr<const std::vector<uint8_t>> ChunkData;
+
+  CompressedImage(std::unique_ptr<MappedMemory> mmap, uint32_t chunk_size,
+                  size_t size, std::vector<uint64_t> chunk_offsets,
+                  size_t cache_size, size_t thread_count);
+
+  ChunkData Decompress(size_t chunk_index);
+  void InsertChunk(size_t chunk_index, ChunkData data);
+
+  std::unique_ptr<MappedMemory> mmap_;
+  uint32_t chunk_size_;
+  size_t size_;
+  std::vector<uint64_t> chunk_offsets_;
+
+  // Decompressed chunks, most recently used at the front of lru_.
+  struct CachedChunk {
+    ChunkData data;
+    std::list<size_t>::iterator lru_it;
+  };
+  std::mutex cache_mutex_;
+  std::unordered_map<size_t, CachedChunk> cache_;
+  std::list<size_t> lru_;
+  size_t cache_capacity_;
+
+  std::unique_ptr<IOWorkerPool> decompress_pool_;
+
+  std::atomic<uint64_t> cache_hits_ = 0;
+  std::atomic<uint64_t> cache_misses_ = 0;
+  std::atomic<uint64_t> bytes_decompressed_ = 0;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_COMPRESSED_IMAGE_H_
@@ -9,6 +9,8 @@
 
 #include "xenia/vfs/device.h"
 
+#include <mutex>
+
 #include "xenia/base/logging.h"
 
 namespace xe {
@@ -17,5 +19,42 @@ namespace vfs {
 Device::Device(const std::string_view mount_path) : mount_path_(mount_path) {}
 Device::~Device() = default;
 
+Entry* Device::ResolvePathCached(const std::string_view path) {
+  // Entry paths are stored without the leading separator.
+  auto key = path;
+  while (!key.empty() && (key.front() == '\\' || key.front() == '/')) {
+    key.remove_prefix(1);
+  }
+
+  uint64_t generation;
+  {
+    std::shared_lock<std::shared_mutex> lock(path_cache_mutex_);
+    auto it = path_cache_.find(key);
+    if (it != path_cache_.cend()) {
+      return it->second;
+    }
+    generation = path_cache_generation_;
+  }
+
+  auto entry = ResolvePath(path);
+  if (!entry || !xe::utf8::equal_case(entry->path(), key)) {
+    // Only positive lookups of paths in their stored form are cached.
+    return entry;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(path_cache_mutex_);
+  // Skip if an entry was deleted while resolving, as it may have been this one.
+  if (generation == path_cache_generation_) {
+    path_cache_.emplace(entry->path(), entry);
+  }
+  return entry;
+}
+
+void Device::InvalidatePathCache() {
+  std::unique_lock<std::shared_mutex> lock(path_cache_mutex_);
+  path_cache_.clear();
+  ++path_cache_generation_;
+}
+
 }  // namespace vfs
 }  // namespace xe
@@ -11,9 +11,10 @@
 #define XENIA_VFS_DEVICE_H_
 
 #include <memory>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
 
-#include "xenia/base/mutex.h"
 #include "xenia/base/string_buffer.h"
 #include "xenia/vfs/entry.h"
 
@@ -33,6 +34,17 @@ class Device {
   virtual void Dump(StringBuffer* string_buffer) = 0;
   virtual Entry* ResolvePath(const std::string_view path) = 0;
 
+  // Resolves path as ResolvePath does, remembering the entry found so that
+  // repeated lookups of the same path skip the directory walk.
+  Entry* ResolvePathCached(const std::string_view path);
+  // Forgets all cached lookups. Must be called with the tree lock held
+  // exclusively whenever an entry is removed.
+  void InvalidatePathCache();
+
+  // Guards the entry tree: lookups and enumeration share it, creating and
+  // deleting entries take it exclusively.
+  std::shared_mutex& tree_mutex() { return tree_mutex_; }
+
   virtual const std::string& name() const = 0;
   virtual uint32_t attributes() const = 0;
   virtual uint32_t component_name_max_length() const = 0;
@@ -43,8 +55,15 @@ class Device {
   virtual uint32_t bytes_per_sector() const = 0;
 
  protected:
-  xe::global_critical_region global_critical_region_;
+  std::shared_mutex tree_mutex_;
   std::string mount_path_;
+
+ private:
+  // Keyed by the path of the cached entry itself, which outlives the mapping.
+  std::shared_mutex path_cache_mutex_;
+  std::unordered_map<std::string_view, Entry*, EntryNameHash, EntryNameEqual>
+      path_cache_;
+  uint64_t path_cache_generation_ = 0;
 };
 
 }  // namespace vfs
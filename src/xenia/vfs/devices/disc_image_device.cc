@@ -21,6 +21,11 @@ using namespace xe::literals;
 
 const size_t kXESectorSize = 2_KiB;
 
+// Decompressed chunks kept around, and threads decompressing the chunks of a
+// single large read, for compressed images.
+const size_t kCompressedCacheSize = 32_MiB;
+const size_t kDecompressThreadCount = 4;
+
 DiscImageDevice::DiscImageDevice(const std::string_view mount_path,
                                  const std::filesystem::path& host_path)
     : Device(mount_path), name_("GDFX"), host_path_(host_path) {}
@@ -34,16 +39,28 @@ bool DiscImageDevice::Initialize() {
     return false;
   }
 
+  if (CompressedImage::IsCompressedImage(mmap_->data(), mmap_->size())) {
+    mmap_.reset();
+    compressed_image_ = CompressedImage::Open(
+        host_path_, kCompressedCacheSize, kDecompressThreadCount);
+    if (!compressed_image_) {
+      XELOGE("Compressed disc image could not be opened");
+      return false;
+    }
+    image_size_ = compressed_image_->size();
+  } else {
+    image_size_ = mmap_->size();
+  }
+
   ParseState state = {0};
-  state.ptr = mmap_->data();
-  state.size = mmap_->size();
+  state.size = image_size_;
   auto result = Verify(&state);
   if (result != Error::kSuccess) {
     XELOGE("Failed to verify disc image header: {}", result);
     return false;
   }
 
-  result = ReadAllEntries(&state, state.ptr + state.root_offset);
+  result = ReadAllEntries(&state);
   if (result != Error::kSuccess) {
     XELOGE("Failed to read all GDFX entries: {}", result);
     return false;
@@ -53,7 +70,7 @@ bool DiscImageDevice::Initialize() {
 }
 
 void DiscImageDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::shared_lock<std::shared_mutex> lock(tree_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
@@ -84,12 +101,13 @@ DiscImageDevice::Error DiscImageDevice::Verify(ParseState* state) {
   }
 
   // Read sector 32 to get FS state.
-  if (state->size < state->game_offset + (32 * kXESectorSize)) {
+  uint8_t fs_header[28];
+  if (!ReadImage(state->game_offset + (32 * kXESectorSize), sizeof(fs_header),
+                 fs_header)) {
     return Error::kErrorReadError;
   }
-  uint8_t* fs_ptr = state->ptr + state->game_offset + (32 * kXESectorSize);
-  state->root_sector = xe::load<uint32_t>(fs_ptr + 20);
-  state->root_size = xe::load<uint32_t>(fs_ptr + 24);
+  state->root_sector = xe::load<uint32_t>(fs_header + 20);
+  state->root_size = xe::load<uint32_t>(fs_header + 24);
   state->root_offset =
       state->game_offset + (state->root_sector * kXESectorSize);
   if (state->root_size < 13 || state->root_size > 32_MiB) {
@@ -100,20 +118,33 @@ DiscImageDevice::Error DiscImageDevice::Verify(ParseState* state) {
 }
 
 bool DiscImageDevice::VerifyMagic(ParseState* state, size_t offset) {
-  if (offset >= state->size) {
+  // Simple check to see if the given offset contains the magic value.
+  char magic[20];
+  return ReadImage(offset, sizeof(magic), magic) &&
+         std::memcmp(magic, "MICROSOFT*XBOX*MEDIA", sizeof(magic)) == 0;
+}
+
+bool DiscImageDevice::ReadImage(size_t offset, size_t length, void* buffer) {
+  if (compressed_image_) {
+    return compressed_image_->Read(offset, length, buffer);
+  }
+  if (offset > image_size_ || length > image_size_ - offset) {
     return false;
   }
-
-  // Simple check to see if the given offset contains the magic value.
-  return std::memcmp(state->ptr + offset, "MICROSOFT*XBOX*MEDIA", 20) == 0;
+  std::memcpy(buffer, mmap_->data() + offset, length);
+  return true;
 }
 
-DiscImageDevice::Error DiscImageDevice::ReadAllEntries(
-    ParseState* state, const uint8_t* root_buffer) {
-  auto root_entry = new DiscImageEntry(this, nullptr, "", mmap_.get());
+DiscImageDevice::Error DiscImageDevice::ReadAllEntries(ParseState* state) {
+  auto root_entry = new DiscImageEntry(this, nullptr, "", mmap_.get(),
+                                       compressed_image_.get());
   root_entry->attributes_ = kFileAttributeDirectory;
   root_entry_ = std::unique_ptr<Entry>(root_entry);
 
+  std::vector<uint8_t> root_buffer(state->root_size);
+  if (!ReadImage(state->root_offset, root_buffer.size(), root_buffer.data())) {
+    return Error::kErrorReadError;
+  }
   if (!ReadEntry(state, root_buffer, 0, root_entry)) {
     return Error::kErrorOutOfMemory;
   }
@@ -121,10 +152,15 @@ DiscImageDevice::Error DiscImageDevice::ReadAllEntries(
   return Error::kSuccess;
 }
 
-bool DiscImageDevice::ReadEntry(ParseState* state, const uint8_t* buffer,
+bool DiscImageDevice::ReadEntry(ParseState* state,
+                                const std::vector<uint8_t>& buffer,
                                 uint16_t entry_ordinal,
                                 DiscImageEntry* parent) {
-  const uint8_t* p = buffer + (entry_ordinal * 4);
+  size_t entry_offset = size_t(entry_ordinal) * 4;
+  if (entry_offset + 14 > buffer.size()) {
+    return false;
+  }
+  const uint8_t* p = buffer.data() + entry_offset;
 
   uint16_t node_l = xe::load<uint16_t>(p + 0);
   uint16_t node_r = xe::load<uint16_t>(p + 2);
@@ -134,13 +170,18 @@ bool DiscImageDevice::ReadEntry(ParseState* state, const uint8_t* buffer,
   uint8_t name_length = xe::load<uint8_t>(p + 13);
   auto name_buffer = reinterpret_cast<const char*>(p + 14);
 
+  if (entry_offset + 14 + name_length > buffer.size()) {
+    return false;
+  }
+
   if (node_l && !ReadEntry(state, buffer, node_l, parent)) {
     return false;
   }
 
   auto name = std::string(name_buffer, name_length);
 
-  auto entry = DiscImageEntry::Create(this, parent, name, mmap_.get());
+  auto entry = DiscImageEntry::Create(this, parent, name, mmap_.get(),
+                                      compressed_image_.get());
   entry->attributes_ = attributes | kFileAttributeReadOnly;
   entry->size_ = length;
   entry->allocation_size_ = xe::round_up(length, bytes_per_sector());
@@ -156,14 +197,17 @@ bool DiscImageDevice::ReadEntry(ParseState* state, const uint8_t* buffer,
     entry->data_size_ = 0;
     if (length) {
       // Not a leaf - read in children.
-      if (state->size < state->game_offset + (sector * kXESectorSize)) {
-        // Out of bounds read.
+      if (length > 32_MiB) {
         return false;
       }
       // Read child list.
-      uint8_t* folder_ptr =
-          state->ptr + state->game_offset + (sector * kXESectorSize);
-      if (!ReadEntry(state, folder_ptr, 0, entry.get())) {
+      std::vector<uint8_t> folder_buffer(length);
+      if (!ReadImage(state->game_offset + (sector * kXESectorSize), length,
+                     folder_buffer.data())) {
+        // Out of bounds read.
+        return false;
+      }
+      if (!ReadEntry(state, folder_buffer, 0, entry.get())) {
         return false;
       }
     }
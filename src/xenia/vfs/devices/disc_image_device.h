@@ -12,8 +12,10 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/compressed_image.h"
 #include "xenia/vfs/device.h"
 
 namespace xe {
@@ -21,6 +23,7 @@ namespace vfs {
 
 class DiscImageEntry;
 
+// GDFX disc images, either raw or stored as a CompressedImage.
 class DiscImageDevice : public Device {
  public:
   DiscImageDevice(const std::string_view mount_path,
@@ -36,7 +39,7 @@ class DiscImageDevice : public Device {
   uint32_t component_name_max_length() const override { return 255; }
 
   uint32_t total_allocation_units() const override {
-    return uint32_t(mmap_->size() / sectors_per_allocation_unit() /
+    return uint32_t(image_size_ / sectors_per_allocation_unit() /
                     bytes_per_sector());
   }
   uint32_t available_allocation_units() const override { return 0; }
@@ -55,10 +58,12 @@ class DiscImageDevice : public Device {
   std::string name_;
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
+  // Only one of these is set, depending on whether the image is compressed.
   std::unique_ptr<MappedMemory> mmap_;
+  std::unique_ptr<CompressedImage> compressed_image_;
+  size_t image_size_ = 0;
 
   typedef struct {
-    uint8_t* ptr;
     size_t size;         // Size (bytes) of total image.
     size_t game_offset;  // Offset (bytes) of game partition.
     size_t root_sector;  // Offset (sector) of root.
@@ -68,8 +73,9 @@ class DiscImageDevice : public Device {
 
   Error Verify(ParseState* state);
   bool VerifyMagic(ParseState* state, size_t offset);
-  Error ReadAllEntries(ParseState* state, const uint8_t* root_buffer);
-  bool ReadEntry(ParseState* state, const uint8_t* buffer,
+  bool ReadImage(size_t offset, size_t length, void* buffer);
+  Error ReadAllEntries(ParseState* state);
+  bool ReadEntry(ParseState* state, const std::vector<uint8_t>& buffer,
                  uint16_t entry_ordinal, DiscImageEntry* parent);
 };
 
@@ -18,9 +18,11 @@ namespace xe {
 namespace vfs {
 
 DiscImageEntry::DiscImageEntry(Device* device, Entry* parent,
-                               const std::string_view path, MappedMemory* mmap)
+                               const std::string_view path, MappedMemory* mmap,
+                               CompressedImage* compressed_image)
     : Entry(device, parent, path),
       mmap_(mmap),
+      compressed_image_(compressed_image),
       data_offset_(0),
       data_size_(0) {}
 
@@ -28,9 +30,10 @@ DiscImageEntry::~DiscImageEntry() = default;
 
 std::unique_ptr<DiscImageEntry> DiscImageEntry::Create(
     Device* device, Entry* parent, const std::string_view name,
-    MappedMemory* mmap) {
+    MappedMemory* mmap, CompressedImage* compressed_image) {
   auto path = xe::utf8::join_guest_paths(parent->path(), name);
-  auto entry = std::make_unique<DiscImageEntry>(device, parent, path, mmap);
+  auto entry = std::make_unique<DiscImageEntry>(device, parent, path, mmap,
+                                                compressed_image);
   return std::move(entry);
 }
 
@@ -41,8 +44,8 @@ X_STATUS DiscImageEntry::Open(uint32_t desired_access, File** out_file) {
 
 std::unique_ptr<MappedMemory> DiscImageEntry::OpenMapped(
     MappedMemory::Mode mode, size_t offset, size_t length) {
-  if (mode != MappedMemory::Mode::kRead) {
-    // Only allow reads.
+  if (mode != MappedMemory::Mode::kRead || !mmap_) {
+    // Only allow reads, of uncompressed images.
     return nullptr;
   }
 
@@ -14,6 +14,7 @@
 #include <vector>
 
 #include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/compressed_image.h"
 #include "xenia/vfs/entry.h"
 
 namespace xe {
@@ -24,20 +25,22 @@ class DiscImageDevice;
 class DiscImageEntry : public Entry {
  public:
   DiscImageEntry(Device* device, Entry* parent, const std::string_view path,
-                 MappedMemory* mmap);
+                 MappedMemory* mmap, CompressedImage* compressed_image);
   ~DiscImageEntry() override;
 
-  static std::unique_ptr<DiscImageEntry> Create(Device* device, Entry* parent,
-                                                const std::string_view name,
-                                                MappedMemory* mmap);
+  static std::unique_ptr<DiscImageEntry> Create(
+      Device* device, Entry* parent, const std::string_view name,
+      MappedMemory* mmap, CompressedImage* compressed_image);
 
+  // Null for compressed images, which are read through compressed_image.
   MappedMemory* mmap() const { return mmap_; }
+  CompressedImage* compressed_image() const { return compressed_image_; }
   size_t data_offset() const { return data_offset_; }
   size_t data_size() const { return data_size_; }
 
   X_STATUS Open(uint32_t desired_access, File** out_file) override;
 
-  bool can_map() const override { return true; }
+  bool can_map() const override { return mmap_ != nullptr; }
   std::unique_ptr<MappedMemory> OpenMapped(MappedMemory::Mode mode,
                                            size_t offset,
                                            size_t length) override;
@@ -46,6 +49,7 @@ class DiscImageEntry : public Entry {
   friend class DiscImageDevice;
 
   MappedMemory* mmap_;
+  CompressedImage* compressed_image_;
   size_t data_offset_;
   size_t data_size_;
 };
@@ -31,7 +31,13 @@ X_STATUS DiscImageFile::ReadSync(void* buffer, size_t buffer_length,
   size_t real_offset = entry_->data_offset() + byte_offset;
   size_t real_length =
       std::min(buffer_length, entry_->data_size() - byte_offset);
-  std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
+  if (entry_->compressed_image()) {
+    if (!entry_->compressed_image()->Read(real_offset, real_length, buffer)) {
+      return X_STATUS_UNSUCCESSFUL;
+    }
+  } else {
+    std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
+  }
   *out_bytes_read = real_length;
   return X_STATUS_SUCCESS;
 }
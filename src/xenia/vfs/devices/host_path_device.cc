@@ -41,14 +41,16 @@ bool HostPathDevice::Initialize() {
 
   auto root_entry = new HostPathEntry(this, nullptr, "", host_path_);
   root_entry->attributes_ = kFileAttributeDirectory;
+  // Directories are listed as they are first looked into rather than walking
+  // the whole host tree here.
+  root_entry->children_populated_ = false;
   root_entry_ = std::unique_ptr<Entry>(root_entry);
-  PopulateEntry(root_entry);
 
   return true;
 }
 
 void HostPathDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::shared_lock<std::shared_mutex> lock(tree_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
@@ -60,19 +62,5 @@ Entry* HostPathDevice::ResolvePath(const std::string_view path) {
   return root_entry_->ResolvePath(path);
 }
 
-void HostPathDevice::PopulateEntry(HostPathEntry* parent_entry) {
-  auto child_infos = xe::filesystem::ListFiles(parent_entry->host_path());
-  for (auto& child_info : child_infos) {
-    auto child = HostPathEntry::Create(
-        this, parent_entry, parent_entry->host_path() / child_info.name,
-        child_info);
-    parent_entry->children_.push_back(std::unique_ptr<Entry>(child));
-
-    if (child_info.type == xe::filesystem::FileInfo::Type::kDirectory) {
-      PopulateEntry(child);
-    }
-  }
-}
-
 }  // namespace vfs
 }  // namespace xe
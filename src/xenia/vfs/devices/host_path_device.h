@@ -10,6 +10,7 @@
 #ifndef XENIA_VFS_DEVICES_HOST_PATH_DEVICE_H_
 #define XENIA_VFS_DEVICES_HOST_PATH_DEVICE_H_
 
+#include <atomic>
 #include <string>
 
 #include "xenia/vfs/device.h"
@@ -17,8 +18,6 @@
 namespace xe {
 namespace vfs {
 
-class HostPathEntry;
-
 class HostPathDevice : public Device {
  public:
   HostPathDevice(const std::string_view mount_path,
@@ -40,13 +39,17 @@ class HostPathDevice : public Device {
   uint32_t sectors_per_allocation_unit() const override { return 1; }
   uint32_t bytes_per_sector() const override { return 0x200; }
 
- private:
-  void PopulateEntry(HostPathEntry* parent_entry);
+  // Whether a file was opened for writing, which may leave the sizes of the
+  // entries listed so far out of date.
+  bool files_written() const { return files_written_; }
+  void set_files_written() { files_written_ = true; }
 
+ private:
   std::string name_;
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
   bool read_only_;
+  std::atomic<bool> files_written_ = false;
 };
 
 }  // namespace vfs
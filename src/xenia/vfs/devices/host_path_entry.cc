@@ -15,6 +15,7 @@
 #include "xenia/base/math.h"
 #include "xenia/base/string.h"
 #include "xenia/vfs/device.h"
+#include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/vfs/devices/host_path_file.h"
 
 namespace xe {
@@ -39,6 +40,8 @@ HostPathEntry* HostPathEntry::Create(Device* device, Entry* parent,
   entry->write_timestamp_ = file_info.write_timestamp;
   if (file_info.type == xe::filesystem::FileInfo::Type::kDirectory) {
     entry->attributes_ = kFileAttributeDirectory;
+    // Listed on first use.
+    entry->children_populated_ = false;
   } else {
     entry->attributes_ = kFileAttributeNormal;
     if (device->is_read_only()) {
@@ -63,6 +66,10 @@ X_STATUS HostPathEntry::Open(uint32_t desired_access, File** out_file) {
     // TODO(benvanik): pick correct response.
     return X_STATUS_NO_SUCH_FILE;
   }
+  if (desired_access & (FileAccess::kGenericWrite | FileAccess::kFileWriteData |
+                        FileAccess::kFileAppendData)) {
+    static_cast<HostPathDevice*>(device_)->set_files_written();
+  }
   *out_file = new HostPathFile(desired_access, this, std::move(file_handle));
   return X_STATUS_SUCCESS;
 }
@@ -109,6 +116,15 @@ bool HostPathEntry::DeleteEntryInternal(Entry* entry) {
   }
 }
 
+void HostPathEntry::PopulateChildrenInternal() {
+  auto child_infos = xe::filesystem::ListFiles(host_path_);
+  children_.reserve(children_.size() + child_infos.size());
+  for (auto& child_info : child_infos) {
+    children_.emplace_back(HostPathEntry::Create(
+        device_, this, host_path_ / child_info.name, child_info));
+  }
+}
+
 void HostPathEntry::update() {
   xe::filesystem::FileInfo file_info;
   if (!xe::filesystem::GetInfo(host_path_, &file_info)) {
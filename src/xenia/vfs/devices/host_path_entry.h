@@ -46,6 +46,7 @@ class HostPathEntry : public Entry {
   std::unique_ptr<Entry> CreateEntryInternal(const std::string_view name,
                                              uint32_t attributes) override;
   bool DeleteEntryInternal(Entry* entry) override;
+  void PopulateChildrenInternal() override;
 
   std::filesystem::path host_path_;
 };
@@ -38,7 +38,7 @@ bool NullDevice::Initialize() {
 }
 
 void NullDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::shared_lock<std::shared_mutex> lock(tree_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
@@ -10,6 +10,7 @@
 #include "xenia/vfs/devices/stfs_container_device.h"
 
 #include <algorithm>
+#include <cstring>
 #include <queue>
 #include <vector>
 
@@ -73,16 +74,16 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
   // Map the file containing the STFS Header and read it.
   XELOGI("Loading STFS header file: {}", xe::path_to_utf8(host_path_));
 
-  auto header_file = xe::filesystem::OpenFile(host_path_, "rb");
+  auto header_file =
+      MappedMemory::Open(host_path_, MappedMemory::Mode::kRead);
   if (!header_file) {
     XELOGE("Error opening STFS header file.");
     return Error::kErrorReadError;
   }
 
-  auto header_result = ReadHeaderAndVerify(header_file);
+  auto header_result = ReadHeaderAndVerify(header_file.get());
   if (header_result != Error::kSuccess) {
     XELOGE("Error reading STFS header: {}", header_result);
-    fclose(header_file);
     files_total_size_ = 0;
     return header_result;
   }
@@ -92,7 +93,7 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
   // NOTE: data_file_count is 0 for STFS and 1 for SVOD
   if (header_.metadata.data_file_count <= 1) {
     XELOGI("STFS container is a single file.");
-    files_.emplace(std::make_pair(0, header_file));
+    files_.push_back(std::move(header_file));
     return Error::kSuccess;
   }
 
@@ -122,32 +123,40 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
   for (size_t i = 0; i < fragment_files.size(); i++) {
     auto& fragment = fragment_files.at(i);
     auto path = fragment.path / fragment.name;
-    auto file = xe::filesystem::OpenFile(path, "rb");
+    auto file = MappedMemory::Open(path, MappedMemory::Mode::kRead);
     if (!file) {
       XELOGI("Failed to map SVOD file {}.", xe::path_to_utf8(path));
       CloseFiles();
       return Error::kErrorReadError;
     }
 
-    xe::filesystem::Seek(file, 0L, SEEK_END);
-    files_total_size_ += xe::filesystem::Tell(file);
-    // no need to seek back, any reads from this file will seek first anyway
-    files_.emplace(std::make_pair(i, file));
+    files_total_size_ += file->size();
+    files_.push_back(std::move(file));
   }
   XELOGI("SVOD successfully mapped {} files.", fragment_files.size());
   return Error::kSuccess;
 }
 
 void StfsContainerDevice::CloseFiles() {
-  for (auto& file : files_) {
-    fclose(file.second);
-  }
   files_.clear();
   files_total_size_ = 0;
 }
 
+const uint8_t* StfsContainerDevice::GetFileData(size_t file_index,
+                                                size_t offset,
+                                                size_t length) const {
+  if (file_index >= files_.size()) {
+    return nullptr;
+  }
+  auto& file = files_[file_index];
+  if (offset > file->size() || length > file->size() - offset) {
+    return nullptr;
+  }
+  return file->data() + offset;
+}
+
 void StfsContainerDevice::Dump(StringBuffer* string_buffer) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::shared_lock<std::shared_mutex> lock(tree_mutex_);
   root_entry_->Dump(string_buffer, 0);
 }
 
@@ -160,20 +169,15 @@ Entry* StfsContainerDevice::ResolvePath(const std::string_view path) {
 }
 
 StfsContainerDevice::Error StfsContainerDevice::ReadHeaderAndVerify(
-    FILE* header_file) {
+    const MappedMemory* header_file) {
   // Check size of the file is enough to store an STFS header
-  xe::filesystem::Seek(header_file, 0L, SEEK_END);
-  files_total_size_ = xe::filesystem::Tell(header_file);
-  xe::filesystem::Seek(header_file, 0L, SEEK_SET);
-
+  files_total_size_ = header_file->size();
   if (sizeof(StfsHeader) > files_total_size_) {
     return Error::kErrorTooSmall;
   }
 
   // Read header & check signature
-  if (fread(&header_, sizeof(StfsHeader), 1, header_file) != 1) {
-    return Error::kErrorReadError;
-  }
+  std::memcpy(&header_, header_file->data(), sizeof(StfsHeader));
 
   if (!header_.header.is_magic_valid()) {
     // Unexpected format.
@@ -198,10 +202,9 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
   // SVOD Systems can have different layouts. The root block is
   // denoted by the magic "MICROSOFT*XBOX*MEDIA" and is always in
   // the first "actual" data fragment of the system.
-  auto& svod_header = files_.at(0);
   const char* MEDIA_MAGIC = "MICROSOFT*XBOX*MEDIA";
 
-  uint8_t magic_buf[20];
+  const uint8_t* magic_buf;
   size_t magic_offset;
 
   // Check for EDGF layout
@@ -211,9 +214,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
     // We can expect the magic block to be located immediately after the hash
     // blocks. We also offset block address calculation by 0x1000 by shifting
     // block indices by +0x2.
-    xe::filesystem::Seek(svod_header, 0x2000, SEEK_SET);
-    if (fread(magic_buf, 1, countof(magic_buf), svod_header) !=
-        countof(magic_buf)) {
+    magic_buf = GetFileData(0, 0x2000, 20);
+    if (!magic_buf) {
       XELOGE("ReadSVOD failed to read SVOD magic at 0x2000");
       return Error::kErrorReadError;
     }
@@ -228,9 +230,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
       return Error::kErrorFileMismatch;
     }
   } else {
-    xe::filesystem::Seek(svod_header, 0x12000, SEEK_SET);
-    if (fread(magic_buf, 1, countof(magic_buf), svod_header) !=
-        countof(magic_buf)) {
+    magic_buf = GetFileData(0, 0x12000, 20);
+    if (!magic_buf) {
       XELOGE("ReadSVOD failed to read SVOD magic at 0x12000");
       return Error::kErrorReadError;
     }
@@ -244,8 +245,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
 
       // Check for XSF Header
       const char* XSF_MAGIC = "XSF";
-      xe::filesystem::Seek(svod_header, 0x2000, SEEK_SET);
-      if (fread(magic_buf, 1, 3, svod_header) != 3) {
+      magic_buf = GetFileData(0, 0x2000, 3);
+      if (!magic_buf) {
         XELOGE("ReadSVOD failed to read SVOD XSF magic at 0x2000");
         return Error::kErrorReadError;
       }
@@ -259,9 +260,8 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
         XELOGI("SVOD magic block found at 0x12000");
       }
     } else {
-      xe::filesystem::Seek(svod_header, 0xD000, SEEK_SET);
-      if (fread(magic_buf, 1, countof(magic_buf), svod_header) !=
-          countof(magic_buf)) {
+      magic_buf = GetFileData(0, 0xD000, 20);
+      if (!magic_buf) {
         XELOGE("ReadSVOD failed to read SVOD magic at 0xD000");
         return Error::kErrorReadError;
       }
@@ -292,8 +292,6 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
   }
 
   // Parse the root directory
-  xe::filesystem::Seek(svod_header, magic_offset + 0x14, SEEK_SET);
-
   struct {
     uint32_t block;
     uint32_t size;
@@ -302,11 +300,13 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSVOD() {
   } root_data;
   static_assert_size(root_data, 0x10);
 
-  if (fread(&root_data, sizeof(root_data), 1, svod_header) != 1) {
+  auto root_data_ptr = GetFileData(0, magic_offset + 0x14, sizeof(root_data));
+  if (!root_data_ptr) {
     XELOGE("ReadSVOD failed to read root block data at 0x{X}",
            magic_offset + 0x14);
     return Error::kErrorReadError;
   }
+  std::memcpy(&root_data, root_data_ptr, sizeof(root_data));
 
   uint64_t root_creation_timestamp =
       decode_fat_timestamp(root_data.creation_date, root_data.creation_time);
@@ -336,9 +336,6 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
   entry_address += true_ordinal_offset;
 
   // Read directory entry
-  auto& file = files_.at(entry_file);
-  xe::filesystem::Seek(file, entry_address, SEEK_SET);
-
 #pragma pack(push, 1)
   struct {
     uint16_t node_l;
@@ -351,21 +348,25 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
   static_assert_size(dir_entry, 0xE);
 #pragma pack(pop)
 
-  if (fread(&dir_entry, sizeof(dir_entry), 1, file) != 1) {
+  auto dir_entry_ptr =
+      GetFileData(entry_file, entry_address, sizeof(dir_entry));
+  if (!dir_entry_ptr) {
     XELOGE("ReadEntrySVOD failed to read directory entry at 0x{X}",
            entry_address);
     return Error::kErrorReadError;
   }
+  std::memcpy(&dir_entry, dir_entry_ptr, sizeof(dir_entry));
 
-  auto name_buffer = std::make_unique<char[]>(dir_entry.name_length);
-  if (fread(name_buffer.get(), 1, dir_entry.name_length, file) !=
-      dir_entry.name_length) {
+  auto name_ptr = GetFileData(entry_file, entry_address + sizeof(dir_entry),
+                              dir_entry.name_length);
+  if (!name_ptr) {
     XELOGE("ReadEntrySVOD failed to read directory entry name at 0x{X}",
            entry_address);
     return Error::kErrorReadError;
   }
 
-  auto name = std::string(name_buffer.get(), dir_entry.name_length);
+  auto name = std::string(reinterpret_cast<const char*>(name_ptr),
+                          dir_entry.name_length);
 
   // Read the left node
   if (dir_entry.node_l) {
@@ -419,8 +420,6 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
       uint32_t block_index = dir_entry.data_block;
       size_t remaining_size = xe::round_up(dir_entry.length, 0x800);
 
-      size_t last_record = -1;
-      size_t last_offset = -1;
       while (remaining_size) {
         const size_t BLOCK_SIZE = 0x800;
 
@@ -430,16 +429,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
         block_index++;
         remaining_size -= BLOCK_SIZE;
 
-        if (offset - last_offset == 0x800) {
-          // Consecutive, so append to last entry.
-          entry->block_list_[last_record].length += BLOCK_SIZE;
-          last_offset = offset;
-          continue;
-        }
-
-        entry->block_list_.push_back({file_index, offset, BLOCK_SIZE});
-        last_record = entry->block_list_.size() - 1;
-        last_offset = offset;
+        entry->AppendBlock(file_index, offset, BLOCK_SIZE);
       }
     }
   }
@@ -519,8 +509,6 @@ void StfsContainerDevice::BlockToOffsetSVOD(size_t block, size_t* out_address,
 }
 
 StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
-  auto& file = files_.at(0);
-
   auto root_entry = new StfsContainerEntry(this, nullptr, "", &files_);
   root_entry->attributes_ = kFileAttributeDirectory;
   root_entry_ = std::unique_ptr<Entry>(root_entry);
@@ -535,12 +523,12 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
   size_t n = 0;
   for (n = 0; n < descriptor.file_table_block_count; n++) {
     auto offset = BlockToOffsetSTFS(table_block_index);
-    xe::filesystem::Seek(file, offset, SEEK_SET);
-
-    if (fread(&directory, sizeof(StfsDirectoryBlock), 1, file) != 1) {
+    auto directory_ptr = GetFileData(0, offset, sizeof(StfsDirectoryBlock));
+    if (!directory_ptr) {
       XELOGE("ReadSTFS failed to read directory block at 0x{X}", offset);
       return Error::kErrorReadError;
     }
+    std::memcpy(&directory, directory_ptr, sizeof(StfsDirectoryBlock));
 
     for (size_t m = 0; m < kEntriesPerDirectoryBlock; m++) {
       auto& dir_entry = directory.entries[m];
@@ -581,24 +569,17 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
       all_entries.push_back(entry.get());
 
       // Fill in all block records.
-      // It's easier to do this now and just look them up later, at the cost
-      // of some memory. Nasty chain walk.
+      // It's easier to do this now and just look them up later. Nasty chain
+      // walk, but consecutive blocks collapse into a single record so reads
+      // only have to search a handful of runs.
       // TODO(benvanik): optimize if flags.contiguous is set.
       if (entry->attributes() & X_FILE_ATTRIBUTE_NORMAL) {
-        uint32_t block_index = dir_entry.start_block_number();
         size_t remaining_size = dir_entry.length;
-        while (remaining_size && block_index != kEndOfChain) {
-          size_t block_size =
-              std::min(static_cast<size_t>(kBlockSize), remaining_size);
-          size_t offset = BlockToOffsetSTFS(block_index);
-          entry->block_list_.push_back({0, offset, block_size});
-          remaining_size -= block_size;
-          auto block_hash = GetBlockHash(block_index);
-          block_index = block_hash->level0_next_block();
-        }
+        uint32_t block_count = ReadBlockChainSTFS(
+            entry.get(), dir_entry.start_block_number(), &remaining_size);
 
         if (remaining_size) {
-          // Loop above must have exited prematurely, bad hash tables?
+          // The chain must have ended prematurely, bad hash tables?
           XELOGW(
               "STFS file {} only found {} bytes for file, expected {} ({} "
               "bytes missing)",
@@ -609,12 +590,11 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
 
         // Check that the number of blocks retrieved from hash entries matches
         // the block count read from the file entry
-        if (entry->block_list_.size() != dir_entry.allocated_data_blocks()) {
+        if (block_count != dir_entry.allocated_data_blocks()) {
           XELOGW(
               "STFS failed to read correct block-chain for entry {}, read {} "
               "blocks, expected {}",
-              entry->name_, entry->block_list_.size(),
-              dir_entry.allocated_data_blocks());
+              entry->name_, block_count, dir_entry.allocated_data_blocks());
           assert_always();
         }
       }
@@ -623,6 +603,9 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
     }
 
     auto block_hash = GetBlockHash(table_block_index);
+    if (!block_hash) {
+      return Error::kErrorReadError;
+    }
     table_block_index = block_hash->level0_next_block();
     if (table_block_index == kEndOfChain) {
       break;
@@ -638,6 +621,34 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
   return Error::kSuccess;
 }
 
+uint32_t StfsContainerDevice::ReadBlockChainSTFS(StfsContainerEntry* entry,
+                                                 uint32_t block_index,
+                                                 size_t* remaining_size) {
+  // Chains mostly stay within a level 0 hash table for a while, so keep the
+  // current one around instead of looking it up for every block.
+  const StfsHashTable* table = nullptr;
+  uint32_t table_index = 0;
+  uint32_t block_count = 0;
+  while (*remaining_size && block_index != kEndOfChain) {
+    size_t block_size =
+        std::min(static_cast<size_t>(kBlockSize), *remaining_size);
+    entry->AppendBlock(0, BlockToOffsetSTFS(block_index), block_size);
+    *remaining_size -= block_size;
+    ++block_count;
+
+    if (!table || block_index / kBlocksPerHashLevel[0] != table_index) {
+      table = GetHashTable(block_index, 0);
+      if (!table) {
+        break;
+      }
+      table_index = block_index / kBlocksPerHashLevel[0];
+    }
+    block_index = table->entries[block_index % kBlocksPerHashLevel[0]]
+                      .level0_next_block();
+  }
+  return block_count;
+}
+
 size_t StfsContainerDevice::BlockToOffsetSTFS(uint64_t block_index) const {
   // For every level there is a hash table
   // Level 0: hash table of next 170 blocks
@@ -696,92 +707,66 @@ size_t StfsContainerDevice::BlockToHashBlockOffsetSTFS(
   return xe::round_up(header_.header.header_size, kBlockSize) + (block << 12);
 }
 
-const StfsHashEntry* StfsContainerDevice::GetBlockHash(uint32_t block_index) {
-  auto& file = files_.at(0);
+const StfsHashTable* StfsContainerDevice::GetHashTable(uint32_t block_index,
+                                                      uint32_t hash_level) {
+  auto& tables = hash_tables_[hash_level];
+  size_t table_index = block_index / kBlocksPerHashLevel[hash_level];
+  if (table_index < tables.size() && tables[table_index]) {
+    return tables[table_index];
+  }
 
   auto& descriptor = header_.metadata.volume_descriptor.stfs;
 
-  // Offset for selecting the secondary hash block, in packages that have them
-  uint32_t secondary_table_offset =
-      descriptor.flags.bits.root_active_index ? kBlockSize : 0;
-
-  auto hash_offset_lv0 = BlockToHashBlockOffsetSTFS(block_index, 0);
-  if (!cached_hash_tables_.count(hash_offset_lv0)) {
-    // If this is read_only_format then it doesn't contain secondary blocks, no
-    // need to check upper hash levels
-    if (descriptor.flags.bits.read_only_format) {
-      secondary_table_offset = 0;
+  // Packages that are not read_only_format keep two copies of each table, the
+  // level above says which one is active (the header for the top level).
+  uint32_t secondary_table_offset = 0;
+  if (!descriptor.flags.bits.read_only_format) {
+    uint32_t top_level = 0;
+    if (descriptor.total_block_count > kBlocksPerHashLevel[1]) {
+      top_level = 2;
+    } else if (descriptor.total_block_count > kBlocksPerHashLevel[0]) {
+      top_level = 1;
+    }
+    if (hash_level >= top_level) {
+      secondary_table_offset =
+          descriptor.flags.bits.root_active_index ? kBlockSize : 0;
     } else {
-      // Not a read-only package, need to check each levels active index flag to
-      // see if we need to use secondary block or not
-
-      // Check level1 table if package has it
-      if (descriptor.total_block_count > kBlocksPerHashLevel[0]) {
-        auto hash_offset_lv1 = BlockToHashBlockOffsetSTFS(block_index, 1);
-
-        if (!cached_hash_tables_.count(hash_offset_lv1)) {
-          // Check level2 table if package has it
-          if (descriptor.total_block_count > kBlocksPerHashLevel[1]) {
-            auto hash_offset_lv2 = BlockToHashBlockOffsetSTFS(block_index, 2);
-
-            if (!cached_hash_tables_.count(hash_offset_lv2)) {
-              xe::filesystem::Seek(
-                  file, hash_offset_lv2 + secondary_table_offset, SEEK_SET);
-
-              StfsHashTable table_lv2;
-              if (fread(&table_lv2, sizeof(StfsHashTable), 1, file) != 1) {
-                XELOGE("GetBlockHash failed to read level2 hash table at 0x{X}",
-                       hash_offset_lv2 + secondary_table_offset);
-                return nullptr;
-              }
-              cached_hash_tables_[hash_offset_lv2] = table_lv2;
-            }
-
-            auto record =
-                (block_index / kBlocksPerHashLevel[1]) % kBlocksPerHashLevel[0];
-            auto record_data =
-                &cached_hash_tables_[hash_offset_lv2].entries[record];
-            secondary_table_offset =
-                record_data->levelN_active_index() ? kBlockSize : 0;
-          }
-
-          xe::filesystem::Seek(file, hash_offset_lv1 + secondary_table_offset,
-                               SEEK_SET);
-
-          StfsHashTable table_lv1;
-          if (fread(&table_lv1, sizeof(StfsHashTable), 1, file) != 1) {
-            XELOGE("GetBlockHash failed to read level1 hash table at 0x{X}",
-                   hash_offset_lv1 + secondary_table_offset);
-            return nullptr;
-          }
-          cached_hash_tables_[hash_offset_lv1] = table_lv1;
-        }
-
-        auto record =
-            (block_index / kBlocksPerHashLevel[0]) % kBlocksPerHashLevel[0];
-        auto record_data =
-            &cached_hash_tables_[hash_offset_lv1].entries[record];
-        secondary_table_offset =
-            record_data->levelN_active_index() ? kBlockSize : 0;
+      auto parent_table = GetHashTable(block_index, hash_level + 1);
+      if (!parent_table) {
+        return nullptr;
       }
+      auto record = (block_index / kBlocksPerHashLevel[hash_level]) %
+                    kBlocksPerHashLevel[0];
+      secondary_table_offset =
+          parent_table->entries[record].levelN_active_index() ? kBlockSize
+                                                               : 0;
     }
+  }
 
-    xe::filesystem::Seek(file, hash_offset_lv0 + secondary_table_offset,
-                         SEEK_SET);
-
-    StfsHashTable table_lv0;
-    if (fread(&table_lv0, sizeof(StfsHashTable), 1, file) != 1) {
-      XELOGE("GetBlockHash failed to read level0 hash table at 0x{X}",
-             hash_offset_lv0 + secondary_table_offset);
-      return nullptr;
-    }
-    cached_hash_tables_[hash_offset_lv0] = table_lv0;
+  auto table_offset =
+      BlockToHashBlockOffsetSTFS(block_index, hash_level) +
+      secondary_table_offset;
+  auto table = reinterpret_cast<const StfsHashTable*>(
+      GetFileData(0, table_offset, sizeof(StfsHashTable)));
+  if (!table) {
+    XELOGE("GetHashTable failed to read level{} hash table at 0x{X}",
+           hash_level, table_offset);
+    return nullptr;
   }
 
-  auto record = block_index % kBlocksPerHashLevel[0];
-  auto record_data = &cached_hash_tables_[hash_offset_lv0].entries[record];
+  if (table_index >= tables.size()) {
+    tables.resize(table_index + 1);
+  }
+  tables[table_index] = table;
+  return table;
+}
 
-  return record_data;
+const StfsHashEntry* StfsContainerDevice::GetBlockHash(uint32_t block_index) {
+  auto table = GetHashTable(block_index, 0);
+  if (!table) {
+    return nullptr;
+  }
+  return &table->entries[block_index % kBlocksPerHashLevel[0]];
 }
 
 XContentPackageType StfsContainerDevice::ReadMagic(
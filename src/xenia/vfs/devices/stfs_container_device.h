@@ -10,11 +10,11 @@
 #ifndef XENIA_VFS_DEVICES_STFS_CONTAINER_DEVICE_H_
 #define XENIA_VFS_DEVICES_STFS_CONTAINER_DEVICE_H_
 
-#include <map>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string_util.h"
 #include "xenia/kernel/util/xex2_info.h"
@@ -108,8 +108,12 @@ class StfsContainerDevice : public Device {
 
   Error OpenFiles();
   void CloseFiles();
+  // Returns a pointer to length bytes at offset in the given backing file, or
+  // nullptr if the file is too short.
+  const uint8_t* GetFileData(size_t file_index, size_t offset,
+                             size_t length) const;
 
-  Error ReadHeaderAndVerify(FILE* header_file);
+  Error ReadHeaderAndVerify(const MappedMemory* header_file);
 
   Error ReadSVOD();
   Error ReadEntrySVOD(uint32_t sector, uint32_t ordinal,
@@ -123,12 +127,21 @@ class StfsContainerDevice : public Device {
   size_t BlockToHashBlockOffsetSTFS(uint32_t block_index,
                                     uint32_t hash_level) const;
 
+  // Walks the block chain of a file starting at block_index, appending the
+  // blocks to entry until remaining_size bytes are covered or the chain ends.
+  // Returns the number of blocks found.
+  uint32_t ReadBlockChainSTFS(StfsContainerEntry* entry, uint32_t block_index,
+                              size_t* remaining_size);
+  // Returns the active hash table of the given level covering block_index.
+  const StfsHashTable* GetHashTable(uint32_t block_index, uint32_t hash_level);
   const StfsHashEntry* GetBlockHash(uint32_t block_index);
 
   std::string name_;
   std::filesystem::path host_path_;
 
-  std::map<size_t, FILE*> files_;
+  // Read-only views of the backing files. Reads copy straight out of these,
+  // so any number of threads can read without locking.
+  std::vector<std::unique_ptr<MappedMemory>> files_;
   size_t files_total_size_;
 
   size_t svod_base_offset_;
@@ -139,7 +152,9 @@ class StfsContainerDevice : public Device {
   uint32_t blocks_per_hash_table_;
   uint32_t block_step[2];
 
-  std::unordered_map<size_t, StfsHashTable> cached_hash_tables_;
+  // Hash tables already located, per level and indexed by the first block they
+  // cover divided by kBlocksPerHashLevel. They point into the mapped package.
+  std::vector<const StfsHashTable*> hash_tables_[3];
 };
 
 }  // namespace vfs
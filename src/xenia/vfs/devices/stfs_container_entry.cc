@@ -11,7 +11,7 @@
 #include "xenia/base/math.h"
 #include "xenia/vfs/devices/stfs_container_file.h"
 
-#include <map>
+#include <algorithm>
 
 namespace xe {
 namespace vfs {
@@ -42,5 +42,55 @@ X_STATUS StfsContainerEntry::Open(uint32_t desired_access, File** out_file) {
   return X_STATUS_SUCCESS;
 }
 
+std::unique_ptr<MappedMemory> StfsContainerEntry::OpenMapped(
+    MappedMemory::Mode mode, size_t offset, size_t length) {
+  if (mode != MappedMemory::Mode::kRead || block_list_.size() != 1) {
+    // Only allow reads of files stored in a single run.
+    return nullptr;
+  }
+
+  auto& record = block_list_[0];
+  auto& file = files_->at(record.file);
+  size_t data_length = std::min(size_, record.length);
+  if (offset > data_length || record.offset + data_length > file->size()) {
+    return nullptr;
+  }
+  size_t real_length = length ? std::min(length, data_length - offset)
+                              : data_length - offset;
+  return file->Slice(record.offset + offset, real_length);
+}
+
+size_t StfsContainerEntry::FindBlock(size_t entry_offset) const {
+  auto it = std::upper_bound(block_list_.begin(), block_list_.end(),
+                             entry_offset,
+                             [](size_t offset, const BlockRecord& record) {
+                               return offset < record.entry_offset;
+                             });
+  if (it == block_list_.begin()) {
+    return block_list_.size();
+  }
+  --it;
+  if (entry_offset - it->entry_offset >= it->length) {
+    return block_list_.size();
+  }
+  return size_t(it - block_list_.begin());
+}
+
+void StfsContainerEntry::AppendBlock(size_t file, size_t offset,
+                                     size_t length) {
+  if (!block_list_.empty()) {
+    auto& last = block_list_.back();
+    if (last.file == file && last.offset + last.length == offset) {
+      last.length += length;
+      return;
+    }
+  }
+  size_t entry_offset = 0;
+  if (!block_list_.empty()) {
+    entry_offset = block_list_.back().entry_offset + block_list_.back().length;
+  }
+  block_list_.push_back({file, offset, length, entry_offset});
+}
+
 }  // namespace vfs
 }  // namespace xe
\ No newline at end of file
@@ -10,16 +10,17 @@
 #ifndef XENIA_VFS_DEVICES_STFS_CONTAINER_ENTRY_H_
 #define XENIA_VFS_DEVICES_STFS_CONTAINER_ENTRY_H_
 
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
 
 namespace xe {
 namespace vfs {
-typedef std::map<size_t, FILE*> MultiFileHandles;
+typedef std::vector<std::unique_ptr<MappedMemory>> MultiFileHandles;
 
 class StfsContainerDevice;
 
@@ -41,16 +42,32 @@ class StfsContainerEntry : public Entry {
 
   X_STATUS Open(uint32_t desired_access, File** out_file) override;
 
+  // Files stored in a single run can be handed out without copying.
+  bool can_map() const override { return block_list_.size() == 1; }
+  std::unique_ptr<MappedMemory> OpenMapped(MappedMemory::Mode mode,
+                                           size_t offset,
+                                           size_t length) override;
+
+  // A run of the entry data that is contiguous in one backing file. Records
+  // are sorted by entry_offset, the offset of the run within the entry data.
   struct BlockRecord {
     size_t file;
     size_t offset;
     size_t length;
+    size_t entry_offset;
   };
   const std::vector<BlockRecord>& block_list() const { return block_list_; }
+  // Index of the record holding the given offset of the entry data, or
+  // block_list().size() if it is past the end.
+  size_t FindBlock(size_t entry_offset) const;
 
  private:
   friend class StfsContainerDevice;
 
+  // Appends the next piece of the entry data, merging it into the last record
+  // if it directly follows it in the same backing file.
+  void AppendBlock(size_t file, size_t offset, size_t length);
+
   MultiFileHandles* files_;
   size_t data_offset_;
   size_t data_size_;
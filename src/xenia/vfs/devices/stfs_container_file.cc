@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #include "xenia/base/math.h"
 #include "xenia/vfs/devices/stfs_container_entry.h"
@@ -33,36 +34,35 @@ X_STATUS StfsContainerFile::ReadSync(void* buffer, size_t buffer_length,
     return X_STATUS_END_OF_FILE;
   }
 
-  size_t src_offset = 0;
   uint8_t* p = reinterpret_cast<uint8_t*>(buffer);
   size_t remaining_length =
       std::min(buffer_length, entry_->size() - byte_offset);
 
   *out_bytes_read = 0;
-  for (size_t i = 0; i < entry_->block_list().size(); i++) {
-    auto& record = entry_->block_list()[i];
-    if (src_offset + record.length <= byte_offset) {
-      // Doesn't begin in this region. Skip it.
-      src_offset += record.length;
-      continue;
-    }
-
-    size_t read_offset =
-        (byte_offset > src_offset) ? byte_offset - src_offset : 0;
+  auto& block_list = entry_->block_list();
+  for (size_t i = entry_->FindBlock(byte_offset);
+       i < block_list.size() && remaining_length; i++) {
+    auto& record = block_list[i];
+    size_t read_offset = (byte_offset > record.entry_offset)
+                             ? byte_offset - record.entry_offset
+                             : 0;
     size_t read_length =
         std::min(record.length - read_offset, remaining_length);
 
+    // Truncated packages only yield what the backing file has.
     auto& file = entry_->files()->at(record.file);
-    xe::filesystem::Seek(file, record.offset + read_offset, SEEK_SET);
-    auto num_read = fread(p, 1, read_length, file);
+    size_t file_offset = record.offset + read_offset;
+    size_t available =
+        file_offset < file->size() ? file->size() - file_offset : 0;
+    size_t copy_length = std::min(read_length, available);
+    std::memcpy(p, file->data() + file_offset, copy_length);
 
-    *out_bytes_read += num_read;
-    p += num_read;
-    src_offset += record.length;
-    remaining_length -= read_length;
-    if (remaining_length == 0) {
+    *out_bytes_read += copy_length;
+    if (copy_length != read_length) {
       break;
     }
+    p += read_length;
+    remaining_length -= read_length;
   }
 
   return X_STATUS_SUCCESS;
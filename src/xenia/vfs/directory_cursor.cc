@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/directory_cursor.h"
+
+#include <algorithm>
+
+namespace xe {
+namespace vfs {
+
+namespace {
+
+char lower_ascii(char c) {
+  return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+bool LessCase(const std::string& left, const std::string& right) {
+  return std::lexicographical_compare(
+      left.cbegin(), left.cend(), right.cbegin(), right.cend(),
+      [](char a, char b) {
+        return uint8_t(lower_ascii(a)) < uint8_t(lower_ascii(b));
+      });
+}
+
+}  // namespace
+
+void DirectoryCursor::SetPattern(const std::string_view pattern) {
+  engine_.SetRule(pattern);
+}
+
+void DirectoryCursor::Scan(Entry* directory) {
+  matches_.clear();
+  position_ = 0;
+  scanned_ = true;
+  directory->MatchChildren(engine_, [this](const Entry& child) {
+    matches_.push_back({child.name(), child.attributes(), child.size(),
+                        child.allocation_size(), child.create_timestamp(),
+                        child.access_timestamp(), child.write_timestamp()});
+  });
+  // Most devices list directories in order already.
+  auto less = [](const Match& left, const Match& right) {
+    return LessCase(left.name, right.name);
+  };
+  if (!std::is_sorted(matches_.cbegin(), matches_.cend(), less)) {
+    std::stable_sort(matches_.begin(), matches_.end(), less);
+  }
+}
+
+const DirectoryCursor::Match* DirectoryCursor::Peek() const {
+  return position_ < matches_.size() ? &matches_[position_] : nullptr;
+}
+
+const DirectoryCursor::Match* DirectoryCursor::Next() {
+  auto match = Peek();
+  if (match) {
+    ++position_;
+  }
+  return match;
+}
+
+}  // namespace vfs
+}  // namespace xe
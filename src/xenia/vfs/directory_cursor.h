@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DIRECTORY_CURSOR_H_
+#define XENIA_VFS_DIRECTORY_CURSOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xenia/base/filesystem_wildcard.h"
+#include "xenia/vfs/entry.h"
+
+namespace xe {
+namespace vfs {
+
+// Enumerates the children of a directory that match a wildcard pattern. The
+// matches are copied and sorted by name, ignoring case, once per scan, so
+// each step of the enumeration is constant time and unaffected by entries
+// created or deleted meanwhile.
+class DirectoryCursor {
+ public:
+  struct Match {
+    std::string name;
+    uint32_t attributes;
+    size_t size;
+    size_t allocation_size;
+    uint64_t create_timestamp;
+    uint64_t access_timestamp;
+    uint64_t write_timestamp;
+  };
+
+  // Matches everything until a pattern is set.
+  void SetPattern(const std::string_view pattern);
+
+  // Takes a new snapshot of the matching children of directory and goes back
+  // to the first one.
+  void Scan(Entry* directory);
+  bool scanned() const { return scanned_; }
+
+  // The next match, without advancing, or nullptr once all were returned.
+  const Match* Peek() const;
+  // The next match, or nullptr once all were returned.
+  const Match* Next();
+
+  // Number of matches returned since the last scan.
+  size_t position() const { return position_; }
+  size_t match_count() const { return matches_.size(); }
+
+ private:
+  xe::filesystem::WildcardEngine engine_;
+  std::vector<Match> matches_;
+  size_t position_ = 0;
+  bool scanned_ = false;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DIRECTORY_CURSOR_H_
@@ -9,6 +9,9 @@
 
 #include "xenia/vfs/entry.h"
 
+#include <mutex>
+#include <shared_mutex>
+
 #include "xenia/base/filesystem.h"
 #include "xenia/base/string.h"
 #include "xenia/vfs/device.h"
@@ -47,33 +50,99 @@ void Entry::Dump(xe::StringBuffer* string_buffer, int indent) {
 bool Entry::is_read_only() const { return device_->is_read_only(); }
 
 Entry* Entry::GetChild(const std::string_view name) {
-  auto global_lock = global_critical_region_.Acquire();
-  auto it = std::find_if(children_.cbegin(), children_.cend(),
-                         [&](const auto& child) {
-                           return xe::utf8::equal_case(child->name(), name);
-                         });
-  if (it == children_.cend()) {
-    return nullptr;
+  {
+    std::shared_lock<std::shared_mutex> lock(device_->tree_mutex());
+    if (are_children_ready()) {
+      return FindChild(name);
+    }
   }
-  return (*it).get();
+  std::unique_lock<std::shared_mutex> lock(device_->tree_mutex());
+  PrepareChildren();
+  return FindChild(name);
 }
 
 Entry* Entry::ResolvePath(const std::string_view path) {
-  // Walk the path, one separator at a time.
+  auto parts = xe::utf8::split_path(path);
+  {
+    // Walk the path, one separator at a time, under a single shared lock. If
+    // a directory along the way is not populated yet or has an out of date
+    // index fall back to the exclusive walk below.
+    std::shared_lock<std::shared_mutex> lock(device_->tree_mutex());
+    Entry* entry = this;
+    for (auto& part : parts) {
+      if (!entry->are_children_ready()) {
+        entry = nullptr;
+        break;
+      }
+      entry = entry->FindChild(part);
+      if (!entry) {
+        // Not found.
+        return nullptr;
+      }
+    }
+    if (entry) {
+      return entry;
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(device_->tree_mutex());
   Entry* entry = this;
-  for (auto& part : xe::utf8::split_path(path)) {
-    entry = entry->GetChild(part);
+  for (auto& part : parts) {
+    entry->PrepareChildren();
+    entry = entry->FindChild(part);
     if (!entry) {
-      // Not found.
       return nullptr;
     }
   }
   return entry;
 }
 
+void Entry::PrepareChildren() {
+  if (are_children_ready()) {
+    return;
+  }
+  if (!children_populated_) {
+    children_populated_ = true;
+    PopulateChildrenInternal();
+    if (are_children_ready()) {
+      return;
+    }
+  }
+  if (!indexed_child_count_) {
+    child_index_.reserve(children_.size());
+  }
+  for (; indexed_child_count_ < children_.size(); ++indexed_child_count_) {
+    auto child = children_[indexed_child_count_].get();
+    // Keep the first of any duplicate names, as the linear search would.
+    child_index_.emplace(child->name(), child);
+  }
+}
+
+Entry* Entry::FindChild(const std::string_view name) const {
+  if (children_.size() >= kChildIndexThreshold) {
+    auto it = child_index_.find(name);
+    return it != child_index_.cend() ? it->second : nullptr;
+  }
+  auto it = std::find_if(children_.cbegin(), children_.cend(),
+                         [&](const auto& child) {
+                           return xe::utf8::equal_case(child->name(), name);
+                         });
+  if (it == children_.cend()) {
+    return nullptr;
+  }
+  return (*it).get();
+}
+
 Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
                               size_t* current_index) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::shared_lock<std::shared_mutex> lock(device_->tree_mutex());
+  if (!children_populated_) {
+    lock.unlock();
+    {
+      std::unique_lock<std::shared_mutex> populate_lock(device_->tree_mutex());
+      PrepareChildren();
+    }
+    lock.lock();
+  }
   while (*current_index < children_.size()) {
     auto& child = children_[*current_index];
     *current_index = *current_index + 1;
@@ -84,12 +153,32 @@ Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
   return nullptr;
 }
 
+void Entry::MatchChildren(const xe::filesystem::WildcardEngine& engine,
+                          const std::function<void(const Entry&)>& callback) {
+  std::shared_lock<std::shared_mutex> lock(device_->tree_mutex());
+  if (!children_populated_) {
+    lock.unlock();
+    {
+      std::unique_lock<std::shared_mutex> populate_lock(device_->tree_mutex());
+      PrepareChildren();
+    }
+    lock.lock();
+  }
+  bool matches_all = engine.matches_all();
+  for (auto& child : children_) {
+    if (matches_all || engine.Match(child->name())) {
+      callback(*child);
+    }
+  }
+}
+
 Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::unique_lock<std::shared_mutex> lock(device_->tree_mutex());
   if (is_read_only()) {
     return nullptr;
   }
-  if (GetChild(name)) {
+  PrepareChildren();
+  if (FindChild(name)) {
     // Already exists.
     return nullptr;
   }
@@ -104,7 +193,7 @@ Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
 }
 
 bool Entry::Delete(Entry* entry) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::unique_lock<std::shared_mutex> lock(device_->tree_mutex());
   if (is_read_only()) {
     return false;
   }
@@ -116,10 +205,19 @@ bool Entry::Delete(Entry* entry) {
   }
   for (auto it = children_.begin(); it != children_.end(); ++it) {
     if (it->get() == entry) {
+      if (size_t(it - children_.begin()) < indexed_child_count_) {
+        auto index_it = child_index_.find(entry->name());
+        if (index_it != child_index_.end() && index_it->second == entry) {
+          child_index_.erase(index_it);
+        }
+        --indexed_child_count_;
+      }
       children_.erase(it);
       break;
     }
   }
+  // The entry (and anything below it) may be cached by path.
+  device_->InvalidatePathCache();
   Touch();
   return true;
 }
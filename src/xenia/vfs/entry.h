@@ -10,8 +10,10 @@
 #ifndef XENIA_VFS_ENTRY_H_
 #define XENIA_VFS_ENTRY_H_
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/filesystem.h"
@@ -19,6 +21,7 @@
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/utf8.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -76,6 +79,20 @@ enum FileAttributeFlags : uint32_t {
   kFileAttributeEncrypted = 0x4000,
 };
 
+// Case-insensitive hashing and comparison of entry names and paths, folding
+// the same way as xe::utf8::equal_case.
+struct EntryNameHash {
+  size_t operator()(const std::string_view name) const {
+    return xe::utf8::hash_fnv1a_case(name);
+  }
+};
+struct EntryNameEqual {
+  bool operator()(const std::string_view left,
+                  const std::string_view right) const {
+    return xe::utf8::equal_case(left, right);
+  }
+};
+
 class Entry {
  public:
   virtual ~Entry();
@@ -105,6 +122,10 @@ class Entry {
   size_t child_count() const { return children_.size(); }
   Entry* IterateChildren(const xe::filesystem::WildcardEngine& engine,
                          size_t* current_index);
+  // Calls callback with every child whose name matches, in order, holding the
+  // device tree lock so that none of them can be deleted meanwhile.
+  void MatchChildren(const xe::filesystem::WildcardEngine& engine,
+                     const std::function<void(const Entry&)>& callback);
 
   Entry* CreateEntry(const std::string_view name, uint32_t attributes);
   bool Delete(Entry* entry);
@@ -131,8 +152,11 @@ class Entry {
     return nullptr;
   }
   virtual bool DeleteEntryInternal(Entry* entry) { return false; }
+  // Called once, with the device tree lock held exclusively, before the
+  // children of an entry that was created with children_populated_ cleared
+  // are first looked up, enumerated or added to.
+  virtual void PopulateChildrenInternal() {}
 
-  xe::global_critical_region global_critical_region_;
   Device* device_;
   Entry* parent_;
   std::string path_;
@@ -145,6 +169,27 @@ class Entry {
   uint64_t access_timestamp_;
   uint64_t write_timestamp_;
   std::vector<std::unique_ptr<Entry>> children_;
+  bool children_populated_ = true;
+
+ private:
+  // Directories with fewer children than this are searched linearly.
+  static constexpr size_t kChildIndexThreshold = 16;
+
+  // Devices append to children_ directly while populating, so the index only
+  // covers the first indexed_child_count_ children and is brought up to date
+  // on the next lookup. Both require the device tree lock.
+  bool are_children_ready() const {
+    return children_populated_ && (children_.size() < kChildIndexThreshold ||
+                                   indexed_child_count_ == children_.size());
+  }
+  // Populates children_ if needed and updates the index. Requires the device
+  // tree lock held exclusively.
+  void PrepareChildren();
+  Entry* FindChild(const std::string_view name) const;
+
+  std::unordered_map<std::string_view, Entry*, EntryNameHash, EntryNameEqual>
+      child_index_;
+  size_t indexed_child_count_ = 0;
 };
 
 }  // namespace vfs
@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/io_worker_pool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace vfs {
+
+IOWorkerPool::IOWorkerPool(const std::string_view name, size_t thread_count,
+                           size_t queue_depth)
+    : queue_depth_(std::max(queue_depth, size_t(1))) {
+  for (size_t i = 0; i < thread_count; ++i) {
+    auto thread =
+        threading::Thread::Create({}, [this]() { WorkerThreadMain(); });
+    assert_not_null(thread);
+    thread->set_name(std::string(name));
+    threads_.push_back(std::move(thread));
+  }
+}
+
+IOWorkerPool::~IOWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  request_cond_.notify_all();
+  for (auto& thread : threads_) {
+    threading::Wait(thread.get(), false);
+  }
+  threads_.clear();
+}
+
+bool IOWorkerPool::Submit(std::function<void()> request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (threads_.empty() || shutting_down_ || pending_count_ >= queue_depth_) {
+      ++rejected_count_;
+      return false;
+    }
+    requests_.push_back(std::move(request));
+    ++pending_count_;
+    peak_pending_count_ = std::max(peak_pending_count_, pending_count_);
+  }
+  request_cond_.notify_one();
+  return true;
+}
+
+void IOWorkerPool::WaitIdle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cond_.wait(lock, [this] { return pending_count_ == 0; });
+}
+
+uint64_t IOWorkerPool::completed_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return completed_count_;
+}
+
+uint64_t IOWorkerPool::rejected_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rejected_count_;
+}
+
+size_t IOWorkerPool::peak_pending_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_pending_count_;
+}
+
+void IOWorkerPool::WorkerThreadMain() {
+  while (true) {
+    std::function<void()> request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      request_cond_.wait(
+          lock, [this] { return shutting_down_ || !requests_.empty(); });
+      // Drain the queue before exiting so no completion is ever lost.
+      if (requests_.empty()) {
+        return;
+      }
+      request = std::move(requests_.front());
+      requests_.pop_front();
+    }
+
+    request();
+
+    bool idle;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++completed_count_;
+      idle = --pending_count_ == 0;
+    }
+    if (idle) {
+      idle_cond_.notify_all();
+    }
+  }
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_IO_WORKER_POOL_H_
+#define XENIA_VFS_IO_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace vfs {
+
+// A pool of host threads performing file I/O on behalf of the caller, so that
+// overlapped requests don't block the issuing thread on host disk latency and
+// independent requests can be in flight at the same time.
+class IOWorkerPool {
+ public:
+  // queue_depth is the maximum number of requests queued or running at once.
+  IOWorkerPool(const std::string_view name, size_t thread_count,
+               size_t queue_depth);
+  ~IOWorkerPool();
+
+  size_t thread_count() const { return threads_.size(); }
+  size_t queue_depth() const { return queue_depth_; }
+
+  // Queues a request to run on one of the worker threads. Returns false
+  // without queuing if queue_depth requests are already pending, in which case
+  // the caller should perform the request itself.
+  bool Submit(std::function<void()> request);
+
+  // Blocks until all submitted requests have completed.
+  void WaitIdle();
+
+  uint64_t completed_count() const;
+  uint64_t rejected_count() const;
+  size_t peak_pending_count() const;
+
+ private:
+  void WorkerThreadMain();
+
+  size_t queue_depth_;
+  std::vector<std::unique_ptr<threading::Thread>> threads_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable request_cond_;
+  std::condition_variable idle_cond_;
+  std::deque<std::function<void()>> requests_;
+  // Queued and running requests.
+  size_t pending_count_ = 0;
+  size_t peak_pending_count_ = 0;
+  uint64_t completed_count_ = 0;
+  uint64_t rejected_count_ = 0;
+  bool shutting_down_ = false;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_IO_WORKER_POOL_H_
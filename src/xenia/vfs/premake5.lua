@@ -7,12 +7,13 @@ project("xenia-vfs")
   kind("StaticLib")
   language("C++")
   links({
+    "snappy",
     "xenia-base",
   })
   defines({
   })
   recursive_platform_files()
-  removefiles({"vfs_dump.cc"})
+  removefiles({"vfs_bench.cc", "vfs_dump.cc"})
 
 project("xenia-vfs-dump")
   uuid("2EF270C7-41A8-4D0E-ACC5-59693A9CCE32")
@@ -32,5 +33,25 @@ project("xenia-vfs-dump")
   resincludedirs({
     project_root,
   })
+
+project("xenia-vfs-bench")
+  uuid("8f3c1b52-6a47-4e0d-9c2b-3d71e5a9f604")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "xenia-base",
+    "xenia-vfs",
+  })
+  defines({})
+
+  files({
+    "vfs_bench.cc",
+    project_root.."/src/xenia/base/console_app_main_"..platform_suffix..".cc",
+  })
+  resincludedirs({
+    project_root,
+  })
+
 include("testing")
 
@@ -0,0 +1,252 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/read_ahead_buffer.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <vector>
+
+namespace xe {
+namespace vfs {
+
+ReadAheadPool::ReadAheadPool(IOWorkerPool* io_worker_pool,
+                             size_t memory_budget, size_t max_window)
+    : io_worker_pool_(io_worker_pool),
+      memory_budget_(memory_budget),
+      max_window_(std::max(max_window, size_t(1))) {}
+
+ReadAheadPool::Statistics ReadAheadPool::statistics() const {
+  Statistics statistics;
+  statistics.read_count = read_count_;
+  statistics.hit_count = hit_count_;
+  statistics.bytes_prefetched = bytes_prefetched_;
+  statistics.bytes_served = bytes_served_;
+  statistics.budget_rejections = budget_rejections_;
+  statistics.queue_rejections = queue_rejections_;
+  statistics.peak_bytes_in_use = peak_bytes_in_use_;
+  return statistics;
+}
+
+bool ReadAheadPool::Reserve(size_t length) {
+  size_t in_use = bytes_in_use_.load(std::memory_order_relaxed);
+  do {
+    if (in_use + length > memory_budget_) {
+      ++budget_rejections_;
+      return false;
+    }
+  } while (!bytes_in_use_.compare_exchange_weak(in_use, in_use + length));
+  size_t peak = peak_bytes_in_use_.load(std::memory_order_relaxed);
+  while (in_use + length > peak &&
+         !peak_bytes_in_use_.compare_exchange_weak(peak, in_use + length)) {
+  }
+  return true;
+}
+
+void ReadAheadPool::Release(size_t length) { bytes_in_use_ -= length; }
+
+struct ReadAheadBuffer::Chunk {
+  enum class State {
+    kQueued,
+    kReading,
+    kReady,
+    // Dropped before a worker got to it.
+    kCancelled,
+  };
+
+  Chunk(ReadAheadPool* pool, size_t offset, size_t length)
+      : pool(pool), offset(offset), data(length) {}
+  ~Chunk() { pool->Release(data.size()); }
+
+  size_t end() const { return offset + data.size(); }
+
+  // Claims a queued chunk for reading, returning false if it was already
+  // claimed or cancelled.
+  bool Claim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (state != State::kQueued) {
+      return false;
+    }
+    state = State::kReading;
+    return true;
+  }
+
+  // Reads a claimed chunk.
+  void Fill(File* file) {
+    size_t bytes_read = 0;
+    if (XFAILED(file->ReadSync(data.data(), data.size(), offset,
+                               &bytes_read))) {
+      bytes_read = 0;
+    }
+    pool->bytes_prefetched_ += bytes_read;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      valid_length = bytes_read;
+      state = State::kReady;
+    }
+    ready_cond.notify_all();
+  }
+
+  ReadAheadPool* pool;
+  size_t offset;
+  std::vector<uint8_t> data;
+
+  std::mutex mutex;
+  std::condition_variable ready_cond;
+  State state = State::kQueued;
+  // Bytes actually read, short at the end of the file or on failure.
+  size_t valid_length = 0;
+};
+
+ReadAheadBuffer::ReadAheadBuffer(ReadAheadPool* pool, File* file,
+                                 size_t file_size)
+    : pool_(pool), file_(file), file_size_(file_size) {}
+
+ReadAheadBuffer::~ReadAheadBuffer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DropChunks();
+}
+
+X_STATUS ReadAheadBuffer::Read(void* buffer, size_t buffer_length,
+                               size_t byte_offset, size_t* out_bytes_read) {
+  std::deque<std::shared_ptr<Chunk>> chunks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (byte_offset == next_offset_) {
+      ++sequential_count_;
+    } else {
+      sequential_count_ = 0;
+      window_ = kMinWindow;
+      DropChunks();
+    }
+    next_offset_ = byte_offset + buffer_length;
+    chunks = chunks_;
+  }
+  ++pool_->read_count_;
+
+  // Copy whatever is prefetched, stopping at the first gap.
+  auto dest = static_cast<uint8_t*>(buffer);
+  size_t served = 0;
+  for (auto& chunk : chunks) {
+    size_t offset = byte_offset + served;
+    if (served == buffer_length || offset < chunk->offset) {
+      break;
+    }
+    if (offset >= chunk->end()) {
+      continue;
+    }
+    // Never wait for a request that may be queued behind this very read on
+    // the same worker threads, read it here instead.
+    if (chunk->Claim()) {
+      chunk->Fill(file_);
+    }
+    std::unique_lock<std::mutex> chunk_lock(chunk->mutex);
+    if (chunk->state == Chunk::State::kCancelled) {
+      break;
+    }
+    chunk->ready_cond.wait(
+        chunk_lock, [&] { return chunk->state == Chunk::State::kReady; });
+    size_t valid_end = chunk->offset + chunk->valid_length;
+    if (offset >= valid_end) {
+      break;
+    }
+    size_t length = std::min(buffer_length - served, valid_end - offset);
+    std::memcpy(dest + served, chunk->data.data() + (offset - chunk->offset),
+                length);
+    served += length;
+    if (valid_end < chunk->end()) {
+      // Short read, nothing follows.
+      break;
+    }
+  }
+  pool_->bytes_served_ += served;
+
+  X_STATUS result = X_STATUS_SUCCESS;
+  size_t bytes_read = 0;
+  if (served < buffer_length) {
+    result = file_->ReadSync(dest + served, buffer_length - served,
+                             byte_offset + served, &bytes_read);
+    if (XFAILED(result) && served) {
+      // Report what was copied, as a short read.
+      result = X_STATUS_SUCCESS;
+      bytes_read = 0;
+    }
+  } else {
+    ++pool_->hit_count_;
+  }
+  *out_bytes_read = served + bytes_read;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sequential_count_ >= kSequentialThreshold) {
+      ScheduleReadAhead(buffer_length);
+    }
+  }
+  return result;
+}
+
+void ReadAheadBuffer::ReleaseChunk(Chunk* chunk) {
+  std::unique_lock<std::mutex> chunk_lock(chunk->mutex);
+  if (chunk->state == Chunk::State::kQueued) {
+    chunk->state = Chunk::State::kCancelled;
+  } else {
+    // The file may be closed once it's forgotten, so a read already started
+    // must finish first.
+    chunk->ready_cond.wait(chunk_lock, [&] {
+      return chunk->state != Chunk::State::kReading;
+    });
+  }
+}
+
+void ReadAheadBuffer::DropChunks() {
+  for (auto& chunk : chunks_) {
+    ReleaseChunk(chunk.get());
+  }
+  chunks_.clear();
+}
+
+void ReadAheadBuffer::ScheduleReadAhead(size_t read_length) {
+  // Forget what has been consumed.
+  while (!chunks_.empty() && chunks_.front()->end() <= next_offset_) {
+    ReleaseChunk(chunks_.front().get());
+    chunks_.pop_front();
+  }
+
+  // Keep at most two windows in flight, starting the next one once less than
+  // a window is left ahead of the reader.
+  window_ = std::min(std::max(window_, read_length), pool_->max_window());
+  size_t offset =
+      chunks_.empty() ? next_offset_ : std::max(chunks_.back()->end(),
+                                                next_offset_);
+  if (chunks_.size() >= 2 || offset - next_offset_ >= window_ ||
+      offset >= file_size_) {
+    return;
+  }
+  size_t length = std::min(window_, file_size_ - offset);
+  if (!pool_->Reserve(length)) {
+    return;
+  }
+  auto chunk = std::make_shared<Chunk>(pool_, offset, length);
+  auto file = file_;
+  bool submitted = pool_->io_worker_pool()->Submit([chunk, file]() {
+    if (chunk->Claim()) {
+      chunk->Fill(file);
+    }
+  });
+  if (!submitted) {
+    ++pool_->queue_rejections_;
+    return;
+  }
+  chunks_.push_back(std::move(chunk));
+  window_ = std::min(window_ * 2, pool_->max_window());
+}
+
+}  // namespace vfs
+}  // namespace xe
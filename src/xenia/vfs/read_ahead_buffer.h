@@ -0,0 +1,114 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_READ_AHEAD_BUFFER_H_
+#define XENIA_VFS_READ_AHEAD_BUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "xenia/vfs/file.h"
+#include "xenia/vfs/io_worker_pool.h"
+
+namespace xe {
+namespace vfs {
+
+// Memory budget, worker threads and statistics shared by the read-ahead
+// buffers of all open files.
+class ReadAheadPool {
+ public:
+  struct Statistics {
+    uint64_t read_count;
+    // Reads served entirely from prefetched data.
+    uint64_t hit_count;
+    uint64_t bytes_prefetched;
+    uint64_t bytes_served;
+    // Prefetches skipped because the memory budget was used up.
+    uint64_t budget_rejections;
+    // Prefetches skipped because the I/O queue was full.
+    uint64_t queue_rejections;
+    size_t peak_bytes_in_use;
+  };
+
+  // max_window is the largest single prefetch, memory_budget the most memory
+  // held by all buffers at once.
+  ReadAheadPool(IOWorkerPool* io_worker_pool, size_t memory_budget,
+                size_t max_window);
+
+  IOWorkerPool* io_worker_pool() const { return io_worker_pool_; }
+  size_t max_window() const { return max_window_; }
+
+  Statistics statistics() const;
+
+ private:
+  friend class ReadAheadBuffer;
+
+  bool Reserve(size_t length);
+  void Release(size_t length);
+
+  IOWorkerPool* io_worker_pool_;
+  size_t memory_budget_;
+  size_t max_window_;
+
+  std::atomic<size_t> bytes_in_use_ = 0;
+  std::atomic<size_t> peak_bytes_in_use_ = 0;
+  std::atomic<uint64_t> read_count_ = 0;
+  std::atomic<uint64_t> hit_count_ = 0;
+  std::atomic<uint64_t> bytes_prefetched_ = 0;
+  std::atomic<uint64_t> bytes_served_ = 0;
+  std::atomic<uint64_t> budget_rejections_ = 0;
+  std::atomic<uint64_t> queue_rejections_ = 0;
+};
+
+// Wraps reads of a single open file, detecting sequential access and reading
+// the data that follows it ahead of time on the I/O worker threads. Reads that
+// do not continue where the previous one ended go straight to the file and
+// drop anything prefetched. Only meant for files that are not written to
+// while open.
+class ReadAheadBuffer {
+ public:
+  ReadAheadBuffer(ReadAheadPool* pool, File* file, size_t file_size);
+  // Waits for any prefetch of the file still running.
+  ~ReadAheadBuffer();
+
+  // Same contract as File::ReadSync.
+  X_STATUS Read(void* buffer, size_t buffer_length, size_t byte_offset,
+                size_t* out_bytes_read);
+
+ private:
+  struct Chunk;
+
+  // Sequential reads needed before prefetching starts.
+  static constexpr uint32_t kSequentialThreshold = 2;
+  static constexpr size_t kMinWindow = 64 * 1024;
+
+  // All require mutex_.
+  void ReleaseChunk(Chunk* chunk);
+  void DropChunks();
+  void ScheduleReadAhead(size_t read_length);
+
+  ReadAheadPool* pool_;
+  File* file_;
+  size_t file_size_;
+
+  std::mutex mutex_;
+  // Prefetched or in flight, in file order.
+  std::deque<std::shared_ptr<Chunk>> chunks_;
+  size_t next_offset_ = SIZE_MAX;
+  uint32_t sequential_count_ = 0;
+  size_t window_ = kMinWindow;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_READ_AHEAD_BUFFER_H_
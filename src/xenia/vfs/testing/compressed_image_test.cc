@@ -0,0 +1,305 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/vfs/compressed_image.h"
+#include "xenia/vfs/devices/disc_image_device.h"
+#include "xenia/vfs/file.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+constexpr size_t kSectorSize = 2048;
+
+std::filesystem::path ImagePath(const char* name) {
+  return std::filesystem::temp_directory_path() /
+         fmt::format("xenia_{}_{}", name, std::random_device()());
+}
+
+void WriteImage(const std::filesystem::path& path,
+                const std::vector<uint8_t>& data) {
+  auto file = xe::filesystem::OpenFile(path, "wb");
+  REQUIRE(file);
+  REQUIRE(fwrite(data.data(), 1, data.size(), file) == data.size());
+  fclose(file);
+}
+
+// Half runs of repeated bytes, half noise, like padded game data.
+void FillPattern(uint8_t* data, size_t size, uint32_t seed) {
+  std::mt19937 rng(seed);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = (i / 4096) & 1 ? uint8_t(i / 4096) : uint8_t(rng());
+  }
+}
+
+// Appends a GDFX directory entry, returning its ordinal.
+uint16_t AddDirectoryEntry(std::vector<uint8_t>& table, const std::string& name,
+                           uint32_t sector, uint32_t length,
+                           uint8_t attributes) {
+  size_t offset = table.size();
+  table.resize(xe::round_up(offset + 14 + name.size(), size_t(4)));
+  auto p = table.data() + offset;
+  xe::store<uint32_t>(p + 4, sector);
+  xe::store<uint32_t>(p + 8, length);
+  p[12] = attributes;
+  p[13] = uint8_t(name.size());
+  std::memcpy(p + 14, name.data(), name.size());
+  return uint16_t(offset / 4);
+}
+
+void LinkRight(std::vector<uint8_t>& table, uint16_t from, uint16_t to) {
+  xe::store<uint16_t>(table.data() + from * 4 + 2, to);
+}
+
+// A GDFX image holding \a.bin, \dir\b.bin and the sizes in file_sizes.
+std::vector<uint8_t> BuildDiscImage(const size_t file_sizes[2]) {
+  constexpr uint32_t kRootSector = 34;
+  constexpr uint32_t kDirSector = 35;
+  constexpr uint32_t kDataSector = 40;
+  uint32_t b_sector =
+      kDataSector +
+      uint32_t(xe::round_up(file_sizes[0], kSectorSize) / kSectorSize);
+  size_t size = b_sector * kSectorSize + file_sizes[1];
+
+  std::vector<uint8_t> image(size);
+  size_t data_offset = kDataSector * kSectorSize;
+  FillPattern(image.data() + data_offset, size - data_offset, 1);
+
+  std::vector<uint8_t> dir;
+  AddDirectoryEntry(dir, "b.bin", b_sector, uint32_t(file_sizes[1]), 0);
+  std::vector<uint8_t> root;
+  auto a = AddDirectoryEntry(root, "a.bin", kDataSector,
+                             uint32_t(file_sizes[0]), 0);
+  auto d = AddDirectoryEntry(root, "dir", kDirSector, uint32_t(dir.size()),
+                             uint8_t(kFileAttributeDirectory));
+  LinkRight(root, a, d);
+
+  auto header = image.data() + 32 * kSectorSize;
+  std::memcpy(header, "MICROSOFT*XBOX*MEDIA", 20);
+  xe::store<uint32_t>(header + 20, kRootSector);
+  xe::store<uint32_t>(header + 24, uint32_t(root.size()));
+  std::memcpy(image.data() + kRootSector * kSectorSize, root.data(),
+              root.size());
+  std::memcpy(image.data() + kDirSector * kSectorSize, dir.data(),
+              dir.size());
+  return image;
+}
+
+std::vector<uint8_t> ReadGuestFile(Device& device, const char* path) {
+  auto entry = device.ResolvePath(path);
+  REQUIRE(entry);
+  File* file = nullptr;
+  REQUIRE(entry->Open(xe::filesystem::FileAccess::kFileReadData, &file) ==
+          X_STATUS_SUCCESS);
+  std::vector<uint8_t> data(entry->size());
+  size_t bytes_read = 0;
+  REQUIRE(file->ReadSync(data.data(), data.size(), 0, &bytes_read) ==
+          X_STATUS_SUCCESS);
+  REQUIRE(bytes_read == data.size());
+  file->Destroy();
+  return data;
+}
+
+TEST_CASE("Compressed image reads any range", "[vfs]") {
+  std::vector<uint8_t> raw(1024 * 1024 + 777);
+  FillPattern(raw.data(), raw.size(), 2);
+  auto raw_path = ImagePath("raw");
+  auto compressed_path = ImagePath("compressed");
+  WriteImage(raw_path, raw);
+  REQUIRE(CompressedImage::Compress(raw_path, compressed_path, 16384, 4));
+  REQUIRE(std::filesystem::file_size(compressed_path) <
+          std::filesystem::file_size(raw_path));
+
+  {
+    // A cache too small for the image, so chunks get evicted.
+    auto image = CompressedImage::Open(compressed_path, 256 * 1024, 4);
+    REQUIRE(image);
+    REQUIRE(image->size() == raw.size());
+    REQUIRE(image->chunk_count() == 65);
+
+    std::mt19937 rng(3);
+    std::vector<uint8_t> data(200000);
+    for (int i = 0; i < 500; ++i) {
+      size_t offset = rng() % raw.size();
+      size_t length = std::min(size_t(rng() % data.size()),
+                               raw.size() - offset);
+      REQUIRE(image->Read(offset, length, data.data()));
+      REQUIRE(!std::memcmp(data.data(), raw.data() + offset, length));
+    }
+    REQUIRE(image->Read(raw.size(), 0, data.data()));
+    REQUIRE_FALSE(image->Read(raw.size() - 1, 2, data.data()));
+
+    auto statistics = image->statistics();
+    REQUIRE(statistics.cache_hits > 0);
+    REQUIRE(statistics.cache_misses > 0);
+    REQUIRE(statistics.bytes_decompressed > 0);
+  }
+
+  SECTION("Damaged index") {
+    std::filesystem::resize_file(compressed_path,
+                                 std::filesystem::file_size(compressed_path) -
+                                     8);
+    REQUIRE_FALSE(CompressedImage::Open(compressed_path, 256 * 1024, 4));
+  }
+
+  SECTION("Chunk count larger than the file") {
+    // An index of 2^61 + 1 entries whose size wraps around to 8 bytes.
+    CompressedImage::Header header;
+    auto file = xe::filesystem::OpenFile(compressed_path, "r+b");
+    REQUIRE(file);
+    REQUIRE(fread(&header, sizeof(header), 1, file) == 1);
+    header.chunk_size = 1;
+    header.uncompressed_size = uint64_t(1) << 61;
+    REQUIRE(!fseek(file, 0, SEEK_SET));
+    REQUIRE(fwrite(&header, sizeof(header), 1, file) == 1);
+    fclose(file);
+    REQUIRE_FALSE(CompressedImage::Open(compressed_path, 256 * 1024, 4));
+  }
+
+  std::filesystem::remove(raw_path);
+  std::filesystem::remove(compressed_path);
+}
+
+TEST_CASE("Compressed disc images read like raw ones", "[vfs]") {
+  const size_t file_sizes[2] = {300000, 70001};
+  auto raw_path = ImagePath("disc.iso");
+  auto compressed_path = ImagePath("disc.xcz");
+  WriteImage(raw_path, BuildDiscImage(file_sizes));
+  REQUIRE(CompressedImage::Compress(raw_path, compressed_path,
+                                    CompressedImage::kDefaultChunkSize, 2));
+  {
+    DiscImageDevice raw("\\Device\\Raw", raw_path);
+    REQUIRE(raw.Initialize());
+    DiscImageDevice compressed("\\Device\\Compressed", compressed_path);
+    REQUIRE(compressed.Initialize());
+    REQUIRE(compressed.total_allocation_units() ==
+            raw.total_allocation_units());
+
+    for (auto path : {"a.bin", "dir\\b.bin"}) {
+      auto raw_data = ReadGuestFile(raw, path);
+      REQUIRE(ReadGuestFile(compressed, path) == raw_data);
+    }
+    REQUIRE(raw.ResolvePath("a.bin")->can_map());
+    REQUIRE_FALSE(compressed.ResolvePath("a.bin")->can_map());
+
+    // Reads in the middle of a file.
+    File* file = nullptr;
+    REQUIRE(compressed.ResolvePath("dir\\b.bin")
+                ->Open(xe::filesystem::FileAccess::kFileReadData, &file) ==
+            X_STATUS_SUCCESS);
+    auto expected = ReadGuestFile(raw, "dir\\b.bin");
+    std::vector<uint8_t> data(1000);
+    size_t bytes_read = 0;
+    REQUIRE(file->ReadSync(data.data(), data.size(), 69500, &bytes_read) ==
+            X_STATUS_SUCCESS);
+    REQUIRE(bytes_read == 501);
+    REQUIRE(!std::memcmp(data.data(), expected.data() + 69500, 501));
+    REQUIRE(file->ReadSync(data.data(), data.size(), 70001, &bytes_read) ==
+            X_STATUS_END_OF_FILE);
+    file->Destroy();
+  }
+  std::filesystem::remove(raw_path);
+  std::filesystem::remove(compressed_path);
+}
+
+TEST_CASE("Compressed image benchmark", "[vfs][.benchmark]") {
+  constexpr size_t kImageSize = 256 * 1024 * 1024;
+  constexpr size_t kReadSize = 32 * 1024;
+  constexpr size_t kReadCount = 20000;
+
+  std::vector<uint8_t> raw(kImageSize);
+  FillPattern(raw.data(), raw.size(), 4);
+  auto raw_path = ImagePath("bench_raw");
+  auto compressed_path = ImagePath("bench_compressed");
+  WriteImage(raw_path, raw);
+  raw.clear();
+
+  auto start = std::chrono::steady_clock::now();
+  REQUIRE(CompressedImage::Compress(raw_path, compressed_path,
+                                    CompressedImage::kDefaultChunkSize, 4));
+  auto compress = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+  // Mostly nearby reads with the occasional seek, as when streaming assets.
+  std::vector<size_t> offsets(kReadCount);
+  std::mt19937 rng(5);
+  size_t offset = 0;
+  for (auto& read_offset : offsets) {
+    offset = rng() % 8 ? offset + kReadSize : rng() % kImageSize;
+    offset %= kImageSize - kReadSize;
+    read_offset = offset;
+  }
+  std::vector<uint8_t> data(kReadSize);
+
+  auto mmap = MappedMemory::Open(raw_path, MappedMemory::Mode::kRead);
+  REQUIRE(mmap);
+  start = std::chrono::steady_clock::now();
+  for (auto read_offset : offsets) {
+    std::memcpy(data.data(), mmap->data() + read_offset, kReadSize);
+  }
+  auto mapped = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  mmap.reset();
+
+  auto image = CompressedImage::Open(compressed_path, 32 * 1024 * 1024, 4);
+  REQUIRE(image);
+  start = std::chrono::steady_clock::now();
+  for (auto read_offset : offsets) {
+    image->Read(read_offset, kReadSize, data.data());
+  }
+  auto compressed = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+  // One read of 4 MiB at a time decompresses 64 chunks in parallel.
+  std::vector<uint8_t> large(4 * 1024 * 1024);
+  auto cold = CompressedImage::Open(compressed_path, 8 * 1024 * 1024, 1);
+  auto parallel = CompressedImage::Open(compressed_path, 8 * 1024 * 1024, 4);
+  double large_read[2];
+  for (int i = 0; i < 2; ++i) {
+    auto& target = i ? parallel : cold;
+    start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < kImageSize; offset += large.size()) {
+      target->Read(offset, large.size(), large.data());
+    }
+    large_read[i] = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  }
+
+  auto statistics = image->statistics();
+  WARN("256 MiB image compressed to "
+       << std::filesystem::file_size(compressed_path) / (1024 * 1024)
+       << " MiB in " << compress << "ms; " << kReadCount
+       << " 32 KiB reads: mapped " << mapped << "ms, compressed "
+       << compressed << "ms (" << statistics.cache_hits << " hits, "
+       << statistics.cache_misses << " misses); 4 MiB reads: "
+       << large_read[0] << "ms on 1 thread, " << large_read[1]
+       << "ms on 4");
+
+  std::filesystem::remove(raw_path);
+  std::filesystem::remove(compressed_path);
+}
+
+}  // namespace xe::vfs::test
@@ -0,0 +1,162 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/filesystem_wildcard.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/devices/host_path_entry.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+std::filesystem::path HostTreePath(const char* name) {
+  return std::filesystem::temp_directory_path() /
+         fmt::format("xenia_{}_{}", name, std::random_device()());
+}
+
+void WriteHostFile(const std::filesystem::path& path) {
+  std::filesystem::create_directories(path.parent_path());
+  auto file = xe::filesystem::OpenFile(path, "wb");
+  REQUIRE(file);
+  fclose(file);
+}
+
+// Counts the entries created so far, without populating anything.
+size_t CountResidentEntries(const Entry* entry) {
+  size_t count = 1;
+  for (auto& child : entry->children()) {
+    count += CountResidentEntries(child.get());
+  }
+  return count;
+}
+
+TEST_CASE("Host path device lists directories on first use", "[vfs]") {
+  auto path = HostTreePath("host_lazy");
+  WriteHostFile(path / "top.bin");
+  WriteHostFile(path / "a" / "b" / "deep.bin");
+  WriteHostFile(path / "c" / "other.bin");
+  std::filesystem::create_directories(path / "d");
+  {
+    HostPathDevice device("\\Device\\Host", path, false);
+    REQUIRE(device.Initialize());
+    auto root = device.ResolvePath("");
+    REQUIRE(root);
+    REQUIRE(root->child_count() == 0);
+
+    auto deep = device.ResolvePath("A\\b\\DEEP.bin");
+    REQUIRE(deep);
+    REQUIRE(deep->name() == "deep.bin");
+    REQUIRE(root->child_count() == 4);
+    auto c = root->GetChild("c");
+    REQUIRE(c);
+    REQUIRE(c->child_count() == 0);
+
+    // Files added on the host before a directory is first visited show up.
+    WriteHostFile(path / "c" / "later.bin");
+    xe::filesystem::WildcardEngine engine;
+    engine.SetRule("*");
+    size_t index = 0;
+    size_t found = 0;
+    while (c->IterateChildren(engine, &index)) {
+      ++found;
+    }
+    REQUIRE(found == 2);
+
+    // Creating an entry lists the directory first, so existing files collide.
+    WriteHostFile(path / "d" / "new" / "x.bin");
+    auto d = root->GetChild("d");
+    REQUIRE(d);
+    REQUIRE(d->CreateEntry("NEW", kFileAttributeDirectory) == nullptr);
+    REQUIRE(device.ResolvePath("d\\new\\x.bin"));
+  }
+  std::filesystem::remove_all(path);
+}
+
+TEST_CASE("Host path devices can be detached and mounted again", "[vfs]") {
+  auto path = HostTreePath("host_detach");
+  WriteHostFile(path / "save" / "data.bin");
+  {
+    VirtualFileSystem vfs;
+    auto device =
+        std::make_unique<HostPathDevice>("\\Device\\Host", path, false);
+    REQUIRE(device->Initialize());
+    auto device_ptr = device.get();
+    vfs.RegisterDevice(std::move(device));
+    auto entry = vfs.ResolvePath("\\Device\\Host\\save\\data.bin");
+    REQUIRE(entry);
+
+    // Reading leaves the listing valid, writing does not.
+    File* file = nullptr;
+    REQUIRE(entry->Open(FileAccess::kFileReadData, &file) == X_STATUS_SUCCESS);
+    file->Destroy();
+    REQUIRE_FALSE(device_ptr->files_written());
+
+    auto detached = vfs.DetachDevice("\\Device\\Host");
+    REQUIRE(detached.get() == device_ptr);
+    REQUIRE(vfs.DetachDevice("\\Device\\Host") == nullptr);
+    REQUIRE(vfs.ResolvePath("\\Device\\Host\\save\\data.bin") == nullptr);
+
+    // The entries listed before are reused rather than listed again.
+    vfs.RegisterDevice(std::move(detached));
+    REQUIRE(vfs.ResolvePath("\\Device\\Host\\save\\data.bin") == entry);
+
+    REQUIRE(entry->Open(FileAccess::kFileWriteData, &file) ==
+            X_STATUS_SUCCESS);
+    file->Destroy();
+    REQUIRE(device_ptr->files_written());
+  }
+  std::filesystem::remove_all(path);
+}
+
+TEST_CASE("Host path device mount benchmark", "[vfs][.benchmark]") {
+  constexpr size_t kDirCount = 50;
+  constexpr size_t kFileCount = 400;
+
+  auto path = HostTreePath("host_mount");
+  for (size_t i = 0; i < kDirCount; ++i) {
+    for (size_t j = 0; j < kFileCount; ++j) {
+      WriteHostFile(path / fmt::format("dir{:03}", i) /
+                    fmt::format("file{:04}.bin", j));
+    }
+  }
+  {
+    auto start = std::chrono::steady_clock::now();
+    HostPathDevice device("\\Device\\Host", path, true);
+    REQUIRE(device.Initialize());
+    auto mount = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    auto root = device.ResolvePath("");
+    auto resident = CountResidentEntries(root);
+
+    start = std::chrono::steady_clock::now();
+    REQUIRE(device.ResolvePath("dir025\\file0200.bin"));
+    auto first_open = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+    WARN("Mounting " << kDirCount * (kFileCount + 1) << " host files took "
+                     << mount << "ms with " << resident
+                     << " entries resident (" << sizeof(HostPathEntry)
+                     << " bytes each plus paths), first lookup " << first_open
+                     << "ms");
+  }
+  std::filesystem::remove_all(path);
+}
+
+}  // namespace xe::vfs::test
@@ -0,0 +1,209 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/vfs/file.h"
+#include "xenia/vfs/io_worker_pool.h"
+#include "xenia/vfs/read_ahead_buffer.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+// An in-memory file that takes latency to serve every read, like a cold disk.
+class MemoryFile : public File {
+ public:
+  MemoryFile(size_t size, std::chrono::microseconds latency)
+      : File(xe::filesystem::FileAccess::kFileReadData, nullptr),
+        data_(size),
+        latency_(latency) {
+    for (size_t i = 0; i < size; ++i) {
+      data_[i] = uint8_t(i * 7 + (i >> 12));
+    }
+  }
+
+  const std::vector<uint8_t>& data() const { return data_; }
+  size_t read_count() const { return read_count_; }
+
+  void Destroy() override {}
+
+  X_STATUS ReadSync(void* buffer, size_t buffer_length, size_t byte_offset,
+                    size_t* out_bytes_read) override {
+    ++read_count_;
+    if (latency_.count()) {
+      std::this_thread::sleep_for(latency_);
+    }
+    if (byte_offset >= data_.size()) {
+      *out_bytes_read = 0;
+      return X_STATUS_END_OF_FILE;
+    }
+    size_t length = std::min(buffer_length, data_.size() - byte_offset);
+    std::memcpy(buffer, data_.data() + byte_offset, length);
+    *out_bytes_read = length;
+    return X_STATUS_SUCCESS;
+  }
+  X_STATUS WriteSync(const void* buffer, size_t buffer_length,
+                     size_t byte_offset, size_t* out_bytes_written) override {
+    return X_STATUS_ACCESS_DENIED;
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+  std::chrono::microseconds latency_;
+  std::atomic<size_t> read_count_ = 0;
+};
+
+bool ReadMatches(ReadAheadBuffer& buffer, const MemoryFile& file,
+                 size_t offset, size_t length) {
+  std::vector<uint8_t> data(length);
+  size_t bytes_read = 0;
+  if (XFAILED(buffer.Read(data.data(), length, offset, &bytes_read))) {
+    return false;
+  }
+  size_t expected = std::min(length, file.data().size() - offset);
+  return bytes_read == expected &&
+         !std::memcmp(data.data(), file.data().data() + offset, expected);
+}
+
+TEST_CASE("Read-ahead serves sequential reads", "[vfs]") {
+  IOWorkerPool io_worker_pool("Read-ahead test", 2, 8);
+  ReadAheadPool pool(&io_worker_pool, 16 * 1024 * 1024, 256 * 1024);
+  MemoryFile file(1024 * 1024 + 123, std::chrono::microseconds(0));
+
+  SECTION("Sequential") {
+    ReadAheadBuffer buffer(&pool, &file, file.data().size());
+    for (size_t offset = 0; offset < file.data().size(); offset += 3000) {
+      REQUIRE(ReadMatches(buffer, file, offset, 3000));
+    }
+    io_worker_pool.WaitIdle();
+    auto statistics = pool.statistics();
+    REQUIRE(statistics.read_count == 350);
+    REQUIRE(statistics.hit_count > 300);
+    // Prefetched windows replace most of the guest reads.
+    REQUIRE(file.read_count() < 50);
+  }
+
+  SECTION("Random") {
+    ReadAheadBuffer buffer(&pool, &file, file.data().size());
+    std::mt19937 rng(1);
+    for (int i = 0; i < 200; ++i) {
+      REQUIRE(ReadMatches(buffer, file, rng() % file.data().size(), 4096));
+    }
+    io_worker_pool.WaitIdle();
+    REQUIRE(pool.statistics().hit_count == 0);
+    REQUIRE(file.read_count() == 200);
+  }
+
+  SECTION("Past the end") {
+    ReadAheadBuffer buffer(&pool, &file, file.data().size());
+    size_t offset = 0;
+    for (; offset + 65536 < file.data().size(); offset += 65536) {
+      REQUIRE(ReadMatches(buffer, file, offset, 65536));
+    }
+    REQUIRE(ReadMatches(buffer, file, offset, 65536));
+    std::vector<uint8_t> data(16);
+    size_t bytes_read = 1;
+    REQUIRE(buffer.Read(data.data(), data.size(), file.data().size(),
+                        &bytes_read) == X_STATUS_END_OF_FILE);
+    REQUIRE(bytes_read == 0);
+  }
+}
+
+TEST_CASE("Read-ahead stays within its memory budget", "[vfs]") {
+  IOWorkerPool io_worker_pool("Read-ahead test", 2, 8);
+  ReadAheadPool pool(&io_worker_pool, 64 * 1024, 64 * 1024);
+  MemoryFile file(1024 * 1024, std::chrono::microseconds(100));
+  {
+    ReadAheadBuffer first(&pool, &file, file.data().size());
+    ReadAheadBuffer second(&pool, &file, file.data().size());
+    for (size_t offset = 0; offset < 512 * 1024; offset += 16384) {
+      REQUIRE(ReadMatches(first, file, offset, 16384));
+      REQUIRE(ReadMatches(second, file, offset, 16384));
+    }
+  }
+  io_worker_pool.WaitIdle();
+  auto statistics = pool.statistics();
+  REQUIRE(statistics.peak_bytes_in_use <= 64 * 1024);
+  REQUIRE(statistics.budget_rejections > 0);
+}
+
+TEST_CASE("Read-ahead skips prefetches when its queue is full", "[vfs]") {
+  IOWorkerPool io_worker_pool("Read-ahead test", 1, 1);
+  ReadAheadPool pool(&io_worker_pool, 1024 * 1024, 64 * 1024);
+  MemoryFile file(1024 * 1024, std::chrono::microseconds(0));
+  // Takes the only slot until released.
+  std::atomic<bool> released = false;
+  REQUIRE(io_worker_pool.Submit([&released]() {
+    while (!released) {
+      std::this_thread::yield();
+    }
+  }));
+  {
+    ReadAheadBuffer buffer(&pool, &file, file.data().size());
+    for (size_t offset = 0; offset < 256 * 1024; offset += 16384) {
+      REQUIRE(ReadMatches(buffer, file, offset, 16384));
+    }
+  }
+  released = true;
+  io_worker_pool.WaitIdle();
+  auto statistics = pool.statistics();
+  REQUIRE(statistics.queue_rejections > 0);
+  REQUIRE(statistics.hit_count == 0);
+  REQUIRE(io_worker_pool.rejected_count() == statistics.queue_rejections);
+}
+
+TEST_CASE("Read-ahead benchmark", "[vfs][.benchmark]") {
+  constexpr size_t kFileSize = 16 * 1024 * 1024;
+  constexpr size_t kChunk = 16 * 1024;
+  const auto kLatency = std::chrono::microseconds(200);
+
+  IOWorkerPool io_worker_pool("Read-ahead bench", 2, 32);
+  ReadAheadPool pool(&io_worker_pool, 64 * 1024 * 1024, 1024 * 1024);
+  MemoryFile file(kFileSize, kLatency);
+
+  std::vector<uint8_t> data(kChunk);
+  size_t bytes_read = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t offset = 0; offset < kFileSize; offset += kChunk) {
+    file.ReadSync(data.data(), kChunk, offset, &bytes_read);
+  }
+  auto direct = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+
+  start = std::chrono::steady_clock::now();
+  {
+    ReadAheadBuffer buffer(&pool, &file, file.data().size());
+    for (size_t offset = 0; offset < kFileSize; offset += kChunk) {
+      buffer.Read(data.data(), kChunk, offset, &bytes_read);
+    }
+  }
+  auto read_ahead = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  auto statistics = pool.statistics();
+
+  WARN("Streaming 16 MiB in 16 KiB reads at " << kLatency.count()
+                                             << "us per host read: direct "
+                                             << direct << "ms, read-ahead "
+                                             << read_ahead << "ms, "
+                                             << statistics.hit_count << " of "
+                                             << statistics.read_count
+                                             << " reads hit");
+}
+
+}  // namespace xe::vfs::test
@@ -0,0 +1,374 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/math.h"
+#include "xenia/vfs/devices/stfs_container_device.h"
+#include "xenia/vfs/devices/stfs_container_entry.h"
+#include "xenia/vfs/devices/stfs_xbox.h"
+#include "xenia/vfs/file.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+constexpr uint32_t kBlockSize = StfsContainerDevice::kBlockSize;
+constexpr uint32_t kBlocksPerHashTable = 170;
+constexpr uint32_t kEndOfChain = 0xFFFFFF;
+
+struct SyntheticFile {
+  std::string name;
+  size_t length;
+  // Data blocks holding the file, in order.
+  std::vector<uint32_t> blocks;
+};
+
+uint8_t PatternByte(size_t file_index, size_t offset) {
+  return uint8_t((offset * 31) ^ (offset >> 9) ^ (file_index * 0x5B));
+}
+
+// Layout of a package with less than 170 * 170 data blocks: each group of 170
+// data blocks is preceded by its level 0 hash table, and the level 1 table
+// follows the first group. Every table takes one backing block in read-only
+// packages and two (a primary and a secondary copy) otherwise.
+uint64_t PhysicalBlock(uint32_t block, uint32_t copies) {
+  return block + (block / kBlocksPerHashTable + 1) * copies +
+         (block >= kBlocksPerHashTable ? copies : 0);
+}
+uint64_t HashTablePhysicalBlock(uint32_t block, uint32_t copies) {
+  if (block < kBlocksPerHashTable) {
+    return 0;
+  }
+  return (block / kBlocksPerHashTable) * (kBlocksPerHashTable + copies) +
+         copies;
+}
+
+// Writes an STFS package whose file table is data block 0, followed by the
+// given files in the root directory. Packages that are not read-only use the
+// secondary copy of the top level table and of every odd level 0 table, with
+// the inactive copies left empty.
+void WriteSyntheticPackage(const std::filesystem::path& path,
+                           const std::vector<SyntheticFile>& files,
+                           bool read_only = true) {
+  uint32_t copies = read_only ? 1 : 2;
+  uint32_t block_count = 1;
+  for (auto& file : files) {
+    for (uint32_t block : file.blocks) {
+      block_count = std::max(block_count, block + 1);
+    }
+  }
+  REQUIRE(block_count < kBlocksPerHashTable * kBlocksPerHashTable);
+
+  size_t header_size = xe::round_up(sizeof(StfsHeader), kBlockSize);
+  bool has_level1 = block_count > kBlocksPerHashTable;
+  std::vector<uint8_t> image(
+      header_size + (PhysicalBlock(block_count - 1, copies) + 1) * kBlockSize);
+  auto block_data = [&](uint32_t block) {
+    return image.data() + header_size +
+           PhysicalBlock(block, copies) * kBlockSize;
+  };
+  auto table_active_copy = [&](uint32_t block) -> uint32_t {
+    if (read_only) {
+      return 0;
+    }
+    return has_level1 ? (block / kBlocksPerHashTable) & 1 : 1;
+  };
+  auto block_hash = [&](uint32_t block) {
+    auto table = reinterpret_cast<StfsHashTable*>(
+        image.data() + header_size +
+        (HashTablePhysicalBlock(block, copies) + table_active_copy(block)) *
+            kBlockSize);
+    return &table->entries[block % kBlocksPerHashTable];
+  };
+  if (!read_only && has_level1) {
+    auto level1_table = reinterpret_cast<StfsHashTable*>(
+        image.data() + header_size +
+        (kBlocksPerHashTable + copies + 1) * kBlockSize);
+    for (uint32_t block = 0; block < block_count;
+         block += kBlocksPerHashTable) {
+      level1_table->entries[block / kBlocksPerHashTable]
+          .set_levelN_active_index(table_active_copy(block) != 0);
+    }
+  }
+
+  auto header = reinterpret_cast<StfsHeader*>(image.data());
+  header->header.magic = XContentPackageType::kCon;
+  header->header.header_size = uint32_t(sizeof(StfsHeader));
+  header->metadata.volume_type = XContentVolumeType::kStfs;
+  header->metadata.data_file_count = 0;
+  auto& descriptor = header->metadata.volume_descriptor.stfs;
+  descriptor.descriptor_length = sizeof(StfsVolumeDescriptor);
+  descriptor.flags.bits.read_only_format = read_only;
+  descriptor.flags.bits.root_active_index = !read_only;
+  descriptor.file_table_block_count = 1;
+  descriptor.set_file_table_block_number(0);
+  descriptor.total_block_count = block_count;
+  descriptor.free_block_count = 0;
+
+  auto directory = reinterpret_cast<StfsDirectoryBlock*>(block_data(0));
+  block_hash(0)->set_level0_next_block(kEndOfChain);
+  for (size_t i = 0; i < files.size(); ++i) {
+    auto& file = files[i];
+    auto& dir_entry = directory->entries[i];
+    std::memcpy(dir_entry.name, file.name.data(), file.name.size());
+    dir_entry.flags.name_length = uint8_t(file.name.size());
+    dir_entry.set_valid_data_blocks(uint32_t(file.blocks.size()));
+    dir_entry.set_allocated_data_blocks(uint32_t(file.blocks.size()));
+    dir_entry.set_start_block_number(file.blocks.front());
+    dir_entry.directory_index = 0xFFFF;
+    dir_entry.length = uint32_t(file.length);
+    for (size_t n = 0; n < file.blocks.size(); ++n) {
+      block_hash(file.blocks[n])
+          ->set_level0_next_block(n + 1 < file.blocks.size()
+                                      ? file.blocks[n + 1]
+                                      : kEndOfChain);
+      uint8_t* data = block_data(file.blocks[n]);
+      for (size_t m = 0; m < kBlockSize; ++m) {
+        data[m] = PatternByte(i, n * kBlockSize + m);
+      }
+    }
+  }
+
+  FILE* out = xe::filesystem::OpenFile(path, "wb");
+  REQUIRE(out);
+  REQUIRE(fwrite(image.data(), 1, image.size(), out) == image.size());
+  fclose(out);
+}
+
+std::vector<uint32_t> ContiguousBlocks(uint32_t first, uint32_t count) {
+  std::vector<uint32_t> blocks(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    blocks[i] = first + i;
+  }
+  return blocks;
+}
+
+// A contiguous file followed by a file whose blocks are scattered over the
+// rest of the package.
+std::vector<SyntheticFile> SyntheticFiles(uint32_t blocks_per_file) {
+  std::vector<uint32_t> scattered =
+      ContiguousBlocks(1 + blocks_per_file, blocks_per_file);
+  std::shuffle(scattered.begin(), scattered.end(), std::mt19937(1234));
+  size_t length = size_t(blocks_per_file) * kBlockSize - 123;
+  return {{"contiguous.bin", length, ContiguousBlocks(1, blocks_per_file)},
+          {"scattered.bin", length, scattered}};
+}
+
+std::filesystem::path SyntheticPackagePath(const char* name) {
+  return std::filesystem::temp_directory_path() /
+         fmt::format("xenia_{}_{}.stfs", name, std::random_device()());
+}
+
+bool CheckPattern(const uint8_t* data, size_t file_index, size_t offset,
+                  size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    if (data[i] != PatternByte(file_index, offset + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST_CASE("STFS container reads", "[stfs]") {
+  auto path = SyntheticPackagePath("stfs_reads");
+  auto files = SyntheticFiles(400);
+  WriteSyntheticPackage(path, files);
+  {
+    StfsContainerDevice device("", path);
+    REQUIRE(device.Initialize());
+
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto entry =
+          static_cast<StfsContainerEntry*>(device.ResolvePath(files[i].name));
+      REQUIRE(entry);
+      REQUIRE(entry->size() == files[i].length);
+
+      File* file = nullptr;
+      REQUIRE(entry->Open(FileAccess::kFileReadData, &file) ==
+              X_STATUS_SUCCESS);
+      std::vector<uint8_t> buffer(files[i].length + kBlockSize);
+      size_t bytes_read = 0;
+
+      // Whole file.
+      REQUIRE(file->ReadSync(buffer.data(), buffer.size(), 0, &bytes_read) ==
+              X_STATUS_SUCCESS);
+      REQUIRE(bytes_read == files[i].length);
+      REQUIRE(CheckPattern(buffer.data(), i, 0, bytes_read));
+
+      // Unaligned reads spanning several blocks.
+      std::mt19937 rng(static_cast<uint32_t>(i));
+      for (int n = 0; n < 200; ++n) {
+        size_t offset = rng() % files[i].length;
+        size_t length = 1 + rng() % (3 * kBlockSize);
+        size_t expected = std::min(length, files[i].length - offset);
+        REQUIRE(file->ReadSync(buffer.data(), length, offset, &bytes_read) ==
+                X_STATUS_SUCCESS);
+        REQUIRE(bytes_read == expected);
+        REQUIRE(CheckPattern(buffer.data(), i, offset, bytes_read));
+      }
+
+      REQUIRE(file->ReadSync(buffer.data(), 16, files[i].length,
+                             &bytes_read) == X_STATUS_END_OF_FILE);
+
+      file->Destroy();
+    }
+
+    // Consecutive blocks collapse into one run per hash table group, the
+    // scattered file needs nearly one per block.
+    auto contiguous = static_cast<StfsContainerEntry*>(
+        device.ResolvePath(files[0].name));
+    auto scattered = static_cast<StfsContainerEntry*>(
+        device.ResolvePath(files[1].name));
+    REQUIRE(contiguous->block_list().size() == 3);
+    REQUIRE(scattered->block_list().size() > 200);
+    REQUIRE_FALSE(contiguous->can_map());
+    REQUIRE(contiguous->FindBlock(0) == 0);
+    REQUIRE(contiguous->FindBlock(169 * kBlockSize) == 1);
+    REQUIRE(contiguous->FindBlock(files[0].length - 1) == 2);
+    REQUIRE(contiguous->FindBlock(files[0].length + kBlockSize) ==
+            contiguous->block_list().size());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("STFS container follows active hash tables", "[stfs]") {
+  auto path = SyntheticPackagePath("stfs_active");
+  auto files = SyntheticFiles(400);
+  WriteSyntheticPackage(path, files, false);
+  {
+    StfsContainerDevice device("", path);
+    REQUIRE(device.Initialize());
+    REQUIRE_FALSE(device.is_read_only());
+
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto entry = device.ResolvePath(files[i].name);
+      REQUIRE(entry);
+      File* file = nullptr;
+      REQUIRE(entry->Open(FileAccess::kFileReadData, &file) ==
+              X_STATUS_SUCCESS);
+      std::vector<uint8_t> buffer(files[i].length);
+      size_t bytes_read = 0;
+      REQUIRE(file->ReadSync(buffer.data(), buffer.size(), 0, &bytes_read) ==
+              X_STATUS_SUCCESS);
+      REQUIRE(bytes_read == files[i].length);
+      REQUIRE(CheckPattern(buffer.data(), i, 0, bytes_read));
+      file->Destroy();
+    }
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("STFS container maps single run files", "[stfs]") {
+  auto path = SyntheticPackagePath("stfs_map");
+  SyntheticFile small = {"small.bin", 100 * kBlockSize - 5,
+                         ContiguousBlocks(1, 100)};
+  WriteSyntheticPackage(path, {small});
+  {
+    StfsContainerDevice device("", path);
+    REQUIRE(device.Initialize());
+    auto entry = device.ResolvePath(small.name);
+    REQUIRE(entry);
+    REQUIRE(entry->can_map());
+
+    auto mapping = entry->OpenMapped(MappedMemory::Mode::kRead, kBlockSize, 0);
+    REQUIRE(mapping);
+    REQUIRE(mapping->size() == small.length - kBlockSize);
+    REQUIRE(CheckPattern(mapping->data(), 0, kBlockSize, mapping->size()));
+    REQUIRE_FALSE(entry->OpenMapped(MappedMemory::Mode::kReadWrite, 0, 0));
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("STFS container read benchmark", "[stfs][.benchmark]") {
+  constexpr size_t kSequentialChunk = 64 * 1024;
+  constexpr size_t kRandomChunk = 4 * 1024;
+  constexpr size_t kRandomReadCount = 100000;
+
+  // Two 56 MiB files, one of them scattered over its whole range.
+  auto path = SyntheticPackagePath("stfs_bench");
+  auto files = SyntheticFiles(14336);
+  WriteSyntheticPackage(path, files);
+  {
+    StfsContainerDevice device("", path);
+    REQUIRE(device.Initialize());
+
+    std::vector<uint8_t> buffer(kSequentialChunk);
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto entry = device.ResolvePath(files[i].name);
+      REQUIRE(entry);
+      File* file = nullptr;
+      REQUIRE(entry->Open(FileAccess::kFileReadData, &file) ==
+              X_STATUS_SUCCESS);
+
+      size_t bytes_read = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t offset = 0; offset < files[i].length;
+           offset += kSequentialChunk) {
+        file->ReadSync(buffer.data(), kSequentialChunk, offset, &bytes_read);
+      }
+      auto sequential = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+      std::mt19937 rng(1);
+      start = std::chrono::steady_clock::now();
+      for (size_t n = 0; n < kRandomReadCount; ++n) {
+        size_t offset = rng() % (files[i].length - kRandomChunk);
+        file->ReadSync(buffer.data(), kRandomChunk, offset, &bytes_read);
+      }
+      auto random = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+      file->Destroy();
+
+      WARN(files[i].name << ": sequential "
+                         << files[i].length / (1024.0 * 1024.0) / sequential
+                         << " MiB/s, random 4 KiB reads "
+                         << random * 1e9 / kRandomReadCount << "ns each");
+    }
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("STFS container mount benchmark", "[stfs][.benchmark]") {
+  constexpr int kMountCount = 20;
+
+  // The largest package the synthetic layout allows, mostly scattered blocks
+  // so every chain step lands in a different hash table.
+  auto path = SyntheticPackagePath("stfs_mount");
+  auto files = SyntheticFiles(14336);
+  WriteSyntheticPackage(path, files);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kMountCount; ++i) {
+    StfsContainerDevice device("", path);
+    REQUIRE(device.Initialize());
+  }
+  auto mount = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count() /
+               kMountCount;
+  std::filesystem::remove(path);
+
+  WARN("Mounting a package of " << 2 * 14336 << " blocks took " << mount
+                                << "ms");
+}
+
+}  // namespace xe::vfs::test
@@ -0,0 +1,282 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2023 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/string.h"
+#include "xenia/vfs/device.h"
+#include "xenia/vfs/directory_cursor.h"
+#include "xenia/vfs/entry.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::vfs::test {
+
+class TreeEntry : public Entry {
+ public:
+  TreeEntry(Device* device, Entry* parent, const std::string_view path,
+            uint32_t attributes)
+      : Entry(device, parent, path) {
+    attributes_ = attributes;
+  }
+
+  // Appends a child the way devices do while populating.
+  TreeEntry* AddChild(const std::string_view name, uint32_t attributes) {
+    auto child = new TreeEntry(device_, this,
+                               xe::utf8::join_guest_paths(path_, name),
+                               attributes);
+    children_.emplace_back(child);
+    return child;
+  }
+
+  X_STATUS Open(uint32_t desired_access, File** out_file) override {
+    return X_STATUS_NOT_IMPLEMENTED;
+  }
+
+ protected:
+  std::unique_ptr<Entry> CreateEntryInternal(const std::string_view name,
+                                             uint32_t attributes) override {
+    return std::make_unique<TreeEntry>(
+        device_, this, xe::utf8::join_guest_paths(path_, name), attributes);
+  }
+  bool DeleteEntryInternal(Entry* entry) override { return true; }
+};
+
+class TreeDevice : public Device {
+ public:
+  explicit TreeDevice(const std::string_view mount_path)
+      : Device(mount_path) {
+    root_entry_ = std::make_unique<TreeEntry>(this, nullptr, "",
+                                              kFileAttributeDirectory);
+  }
+
+  TreeEntry* root_entry() const { return root_entry_.get(); }
+
+  bool Initialize() override { return true; }
+  bool is_read_only() const override { return false; }
+  void Dump(StringBuffer* string_buffer) override {}
+  Entry* ResolvePath(const std::string_view path) override {
+    return root_entry_->ResolvePath(path);
+  }
+
+  const std::string& name() const override { return name_; }
+  uint32_t attributes() const override { return 0; }
+  uint32_t component_name_max_length() const override { return 255; }
+  uint32_t total_allocation_units() const override { return 0; }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 1; }
+  uint32_t bytes_per_sector() const override { return 0x200; }
+
+ private:
+  std::string name_ = "Tree";
+  std::unique_ptr<TreeEntry> root_entry_;
+};
+
+// Mounts a tree of dir_count directories of file_count files each.
+TreeDevice* MountTree(VirtualFileSystem& vfs, size_t dir_count,
+                      size_t file_count) {
+  auto device = std::make_unique<TreeDevice>("\\Device\\Tree");
+  for (size_t i = 0; i < dir_count; ++i) {
+    auto dir = device->root_entry()->AddChild(fmt::format("Dir{:04}", i),
+                                              kFileAttributeDirectory);
+    for (size_t j = 0; j < file_count; ++j) {
+      dir->AddChild(fmt::format("File{:05}.bin", j), kFileAttributeNormal);
+    }
+  }
+  auto result = device.get();
+  vfs.RegisterDevice(std::move(device));
+  return result;
+}
+
+TEST_CASE("VFS resolves paths case-insensitively", "[vfs]") {
+  VirtualFileSystem vfs;
+  auto device = MountTree(vfs, 4, 100);
+
+  // Small directory, searched linearly.
+  auto dir = vfs.ResolvePath("\\Device\\Tree\\dir0002");
+  REQUIRE(dir);
+  REQUIRE(dir->name() == "Dir0002");
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0004") == nullptr);
+
+  // Large directory, searched through its index.
+  auto file = vfs.ResolvePath("\\Device\\Tree\\Dir0002\\File00042.bin");
+  REQUIRE(file);
+  REQUIRE(file->parent() == dir);
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\DIR0002\\file00042.BIN") == file);
+  REQUIRE(dir->GetChild("FILE00042.bin") == file);
+  REQUIRE(device->ResolvePath("dir0002/file00042.bin") == file);
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0002\\File00100.bin") ==
+          nullptr);
+
+  // Children appended after the index was built are still found.
+  auto late = static_cast<TreeEntry*>(dir)->AddChild("Late.bin",
+                                                     kFileAttributeNormal);
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0002\\late.bin") == late);
+
+  // Created and deleted entries are seen by later lookups.
+  auto created = dir->CreateEntry("Created.bin", kFileAttributeNormal);
+  REQUIRE(created);
+  REQUIRE(dir->CreateEntry("CREATED.BIN", kFileAttributeNormal) == nullptr);
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0002\\created.bin") == created);
+  REQUIRE(created->Delete());
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0002\\created.bin") == nullptr);
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0002\\File00042.bin") == file);
+  REQUIRE(file->Delete());
+  REQUIRE(vfs.ResolvePath("\\Device\\Tree\\Dir0002\\File00042.bin") ==
+          nullptr);
+  REQUIRE(dir->GetChild("File00043.bin"));
+  REQUIRE(dir->GetChild("Late.bin") == late);
+}
+
+TEST_CASE("VFS path resolution benchmark", "[vfs][.benchmark]") {
+  constexpr size_t kDirCount = 100;
+  constexpr size_t kFileCount = 1000;
+  constexpr size_t kLookupCount = 1000000;
+
+  VirtualFileSystem vfs;
+  auto device = MountTree(vfs, kDirCount, kFileCount);
+
+  std::mt19937 rng(1);
+  std::vector<std::string> paths(4096);
+  for (auto& path : paths) {
+    path = fmt::format("\\Device\\Tree\\dir{:04}\\FILE{:05}.BIN",
+                       rng() % kDirCount, rng() % kFileCount);
+  }
+
+  std::vector<std::string> relative_paths;
+  for (auto& path : paths) {
+    relative_paths.push_back(path.substr(device->mount_path().size()));
+  }
+
+  size_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kLookupCount; ++i) {
+    found += device->ResolvePath(relative_paths[i % paths.size()]) != nullptr;
+  }
+  auto uncached = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - start)
+                      .count() /
+                  kLookupCount;
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kLookupCount; ++i) {
+    found += vfs.ResolvePath(paths[i % paths.size()]) != nullptr;
+  }
+  auto cached = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count() /
+                kLookupCount;
+  REQUIRE(found == 2 * kLookupCount);
+
+  WARN("Resolving in a tree of " << kDirCount * (kFileCount + 1)
+                                 << " entries took " << uncached
+                                 << "ns per walk, " << cached
+                                 << "ns per full lookup through the VFS");
+}
+
+TEST_CASE("Directory cursor enumerates a sorted snapshot", "[vfs]") {
+  VirtualFileSystem vfs;
+  auto device = MountTree(vfs, 1, 0);
+  auto dir = static_cast<TreeEntry*>(device->root_entry()->children()[0].get());
+  for (auto name : {"b.sav", "C.dat", "a.SAV", "B2.sav", "d"}) {
+    dir->AddChild(name, kFileAttributeNormal);
+  }
+
+  auto names = [](DirectoryCursor& cursor) {
+    std::vector<std::string> result;
+    while (auto match = cursor.Next()) {
+      result.push_back(match->name);
+    }
+    return result;
+  };
+
+  DirectoryCursor cursor;
+  REQUIRE_FALSE(cursor.scanned());
+  cursor.Scan(dir);
+  REQUIRE(cursor.match_count() == 5);
+  REQUIRE(names(cursor) == std::vector<std::string>{"a.SAV", "b.sav", "B2.sav",
+                                                    "C.dat", "d"});
+  REQUIRE(cursor.position() == 5);
+  REQUIRE(cursor.Next() == nullptr);
+
+  cursor.SetPattern("*.sav");
+  cursor.Scan(dir);
+  REQUIRE(names(cursor) ==
+          std::vector<std::string>{"a.SAV", "b.sav", "B2.sav"});
+  cursor.SetPattern("B*");
+  cursor.Scan(dir);
+  REQUIRE(names(cursor) == std::vector<std::string>{"b.sav", "B2.sav"});
+
+  // The snapshot outlives entries deleted after it was taken, and entries
+  // created meanwhile only show up once scanned again.
+  cursor.SetPattern("*");
+  cursor.Scan(dir);
+  REQUIRE(cursor.Next()->name == "a.SAV");
+  REQUIRE(dir->GetChild("b.sav")->Delete());
+  REQUIRE(dir->CreateEntry("a0", kFileAttributeNormal));
+  REQUIRE(names(cursor) ==
+          std::vector<std::string>{"b.sav", "B2.sav", "C.dat", "d"});
+  cursor.Scan(dir);
+  REQUIRE(names(cursor) ==
+          std::vector<std::string>{"a.SAV", "a0", "B2.sav", "C.dat", "d"});
+}
+
+TEST_CASE("Directory enumeration benchmark", "[vfs][.benchmark]") {
+  constexpr size_t kFileCount = 20000;
+
+  VirtualFileSystem vfs;
+  auto device = MountTree(vfs, 1, 0);
+  auto dir = static_cast<TreeEntry*>(device->root_entry()->children()[0].get());
+  for (size_t i = 0; i < kFileCount; ++i) {
+    dir->AddChild(fmt::format("Save{:05}.{}", i, i % 4 ? "dat" : "sav"),
+                  kFileAttributeNormal);
+  }
+
+  for (auto pattern : {"*", "*.sav"}) {
+    auto start = std::chrono::steady_clock::now();
+    xe::filesystem::WildcardEngine engine;
+    engine.SetRule(pattern);
+    size_t index = 0;
+    size_t iterated = 0;
+    while (dir->IterateChildren(engine, &index)) {
+      ++iterated;
+    }
+    auto iterate = std::chrono::duration<double, std::nano>(
+                       std::chrono::steady_clock::now() - start)
+                       .count() /
+                   iterated;
+
+    start = std::chrono::steady_clock::now();
+    DirectoryCursor cursor;
+    cursor.SetPattern(pattern);
+    cursor.Scan(dir);
+    size_t enumerated = 0;
+    while (cursor.Next()) {
+      ++enumerated;
+    }
+    auto snapshot = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count() /
+                    enumerated;
+    REQUIRE(enumerated == iterated);
+
+    WARN("Enumerating " << enumerated << " of " << kFileCount
+                        << " entries matching " << pattern << " took "
+                        << iterate << "ns per entry iterating, " << snapshot
+                        << "ns per entry from a sorted snapshot");
+  }
+}
+
+}  // namespace xe::vfs::test
@@ -0,0 +1,229 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/filesystem_wildcard.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string.h"
+
+#include "xenia/vfs/devices/disc_image_device.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/devices/stfs_container_device.h"
+#include "xenia/vfs/file.h"
+#include "xenia/vfs/io_worker_pool.h"
+
+namespace xe {
+namespace vfs {
+
+DEFINE_transient_path(source, "",
+                      "Specifies the STFS package, disc image or directory to "
+                      "benchmark.",
+                      "General");
+DEFINE_transient_string(bench_mode, "stream",
+                        "Benchmark to run: [stream, random].", "General");
+DEFINE_transient_string(bench_file, "",
+                        "Path of the file within the source to read. Defaults "
+                        "to the largest file.",
+                        "General");
+DEFINE_int32(bench_threads, 4,
+             "Number of I/O worker threads, 0 to read on the calling thread.",
+             "General");
+DEFINE_int32(bench_queue_depth, 8, "Maximum number of reads in flight.",
+             "General");
+DEFINE_int32(bench_chunk_size, 64 * 1024, "Size of each read in bytes.",
+             "General");
+DEFINE_int32(bench_read_count, 100000,
+             "Number of reads issued by the random benchmark.", "General");
+
+using Clock = std::chrono::steady_clock;
+
+static std::unique_ptr<Device> CreateDevice(
+    const std::filesystem::path& path) {
+  std::unique_ptr<Device> device;
+  if (std::filesystem::is_directory(path)) {
+    device = std::make_unique<HostPathDevice>("", path, true);
+  } else if (auto extension =
+                 xe::utf8::lower_ascii(xe::path_to_utf8(path.extension()));
+             extension == ".iso" || extension == ".xcz") {
+    device = std::make_unique<DiscImageDevice>("", path);
+  } else {
+    device = std::make_unique<StfsContainerDevice>("", path);
+  }
+  if (!device->Initialize()) {
+    return nullptr;
+  }
+  return device;
+}
+
+static Entry* FindLargestFile(Entry* root) {
+  Entry* largest = nullptr;
+  // Host path devices only list a directory when it is first iterated.
+  xe::filesystem::WildcardEngine match_all;
+  std::queue<Entry*> queue;
+  queue.push(root);
+  while (!queue.empty()) {
+    auto entry = queue.front();
+    queue.pop();
+    size_t child_index = 0;
+    while (auto child = entry->IterateChildren(match_all, &child_index)) {
+      queue.push(child);
+    }
+    if (!(entry->attributes() & kFileAttributeDirectory) &&
+        (!largest || entry->size() > largest->size())) {
+      largest = entry;
+    }
+  }
+  return largest;
+}
+
+static double ToSeconds(Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+// Reads the whole file front to back in bench_chunk_size pieces, keeping up to
+// bench_queue_depth reads in flight on the I/O worker pool, like a guest
+// streaming thread issuing overlapped NtReadFile calls.
+static int BenchStream(Entry* entry) {
+  File* file = nullptr;
+  if (entry->Open(FileAccess::kFileReadData, &file) != X_STATUS_SUCCESS) {
+    XELOGE("Failed to open {}", entry->path());
+    return 1;
+  }
+
+  size_t chunk_size = size_t(std::max(cvars::bench_chunk_size, 512));
+  size_t queue_depth = size_t(std::max(cvars::bench_queue_depth, 1));
+  size_t thread_count = size_t(std::max(cvars::bench_threads, 0));
+  size_t chunk_count = (entry->size() + chunk_size - 1) / chunk_size;
+
+  std::atomic<size_t> bytes_read_total(0);
+  std::atomic<size_t> failed_reads(0);
+  auto read_chunk = [&](size_t chunk_index) {
+    thread_local std::vector<uint8_t> buffer;
+    buffer.resize(chunk_size);
+    size_t bytes_read = 0;
+    if (file->ReadSync(buffer.data(), chunk_size, chunk_index * chunk_size,
+                       &bytes_read) != X_STATUS_SUCCESS) {
+      ++failed_reads;
+    }
+    bytes_read_total += bytes_read;
+  };
+
+  auto start = Clock::now();
+  if (!thread_count) {
+    for (size_t i = 0; i < chunk_count; ++i) {
+      read_chunk(i);
+    }
+  } else {
+    IOWorkerPool pool("VFS Bench I/O", thread_count, queue_depth);
+    for (size_t i = 0; i < chunk_count;) {
+      if (pool.Submit([&read_chunk, i]() { read_chunk(i); })) {
+        ++i;
+      } else {
+        threading::MaybeYield();
+      }
+    }
+    pool.WaitIdle();
+  }
+  double seconds = ToSeconds(Clock::now() - start);
+  file->Destroy();
+
+  XELOGI("stream {}: {} bytes in {:.3f}s, {:.1f} MiB/s ({} threads, queue "
+         "depth {}, {} byte chunks, {} failed reads)",
+         entry->path(), bytes_read_total.load(), seconds,
+         bytes_read_total.load() / (1024.0 * 1024.0) / std::max(seconds, 1e-9),
+         thread_count, queue_depth, chunk_size, failed_reads.load());
+  return failed_reads ? 1 : 0;
+}
+
+// Reads bench_chunk_size pieces at random offsets from the calling thread, like
+// a title seeking around a package for on-demand assets.
+static int BenchRandom(Entry* entry) {
+  File* file = nullptr;
+  if (entry->Open(FileAccess::kFileReadData, &file) != X_STATUS_SUCCESS) {
+    XELOGE("Failed to open {}", entry->path());
+    return 1;
+  }
+
+  size_t chunk_size = size_t(std::max(cvars::bench_chunk_size, 1));
+  size_t read_count = size_t(std::max(cvars::bench_read_count, 1));
+  size_t offset_range =
+      entry->size() > chunk_size ? entry->size() - chunk_size + 1 : 1;
+  std::vector<uint8_t> buffer(chunk_size);
+  std::mt19937_64 rng(0);
+
+  size_t bytes_read_total = 0;
+  size_t failed_reads = 0;
+  auto start = Clock::now();
+  for (size_t i = 0; i < read_count; ++i) {
+    size_t bytes_read = 0;
+    if (file->ReadSync(buffer.data(), chunk_size, rng() % offset_range,
+                       &bytes_read) != X_STATUS_SUCCESS) {
+      ++failed_reads;
+    }
+    bytes_read_total += bytes_read;
+  }
+  double seconds = ToSeconds(Clock::now() - start);
+  file->Destroy();
+
+  XELOGI("random {}: {} reads of {} bytes in {:.3f}s, {:.0f}ns per read, "
+         "{:.1f} MiB/s ({} failed reads)",
+         entry->path(), read_count, chunk_size, seconds,
+         seconds * 1e9 / read_count,
+         bytes_read_total / (1024.0 * 1024.0) / std::max(seconds, 1e-9),
+         failed_reads);
+  return failed_reads ? 1 : 0;
+}
+
+int vfs_bench_main(const std::vector<std::string>& args) {
+  if (cvars::source.empty()) {
+    XELOGE("Usage: {} [source]", xe::path_to_utf8(args[0]));
+    return 1;
+  }
+
+  auto mount_start = Clock::now();
+  auto device = CreateDevice(cvars::source);
+  if (!device) {
+    XELOGE("Failed to initialize device");
+    return 1;
+  }
+  XELOGI("mount: {:.3f}s", ToSeconds(Clock::now() - mount_start));
+
+  Entry* entry = cvars::bench_file.empty()
+                     ? FindLargestFile(device->ResolvePath("/"))
+                     : device->ResolvePath(cvars::bench_file);
+  if (!entry) {
+    XELOGE("No file to benchmark");
+    return 1;
+  }
+
+  if (cvars::bench_mode == "stream") {
+    return BenchStream(entry);
+  } else if (cvars::bench_mode == "random") {
+    return BenchRandom(entry);
+  }
+  XELOGE("Unknown benchmark mode {}", cvars::bench_mode);
+  return 1;
+}
+
+}  // namespace vfs
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-vfs-bench", xe::vfs::vfs_bench_main, "[source]",
+                      "source");
@@ -7,18 +7,31 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
 #include <queue>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "xenia/base/console_app_main.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/utf8.h"
+#include "xenia/base/xxhash.h"
 
+#include "xenia/vfs/compressed_image.h"
+#include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/file.h"
+#include "xenia/vfs/io_worker_pool.h"
 
 namespace xe {
 namespace vfs {
@@ -31,7 +44,199 @@ DEFINE_transient_path(source, "", "Specifies the file to dump from.",
 DEFINE_transient_path(dump_path, "",
                       "Specifies the directory to dump files to.", "General");
 
+DEFINE_transient_path(compress_to, "",
+                      "Converts the source disc image into a compressed image "
+                      "at this path instead of dumping files.",
+                      "General");
+
+DEFINE_int32(compress_chunk_size, 64 * 1024,
+             "Size in bytes of each independently compressed chunk of a "
+             "compressed image.",
+             "General");
+
+DEFINE_int32(dump_threads, 0,
+             "Number of threads extracting files, or 0 for one per core.",
+             "General");
+
+DEFINE_int32(dump_buffer_size, 8 * 1024 * 1024,
+             "Size in bytes of the copy buffer of each extracting thread.",
+             "General");
+
+DEFINE_bool(verify, false,
+            "Hashes every dumped file after extraction and compares it with "
+            "the source.",
+            "General");
+
+static bool IsDiscImage(const std::filesystem::path& path) {
+  auto extension = xe::utf8::lower_ascii(xe::path_to_utf8(path.extension()));
+  return extension == ".iso" || extension == ".xcz";
+}
+
+struct DumpItem {
+  Entry* entry;
+  std::filesystem::path dest_path;
+};
+
+// Passes the contents of an entry to consume a block at a time, straight from
+// the image when it can be mapped and through buffer otherwise.
+static bool ReadEntryBlocks(
+    Entry* entry, uint8_t* buffer, size_t buffer_size,
+    const std::function<bool(size_t offset, const uint8_t* data,
+                             size_t length)>& consume) {
+  if (!entry->size()) {
+    return true;
+  }
+  if (entry->can_map()) {
+    auto map = entry->OpenMapped(xe::MappedMemory::Mode::kRead);
+    if (map) {
+      return consume(0, map->data(), map->size());
+    }
+  }
+
+  File* in_file = nullptr;
+  if (entry->Open(FileAccess::kFileReadData, &in_file) != X_STATUS_SUCCESS) {
+    return false;
+  }
+  bool succeeded = true;
+  for (size_t offset = 0; succeeded && offset < entry->size();) {
+    size_t bytes_read = 0;
+    if (XFAILED(in_file->ReadSync(buffer,
+                                  std::min(buffer_size, entry->size() - offset),
+                                  offset, &bytes_read)) ||
+        !bytes_read) {
+      succeeded = false;
+      break;
+    }
+    succeeded = consume(offset, buffer, bytes_read);
+    offset += bytes_read;
+  }
+  in_file->Destroy();
+  return succeeded;
+}
+
+static bool WriteFully(xe::filesystem::FileHandle* file, size_t offset,
+                       const uint8_t* data, size_t length) {
+  while (length) {
+    size_t bytes_written = 0;
+    if (!file->Write(offset, data, length, &bytes_written) || !bytes_written) {
+      return false;
+    }
+    offset += bytes_written;
+    data += bytes_written;
+    length -= bytes_written;
+  }
+  return true;
+}
+
+static bool DumpFile(const DumpItem& item, uint8_t* buffer,
+                     size_t buffer_size) {
+  if (!xe::filesystem::CreateEmptyFile(item.dest_path)) {
+    return false;
+  }
+  auto file = xe::filesystem::FileHandle::OpenExisting(
+      item.dest_path, FileAccess::kFileWriteData);
+  // Sized up front so the blocks can land in any order without the file
+  // growing a piece at a time.
+  if (!file || !file->SetLength(item.entry->size())) {
+    return false;
+  }
+  return ReadEntryBlocks(
+      item.entry, buffer, buffer_size,
+      [&](size_t offset, const uint8_t* data, size_t length) {
+        return WriteFully(file.get(), offset, data, length);
+      });
+}
+
+static bool VerifyFile(const DumpItem& item, uint8_t* buffer,
+                       size_t buffer_size) {
+  XXH3_state_t state;
+  XXH3_64bits_reset(&state);
+  if (!ReadEntryBlocks(item.entry, buffer, buffer_size,
+                       [&](size_t offset, const uint8_t* data, size_t length) {
+                         XXH3_64bits_update(&state, data, length);
+                         return true;
+                       })) {
+    return false;
+  }
+  uint64_t source_hash = XXH3_64bits_digest(&state);
+
+  auto file = xe::filesystem::FileHandle::OpenExisting(
+      item.dest_path, FileAccess::kFileReadData);
+  if (!file) {
+    return false;
+  }
+  XXH3_64bits_reset(&state);
+  size_t offset = 0;
+  while (true) {
+    size_t bytes_read = 0;
+    if (!file->Read(offset, buffer, buffer_size, &bytes_read)) {
+      return false;
+    }
+    if (!bytes_read) {
+      break;
+    }
+    XXH3_64bits_update(&state, buffer, bytes_read);
+    offset += bytes_read;
+  }
+  return offset == item.entry->size() &&
+         XXH3_64bits_digest(&state) == source_hash;
+}
+
+// Runs process on every item across thread_count threads, each with its own
+// page aligned buffer, and returns the paths of the items that failed.
+static std::vector<std::filesystem::path> ProcessItems(
+    const std::vector<DumpItem>& items, size_t thread_count,
+    size_t buffer_size,
+    bool (*process)(const DumpItem& item, uint8_t* buffer,
+                    size_t buffer_size)) {
+  std::atomic<size_t> next_item = 0;
+  std::mutex failed_mutex;
+  std::vector<std::filesystem::path> failed;
+  auto worker = [&]() {
+    auto alignment = std::align_val_t(xe::memory::page_size());
+    auto buffer =
+        static_cast<uint8_t*>(::operator new[](buffer_size, alignment));
+    for (size_t i; (i = next_item++) < items.size();) {
+      if (!process(items[i], buffer, buffer_size)) {
+        std::lock_guard<std::mutex> lock(failed_mutex);
+        failed.push_back(items[i].dest_path);
+      }
+    }
+    ::operator delete[](buffer, alignment);
+  };
+
+  IOWorkerPool pool("vfs-dump", thread_count, thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    pool.Submit(worker);
+  }
+  pool.WaitIdle();
+  return failed;
+}
+
 int vfs_dump_main(const std::vector<std::string>& args) {
+  if (!cvars::source.empty() && !cvars::compress_to.empty()) {
+    if (cvars::compress_chunk_size <= 0) {
+      XELOGE("Invalid chunk size {}", cvars::compress_chunk_size);
+      return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!CompressedImage::Compress(
+            cvars::source, cvars::compress_to,
+            uint32_t(cvars::compress_chunk_size),
+            std::max(std::thread::hardware_concurrency(), 1u))) {
+      return 1;
+    }
+    XELOGI("Compressed {} ({} bytes) to {} ({} bytes) in {}ms",
+           xe::path_to_utf8(cvars::source),
+           std::filesystem::file_size(cvars::source),
+           xe::path_to_utf8(cvars::compress_to),
+           std::filesystem::file_size(cvars::compress_to),
+           std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start)
+               .count());
+    return 0;
+  }
+
   if (cvars::source.empty() || cvars::dump_path.empty()) {
     XELOGE("Usage: {} [source] [dump_path]", xe::path_to_utf8(args[0]));
     return 1;
@@ -41,21 +246,23 @@ int vfs_dump_main(const std::vector<std::string>& args) {
   std::unique_ptr<vfs::Device> device;
 
   // TODO: Flags specifying the type of device.
-  device = std::make_unique<vfs::StfsContainerDevice>("", cvars::source);
+  if (IsDiscImage(cvars::source)) {
+    device = std::make_unique<vfs::DiscImageDevice>("", cvars::source);
+  } else {
+    device = std::make_unique<vfs::StfsContainerDevice>("", cvars::source);
+  }
   if (!device->Initialize()) {
     XELOGE("Failed to initialize device");
     return 1;
   }
 
-  // Run through all the files, breadth-first style.
+  // Run through all the files, breadth-first style, creating the directories
+  // and listing the files to extract.
+  std::vector<DumpItem> items;
+  size_t total_size = 0;
   std::queue<vfs::Entry*> queue;
   auto root = device->ResolvePath("/");
   queue.push(root);
-
-  // Allocate a buffer when needed.
-  size_t buffer_size = 0;
-  uint8_t* buffer = nullptr;
-
   while (!queue.empty()) {
     auto entry = queue.front();
     queue.pop();
@@ -69,46 +276,50 @@ int vfs_dump_main(const std::vector<std::string>& args) {
       std::filesystem::create_directories(dest_name);
       continue;
     }
+    items.push_back({entry, dest_name});
+    total_size += entry->size();
+  }
+  // Largest first, so that no thread is left with a big file at the end.
+  std::stable_sort(items.begin(), items.end(),
+                   [](const DumpItem& a, const DumpItem& b) {
+                     return a.entry->size() > b.entry->size();
+                   });
 
-    vfs::File* in_file = nullptr;
-    if (entry->Open(FileAccess::kFileReadData, &in_file) != X_STATUS_SUCCESS) {
-      continue;
-    }
-
-    auto file = xe::filesystem::OpenFile(dest_name, "wb");
-    if (!file) {
-      in_file->Destroy();
-      continue;
-    }
-
-    if (entry->can_map()) {
-      auto map = entry->OpenMapped(xe::MappedMemory::Mode::kRead);
-      fwrite(map->data(), map->size(), 1, file);
-      map->Close();
-    } else {
-      // Can't map the file into memory. Read it into a temporary buffer.
-      if (!buffer || entry->size() > buffer_size) {
-        // Resize the buffer.
-        if (buffer) {
-          delete[] buffer;
-        }
-
-        // Allocate a buffer rounded up to the nearest 512MB.
-        buffer_size = xe::round_up(entry->size(), 512_MiB);
-        buffer = new uint8_t[buffer_size];
-      }
-
-      size_t bytes_read = 0;
-      in_file->ReadSync(buffer, entry->size(), 0, &bytes_read);
-      fwrite(buffer, bytes_read, 1, file);
-    }
+  size_t thread_count = cvars::dump_threads > 0
+                            ? size_t(cvars::dump_threads)
+                            : std::max(std::thread::hardware_concurrency(), 1u);
+  size_t buffer_size = xe::round_up(
+      size_t(std::max(cvars::dump_buffer_size, 1)), xe::memory::page_size());
 
-    fclose(file);
-    in_file->Destroy();
+  auto start = std::chrono::steady_clock::now();
+  auto failed = ProcessItems(items, thread_count, buffer_size, DumpFile);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  for (auto& path : failed) {
+    XELOGE("Failed to dump {}", xe::path_to_utf8(path));
+  }
+  XELOGI("Dumped {} files, {:.1f} MiB, in {:.2f}s ({:.1f} MiB/s) on {} threads",
+         items.size() - failed.size(), total_size / double(1_MiB), seconds,
+         total_size / double(1_MiB) / std::max(seconds, 1e-6), thread_count);
+  if (!failed.empty()) {
+    return 1;
   }
 
-  if (buffer) {
-    delete[] buffer;
+  if (cvars::verify) {
+    start = std::chrono::steady_clock::now();
+    failed = ProcessItems(items, thread_count, buffer_size, VerifyFile);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+    for (auto& path : failed) {
+      XELOGE("Verification failed for {}", xe::path_to_utf8(path));
+    }
+    XELOGI("Verified {} of {} files in {:.2f}s", items.size() - failed.size(),
+           items.size(), seconds);
+    if (!failed.empty()) {
+      return 1;
+    }
   }
 
   return 0;
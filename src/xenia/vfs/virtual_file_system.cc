@@ -9,6 +9,8 @@
 
 #include "xenia/vfs/virtual_file_system.h"
 
+#include <mutex>
+
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
 #include "xenia/kernel/xfile.h"
@@ -26,26 +28,32 @@ VirtualFileSystem::~VirtualFileSystem() {
 }
 
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::unique_lock<std::shared_mutex> lock(mutex_);
   devices_.emplace_back(std::move(device));
   return true;
 }
 
 bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
-  auto global_lock = global_critical_region_.Acquire();
+  return DetachDevice(path) != nullptr;
+}
+
+std::unique_ptr<Device> VirtualFileSystem::DetachDevice(
+    const std::string_view path) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
   for (auto it = devices_.begin(); it != devices_.end(); ++it) {
     if ((*it)->mount_path() == path) {
       XELOGD("Unregistered device: {}", (*it)->mount_path());
+      auto device = std::move(*it);
       devices_.erase(it);
-      return true;
+      return device;
     }
   }
-  return false;
+  return nullptr;
 }
 
 bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
                                              const std::string_view target) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::unique_lock<std::shared_mutex> lock(mutex_);
   symlinks_.insert({std::string(path), std::string(target)});
   XELOGD("Registered symbolic link: {} => {}", path, target);
 
@@ -53,7 +61,7 @@ bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
 }
 
 bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::unique_lock<std::shared_mutex> lock(mutex_);
   auto it = std::find_if(
       symlinks_.cbegin(), symlinks_.cend(),
       [&](const auto& s) { return xe::utf8::equal_case(path, s.first); });
@@ -68,6 +76,7 @@ bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
 
 bool VirtualFileSystem::FindSymbolicLink(const std::string_view path,
                                          std::string& target) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
   auto it = std::find_if(
       symlinks_.cbegin(), symlinks_.cend(),
       [&](const auto& s) { return xe::utf8::starts_with_case(path, s.first); });
@@ -100,7 +109,7 @@ bool VirtualFileSystem::ResolveSymbolicLink(const std::string_view path,
 }
 
 Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::shared_lock<std::shared_mutex> lock(mutex_);
 
   // Resolve relative paths
   auto normalized_path(xe::utf8::canonicalize_guest_path(path));
@@ -127,7 +136,7 @@ Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
 
   const auto& device = *it;
   auto relative_path = normalized_path.substr(device->mount_path().size());
-  return device->ResolvePath(relative_path);
+  return device->ResolvePathCached(relative_path);
 }
 
 Entry* VirtualFileSystem::CreatePath(const std::string_view path,
@@ -11,11 +11,11 @@
 #define XENIA_VFS_VIRTUAL_FILE_SYSTEM_H_
 
 #include <memory>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
-#include "xenia/base/mutex.h"
 #include "xenia/vfs/device.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
@@ -30,6 +30,9 @@ class VirtualFileSystem {
 
   bool RegisterDevice(std::unique_ptr<Device> device);
   bool UnregisterDevice(const std::string_view path);
+  // Unregisters a device without destroying it, so that it can be registered
+  // again later. Returns nullptr if no device is mounted at path.
+  std::unique_ptr<Device> DetachDevice(const std::string_view path);
 
   bool RegisterSymbolicLink(const std::string_view path,
                             const std::string_view target);
@@ -48,7 +51,8 @@ class VirtualFileSystem {
                     FileAction* out_action);
 
  private:
-  xe::global_critical_region global_critical_region_;
+  // Guards devices_ and symlinks_; path resolution only needs it shared.
+  std::shared_mutex mutex_;
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
 